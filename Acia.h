@@ -0,0 +1,253 @@
+// 6551 ACIA: a serial port for the guest, with its host end in SerialHost.
+//
+// Registers (repeated through the mapped range):
+//   +0 data      read: received byte, clears RDRF   write: transmit
+//   +1 status    read: IRQ(7) DSR(6) DCD(5) TDRE(4) RDRF(3) OVR(2) FE(1) PE(0)
+//                write: programmed reset
+//   +2 command   DTR(0), receive IRQ disable(1), transmit control(3-2),
+//                01 enabling the transmit IRQ
+//   +3 control   baud rate (3-0) and framing, which only matter when timed
+//
+// The transmit and receive registers are the two ends of the host rings,
+// so the guest moves bytes with plain loads and stores and the I/O thread
+// batches them into as few syscalls as it can. A full ring is flow
+// control rather than an overrun: TDRE stays clear until the host drains
+// the transmit ring, and the host stops reading while the receive ring is
+// full, so no byte is ever lost and OVR, FE and PE always read 0.
+//
+// Untimed (Clock = 0) the port is as fast as the host. With Clock set to
+// the emulated CPU frequency, TDRE takes the time of a 10-bit frame at the
+// rate selected in the control register after each transmitted byte.
+//
+// IRQ is level triggered through the Scheduler: asserted while RDRF is set
+// with the receive IRQ enabled, or TDRE with the transmit IRQ enabled.
+// Bytes from the host reach the guest at the CPU thread's next slice start
+// or idle point, so a guest waiting in an idle loop wakes up for input.
+
+#pragma once
+
+#include <stdio.h>
+
+#include <memory>
+
+#include "Mem.h"
+#include "Scheduler.h"
+#include "SerialHost.h"
+
+struct Acia6551 : BusHandler {
+    static constexpr u32 IRQ_SOURCE = 1u << 9;
+
+    // emulated CPU frequency for baud rate timing; 0 for an untimed port
+    u32 Clock = 0;
+
+    // a stream of output wakes the I/O thread at most once per KickCycles
+    // (or per KickBytes queued), a byte after a pause at once; needs Events
+    u32 KickCycles = 20000;
+    u32 KickBytes = SerialHost::RING_SIZE / 4;
+
+    // bytes the guest stored while TDRE was clear
+    u64 Dropped = 0;
+
+    // Events may be null, leaving a port the guest can only poll
+    Acia6551( SerialHost* InHost, Scheduler* InEvents )
+        : Host(InHost), Events(InEvents), Self(std::make_shared<Acia6551*>(this))
+    {
+        if (Host && Events)
+        {
+            std::shared_ptr<Acia6551*> Handle = Self;
+            Host->OnReceive = [this, Handle]()
+            {
+                // one posted wake-up until the CPU thread has picked it up
+                if (!ReceivePosted.exchange(true))
+                {
+                    Events->Post([Handle]( Scheduler& )
+                    {
+                        if (Acia6551* Port = *Handle)
+                        {
+                            Port->ReceivePosted.store(false);
+                            Port->Pull();
+                            Port->UpdateIRQ(Port->Events->Now);
+                        }
+                    });
+                }
+            };
+        }
+    }
+
+    // a port that owns its host end, started here
+    Acia6551( std::unique_ptr<SerialHost> InHost, Scheduler* InEvents )
+        : Acia6551(InHost.get(), InEvents)
+    {
+        OwnedHost = std::move(InHost);
+        OwnedHost->Start();
+    }
+
+    ~Acia6551() override
+    {
+        if (Host)
+        {
+            Host->Stop();
+            Host->OnReceive = nullptr;
+        }
+        *Self = nullptr;            // mail already posted finds no port
+        if (Events && TimerId)
+        {
+            Events->Cancel(TimerId);
+        }
+        if (Events && FlushId)
+        {
+            Events->Cancel(FlushId);
+        }
+        if (Events)
+        {
+            Events->ClearIRQ(IRQ_SOURCE);
+        }
+    }
+
+    Byte Read( Word Address, u64 Time ) override
+    {
+        switch (Address & 3)
+        {
+        case 0:
+        {
+            const Byte Value = RxData;
+            RxFull = false;
+            Pull();
+            UpdateIRQ(Time);
+            return Value;
+        }
+        case 1:
+            Pull();
+            return Status(Time);
+        case 2:
+            return Command;
+        default:
+            return Control;
+        }
+    }
+
+    void Write( Word Address, Byte Value, u64 Time ) override
+    {
+        switch (Address & 3)
+        {
+        case 0:
+            if (!TransmitReady(Time) || !Host)
+            {
+                Dropped++;
+                break;
+            }
+            Host->ToHost.Push(Value);
+            Wake(Time);
+            if (Clock)
+            {
+                TxBusyUntil = Time + FrameCycles();
+            }
+            break;
+        case 1:
+            Command &= 0xE0;        // programmed reset
+            break;
+        case 2:
+            Command = Value;
+            break;
+        default:
+            Control = Value;
+            break;
+        }
+        UpdateIRQ(Time);
+    }
+
+private:
+    SerialHost* Host;
+    Scheduler* Events;
+    std::unique_ptr<SerialHost> OwnedHost;
+    std::shared_ptr<Acia6551*> Self;
+    std::atomic<bool> ReceivePosted{false};
+
+    Byte RxData = 0;
+    bool RxFull = false;
+    Byte Command = 0;
+    Byte Control = 0;
+    u64 TxBusyUntil = 0;
+    u64 LastKick = 0;
+    u32 TimerId = 0;
+    u32 FlushId = 0;
+
+    bool ReceiveIRQ() const { return (Command & 0x03) == 0x01; }
+    bool TransmitIRQ() const { return (Command & 0x0D) == 0x05; }
+
+    // moves the next received byte into the data register once it is free
+    void Pull()
+    {
+        if (!RxFull && Host && Host->ToGuest.Pop(RxData))
+        {
+            RxFull = true;
+        }
+    }
+
+    // each Kick may cost the I/O thread a wake-up and a write() for what
+    // has queued so far, so a guest printing flat out has its output
+    // flushed by a scheduled event instead, in large batches
+    void Wake( u64 Time )
+    {
+        if (!Events || Host->ToHost.Size() >= KickBytes || Time >= LastKick + KickCycles)
+        {
+            LastKick = Time;
+            Host->Kick();
+        }
+        else if (!FlushId)
+        {
+            FlushId = Events->Schedule(LastKick + KickCycles, [this]( Scheduler&, u64 Now )
+            {
+                FlushId = 0;
+                LastKick = Now;
+                Host->Kick();
+            });
+        }
+    }
+
+    bool TransmitReady( u64 Time ) const
+    {
+        return Time >= TxBusyUntil && Host && !Host->ToHost.Full();
+    }
+
+    Byte Status( u64 Time ) const
+    {
+        const bool Tdre = TransmitReady(Time);
+        const bool Irq = (RxFull && ReceiveIRQ()) || (Tdre && TransmitIRQ());
+        return (Irq ? 0x80 : 0) | (Tdre ? 0x10 : 0) | (RxFull ? 0x08 : 0);
+    }
+
+    // cycles per 10-bit frame at the control register's rate
+    u64 FrameCycles() const
+    {
+        static const u32 Baud[16] = {
+            115200, 50, 75, 110, 135, 150, 300, 600, 1200, 1800, 2400, 3600, 4800, 7200, 9600, 19200
+        };
+        return (u64)Clock * 10 / Baud[Control & 0x0F];
+    }
+
+    void UpdateIRQ( u64 Time )
+    {
+        if (!Events)
+        {
+            return;
+        }
+        if (Status(Time) & 0x80)
+        {
+            Events->RaiseIRQ(IRQ_SOURCE);
+            return;
+        }
+        Events->ClearIRQ(IRQ_SOURCE);
+        // a transmitter the guest waits on by interrupt: look again when the
+        // frame is out, or shortly if the host has not drained the ring yet
+        if (TransmitIRQ() && !TimerId && Host)
+        {
+            const u64 When = Time < TxBusyUntil ? TxBusyUntil : Time + 256;
+            TimerId = Events->Schedule(When, [this]( Scheduler&, u64 Now )
+            {
+                TimerId = 0;
+                UpdateIRQ(Now);
+            });
+        }
+    }
+};
@@ -0,0 +1,217 @@
+// Runtime side of ahead-of-time translated ROMs (see aot_6502.cpp).
+//
+// A translated module is a shared object exporting Aot6502Module(): the ROM
+// image it was built from plus one native function per basic block. The
+// AotRunner dispatches on PC to those functions and falls back to
+// CPU::Execute one instruction at a time for anything the module does not
+// cover. Code pages are compared against the image before their blocks run
+// again after any write that may have touched them or any bank switch, so
+// self-modifying code, late ROM swaps and other banks mapped over the
+// image all go back to the interpreter.
+//
+// Translated blocks keep cycles, flags and memory identical to the
+// interpreter, including its quirks. They do not feed edge coverage, the
+// shadow call stack or the sampler. A CPU with a Scheduler attached always
+// runs interpreted so interrupts are taken at exact boundaries, and so does
+// one with HLE traps, which fire on the interpreter's JSR.
+
+#pragma once
+
+#include <string.h>
+
+#include <vector>
+
+#include "CPU.h"
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+struct AotContext {
+    CPU* cpu;
+    Mem* memory;
+    u64 Retired;        // instructions completed by translated code
+    bool CodeWritten;   // a store hit a page holding translated code
+};
+
+// runs one block from cpu->PC; returns the cycle countdown and leaves PC at
+// the next instruction, exactly as CPU::Execute would
+using AotBlockFn = s32 (*)( AotContext& Ctx, s32 Cycles );
+
+struct AotBlock {
+    Word Start;
+    Word End;           // one past the last byte the block was built from
+    AotBlockFn Fn;
+};
+
+static constexpr u32 AOT_MODULE_VERSION = 1;
+
+struct AotModule {
+    u32 Version;
+    Word ImageStart;
+    u32 ImageSize;
+    const Byte* Image;
+    u32 BlockCount;
+    const AotBlock* Blocks;
+};
+
+using AotModuleFn = const AotModule* (*)();
+#define AOT6502_MODULE_SYMBOL "Aot6502Module"
+
+struct AotRunner {
+    u64 BlocksRun = 0;
+    u64 InterpretedSteps = 0;
+    u64 PageChecks = 0;
+    u64 PagesRejected = 0;      // code page no longer matched the image
+
+    ~AotRunner()
+    {
+#ifndef _WIN32
+        if (Library)
+        {
+            dlclose(Library);
+        }
+#endif
+    }
+
+    bool Attach( const AotModule* InModule )
+    {
+        if (!InModule || InModule->Version != AOT_MODULE_VERSION)
+        {
+            return false;
+        }
+        Module = InModule;
+        Table.assign(Mem::MAX_MEM, nullptr);
+        for (u32 i = 0; i < Module->BlockCount; i++)
+        {
+            Table[Module->Blocks[i].Start] = &Module->Blocks[i];
+        }
+        return true;
+    }
+
+    bool Load( const char* Path )
+    {
+#ifndef _WIN32
+        Library = dlopen(Path, RTLD_NOW | RTLD_LOCAL);
+        if (!Library)
+        {
+            fprintf(stderr, "aot: %s\n", dlerror());
+            return false;
+        }
+        const AotModuleFn Entry = (AotModuleFn)dlsym(Library, AOT6502_MODULE_SYMBOL);
+        if (!Entry || !Attach(Entry()))
+        {
+            fprintf(stderr, "aot: %s is not a compatible translated module\n", Path);
+            return false;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // same contract as CPU::Execute
+    s32 Execute( CPU& cpu, Mem& memory, s32 Cycles )
+    {
+        if (!Module || cpu.Events || cpu.Traps)
+        {
+            return cpu.Execute(Cycles, memory);
+        }
+        const s32 CyclesRequested = Cycles;
+        s32 BlockCycles = 0;
+        AotContext Ctx = { &cpu, &memory, 0, false };
+
+        // memory may have been changed by the caller since the last slice
+        Unverify();
+        while (Cycles > 0 && cpu.PC != cpu.TrapPC)
+        {
+            const AotBlock* Block = Table[cpu.PC];
+            if (Block && Runnable(*Block, cpu, memory))
+            {
+                const s32 Before = Cycles;
+                // the interpreter steps in between keep the counters current
+                memory.SliceEnd = cpu.Counters.Cycles + BlockCycles + Cycles;
+                Cycles = Block->Fn(Ctx, Cycles);
+                BlockCycles += Before - Cycles;
+                BlocksRun++;
+                if (Ctx.CodeWritten)
+                {
+                    Ctx.CodeWritten = false;
+                    Unverify();
+                }
+                continue;
+            }
+            // the interpreter can write anywhere, so recheck code afterwards
+            Cycles -= cpu.Execute(1, memory);
+            InterpretedSteps++;
+            Unverify();
+        }
+
+        cpu.Counters.InstructionsRetired += Ctx.Retired;
+        cpu.Counters.Cycles += BlockCycles;
+        memory.SliceEnd = cpu.Counters.Cycles;
+        if (cpu.Metrics)
+        {
+            cpu.Metrics->Publish(cpu.Counters);
+        }
+        return CyclesRequested - Cycles;
+    }
+
+private:
+    const AotModule* Module = nullptr;
+    std::vector<const AotBlock*> Table;
+    bool Verified[Mem::NUM_PAGES] = {};
+    bool AnyVerified = false;
+    u64 MapVersion = ~0ull;
+    void* Library = nullptr;
+
+    void Unverify()
+    {
+        MapVersion = ~0ull;
+        if (AnyVerified)
+        {
+            memset(Verified, 0, sizeof(Verified));
+            AnyVerified = false;
+        }
+    }
+
+    bool PageMatches( u32 Page, const Mem& memory )
+    {
+        // a bank switch may have put different code behind verified pages
+        if (memory.MapVersion != MapVersion)
+        {
+            Unverify();
+            MapVersion = memory.MapVersion;
+        }
+        if (Verified[Page])
+        {
+            return true;
+        }
+        const u32 ImageEnd = Module->ImageStart + Module->ImageSize;
+        const u32 From = Page * Mem::PAGE_SIZE > Module->ImageStart ? Page * Mem::PAGE_SIZE : Module->ImageStart;
+        const u32 To = (Page + 1) * Mem::PAGE_SIZE < ImageEnd ? (Page + 1) * Mem::PAGE_SIZE : ImageEnd;
+        PageChecks++;
+        const Byte* Mapped = memory.ReadPages[Page];
+        if (From < To && (!Mapped || memcmp(Mapped + From % Mem::PAGE_SIZE, Module->Image + (From - Module->ImageStart), To - From) != 0))
+        {
+            PagesRejected++;
+            return false;
+        }
+        Verified[Page] = true;
+        AnyVerified = true;
+        return true;
+    }
+
+    bool Runnable( const AotBlock& Block, const CPU& cpu, const Mem& memory )
+    {
+        // a trap inside the block has to stop mid-way, which only the
+        // interpreter can do
+        if (cpu.TrapPC > Block.Start && cpu.TrapPC < Block.End)
+        {
+            return false;
+        }
+        const u32 First = Block.Start / Mem::PAGE_SIZE;
+        const u32 Last = (Block.End - 1u) / Mem::PAGE_SIZE;
+        return PageMatches(First, memory) && (Last == First || PageMatches(Last, memory));
+    }
+};
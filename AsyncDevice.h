@@ -0,0 +1,216 @@
+// Devices that run on their own host thread, decoupled from CPU::Execute.
+//
+// CPU stores to the device's pages are posted as (cycle, address, value)
+// records to a lock-free SPSC queue; the device thread pops them in order,
+// advances its model to each record's cycle (CatchUp) and applies it
+// (OnWrite). Between stores the CPU thread calls Sync(now) after each slice
+// so the device can also catch up to the CPU clock while nothing is written.
+// A sound generator or video renderer then does its heavy work off the CPU
+// thread, which only pays for a queue push per register store.
+//
+// CPU reads never wait for the device: they return the read-back byte the
+// device last published with SetReadBack (0xFF, open bus, until it does),
+// so write-only registers and status the device updates as it goes work
+// without a round trip. Devices whose reads must reflect the exact cycle
+// belong on the CPU thread as a plain BusHandler instead.
+//
+// The CPU only blocks if it gets a whole queue ahead of the device (counted
+// in Stalls). Host code that presents device output per frame uses
+// WaitFor(cycle) to let the device finish up to that point.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Mem.h"
+#include "SpscQueue.h"
+
+struct BusWrite {
+    u64 Cycle;
+    Word Address;
+    Byte Value;
+};
+
+struct AsyncDevice : BusHandler {
+    static constexpr u32 QUEUE_SIZE = 4096;
+
+    // CPU-thread statistics
+    u64 Posted = 0;
+    u64 Stalls = 0;
+
+    // the read-back table covers Size bytes from Base
+    AsyncDevice( Word InBase, u32 Size )
+        : Base(InBase), ReadBack(Size)
+    {
+        for (std::atomic<Byte>& Value : ReadBack)
+        {
+            Value.store(0xFF, std::memory_order_relaxed);
+        }
+    }
+
+    // derived devices must Stop() in their own destructor, while CatchUp
+    // and OnWrite are still theirs to call
+    ~AsyncDevice() override
+    {
+        Stop();
+    }
+
+    void Start()
+    {
+        if (!Worker.joinable())
+        {
+            Running.store(true);
+            Worker = std::thread([this]() { Loop(); });
+        }
+    }
+
+    // drains every record already posted, then joins the device thread
+    void Stop()
+    {
+        if (Worker.joinable())
+        {
+            Running.store(false);
+            Wake();
+            Worker.join();
+        }
+    }
+
+    Byte Read( Word Address, u64 ) override
+    {
+        const u32 Offset = (u32)(Word)(Address - Base);
+        return Offset < ReadBack.size() ? ReadBack[Offset].load(std::memory_order_relaxed) : 0xFF;
+    }
+
+    void Write( Word Address, Byte Value, u64 Time ) override
+    {
+        while (!Queue.Push({ Time, Address, Value }))
+        {
+            Stalls++;
+            Wake();
+            std::this_thread::yield();
+        }
+        Posted++;
+        // one wake-up per sleep, not one per store
+        if (Sleeping.load(std::memory_order_relaxed) && Sleeping.exchange(false))
+        {
+            Wake();
+        }
+    }
+
+    // CPU thread: the CPU has reached Now; call after each Execute slice
+    void Sync( u64 Now )
+    {
+        CpuClock.store(Now, std::memory_order_release);
+        if (Sleeping.load(std::memory_order_relaxed) && Sleeping.exchange(false))
+        {
+            Wake();
+        }
+    }
+
+    // how far the device model has run
+    u64 DeviceClock() const
+    {
+        return Done.load(std::memory_order_acquire);
+    }
+
+    // any thread but the device's: waits until the device has run to Cycle,
+    // which Sync() must already have passed
+    void WaitFor( u64 Cycle )
+    {
+        while (DeviceClock() < Cycle)
+        {
+            Wake();
+            std::this_thread::yield();
+        }
+    }
+
+protected:
+    // device thread: run the model up to Cycle
+    virtual void CatchUp( u64 Cycle ) = 0;
+
+    // device thread: a CPU store, applied after CatchUp(Cycle)
+    virtual void OnWrite( Word Address, Byte Value, u64 Cycle ) = 0;
+
+    // device thread: what CPU reads of Address return from now on
+    void SetReadBack( Word Address, Byte Value )
+    {
+        const u32 Offset = (u32)(Word)(Address - Base);
+        if (Offset < ReadBack.size())
+        {
+            ReadBack[Offset].store(Value, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    Word Base;
+    std::vector<std::atomic<Byte>> ReadBack;
+    SpscQueue<BusWrite, QUEUE_SIZE> Queue;
+    std::atomic<u64> CpuClock{0};
+    std::atomic<u64> Done{0};
+
+    std::thread Worker;
+    std::atomic<bool> Running{false};
+    std::atomic<bool> Sleeping{false};
+    std::mutex Lock;
+    std::condition_variable Wakeup;
+
+    void Wake()
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Wakeup.notify_one();
+    }
+
+    void Loop()
+    {
+        BusWrite Batch[256];
+        u64 At = Done.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            // read the clock first: every record posted before it was
+            // published is then already visible in the queue
+            const u64 Target = CpuClock.load(std::memory_order_acquire);
+            const bool Stopping = !Running.load();
+            const u32 Count = Queue.PopBatch(Batch, 256);
+            for (u32 i = 0; i < Count; i++)
+            {
+                if (Batch[i].Cycle > At)
+                {
+                    At = Batch[i].Cycle;
+                    CatchUp(At);
+                }
+                OnWrite(Batch[i].Address, Batch[i].Value, At);
+            }
+            if (Count > 0)
+            {
+                Done.store(At, std::memory_order_release);
+                continue;
+            }
+            if (Target > At)
+            {
+                At = Target;
+                CatchUp(At);
+                Done.store(At, std::memory_order_release);
+                continue;
+            }
+            if (Stopping)
+            {
+                return;
+            }
+
+            // nothing to do: sleep until the CPU posts or syncs; the timeout
+            // covers a wake-up racing with going to sleep
+            Sleeping.store(true);
+            if (Queue.Empty() && CpuClock.load() == Target && Running.load())
+            {
+                std::unique_lock<std::mutex> Guard(Lock);
+                Wakeup.wait_for(Guard, std::chrono::milliseconds(1));
+            }
+            Sleeping.store(false);
+        }
+    }
+};
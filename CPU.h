@@ -0,0 +1,2259 @@
+// 6502 CPU core: registers, addressing modes and instruction dispatch
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+
+#include "CallStack.h"
+#include "HeatMap.h"
+#include "Hle.h"
+#include "Mem.h"
+#include "Metrics.h"
+#include "Scheduler.h"
+#include "StatusFlags.h"
+
+// instruction idioms Execute runs as one fused handler
+enum FusionKind {
+    FUSE_COMPARE_BRANCH,     // CMP/CPX/CPY + BNE/BEQ
+    FUSE_DECREMENT_BRANCH,   // DEX/DEY + BNE/BEQ
+    FUSE_COPY_INDIRECT_Y,    // LDA (zp),Y + STA (zp),Y + INY
+    FUSE_CLEAR_CARRY_ADD,    // CLC + ADC #imm / ADC zp
+    FUSION_KINDS
+};
+
+// how often each idiom's leading instruction was fused with its followers,
+// and how often it ran alone because the next opcode (or budget) did not fit
+struct FusionCounters {
+    u64 Fused[FUSION_KINDS] = {};
+    u64 Unfused[FUSION_KINDS] = {};
+
+    static const char* Name( u32 Kind )
+    {
+        static const char* const Names[FUSION_KINDS] = {
+            "cmp+branch", "dex/dey+branch", "lda(zp),y+sta(zp),y+iny", "clc+adc" };
+        return Kind < FUSION_KINDS ? Names[Kind] : "?";
+    }
+
+    void Add( const FusionCounters& Other )
+    {
+        for (u32 i = 0; i < FUSION_KINDS; i++)
+        {
+            Fused[i] += Other.Fused[i];
+            Unfused[i] += Other.Unfused[i];
+        }
+    }
+};
+
+struct CPU {
+    
+    Word PC;           // program counter
+    Byte SP;           // stack pointer
+
+
+    Byte A, X, Y;      // registers
+
+    union {
+        Byte PS;
+        StatusFlags Flag;
+
+    };
+
+    // hot-path counters, published to Metrics (if set) after each Execute
+    CPUCounters Counters;
+    MetricsSlot* Metrics = nullptr;
+
+    // optional guest call tracking and stack sampling, see CallStack.h
+    ShadowCallStack* CallStack = nullptr;
+    StackSampler* Sampler = nullptr;
+
+    // device events and interrupt lines, see Scheduler.h
+    Scheduler* Events = nullptr;
+
+    // native stand-ins for guest subroutines, see Hle.h
+    HleTable* Traps = nullptr;
+
+    // per-page access counts, sampled or with HEATMAP6502 exact, see HeatMap.h
+    AccessHeatMap* Heat = nullptr;
+
+    // fast-forward side-effect-free polling loops to the next event
+    bool SkipIdleLoops = true;
+
+    // run common idioms as superinstructions; cycles and flags are unchanged
+    bool FuseInstructions = true;
+    FusionCounters Fusion;
+    
+    // registers only, memory is left alone as on the real chip
+    void ResetCPU() {
+        PC = 0xFFFC;
+        SP = 0xFF;
+        Flag.C = Flag.Z = Flag.I = Flag.D = Flag.B = Flag.V = Flag.N = Flag.D = 0;
+        A = X = Y = 0;
+    }
+
+    void Reset( Mem& memory ) {
+        ResetCPU();
+        memory.Initialize();
+    }
+
+    // registers reset, memory rolled back to Baseline (dirty pages only)
+    void Reset( Mem& memory, const Mem& Baseline ) {
+        ResetCPU();
+        memory.RestoreDirtyPages(Baseline);
+    }
+
+    // registers and memory folded into one value; O(1) with a StateHash
+    // attached to memory, a full pass over Data without
+    u64 StateDigest( Mem& memory ) const {
+        const u64 Memory = memory.Hash ? memory.Hash->Memory(memory.Data) : StateHash::Compute(memory.Data);
+        const u64 Registers = (u64)PC << 40 | (u64)SP << 32 | (u64)A << 24 | (u64)X << 16 | (u64)Y << 8 | PS;
+        return Memory + StateHash::Mix(Registers | 1ull << 63);
+    }
+
+    FORCE_INLINE void CountAccess( AccessHeatMap::Kind What, Word Address ) {
+#ifdef HEATMAP6502
+        if (UNLIKELY(Heat)) {
+            Heat->Count(What, Address);
+        }
+#else
+        (void)What;
+        (void)Address;
+#endif
+    }
+
+    FORCE_INLINE Byte FetchByte( s32& Cycles, const Mem& memory ) {
+        CountAccess(AccessHeatMap::FETCH, PC);
+        Byte Data = memory.Read(PC, Cycles);
+        PC++;
+        Cycles--;
+        return Data;
+
+    }
+
+    FORCE_INLINE SByte FetchSByte( s32& Cycles, const Mem& memory ) {
+        return FetchByte(Cycles, memory);
+
+    }
+
+    FORCE_INLINE Word FetchWord ( s32& Cycles, const Mem& memory )
+    {
+        // 6502 is little endian
+        CountAccess(AccessHeatMap::FETCH, PC);
+        Word Data = memory.Read(PC, Cycles);
+        PC++;
+
+        CountAccess(AccessHeatMap::FETCH, PC);
+        Data |= (memory.Read(PC, Cycles - 1) << 8);
+        PC++;
+        Cycles-=2;
+
+
+        return Data;
+    }
+
+
+    FORCE_INLINE Byte ReadByteFromZeroPage( s32& Cycles, Byte Address,  Mem& memory ) 
+    {
+        CountAccess(AccessHeatMap::READ, Address);
+        Byte Data = memory.Read(Address, Cycles);
+        Cycles--;
+        return Data;
+    }
+
+    FORCE_INLINE Byte ReadByte( s32& Cycles, Word Address, const Mem& memory ) 
+    {
+        CountAccess(AccessHeatMap::READ, Address);
+        Byte Data = memory.Read(Address, Cycles);
+        Cycles--;
+        return Data;
+    }
+
+    FORCE_INLINE Word ReadWord( s32& Cycles, Word Address, const Mem& memory ) 
+    {
+        Byte LoByte = ReadByte(Cycles, Address, memory);
+        Byte HiByte = ReadByte(Cycles, Address + 1, memory);
+        return LoByte | (HiByte << 8);
+    }
+
+    // write 1 byte to memory
+    FORCE_INLINE void WriteByte( Byte Value, s32& Cycles, Word Address, Mem& memory )
+    {
+        CountAccess(AccessHeatMap::WRITE, Address);
+        memory.Write(Address, Value, Cycles);
+        Cycles--;
+    }
+
+    // write 2 bytes to memory
+    FORCE_INLINE void WriteWord(Word Value, s32& Cycles, Word Address, Mem& memory) 
+    {
+        CountAccess(AccessHeatMap::WRITE, Address);
+        CountAccess(AccessHeatMap::WRITE, (Word)(Address + 1));
+        memory.Write(Address, Value & 0xFF, Cycles);
+        memory.Write(Address + 1, Value >> 8, Cycles - 1);
+        Cycles -= 2;
+    }
+
+    FORCE_INLINE Word SPToAddress() const
+    {
+        return 0x100 | SP;
+    }
+
+    void PushWordToStack(s32& Cycles, Mem& memory, Word Value)
+    {
+        if (SP < 0x02)
+        {
+            Counters.StackOverflows++;
+            if (memory.Shadow)
+            {
+                memory.Shadow->OnStackWrap(true, SP);
+            }
+        }
+        WriteByte(Value >> 8, Cycles, SPToAddress(), memory);
+        SP--;
+        WriteByte(Value & 0xFF, Cycles, SPToAddress(), memory);
+        SP--; 
+    }
+
+    void PushPCMinusOneToStack(s32& Cycles, Mem& memory)
+    {
+        PushWordToStack(Cycles, memory, PC-1); 
+    }
+
+    void PushPCPlusOneToStack(s32& Cycles, Mem& memory)
+    {
+        PushWordToStack(Cycles, memory, PC+1); 
+    }
+
+    void PushPCToStack(s32& Cycles, Mem& memory)
+    {
+        PushWordToStack(Cycles, memory, PC);
+    }
+
+    FORCE_INLINE void PushByteOnToStack(s32& Cycles, Byte Value, Mem& memory)
+    {
+        if (SP == 0x00)
+        {
+            Counters.StackOverflows++;
+            if (memory.Shadow)
+            {
+                memory.Shadow->OnStackWrap(true, SP);
+            }
+        }
+        const Word SPWord = SPToAddress();
+        CountAccess(AccessHeatMap::WRITE, SPWord);
+        memory.Write(SPWord, Value, Cycles);
+        Cycles--;
+        SP--;
+        Cycles--;
+    }
+    
+    FORCE_INLINE Byte PopByteFromStack (s32& Cycles, Mem& memory)
+    {
+        if (SP == 0xFF)
+        {
+            Counters.StackUnderflows++;
+            if (memory.Shadow)
+            {
+                memory.Shadow->OnStackWrap(false, SP);
+            }
+        }
+        SP++;
+        Cycles--;
+        const Word SPWord = SPToAddress();
+        CountAccess(AccessHeatMap::READ, SPWord);
+        Byte Value = memory.Read(SPWord, Cycles);
+        Cycles--;
+        return Value;
+
+    }
+
+
+    Word PopWordFromStack (s32& Cycles, Mem& memory)
+    {
+        if (SP >= 0xFE)
+        {
+            Counters.StackUnderflows++;
+            if (memory.Shadow)
+            {
+                memory.Shadow->OnStackWrap(false, SP);
+            }
+        }
+        Word ValueFromStack = ReadWord(Cycles, SPToAddress()+1, memory);
+        SP += 2;
+        Cycles--;
+        return ValueFromStack;
+
+    }
+
+    static constexpr Byte 
+        NegativeFlagBit =  0b10000000,
+        OverflowFlagBit =  0b01000000,
+        ZeroBit = 0b00000001, 
+        BreakFlagBit = 0b00010000,
+        UnusedFlagBit = 0b00100000;
+
+    // opcodes
+    static constexpr Byte
+		//LDA
+		INS_LDA_IM = 0xA9,
+		INS_LDA_ZP = 0xA5,
+		INS_LDA_ZPX = 0xB5,
+		INS_LDA_ABS = 0xAD,
+		INS_LDA_ABSX = 0xBD,
+		INS_LDA_ABSY = 0xB9,
+		INS_LDA_INDX = 0xA1,
+		INS_LDA_INDY = 0xB1,
+		//LDX
+		INS_LDX_IM = 0xA2,
+		INS_LDX_ZP = 0xA6,
+		INS_LDX_ZPY = 0xB6,
+		INS_LDX_ABS = 0xAE,
+		INS_LDX_ABSY = 0xBE,
+		//LDY
+		INS_LDY_IM = 0xA0,
+		INS_LDY_ZP = 0xA4,
+		INS_LDY_ZPX = 0xB4,
+		INS_LDY_ABS = 0xAC,
+		INS_LDY_ABSX = 0xBC,
+		//STA
+		INS_STA_ZP = 0x85,
+		INS_STA_ZPX = 0x95,
+		INS_STA_ABS = 0x8D,
+		INS_STA_ABSX = 0x9D,
+		INS_STA_ABSY = 0x99,
+		INS_STA_INDX = 0x81,
+		INS_STA_INDY = 0x91,
+		//STX
+		INS_STX_ZP = 0x86,
+		INS_STX_ZPY = 0x96,
+		INS_STX_ABS = 0x8E,
+		//STY
+		INS_STY_ZP = 0x84,
+		INS_STY_ZPX = 0x94,
+		INS_STY_ABS = 0x8C,
+
+		INS_TSX = 0xBA,
+		INS_TXS = 0x9A,
+		INS_PHA = 0x48,
+		INS_PLA = 0x68,
+		INS_PHP = 0x08,
+		INS_PLP = 0x28,
+
+		INS_JMP_ABS = 0x4C,
+		INS_JMP_IND = 0x6C,
+		INS_JSR = 0x20,
+		INS_RTS = 0x60,
+		
+		//Logical Ops
+
+		//AND
+		INS_AND_IM = 0x29,
+		INS_AND_ZP = 0x25,
+		INS_AND_ZPX = 0x35,
+		INS_AND_ABS = 0x2D,
+		INS_AND_ABSX = 0x3D,
+		INS_AND_ABSY = 0x39,
+		INS_AND_INDX = 0x21,
+		INS_AND_INDY = 0x31,
+
+		//OR
+		INS_ORA_IM = 0x09,
+		INS_ORA_ZP = 0x05,
+		INS_ORA_ZPX = 0x15,
+		INS_ORA_ABS = 0x0D,
+		INS_ORA_ABSX = 0x1D,
+		INS_ORA_ABSY = 0x19,
+		INS_ORA_INDX = 0x01,
+		INS_ORA_INDY = 0x11,
+
+		//EOR
+		INS_EOR_IM = 0x49,
+		INS_EOR_ZP  = 0x45,
+		INS_EOR_ZPX = 0x55,
+		INS_EOR_ABS = 0x4D,
+		INS_EOR_ABSX = 0x5D,
+		INS_EOR_ABSY = 0x59,
+		INS_EOR_INDX = 0x41,
+		INS_EOR_INDY = 0x51,
+
+		//BIT
+		INS_BIT_ZP = 0x24,
+		INS_BIT_ABS = 0x2C,
+
+		//Transfer Registers
+		INS_TAX = 0xAA,
+		INS_TAY = 0xA8,
+		INS_TXA = 0x8A,
+		INS_TYA = 0x98,
+
+		//Increments, Decrements
+		INS_INX = 0xE8,
+		INS_INY = 0xC8,
+		INS_DEY = 0x88,
+		INS_DEX = 0xCA,
+		INS_DEC_ZP = 0xC6,
+		INS_DEC_ZPX = 0xD6,
+		INS_DEC_ABS = 0xCE,
+		INS_DEC_ABSX = 0xDE,
+		INS_INC_ZP = 0xE6,
+		INS_INC_ZPX = 0xF6,
+		INS_INC_ABS = 0xEE,
+		INS_INC_ABSX = 0xFE,
+
+		//branches
+		INS_BEQ = 0xF0,
+		INS_BNE = 0xD0,
+		INS_BCS = 0xB0,
+		INS_BCC = 0x90,
+		INS_BMI = 0x30,
+		INS_BPL = 0x10,
+		INS_BVC = 0x50,
+		INS_BVS = 0x70,
+
+		//status flag changes
+		INS_CLC = 0x18,
+		INS_SEC = 0x38,
+		INS_CLD = 0xD8,
+		INS_SED = 0xF8,
+		INS_CLI = 0x58,
+		INS_SEI = 0x78,
+		INS_CLV = 0xB8,
+
+		//Arithmetic
+		INS_ADC_IM = 0x69,
+		INS_ADC_ZP = 0x65,
+		INS_ADC_ZPX = 0x75,
+		INS_ADC_ABS = 0x6D,
+		INS_ADC_ABSX = 0x7D,
+		INS_ADC_ABSY = 0x79,
+		INS_ADC_INDX = 0x61,
+		INS_ADC_INDY = 0x71,
+
+		INS_SBC = 0xE9,
+		INS_SBC_ABS = 0xED,
+		INS_SBC_ZP = 0xE5,
+		INS_SBC_ZPX = 0xF5,
+		INS_SBC_ABSX = 0xFD,
+		INS_SBC_ABSY = 0xF9,
+		INS_SBC_INDX = 0xE1,
+		INS_SBC_INDY = 0xF1,
+
+		// Register Comparison
+		INS_CMP = 0xC9,
+		INS_CMP_ZP = 0xC5,
+		INS_CMP_ZPX = 0xD5,
+		INS_CMP_ABS = 0xCD,
+		INS_CMP_ABSX = 0xDD,
+		INS_CMP_ABSY = 0xD9,
+		INS_CMP_INDX = 0xC1,
+		INS_CMP_INDY = 0xD1,
+
+		INS_CPX = 0xE0,
+		INS_CPY = 0xC0,
+		INS_CPX_ZP = 0xE4,
+		INS_CPY_ZP = 0xC4,
+		INS_CPX_ABS = 0xEC,
+		INS_CPY_ABS = 0xCC,
+
+		// shifts
+		INS_ASL = 0x0A,
+		INS_ASL_ZP = 0x06,
+		INS_ASL_ZPX = 0x16,
+		INS_ASL_ABS = 0x0E,
+		INS_ASL_ABSX = 0x1E,
+
+		INS_LSR = 0x4A,
+		INS_LSR_ZP = 0x46,
+		INS_LSR_ZPX = 0x56,
+		INS_LSR_ABS = 0x4E,
+		INS_LSR_ABSX = 0x5E,
+
+		INS_ROL = 0x2A,
+		INS_ROL_ZP = 0x26,
+		INS_ROL_ZPX = 0x36,
+		INS_ROL_ABS = 0x2E,
+		INS_ROL_ABSX = 0x3E,
+
+		INS_ROR = 0x6A,
+		INS_ROR_ZP = 0x66,
+		INS_ROR_ZPX = 0x76,
+		INS_ROR_ABS = 0x6E,
+		INS_ROR_ABSX = 0x7E,
+
+		//misc
+		INS_NOP = 0xEA,
+		INS_BRK = 0x00,
+		INS_RTI = 0x40
+		;
+
+    // AFL-style edge coverage of taken control flow, off unless CoverageMap
+    // points at CoverageMapSize counters
+    static constexpr u32 CoverageMapSize = 1 << 16;
+    Byte* CoverageMap = nullptr;
+
+    void RecordEdge( Word From, Word To )
+    {
+        if (CoverageMap)
+        {
+            const u32 Index = (((From * 0x9E37u) >> 1) ^ (To * 0x9E37u)) & (CoverageMapSize - 1);
+            CoverageMap[Index]++;
+        }
+    }
+
+    FORCE_INLINE void SetZeroAndNegativeFlags(Byte Register)
+    {
+        Flag.Z = (Register == 0);
+        Flag.N = (Register & 0b10000000) > 0;
+    }
+
+    // ALU and shift rules, shared by Execute and translated code (Aot.h) so
+    // a flag fix only has to be made once
+
+    FORCE_INLINE void AddWithCarry( Byte Operand )
+    {
+        const bool AreSignBitsTheSame = !((A ^ Operand) & NegativeFlagBit);
+        Word Sum = A;
+        Sum += Operand;
+        Sum += Flag.C;
+        A = Sum & 0xFF;
+        SetZeroAndNegativeFlags(A);
+        Flag.C = Sum > 0xFF;
+        Flag.V = AreSignBitsTheSame && (((A & Operand) & NegativeFlagBit) > 0);
+    }
+
+    FORCE_INLINE void SubtractWithCarry( Byte Operand )
+    {
+        AddWithCarry(~Operand);
+    }
+
+    // N from RegisterValue - Operand; Z and C are taken from A whichever
+    // register is compared
+    FORCE_INLINE void CompareRegister( Byte Operand, Byte RegisterValue )
+    {
+        Byte Temp = RegisterValue - Operand;
+        Flag.N = (Temp & NegativeFlagBit) > 0;
+        Flag.Z = A == Operand;
+        Flag.C = A >= Operand;
+    }
+
+    FORCE_INLINE Byte ShiftLeft( Byte Operand, s32& Cycles )
+    {
+        Flag.C = (Operand & NegativeFlagBit) > 0;
+        Byte Result = Operand << 1;
+        SetZeroAndNegativeFlags(Result);
+        Cycles--;
+        return Result;
+    }
+
+    FORCE_INLINE Byte ShiftRight( Byte Operand, s32& Cycles )
+    {
+        constexpr Byte BitZero = 0b00000001;
+        Flag.C = (Operand & BitZero) > 0;
+        Byte Result = Operand >> 1;
+        SetZeroAndNegativeFlags(Result);
+        Cycles--;
+        return Result;
+    }
+
+    FORCE_INLINE Byte RotateLeft( Byte Operand, s32& Cycles )
+    {
+        Byte NewBit0 = Flag.C ? ZeroBit : 0;
+        Flag.C = (Operand & NegativeFlagBit) > 0;
+        Operand = Operand << 1;
+        Operand |= NewBit0;
+        SetZeroAndNegativeFlags(Operand);
+        Cycles--;
+        return Operand;
+    }
+
+    FORCE_INLINE Byte RotateRight( Byte Operand, s32& Cycles )
+    {
+        bool OldBit0 = (Operand & ZeroBit) > 0;
+        Operand = Operand >> 1;
+        if (Flag.C)
+        {
+            Operand |= NegativeFlagBit;
+        }
+        Cycles--;
+        Flag.C = OldBit0;
+        SetZeroAndNegativeFlags(Operand);
+        return Operand;
+    }
+
+    FORCE_INLINE Word AddrZeroPage( s32& Cycles, const Mem& memory)
+    {
+        Byte ZeroPageAddr = FetchByte ( Cycles, memory );
+        return ZeroPageAddr;
+    }
+
+    FORCE_INLINE Word AddrZeroPageX( s32& Cycles, const Mem& memory)
+    {
+        Byte ZeroPageAddr = FetchByte ( Cycles, memory );
+        ZeroPageAddr += X;
+        Cycles--;
+        return ZeroPageAddr;
+    }
+
+    FORCE_INLINE Word AddrZeroPageY( s32& Cycles, const Mem& memory)
+    {
+        Byte ZeroPageAddr = FetchByte ( Cycles, memory );
+        ZeroPageAddr += Y;
+        Cycles--;
+        return ZeroPageAddr;
+    }
+
+    FORCE_INLINE Word AddrAbsolute( s32& Cycles, const Mem& memory)
+    {
+        Word AbsAddress = FetchWord(Cycles, memory);
+        return AbsAddress;
+    }
+
+    FORCE_INLINE Word AddrAbsoluteX( s32& Cycles, const Mem& memory)
+    {
+        Word AbsAddress = FetchWord(Cycles, memory);
+        Word AbsAddressX = AbsAddress + X;
+        if ((AbsAddressX & 0xFF00) !=  (AbsAddress & 0xFF00))
+        {
+            Cycles--;
+        }
+        return AbsAddressX;
+    }
+
+    FORCE_INLINE Word AddrAbsoluteX_5( s32& Cycles, const Mem& memory)
+    {
+        Word AbsAddress = FetchWord(Cycles, memory);
+        Word AbsAddressX = AbsAddress + X;
+        Cycles--;
+        return AbsAddressX;
+    }
+    
+    FORCE_INLINE Word AddrAbsoluteY( s32& Cycles, const Mem& memory)
+    {
+        Word AbsAddress = FetchWord(Cycles, memory);
+        Word AbsAddressY = AbsAddress + Y;
+        if ((AbsAddressY & 0xFF00) !=  (AbsAddress & 0xFF00))
+        {
+            Cycles--;
+        }
+        return AbsAddressY;
+    }
+
+    FORCE_INLINE Word AddrAbsoluteY_5( s32& Cycles, const Mem& memory)
+    {
+        Word AbsAddress = FetchWord(Cycles, memory);
+        Word AbsAddressY = AbsAddress + Y;
+        Cycles--;
+        return AbsAddressY;
+    }
+
+    FORCE_INLINE Word AddrIndirectX( s32& Cycles, const Mem& memory)
+    {
+        Byte ZPAddress = FetchByte( Cycles, memory );
+        ZPAddress += X;
+        Cycles--;
+        Word EffectiveAddr = ReadWord(Cycles, ZPAddress, memory);
+        return EffectiveAddr;
+    }
+
+    FORCE_INLINE Word AddrIndirectY( s32& Cycles, const Mem& memory)
+    {
+        Byte ZPAddress = FetchByte( Cycles, memory );
+        Word EffectiveAddr = ReadWord( Cycles, ZPAddress, memory);
+        Word EffectiveAddrY = EffectiveAddr + Y;
+        if ((EffectiveAddrY & 0xFF00) !=  (EffectiveAddr & 0xFF00))
+        {
+            Cycles--;
+        }
+        return EffectiveAddrY;
+    }
+
+    FORCE_INLINE Word AddrIndirectY_6( s32& Cycles, const Mem& memory)
+    {
+        Byte ZPAddress = FetchByte( Cycles, memory );
+        Word EffectiveAddr = ReadWord( Cycles, ZPAddress, memory);
+        Word EffectiveAddrY = EffectiveAddr + Y;
+        Cycles--;
+        return EffectiveAddrY;
+    }
+
+
+    // stop address for headless runs, -1 disables the trap
+    s32 TrapPC = -1;
+
+    // one iteration of a polling loop: its cost and the registers it leaves
+    struct IdleLoop {
+        u32 Cycles;
+        u32 Instructions;
+        Byte A, X, Y;
+        StatusFlags Flag;
+    };
+
+    // true if Head..Branch is a loop that only reads and tests
+    // (LDA/LDX/LDY/BIT zp|abs, optionally AND/CMP #imm, then a conditional
+    // branch back to Head) and would keep branching back forever when
+    // entered with the current registers and memory
+    NO_INLINE bool FindIdleLoop( Word Head, Word Branch, const Mem& memory, IdleLoop& Loop ) const
+    {
+        if (TrapPC >= Head && TrapPC <= Branch)
+        {
+            return false;
+        }
+        Loop = { 0, 1, A, X, Y, Flag };
+        Word At = Head;
+        const Byte Load = memory.Read(At);
+        Word Polled;
+        switch (Load)
+        {
+        case INS_LDA_ZP: case INS_LDX_ZP: case INS_LDY_ZP: case INS_BIT_ZP:
+            Polled = memory.Read(At + 1);
+            Loop.Cycles = 3;
+            At += 2;
+            break;
+        case INS_LDA_ABS: case INS_LDX_ABS: case INS_LDY_ABS: case INS_BIT_ABS:
+            Polled = memory.Read(At + 1) | (memory.Read(At + 2) << 8);
+            Loop.Cycles = 4;
+            At += 3;
+            break;
+        default:
+            return false;
+        }
+        // a device register may change state when read
+        if (!memory.IsPlainRead(Polled))
+        {
+            return false;
+        }
+        const Byte Value = memory.Read(Polled);
+        switch (Load)
+        {
+        case INS_LDA_ZP: case INS_LDA_ABS: Loop.A = Value; break;
+        case INS_LDX_ZP: case INS_LDX_ABS: Loop.X = Value; break;
+        case INS_LDY_ZP: case INS_LDY_ABS: Loop.Y = Value; break;
+        default: break;
+        }
+        if (Load == INS_BIT_ZP || Load == INS_BIT_ABS)
+        {
+            // same flag rules as the BIT handlers
+            Loop.Flag.Z = !(Loop.A & Value);
+            Loop.Flag.N = (Value & NegativeFlagBit) != 0;
+            Loop.Flag.V = (Value * OverflowFlagBit) != 0;
+        }
+        else
+        {
+            Loop.Flag.Z = Value == 0;
+            Loop.Flag.N = (Value & NegativeFlagBit) != 0;
+        }
+
+        if (At != Branch && (memory.Read(At) == INS_AND_IM || memory.Read(At) == INS_CMP))
+        {
+            const Byte Operand = memory.Read(At + 1);
+            if (memory.Read(At) == INS_AND_IM)
+            {
+                Loop.A &= Operand;
+                Loop.Flag.Z = Loop.A == 0;
+                Loop.Flag.N = (Loop.A & NegativeFlagBit) != 0;
+            }
+            else
+            {
+                Loop.Flag.N = ((Byte)(Loop.A - Operand) & NegativeFlagBit) != 0;
+                Loop.Flag.Z = Loop.A == Operand;
+                Loop.Flag.C = Loop.A >= Operand;
+            }
+            Loop.Cycles += 2;
+            Loop.Instructions++;
+            At += 2;
+        }
+        if (At != Branch)
+        {
+            return false;
+        }
+
+        bool Taken;
+        switch (memory.Read(Branch))
+        {
+        case INS_BEQ: Taken = Loop.Flag.Z;  break;
+        case INS_BNE: Taken = !Loop.Flag.Z; break;
+        case INS_BCS: Taken = Loop.Flag.C;  break;
+        case INS_BCC: Taken = !Loop.Flag.C; break;
+        case INS_BMI: Taken = Loop.Flag.N;  break;
+        case INS_BPL: Taken = !Loop.Flag.N; break;
+        case INS_BVS: Taken = Loop.Flag.V;  break;
+        case INS_BVC: Taken = !Loop.Flag.V; break;
+        default: return false;
+        }
+        const Word Next = Branch + 2;
+        Loop.Cycles += 3 + ((Head >> 8) != (Next >> 8));
+        Loop.Instructions++;
+        return Taken;
+    }
+
+    // cycles the interrupt entry took
+    s32 Interrupt( Mem& memory, Word Vector )
+    {
+        s32 Cycles = -1;   // internal cycle before the pushes
+        const Byte SPBefore = SP;
+        const Word From = PC;
+        PushPCToStack(Cycles, memory);
+        PushByteOnToStack(Cycles, (PS | UnusedFlagBit) & ~BreakFlagBit, memory);
+        Flag.I = true;
+        PC = ReadWord(Cycles, Vector, memory);
+        if (CallStack)
+        {
+            CallStack->OnCall(From, PC, From, SPBefore, 3, true);
+        }
+        Counters.InterruptsTaken++;
+        return -Cycles;
+    }
+
+    // runs events due at Time, then takes a pending NMI or unmasked IRQ;
+    // returns the cycles spent entering an interrupt
+    s32 ServiceEvents( u64 Time, Mem& memory )
+    {
+        Events->Now = Time;
+        Events->RunDue(Time);
+        if (Events->NMIPending)
+        {
+            Events->NMIPending = false;
+            return Interrupt(memory, 0xFFFA);
+        }
+        if (Events->IRQLines && !Flag.I)
+        {
+            return Interrupt(memory, 0xFFFE);
+        }
+        return 0;
+    }
+
+    // runs the native routine for a JSR that just landed on Address, then
+    // the routine's RTS; returns the cost of the whole call after the JSR
+    HleCost RunTrap( Word Address, Mem& memory )
+    {
+        HleTable::Entry& Trap = *Traps->Find(Address);
+        Trap.Calls++;
+        Traps->Calls++;
+        if (Traps->Validate)
+        {
+            return ValidateTrap(Trap, memory);
+        }
+        return ReturnFromTrap(Address, Trap.Fn(*this, memory), memory);
+    }
+
+    HleCost ReturnFromTrap( Word Address, HleCost Cost, Mem& memory )
+    {
+        s32 Cycles = -1;   // opcode fetch
+        const Byte SPBefore = SP;
+        const Word ReturnAddress = PopWordFromStack(Cycles, memory);
+        RecordEdge(Address, ReturnAddress + 1);
+        if (CallStack)
+        {
+            CallStack->OnReturn(Address, ReturnAddress + 1, SPBefore, 2, false);
+        }
+        PC = ReturnAddress + 1;
+        Cycles -= 2;
+        return { Cost.Cycles + (u32)-Cycles, Cost.Instructions + 1 };
+    }
+
+    // a copy's accesses that would reach live devices, bank registers or
+    // banked RAM: recorded and dropped
+    struct IsolationGuard : BusHandler {
+        s32 Touched = -1;
+        Byte Read( Word Address, u64 ) override { Touched = Address; return 0xFF; }
+        void Write( Word Address, Byte, u64 ) override { Touched = Address; }
+    };
+
+    // runs the guest routine on copies up to its RTS, then the native one for
+    // real; on any difference the guest's result wins. A routine that touches
+    // a handler page or storage outside Mem::Data is not validated
+    HleCost ValidateTrap( HleTable::Entry& Trap, Mem& memory )
+    {
+        constexpr u64 MaxCycles = 100000000;
+        std::unique_ptr<Mem> Reference(new Mem(memory));
+        // the copy shares the live handlers and banks; cut it off from them
+        IsolationGuard Isolation;
+        for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+        {
+            const Byte* Own = &Reference->Data[Page * Mem::PAGE_SIZE];
+            if (Reference->WritePages[Page] && Reference->WritePages[Page] != Own)
+            {
+                Reference->WritePages[Page] = nullptr;
+                Reference->Handlers[Page] = &Isolation;
+            }
+            if (Reference->Handlers[Page])
+            {
+                Reference->Handlers[Page] = &Isolation;
+            }
+        }
+        CPU Guest = *this;
+        Guest.Traps = nullptr;
+        Guest.Metrics = nullptr;
+        Guest.CallStack = nullptr;
+        Guest.Sampler = nullptr;
+        Guest.Events = nullptr;
+        Guest.CoverageMap = nullptr;
+        Guest.Heat = nullptr;
+        Guest.TrapPC = -1;
+        Guest.Counters = CPUCounters();
+        const Byte ReturnSP = SP + 2;
+        const Word ReturnPC = (Word)((memory.Read(0x100 | ReturnSP) << 8 | memory.Read(0x100 | (Byte)(SP + 1))) + 1);
+        while (!(Guest.PC == ReturnPC && Guest.SP == ReturnSP) && Guest.Counters.Cycles < MaxCycles
+            && Isolation.Touched < 0)
+        {
+            Guest.Execute(1, *Reference);
+        }
+
+        const HleCost Native = ReturnFromTrap(Trap.Address, Trap.Fn(*this, memory), memory);
+        if (Isolation.Touched >= 0)
+        {
+            if (Trap.Unvalidated++ == 0)
+            {
+                fprintf(stderr, "hle: %s at %04X touches $%04X (device or bank), its calls are not validated\n",
+                    Trap.Name.c_str(), Trap.Address, Isolation.Touched);
+            }
+            Traps->Unvalidated++;
+            return Native;
+        }
+        const bool Returned = Guest.PC == ReturnPC && Guest.SP == ReturnSP;
+        if (Returned && Guest.A == A && Guest.X == X && Guest.Y == Y && Guest.PS == PS && Guest.PC == PC && Guest.SP == SP
+            && Guest.Counters.Cycles == Native.Cycles && Guest.Counters.InstructionsRetired == Native.Instructions
+            && memcmp(Reference->Data, memory.Data, Mem::MAX_MEM) == 0)
+        {
+            return Native;
+        }
+
+        Trap.Mismatches++;
+        Traps->Mismatches++;
+        fprintf(stderr, "hle: %s at %04X differs from the guest routine:\n", Trap.Name.c_str(), Trap.Address);
+        if (!Returned)
+        {
+            fprintf(stderr, "  guest routine did not return within %llu cycles\n", (unsigned long long)MaxCycles);
+            return Native;
+        }
+        fprintf(stderr, "  guest  A=%02X X=%02X Y=%02X PS=%02X SP=%02X PC=%04X cycles=%llu instructions=%llu\n",
+            Guest.A, Guest.X, Guest.Y, Guest.PS, Guest.SP, Guest.PC,
+            (unsigned long long)Guest.Counters.Cycles, (unsigned long long)Guest.Counters.InstructionsRetired);
+        fprintf(stderr, "  native A=%02X X=%02X Y=%02X PS=%02X SP=%02X PC=%04X cycles=%u instructions=%u\n",
+            A, X, Y, PS, SP, PC, Native.Cycles, Native.Instructions);
+        bool Reported = false;
+        for (u32 Address = 0; Address < Mem::MAX_MEM; Address++)
+        {
+            if (Reference->Data[Address] != memory.Data[Address])
+            {
+                if (!Reported)
+                {
+                    fprintf(stderr, "  first memory difference at %04X: guest %02X, native %02X\n",
+                        Address, Reference->Data[Address], memory.Data[Address]);
+                    Reported = true;
+                }
+                memory[Address] = Reference->Data[Address];
+            }
+        }
+        A = Guest.A;
+        X = Guest.X;
+        Y = Guest.Y;
+        PS = Guest.PS;
+        SP = Guest.SP;
+        PC = Guest.PC;
+        return { (u32)Guest.Counters.Cycles, (u32)Guest.Counters.InstructionsRetired };
+    }
+
+    static constexpr s32 NO_EVENT = -0x7FFFFFFF - 1;
+
+    // countdown value at which Execute's next heat map sample falls, NO_EVENT
+    // when none; the instruction running at that point is the one sampled,
+    // so the last HEAT_LEAD cycles before it are stepped one by one
+    s32 HeatAt = NO_EVENT;
+    static constexpr s32 HEAT_LEAD = 8;
+
+    // value of Execute's cycle countdown at which it next leaves the fast
+    // path: a scheduler event falling due or a heat map sample
+    s32 EventThreshold( u64 Base, s32 CyclesRequested, s32 Cycles ) const
+    {
+        const s32 Due = EventsDue(Base, CyclesRequested, Cycles);
+        if (HeatAt == NO_EVENT)
+        {
+            return Due;
+        }
+        if (Cycles <= HeatAt + HEAT_LEAD)
+        {
+            return CyclesRequested;
+        }
+        return Due > HeatAt + HEAT_LEAD ? Due : HeatAt + HEAT_LEAD;
+    }
+
+    // value of Execute's cycle countdown at which the next event falls due
+    s32 EventsDue( u64 Base, s32 CyclesRequested, s32 Cycles ) const
+    {
+        if (!Events)
+        {
+            return NO_EVENT;
+        }
+        if (Events->NMIPending || Events->IRQLines)
+        {
+            // a masked IRQ is rechecked every instruction until CLI or ack
+            return CyclesRequested;
+        }
+        const u64 Next = Events->NextEvent();
+        const u64 Elapsed = (u64)(CyclesRequested - Cycles);
+        if (Next == Scheduler::NEVER || Next >= Base + CyclesRequested)
+        {
+            return NO_EVENT;
+        }
+        return Next <= Base + Elapsed ? CyclesRequested : CyclesRequested - (s32)(Next - Base);
+    }
+
+    // returns the number of cycles used, which can overshoot the request by
+    // the tail of the last instruction
+    s32 Execute( s32 Cycles, Mem& memory )
+    {
+        const s32 CyclesRequested = Cycles;
+        u64 InstructionsRetired = 0;
+
+        const u64 Base = Events ? Events->Now : 0;
+        if (Events)
+        {
+            Events->DrainMail();
+        }
+        // devices timestamp accesses against the scheduler's clock when
+        // there is one, otherwise against this CPU's cycle count
+        const u64 Origin = Events ? Base : Counters.Cycles;
+        memory.SliceEnd = Origin + CyclesRequested;
+        // a sampled heat map: the instruction started at HeatStart with these
+        // registers is counted if it runs across HeatAt, scaled up from its
+        // own cycles to the HeatGap cycles since the previous sample
+        HeatAt = Heat && !AccessHeatMap::COUNTS_BUILT_IN ? Cycles - Heat->SampleIn : NO_EVENT;
+        s32 HeatGap = Heat ? Heat->SampleGap : 0;
+        bool HeatArmed = false;
+        s32 HeatStart = 0;
+        Word HeatPC = 0;
+        Byte HeatX = 0, HeatY = 0, HeatSP = 0;
+        auto TakeHeatSample = [&]()
+        {
+            if (HeatArmed)
+            {
+                const s32 Spent = HeatStart - Cycles > 0 ? HeatStart - Cycles : 1;
+                Heat->Sample(HeatPC, HeatX, HeatY, HeatSP, memory.ReadPages, (u64)((HeatGap + Spent / 2) / Spent));
+            }
+            while (Cycles <= HeatAt)
+            {
+                HeatGap = Heat->NextSample();
+                HeatAt -= HeatGap;
+            }
+        };
+        s32 EventAt = EventThreshold(Base, CyclesRequested, Cycles);
+        if (Events)
+        {
+            Events->Recheck = &EventAt;
+        }
+
+        // set when a branch or jump has just entered a polling loop; handled
+        // at the top of the loop through the event check, off the hot path
+        IdleLoop Idle;
+        bool IdleFound = false;
+
+        // Load a Register with a value from the memory address
+
+        auto LoadRegister = [&Cycles, &memory, this](Word Address, Byte& Register) FORCE_INLINE_LAMBDA
+        {
+            Register = ReadByte(Cycles, Address, memory);
+            SetZeroAndNegativeFlags(Register);
+        };
+
+        auto And = [&Cycles, &memory, this](Word Address) FORCE_INLINE_LAMBDA
+        {
+            A &= ReadByte(Cycles, Address, memory);
+            SetZeroAndNegativeFlags(A);
+        };
+
+        auto Ora = [&Cycles, &memory, this](Word Address) FORCE_INLINE_LAMBDA
+        {
+            A |= ReadByte(Cycles, Address, memory);
+            SetZeroAndNegativeFlags(A);
+        };
+
+        auto Eor = [&Cycles, &memory, this](Word Address) FORCE_INLINE_LAMBDA
+        {
+            A ^= ReadByte(Cycles, Address, memory);
+            SetZeroAndNegativeFlags(A);
+        };
+
+        auto BranchIf = [&Cycles, &memory, &Idle, &IdleFound, &EventAt, CyclesRequested, this]( bool Test, bool Expected) FORCE_INLINE_LAMBDA
+        {
+            SByte Offset = FetchSByte(Cycles, memory);
+                const Word PCOld = PC;
+                if (Test == Expected)
+                {
+                    PC += Offset;
+                    Cycles--;
+                    const bool PageChanged = (PC >> 8) != (PCOld >> 8);
+                    if (PageChanged)
+                    {
+                        Cycles--;
+                    }
+                    // polling loops are at most 5 bytes plus the branch
+                    if (Offset < 0 && Offset >= -7 && SkipIdleLoops && FindIdleLoop(PC, PCOld - 2, memory, Idle))
+                    {
+                        IdleFound = true;
+                        EventAt = CyclesRequested;
+                    }
+                }
+                RecordEdge(PCOld - 2, PC);
+        };
+
+        // consumes the next opcode if it is Next and the loop would have run
+        // it anyway (budget left, no trap at PC, no event, IRQ or NMI due
+        // before it)
+        auto FuseNext = [&Cycles, &memory, &InstructionsRetired, &EventAt, this]( Byte Next ) FORCE_INLINE_LAMBDA -> bool
+        {
+            if (!FuseInstructions || Cycles <= 0 || Cycles <= EventAt || PC == TrapPC || memory.Read(PC) != Next)
+            {
+                return false;
+            }
+#ifdef SANITIZE6502
+            if (UNLIKELY(memory.Shadow))
+            {
+                memory.Shadow->OnFetch(PC);
+            }
+#endif
+            FetchByte(Cycles, memory);
+            InstructionsRetired++;
+            return true;
+        };
+
+        // set by flag-setting instructions that are usually followed by
+        // BNE/BEQ; the branch is then taken right after the switch
+        FusionKind ZeroBranch = FUSION_KINDS;
+
+
+        auto ADC = [this](Byte Operand) FORCE_INLINE_LAMBDA
+        {
+            AddWithCarry(Operand);
+        };
+
+        auto SBC = [this](Byte Operand) FORCE_INLINE_LAMBDA
+        {
+            SubtractWithCarry(Operand);
+        };
+
+        auto ASL = [&Cycles, this](Byte Operand) FORCE_INLINE_LAMBDA -> Byte
+        {
+            return ShiftLeft(Operand, Cycles);
+        };
+
+        auto LSR = [&Cycles, this](Byte Operand) FORCE_INLINE_LAMBDA -> Byte
+        {
+            return ShiftRight(Operand, Cycles);
+        };
+
+        auto ROL = [&Cycles, this]( Byte Operand ) FORCE_INLINE_LAMBDA -> Byte
+        {
+            return RotateLeft(Operand, Cycles);
+        };
+
+        auto ROR = [&Cycles, this]( Byte Operand ) FORCE_INLINE_LAMBDA -> Byte
+        {
+            return RotateRight(Operand, Cycles);
+        };
+
+        auto RegisterCompare = [&ZeroBranch, this](Word Operand, Byte RegisterValue)
+        {
+            CompareRegister((Byte)Operand, RegisterValue);
+            ZeroBranch = FUSE_COMPARE_BRANCH;
+        };
+
+        auto PushPSToStack = [&Cycles, &memory, this]() FORCE_INLINE_LAMBDA
+        {
+            Byte PSStack = PS | BreakFlagBit | UnusedFlagBit;
+            PushByteOnToStack(Cycles, PSStack, memory);
+        };
+
+        auto PopPSFromStack = [&Cycles, &memory, this]() FORCE_INLINE_LAMBDA
+        {
+            PS = PopByteFromStack(Cycles, memory);
+            Flag.B = false;
+            Flag.Unused = false;
+        };
+
+        while(Cycles > 0)
+        {
+            if (Cycles <= EventAt)
+            {
+                if (Cycles <= HeatAt)
+                {
+                    TakeHeatSample();
+                }
+                HeatArmed = false;
+                EventAt = EventThreshold(Base, CyclesRequested, Cycles);
+                if (IdleFound)
+                {
+                    // skip whole iterations of the polling loop up to the next
+                    // event or the end of the slice; the final partial iteration
+                    // runs normally so every boundary stays exact
+                    IdleFound = false;
+                    bool GotMail = false;
+                    if (Events && Events->BlockWhenIdle && EventsDue(Base, CyclesRequested, Cycles) == NO_EVENT
+                        && Events->NextEvent() == Scheduler::NEVER)
+                    {
+                        // nothing will ever end this loop but another thread;
+                        // emulated time stands still while we wait
+                        Events->Now = Base + (CyclesRequested - Cycles);
+                        GotMail = Events->WaitForMail();
+                        EventAt = EventThreshold(Base, CyclesRequested, Cycles);
+                    }
+                    const s32 Floor = EventAt > 0 ? EventAt : 0;
+                    if (!GotMail && Cycles - Floor > (s32)Idle.Cycles)
+                    {
+                        const s32 Iterations = (Cycles - Floor - 1) / (s32)Idle.Cycles;
+                        Cycles -= Iterations * (s32)Idle.Cycles;
+                        InstructionsRetired += (u64)Iterations * Idle.Instructions;
+                        Counters.IdleCyclesSkipped += (u64)Iterations * Idle.Cycles;
+                        A = Idle.A;
+                        X = Idle.X;
+                        Y = Idle.Y;
+                        Flag = Idle.Flag;
+                    }
+                }
+                if (Events && Cycles <= EventAt)
+                {
+                    const s32 Used = ServiceEvents(Base + (CyclesRequested - Cycles), memory);
+                    Cycles -= Used;
+                    EventAt = EventThreshold(Base, CyclesRequested, Cycles);
+                    if (Used)
+                    {
+                        continue;
+                    }
+                }
+                if (Cycles <= HeatAt + HEAT_LEAD && HeatAt != NO_EVENT)
+                {
+                    HeatArmed = true;
+                    HeatStart = Cycles;
+                    HeatPC = PC;
+                    HeatX = X;
+                    HeatY = Y;
+                    HeatSP = SP;
+                }
+            }
+            if (PC == TrapPC)
+            {
+                break;
+            }
+            if (Sampler && Sampler->Pending.load(std::memory_order_relaxed))
+            {
+                Sampler->Capture(CallStack, PC);
+            }
+#ifdef SANITIZE6502
+            if (UNLIKELY(memory.Shadow))
+            {
+                memory.Shadow->OnFetch(PC);
+            }
+#endif
+            Byte Ins = FetchByte(Cycles, memory);
+            InstructionsRetired++;
+            switch ( Ins )
+            {
+            case INS_LDA_IM:
+            {
+                A = FetchByte ( Cycles, memory );
+                SetZeroAndNegativeFlags(A);
+            } break;
+            case INS_LDX_IM:
+            {
+                X = FetchByte ( Cycles, memory );
+                SetZeroAndNegativeFlags(X);
+            } break;
+            case INS_LDY_IM:
+            {
+                Y = FetchByte ( Cycles, memory );
+                SetZeroAndNegativeFlags(Y);
+            } break;
+            case INS_LDA_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                LoadRegister( Address, A);
+
+            } break;
+            case INS_LDX_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                LoadRegister( Address, X);
+            } break;
+            case INS_LDX_ZPY:
+            {
+                Word Address = AddrZeroPageY(Cycles, memory);
+                LoadRegister( Address, X);
+
+            } break;
+            case INS_LDY_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                LoadRegister( Address, Y);
+
+            } break;
+            case INS_LDA_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                LoadRegister( Address, A);
+            } break;
+            case INS_LDY_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                LoadRegister( Address, Y);
+            } break;
+            case INS_LDA_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                LoadRegister( Address, A);
+            } break;
+            case INS_LDX_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                LoadRegister( Address, X);
+            } break;
+            case INS_LDY_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                LoadRegister( Address, Y);
+            } break;
+            case INS_LDA_ABSX:
+            {
+                Word Address = AddrAbsoluteX( Cycles, memory);
+                LoadRegister( Address, A);
+                
+            } break;
+            case INS_LDY_ABSX:
+            {
+                Word Address = AddrAbsoluteX( Cycles, memory);
+                LoadRegister( Address, Y);
+                
+            } break;
+            case INS_LDA_ABSY:
+            {
+                Word Address = AddrAbsoluteY( Cycles, memory);
+                LoadRegister( Address, A);
+                
+            } break;
+            case INS_LDX_ABSY:
+            {
+                Word Address = AddrAbsoluteY( Cycles, memory);
+                LoadRegister( Address, X);
+                
+            } break;
+            case INS_LDA_INDX:
+            {
+                Word Address = AddrIndirectX(Cycles, memory);
+                LoadRegister( Address, A);
+            } break;
+            case INS_LDA_INDY:
+            {
+                Word Address = AddrIndirectY(Cycles, memory);
+                LoadRegister( Address, A);
+                // block copy loop body
+                if (FuseNext(INS_STA_INDY))
+                {
+                    Address = AddrIndirectY_6(Cycles, memory);
+                    WriteByte(A, Cycles, Address, memory);
+                    if (FuseNext(INS_INY))
+                    {
+                        Y++;
+                        Cycles--;
+                        SetZeroAndNegativeFlags(Y);
+                        Fusion.Fused[FUSE_COPY_INDIRECT_Y]++;
+                        break;
+                    }
+                }
+                Fusion.Unfused[FUSE_COPY_INDIRECT_Y]++;
+            } break;
+            case INS_STA_ZP:
+            {
+                Word Address = AddrZeroPage( Cycles, memory);
+                WriteByte(A, Cycles, Address, memory);
+
+            } break;
+            case INS_STX_ZP:
+            {
+                Word Address = AddrZeroPage( Cycles, memory);
+                WriteByte(X, Cycles, Address, memory);
+
+            } break;
+            case INS_STX_ZPY:
+            {
+                Word Address = AddrZeroPageY( Cycles, memory);
+                WriteByte(X, Cycles, Address, memory);
+
+            } break;
+            case INS_STY_ZP:
+            {
+                Word Address = AddrZeroPage( Cycles, memory);
+                WriteByte(Y, Cycles, Address, memory);
+
+            } break;
+            case INS_STA_ABS:
+            {
+                Word Address = AddrAbsolute( Cycles, memory);
+                WriteByte(A, Cycles, Address, memory);
+
+            } break;
+            case INS_STX_ABS:
+            {
+                Word Address = AddrAbsolute( Cycles, memory);
+                WriteByte(X, Cycles, Address, memory);
+
+            } break;
+            case INS_STY_ABS:
+            {
+                Word Address = AddrAbsolute( Cycles, memory);
+                WriteByte(Y, Cycles, Address, memory);
+
+            } break;
+            case INS_STA_ZPX:
+            {
+                Word Address = AddrZeroPageX( Cycles, memory);
+                WriteByte(A, Cycles, Address, memory);
+
+            } break;
+            case INS_STY_ZPX:
+            {
+                Word Address = AddrZeroPageX( Cycles, memory);
+                WriteByte(Y, Cycles, Address, memory);
+
+            } break;
+            case INS_STA_ABSX:
+            {
+                Word Address = AddrAbsoluteX_5( Cycles, memory);
+                WriteByte(A, Cycles, Address, memory);
+
+            } break;
+            case INS_STA_ABSY:
+            {
+                Word Address = AddrAbsoluteY_5( Cycles, memory);
+                WriteByte(A, Cycles, Address, memory);
+
+            } break;
+            case INS_STA_INDX:
+            {
+                Word Address = AddrIndirectX(Cycles, memory);
+                WriteByte(A, Cycles, Address, memory);
+
+            } break;
+            case INS_STA_INDY:
+            {
+                Word Address = AddrIndirectY_6(Cycles, memory);
+                WriteByte(A, Cycles, Address, memory);
+
+            } break;
+            case INS_JSR:
+            {
+                Word SubAddr = FetchWord(Cycles, memory);
+                const Byte SPBefore = SP;
+                PushPCMinusOneToStack( Cycles, memory);
+                RecordEdge(PC - 3, SubAddr);
+                if (CallStack)
+                {
+                    CallStack->OnCall(PC - 3, SubAddr, PC, SPBefore, 2, false);
+                }
+                PC = SubAddr;
+                Cycles--;
+                if (Traps && Traps->Has(SubAddr) && SubAddr != TrapPC)
+                {
+                    const HleCost Cost = RunTrap(SubAddr, memory);
+                    Cycles -= Cost.Cycles;
+                    InstructionsRetired += Cost.Instructions;
+                }
+            } break;
+            case INS_RTS:
+            {
+                const Byte SPBefore = SP;
+                Word ReturnAddress = PopWordFromStack(Cycles, memory);
+                RecordEdge(PC - 1, ReturnAddress + 1);
+                if (CallStack)
+                {
+                    CallStack->OnReturn(PC - 1, ReturnAddress + 1, SPBefore, 2, false);
+                }
+                PC = ReturnAddress + 1;
+                Cycles -= 2;
+            } break;
+            case INS_JMP_ABS:
+            {
+                Word Address = AddrAbsolute( Cycles, memory );
+                RecordEdge(PC - 3, Address);
+                // JMP * spins without touching anything
+                if (Address == (Word)(PC - 3) && SkipIdleLoops && Address != TrapPC)
+                {
+                    Idle = { 3, 1, A, X, Y, Flag };
+                    IdleFound = true;
+                    EventAt = CyclesRequested;
+                }
+                PC = Address; 
+            } break;
+            case INS_JMP_IND:
+            {
+                Word Address = AddrAbsolute( Cycles, memory );
+                Address = ReadWord( Cycles, Address, memory );
+                RecordEdge(PC - 3, Address);
+                PC = Address; 
+            } break;
+            case INS_TSX:
+            {
+                X = SP;
+                Cycles--;
+                SetZeroAndNegativeFlags(X);
+
+            } break;
+            case INS_TXS:
+            {
+                SP = X;
+                Cycles--;
+
+            } break;
+            case INS_PHA:
+            {
+                PushByteOnToStack(Cycles, A, memory);
+            } break;
+            case INS_PHP:
+            {
+                PushPSToStack();
+            } break;
+            case INS_PLA:
+            {
+                A = PopByteFromStack(Cycles, memory);
+                SetZeroAndNegativeFlags(A);
+                Cycles--;
+            } break;
+            case INS_PLP:
+            {
+                PopPSFromStack();
+                Cycles--;
+            } break;
+            case INS_AND_IM:
+            {
+                A &= FetchByte(Cycles, memory);
+                SetZeroAndNegativeFlags(A);
+            } break;
+            case INS_ORA_IM:
+            {
+                A |= FetchByte(Cycles, memory);
+                SetZeroAndNegativeFlags(A);
+            } break;
+            case INS_EOR_IM:
+            {
+                A ^= FetchByte(Cycles, memory);
+                SetZeroAndNegativeFlags(A);
+            } break;
+            case INS_AND_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                And(Address);
+            } break;
+            case INS_ORA_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Ora(Address);
+            } break;
+            case INS_EOR_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Eor(Address);
+            } break;
+            case INS_AND_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                And(Address);
+            } break;
+            case INS_ORA_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                Ora(Address);
+            } break;
+            case INS_EOR_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                Eor(Address);
+            } break;
+            case INS_AND_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                And(Address);
+            } break;
+            case INS_ORA_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Ora(Address);
+            } break;
+            case INS_EOR_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Eor(Address);
+            } break;
+            case INS_AND_ABSX:
+            {
+                Word Address = AddrAbsoluteX(Cycles, memory);
+                And(Address);
+            } break;
+            case INS_ORA_ABSX:
+            {
+                Word Address = AddrAbsoluteX(Cycles, memory);
+                Ora(Address);
+            } break;
+            case INS_EOR_ABSX:
+            {
+                Word Address = AddrAbsoluteX(Cycles, memory);
+                Eor(Address);
+            } break;
+            case INS_AND_ABSY:
+            {
+                Word Address = AddrAbsoluteY(Cycles, memory);
+                And(Address);
+            } break;
+            case INS_ORA_ABSY:
+            {
+                Word Address = AddrAbsoluteY(Cycles, memory);
+                Ora(Address);
+            } break;
+            case INS_EOR_ABSY:
+            {
+                Word Address = AddrAbsoluteY(Cycles, memory);
+                Eor(Address);
+            } break;
+            case INS_AND_INDX:
+            {
+                Word Address = AddrIndirectX(Cycles, memory);
+                And(Address);
+            } break;
+            case INS_ORA_INDX:
+            {
+                Word Address = AddrIndirectX(Cycles, memory);
+                Ora(Address);
+            } break;
+            case INS_EOR_INDX:
+            {
+                Word Address = AddrIndirectX(Cycles, memory);
+                Eor(Address);
+            } break;
+            case INS_AND_INDY:
+            {
+                Word Address = AddrIndirectY(Cycles, memory);
+                And(Address);
+            } break;
+            case INS_ORA_INDY:
+            {
+                Word Address = AddrIndirectY(Cycles, memory);
+                Ora(Address);
+            } break;
+            case INS_EOR_INDY:
+            {
+                Word Address = AddrIndirectY(Cycles, memory);
+                Eor(Address);
+            } break;
+            case INS_BIT_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Flag.Z = !(A & Value);
+                Flag.N = (Value & NegativeFlagBit) != 0;
+                Flag.V = (Value * OverflowFlagBit) != 0;
+
+            } break;
+            case INS_BIT_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Flag.Z = !(A & Value);
+                Flag.N = (Value & NegativeFlagBit) != 0;
+                Flag.V = (Value * OverflowFlagBit) != 0;
+
+            } break;
+            case INS_TAX:
+            {
+                X = A;
+                Cycles--;
+                SetZeroAndNegativeFlags(X);
+            } break;
+            case INS_TAY:
+            {
+                Y = A;
+                Cycles--;
+                SetZeroAndNegativeFlags(Y);
+            } break;
+            case INS_TXA:
+            {
+                A = X;
+                Cycles--;
+                SetZeroAndNegativeFlags(A);
+            } break;
+            case INS_TYA:
+            {
+                A = Y;
+                Cycles--;
+                SetZeroAndNegativeFlags(A);
+            } break;
+            case INS_INX:
+            {
+                X++;
+                Cycles--;
+                SetZeroAndNegativeFlags(X);
+            } break;
+            case INS_INY:
+            {
+                Y++;
+                Cycles--;
+                SetZeroAndNegativeFlags(Y);
+            } break;
+            case INS_DEY:
+            {
+                Y--;
+                Cycles--;
+                SetZeroAndNegativeFlags(Y);
+                ZeroBranch = FUSE_DECREMENT_BRANCH;
+            } break;
+            case INS_DEX:
+            {
+                X--;
+                Cycles--;
+                SetZeroAndNegativeFlags(Y);
+                ZeroBranch = FUSE_DECREMENT_BRANCH;
+            } break;
+            case INS_DEC_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Value--;
+                Cycles--;
+                WriteByte(Value, Cycles, Address, memory);
+                SetZeroAndNegativeFlags(Value);
+            } break;
+            case INS_DEC_ZPX:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Address += X;
+                Cycles--;
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Value--;
+                Cycles--;
+                WriteByte(Value, Cycles, Address, memory);
+                SetZeroAndNegativeFlags(Value);
+            } break;
+            case INS_DEC_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Value--;
+                Cycles--;
+                WriteByte(Value, Cycles, Address, memory);
+                SetZeroAndNegativeFlags(Value);
+            } break;
+            case INS_DEC_ABSX:
+            {
+                Word Address = AddrAbsoluteX_5(Cycles, memory);
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Value++;
+                Cycles--;
+                WriteByte(Value, Cycles, Address, memory);
+                SetZeroAndNegativeFlags(Value);
+            } break;
+            case INS_INC_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Value++;
+                Cycles--;
+                WriteByte(Value, Cycles, Address, memory);
+                SetZeroAndNegativeFlags(Value);
+            } break;
+            case INS_INC_ZPX:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Address += X;
+                Cycles--;
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Value++;
+                Cycles--;
+                WriteByte(Value, Cycles, Address, memory);
+                SetZeroAndNegativeFlags(Value);
+            } break;
+            case INS_INC_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Value++;
+                Cycles--;
+                WriteByte(Value, Cycles, Address, memory);
+                SetZeroAndNegativeFlags(Value);
+            } break;
+            case INS_INC_ABSX:
+            {
+                Word Address = AddrAbsoluteX_5(Cycles, memory);
+                Byte Value = ReadByte(Cycles, Address, memory);
+                Value++;
+                Cycles--;
+                WriteByte(Value, Cycles, Address, memory);
+                SetZeroAndNegativeFlags(Value);
+            } break;
+            case INS_BEQ:
+            {   
+                BranchIf(Flag.Z, true);
+            } break;
+            case INS_BNE:
+            {   
+                BranchIf(Flag.Z, false);
+            } break;
+            case INS_BCS:
+            {   
+                BranchIf(Flag.C, true);
+            } break;
+            case INS_BCC:
+            {   
+                BranchIf(Flag.C, false);
+            } break;
+            case INS_BMI:
+            {   
+                BranchIf(Flag.N, true);
+            } break;
+            case INS_BPL:
+            {   
+                BranchIf(Flag.N, false);
+            } break;
+            case INS_BVC:
+            {   
+                BranchIf(Flag.V, false);
+            } break;
+            case INS_BVS:
+            {   
+                BranchIf(Flag.V, true);
+            } break;
+            case INS_CLC:
+            {
+                Flag.C = false;
+                Cycles--;
+                if (FuseNext(INS_ADC_IM))
+                {
+                    ADC(FetchByte(Cycles, memory));
+                    Fusion.Fused[FUSE_CLEAR_CARRY_ADD]++;
+                }
+                else if (FuseNext(INS_ADC_ZP))
+                {
+                    Word Address = AddrZeroPage(Cycles, memory);
+                    ADC(ReadByte(Cycles, Address, memory));
+                    Fusion.Fused[FUSE_CLEAR_CARRY_ADD]++;
+                }
+                else
+                {
+                    Fusion.Unfused[FUSE_CLEAR_CARRY_ADD]++;
+                }
+            } break;
+            case INS_SEC:
+            {
+                Flag.C = true;
+                Cycles--;
+            } break;
+            case INS_CLD:
+            {
+                Flag.D = false;
+                Cycles--;
+            } break;
+            case INS_SED:
+            {
+                Flag.D = true;
+                Cycles--;
+            } break;
+            case INS_CLI:
+            {
+                Flag.I = false;
+                Cycles--;
+            } break;
+            case INS_CLV:
+            {
+                Flag.V = false;
+                Cycles--;
+            } break;
+            case INS_SEI:
+            {
+                Flag.I = true;
+                Cycles--;
+            } break;
+            case INS_NOP:
+            {
+                Cycles--;
+            } break;
+            case INS_ADC_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                ADC(Operand);
+            } break;
+            case INS_ADC_IM:
+            {
+                Byte Operand = FetchByte(Cycles, memory);
+                ADC(Operand);
+            } break;
+            case INS_ADC_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                ADC(Operand);
+            } break;
+            case INS_ADC_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                ADC(Operand);
+            } break;
+            case INS_ADC_ABSX:
+            {
+                Word Address = AddrAbsoluteX(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                ADC(Operand);
+            } break;
+            case INS_ADC_ABSY:
+            {
+                Word Address = AddrAbsoluteY(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                ADC(Operand);
+            } break;
+            case INS_ADC_INDX:
+            {
+                Word Address = AddrIndirectX(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                ADC(Operand);
+            } break;
+            case INS_ADC_INDY:
+            {
+                Word Address = AddrIndirectY(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                ADC(Operand);
+            } break;
+            case INS_CMP:
+            {
+                Byte Operand = FetchByte(Cycles, memory);
+                RegisterCompare(Operand, A);
+            } break;
+            case INS_CPX:
+            {
+                Byte Operand = FetchByte(Cycles, memory);
+                RegisterCompare(Operand, X);
+            } break;
+            case INS_CPY:
+            {
+                Byte Operand = FetchByte(Cycles, memory);
+                RegisterCompare(Operand, Y);
+            } break;
+            case INS_CMP_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, A);
+            } break;
+            case INS_CPX_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, X);
+            } break;
+            case INS_CPY_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, Y);
+            } break;
+            case INS_CMP_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, A);
+            } break;
+            case INS_CMP_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, A);
+            } break;
+            case INS_CPX_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, X);
+            } break;
+            case INS_CPY_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, Y);
+            } break;
+            case INS_CMP_ABSX:
+            {
+                Word Address = AddrAbsoluteX(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, A);
+            } break;
+            case INS_CMP_ABSY:
+            {
+                Word Address = AddrAbsoluteY(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, A);
+            } break;
+            case INS_CMP_INDX:
+            {
+                Word Address = AddrIndirectX(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, A);
+            } break;
+            case INS_CMP_INDY:
+            {
+                Word Address = AddrIndirectY(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                RegisterCompare(Operand, A);
+            } break;
+            case INS_SBC:
+            {
+                Byte Operand = FetchByte( Cycles, memory );
+                SBC( Operand );
+            } break;
+            case INS_SBC_ABS:
+            {
+                Word Address = AddrAbsolute( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                SBC( Operand );
+            } break;
+            case INS_SBC_ZP:
+            {
+                Word Address = AddrZeroPage( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                SBC( Operand );
+            } break;
+            case INS_SBC_ZPX:
+            {
+                Word Address = AddrZeroPageX( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                SBC( Operand );
+            } break;
+            case INS_SBC_ABSX:
+            {
+                Word Address = AddrAbsoluteX( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                SBC( Operand );
+            } break;
+            case INS_SBC_ABSY:
+            {
+                Word Address = AddrAbsoluteY( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                SBC( Operand );
+            } break;
+            case INS_SBC_INDX:
+            {
+                Word Address = AddrIndirectX( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                SBC( Operand );
+            } break;
+            case INS_SBC_INDY:
+            {
+                Word Address = AddrIndirectY( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                SBC( Operand );
+            } break;
+            case INS_ASL:
+            {
+                A = ASL(A);
+            } break;
+            case INS_ASL_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = ASL(Operand);
+                WriteByte(Result, Cycles, Address, memory);
+            } break;
+            case INS_ASL_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = ASL(Operand);
+                WriteByte(Result, Cycles, Address, memory );
+            } break;
+            case INS_ASL_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = ASL( Operand );
+                WriteByte(Result, Cycles, Address, memory);
+            } break;
+            case INS_ASL_ABSX:
+            {
+                Word Address = AddrAbsoluteX_5(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory );
+                Byte Result = ASL(Operand);
+                WriteByte(Result, Cycles, Address, memory);
+            } break;
+            case INS_LSR:
+            {
+                A = LSR(A);
+            } break;
+            case INS_LSR_ZP:
+            {
+                Word Address = AddrZeroPage(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = LSR(Operand);
+                WriteByte(Result, Cycles, Address, memory);
+            } break;
+            case INS_LSR_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = LSR(Operand);
+                WriteByte(Result, Cycles, Address, memory);
+            } break;
+            case INS_LSR_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = LSR(Operand);
+                WriteByte( Result, Cycles, Address, memory);
+            } break;
+            case INS_LSR_ABSX:
+            {
+                Word Address = AddrAbsoluteX_5( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                Byte Result = LSR( Operand );
+                WriteByte( Result, Cycles, Address, memory );
+            } break;
+            case INS_ROL:
+            {
+                A = ROL(A);
+            } break;
+            case INS_ROL_ZP:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = ROL(Operand);
+                WriteByte( Result, Cycles, Address, memory);
+            } break;
+            case INS_ROL_ZPX:
+            {
+                Word Address = AddrZeroPageX( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                Byte Result = ROL( Operand );
+                WriteByte( Result, Cycles, Address, memory );
+            } break;
+            case INS_ROL_ABS:
+            {
+                Word Address = AddrAbsolute( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                Byte Result = ROL( Operand );
+                WriteByte( Result, Cycles, Address, memory );
+            } break;
+            case INS_ROL_ABSX:
+            {
+                Word Address = AddrAbsoluteX_5( Cycles, memory );
+                Byte Operand = ReadByte( Cycles, Address, memory );
+                Byte Result = ROL( Operand );
+                WriteByte( Result, Cycles, Address, memory );
+            } break;
+            case INS_ROR:
+            {
+                A = ROR(A);
+            } break; 
+            case INS_ROR_ZP:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = ROR(Operand);
+                WriteByte( Result, Cycles, Address, memory);
+            } break;
+            case INS_ROR_ZPX:
+            {
+                Word Address = AddrZeroPageX(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = ROR(Operand);
+                WriteByte(Result, Cycles, Address, memory);
+            } break;
+            case INS_ROR_ABS:
+            {
+                Word Address = AddrAbsolute(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = ROR(Operand);
+                WriteByte(Result, Cycles, Address, memory);
+            } break;
+            case INS_ROR_ABSX:
+            {
+                Word Address = AddrAbsoluteX_5(Cycles, memory);
+                Byte Operand = ReadByte(Cycles, Address, memory);
+                Byte Result = ROR(Operand);
+                WriteByte(Result, Cycles, Address, memory);
+            } break;
+            case INS_BRK:
+            {
+                const Byte SPBefore = SP;
+                const Word BreakSite = PC - 1;
+                const Word ReturnAddress = PC + 1;
+                PushPCPlusOneToStack(Cycles, memory);
+                PushPSToStack();
+                constexpr Word InterruptVector = 0xFFFE;
+                PC = ReadWord(Cycles, InterruptVector, memory);
+                if (CallStack)
+                {
+                    CallStack->OnCall(BreakSite, PC, ReturnAddress, SPBefore, 3, true);
+                }
+                Flag.B = true;
+                Flag.I = true;
+                Counters.InterruptsTaken++;
+            } break;
+            case INS_RTI:
+            {
+                const Byte SPBefore = SP;
+                const Word ReturnSite = PC - 1;
+                PopPSFromStack();
+                PC = PopWordFromStack( Cycles, memory );
+                if (CallStack)
+                {
+                    CallStack->OnReturn(ReturnSite, PC, SPBefore, 3, true);
+                }
+            } break;
+            default:
+            {
+               Counters.UnhandledOpcodes++;
+               printf("Instruction not handled %d", Ins);
+            } break;
+            }
+
+            if (ZeroBranch != FUSION_KINDS)
+            {
+                if (FuseNext(INS_BNE))
+                {
+                    BranchIf(Flag.Z, false);
+                    Fusion.Fused[ZeroBranch]++;
+                }
+                else if (FuseNext(INS_BEQ))
+                {
+                    BranchIf(Flag.Z, true);
+                    Fusion.Fused[ZeroBranch]++;
+                }
+                else
+                {
+                    Fusion.Unfused[ZeroBranch]++;
+                }
+                ZeroBranch = FUSION_KINDS;
+            }
+        } 
+
+        Counters.InstructionsRetired += InstructionsRetired;
+        Counters.Cycles += CyclesRequested - Cycles;
+        if (HeatAt != NO_EVENT)
+        {
+            if (Cycles <= HeatAt)
+            {
+                TakeHeatSample();
+            }
+            Heat->SampleIn = Cycles - HeatAt;
+            Heat->SampleGap = HeatGap;
+            HeatAt = NO_EVENT;
+        }
+        if (Events)
+        {
+            Events->Now = Base + (CyclesRequested - Cycles);
+            Events->Recheck = nullptr;
+        }
+        memory.SliceEnd = Origin + (CyclesRequested - Cycles);
+        if (Metrics)
+        {
+            Metrics->Publish(Counters);
+        }
+        return CyclesRequested - Cycles;
+    }
+
+};
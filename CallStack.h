@@ -0,0 +1,217 @@
+// Shadow call stack kept alongside the guest's page-1 stack, plus a timer
+// driven sampler that records guest call stacks for statistical profiling.
+//
+// JSR/BRK push a frame, RTS/RTI pop one. Because the shadow stack records
+// where each call should return to, it can tell a genuine return from a
+// guest that rewrote its return address or unbalanced its stack.
+
+#pragma once
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "Types.h"
+
+struct ShadowCallStack {
+    static constexpr u32 MAX_DEPTH = 256;
+
+    struct Frame {
+        Word CallSite;       // address of the JSR / BRK
+        Word Target;         // subroutine or interrupt handler entered
+        Word ReturnAddress;  // where execution should resume
+        Byte SP;             // guest SP after the return address was pushed
+        bool Interrupt;
+    };
+
+    Frame Frames[MAX_DEPTH];
+    u32 Depth = 0;
+
+    u64 Overflows = 0;          // push wrapped SP past 0x00
+    u64 Underflows = 0;         // pop wrapped SP past 0xFF or found no frame
+    u64 MismatchedReturns = 0;  // return address differs from the one pushed
+    u64 DepthExceeded = 0;      // deeper than MAX_DEPTH, oldest frames dropped
+
+    // set on every error so callers can poll for the last incident
+    bool LastErrorValid = false;
+    Word LastErrorPC = 0;
+    const char* LastError = "";
+
+    void Clear()
+    {
+        Depth = 0;
+        Overflows = Underflows = MismatchedReturns = DepthExceeded = 0;
+        LastErrorValid = false;
+    }
+
+    // SPBefore is the guest SP before the return address was pushed
+    void OnCall( Word CallSite, Word Target, Word ReturnAddress, Byte SPBefore, Byte PushedBytes, bool Interrupt )
+    {
+        if (SPBefore < PushedBytes)
+        {
+            Overflows++;
+            Error(CallSite, "stack overflow");
+        }
+        if (Depth == MAX_DEPTH)
+        {
+            // keep the innermost frames, they are the ones that matter
+            for (u32 i = 1; i < MAX_DEPTH; i++)
+            {
+                Frames[i - 1] = Frames[i];
+            }
+            Depth--;
+            DepthExceeded++;
+        }
+        Frames[Depth++] = { CallSite, Target, ReturnAddress, (Byte)(SPBefore - PushedBytes), Interrupt };
+    }
+
+    // SPBefore is the guest SP before the return address was popped
+    void OnReturn( Word ReturnSite, Word ReturnAddress, Byte SPBefore, Byte PoppedBytes, bool Interrupt )
+    {
+        const bool Wrapped = (u32)SPBefore + PoppedBytes > 0xFF;
+        if (Wrapped)
+        {
+            Underflows++;
+            Error(ReturnSite, "stack underflow");
+        }
+        if (Depth == 0)
+        {
+            if (!Wrapped)
+            {
+                Underflows++;
+                Error(ReturnSite, Interrupt ? "RTI without interrupt frame" : "RTS without call frame");
+            }
+            return;
+        }
+        const Frame& Top = Frames[Depth - 1];
+        if (Top.ReturnAddress == ReturnAddress && Top.Interrupt == Interrupt)
+        {
+            Depth--;
+            return;
+        }
+
+        // unwound through several frames (e.g. an error exit that resets SP)?
+        for (u32 i = Depth - 1; i-- > 0;)
+        {
+            if (Frames[i].ReturnAddress == ReturnAddress && Frames[i].Interrupt == Interrupt)
+            {
+                Depth = i;
+                return;
+            }
+        }
+
+        // a computed jump via pushed address (RTS trick) or a corrupted stack;
+        // drop the top frame so depth stays in step with the guest
+        MismatchedReturns++;
+        Error(ReturnSite, "mismatched return");
+        Depth--;
+    }
+
+    void Error( Word PC, const char* What )
+    {
+        LastErrorValid = true;
+        LastErrorPC = PC;
+        LastError = What;
+    }
+
+    void Print( FILE* Out, Word PC ) const
+    {
+        fprintf(Out, "  #0 0x%04X\n", PC);
+        for (u32 i = Depth; i-- > 0;)
+        {
+            fprintf(Out, "  #%u 0x%04X %s from 0x%04X\n", Depth - i, Frames[i].Target,
+                Frames[i].Interrupt ? "interrupt" : "called", Frames[i].CallSite);
+        }
+    }
+};
+
+// Periodically asks the CPU to record its call stack. The timer thread only
+// raises a flag; the CPU checks it between instructions and does the work
+// on its own thread, so the sample is always consistent.
+struct StackSampler {
+    u32 IntervalUs = 1000;
+
+    // "outermost;...;innermost" -> hits, the folded format flame graph tools read
+    std::unordered_map<std::string, u64> Folded;
+    u64 Samples = 0;
+
+    std::atomic<bool> Pending{false};
+
+    ~StackSampler() { Stop(); }
+
+    void Start()
+    {
+        Running = true;
+        Timer = std::thread([this]()
+        {
+            auto Next = std::chrono::steady_clock::now();
+            while (Running.load(std::memory_order_relaxed))
+            {
+                Next += std::chrono::microseconds(IntervalUs);
+                std::this_thread::sleep_until(Next);
+                Pending.store(true, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    void Stop()
+    {
+        if (Timer.joinable())
+        {
+            Running = false;
+            Timer.join();
+        }
+    }
+
+    // called by the CPU thread when Pending is seen
+    void Capture( const ShadowCallStack* Stack, Word PC )
+    {
+        Pending.store(false, std::memory_order_relaxed);
+        std::string Key;
+        char Name[8];
+        if (Stack)
+        {
+            for (u32 i = 0; i < Stack->Depth; i++)
+            {
+                snprintf(Name, sizeof(Name), "%04X;", Stack->Frames[i].Target);
+                Key += Name;
+            }
+        }
+        snprintf(Name, sizeof(Name), "%04X", PC);
+        Key += Name;
+        Folded[Key]++;
+        Samples++;
+    }
+
+    void Merge( const StackSampler& Other )
+    {
+        for (const auto& Entry : Other.Folded)
+        {
+            Folded[Entry.first] += Entry.second;
+        }
+        Samples += Other.Samples;
+    }
+
+    bool WriteFolded( const char* Path ) const
+    {
+        FILE* File = fopen(Path, "w");
+        if (!File)
+        {
+            return false;
+        }
+        for (const auto& Entry : Folded)
+        {
+            fprintf(File, "%s %llu\n", Entry.first.c_str(), (unsigned long long)Entry.second);
+        }
+        fclose(File);
+        return true;
+    }
+
+private:
+    std::thread Timer;
+    std::atomic<bool> Running{false};
+};
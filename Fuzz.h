@@ -0,0 +1,65 @@
+// In-process fuzzing target: feeds inputs to a guest program and resets the
+// machine between runs by restoring only the pages the previous run touched
+
+#pragma once
+
+#include <string.h>
+
+#include "CPU.h"
+
+struct FuzzTarget {
+
+    enum class Outcome { Exited, Timeout };
+
+    Mem Baseline;          // memory image every run starts from
+    Mem Work;              // memory the guest actually runs in
+    CPU BaselineCPU;
+    CPU cpu;
+
+    Word InputAddress = 0x0200;    // where input bytes are copied
+    Word InputMaxSize = 0x0600;    // larger inputs are truncated
+    s32 LengthAddress = -1;        // optional 16-bit length word for the guest
+    s32 ExitPC = -1;               // run ends when PC reaches it
+    s32 CycleBudget = 100000;      // anything longer counts as a timeout
+
+    Byte* CoverageMap = nullptr;
+
+    // call once after Baseline and BaselineCPU are set up
+    void Prepare()
+    {
+        memcpy(Work.Data, Baseline.Data, Mem::MAX_MEM);
+        Work.ClearDirtyPages();
+        BaselineCPU.CoverageMap = CoverageMap;
+        BaselineCPU.TrapPC = ExitPC;
+        cpu = BaselineCPU;
+    }
+
+    Outcome Run( const Byte* Input, size_t Size )
+    {
+        // undo the previous run, cost is proportional to the pages it wrote
+        Work.RestoreDirtyPages(Baseline);
+        cpu = BaselineCPU;
+
+        const size_t Copied = Size < InputMaxSize ? Size : InputMaxSize;
+        for (size_t i = 0; i < Copied; i++)
+        {
+            Work[(Word)(InputAddress + i)] = Input[i];
+        }
+        if (LengthAddress >= 0)
+        {
+            Work[(Word)LengthAddress] = Copied & 0xFF;
+            Work[(Word)(LengthAddress + 1)] = (Copied >> 8) & 0xFF;
+        }
+
+        s32 Used = 0;
+        while (Used < CycleBudget)
+        {
+            if (cpu.PC == ExitPC)
+            {
+                return Outcome::Exited;
+            }
+            Used += cpu.Execute(CycleBudget - Used, Work);
+        }
+        return cpu.PC == ExitPC ? Outcome::Exited : Outcome::Timeout;
+    }
+};
@@ -0,0 +1,426 @@
+// Memory access heatmap: reads, writes and instruction fetches counted per
+// 256-byte page and per zero-page byte, collected in windows of emulated
+// time and exported as CSV or JSON.
+//
+// An attached map (cpu.Heat) is filled in one of two ways:
+//
+// Sampled, the default. Sample points fall every SamplePeriod cycles or so
+// (jittered so loops do not alias with them). Execute steps the last few
+// cycles before each point one instruction at a time, through the same
+// check it uses for scheduler events, and Sample() decodes the instruction
+// running across the point from its opcode: its fetch bytes, the effective
+// address it reads or writes, pointer and stack bytes. An instruction is
+// hit in proportion to its cycles, so its accesses are counted gap/cycles
+// times, and the counts are estimates that converge on the exact ones over
+// a window of a few thousand samples. Polling loops fast-forwarded by
+// SkipIdleLoops are sampled like any other code. Memory is only peeked
+// through the page table, so sampling has no side effects on devices.
+// Nothing is added to the per-access path: the overhead is a few checks
+// and one decode per sample, about 1% at the default period, and the mode
+// is meant to stay on for full-length production runs.
+//
+// Exact, with -DHEATMAP6502. The CPU's access chokepoints (FetchByte,
+// FetchWord, ReadByte, WriteByte and the stack push/pop helpers) count
+// every byte the guest touches once with what it was used for; operand
+// bytes count as fetches. A never-taken test on the read path is a visible
+// cost, so this is a separate build, like the sanitizer, and an attached
+// map then adds an increment or two per access: the interpreter runs at
+// about 0.55x its normal speed, more for polling-heavy guests since skipped
+// idle loops would go uncounted (turn cpu.SkipIdleLoops off, as 6502farm
+// --heatmap does in that build). Use it to check a sampled profile on a
+// representative stretch of a workload.
+//
+// Neither mode sees the work of native HLE traps or host accesses through
+// Mem; the sampled mode also misses interrupt entry (the pushes and vector
+// read of an IRQ or NMI).
+//
+// Windows are closed by the host, which knows the cycle clock: run Execute in
+// slices no longer than CyclesLeftInWindow() and pass the cycles used to
+// Advance(). Closed windows keep only the cells that were touched, so long
+// runs cost memory in proportion to their working sets. Restart() begins
+// again from window 0 and adds into the windows already there, which sums
+// several runs (e.g. a test corpus) aligned at their start.
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Types.h"
+
+struct AccessHeatMap {
+    enum Kind : u32 {
+        READ,
+        WRITE,
+        FETCH,
+        KINDS
+    };
+
+    static constexpr u32 PAGES = 256;
+    // cell index of zero-page byte N is ZERO_PAGE + N
+    static constexpr u32 ZERO_PAGE = PAGES;
+    static constexpr u32 CELLS = PAGES + 256;
+
+#ifdef HEATMAP6502
+    static constexpr bool COUNTS_BUILT_IN = true;
+#else
+    static constexpr bool COUNTS_BUILT_IN = false;
+#endif
+
+    struct Cell {
+        Word Where;
+        u64 Count[KINDS];
+    };
+
+    struct Window {
+        u64 StartCycle = 0;
+        u64 EndCycle = 0;
+        std::vector<Cell> Cells;    // ascending Where, touched cells only
+
+        // pages with any access in the window
+        u32 WorkingSet() const
+        {
+            u32 Pages = 0;
+            for (const Cell& Entry : Cells)
+            {
+                Pages += Entry.Where < PAGES;
+            }
+            return Pages;
+        }
+    };
+
+    // 0 keeps the whole run in one window
+    u64 WindowCycles = 1000000;
+    std::vector<Window> Windows;
+
+    // sampled mode: mean cycles between samples
+    u32 SamplePeriod = 2000;
+    // sampled mode, kept by CPU::Execute across slices: cycles to the next
+    // sample and the length of the gap it closes
+    s32 SampleIn = 1;
+    s32 SampleGap = 1;
+
+    FORCE_INLINE void Count( Kind What, Word Address )
+    {
+        Current[Address / 256][What]++;
+        if (Address < 256)
+        {
+            Current[ZERO_PAGE + Address][What]++;
+        }
+    }
+
+    // sampled mode: cycles from this sample to the next, SamplePeriod on
+    // average
+    s32 NextSample()
+    {
+        Jitter ^= Jitter << 13;
+        Jitter ^= Jitter >> 17;
+        Jitter ^= Jitter << 5;
+        const u32 Period = SamplePeriod ? SamplePeriod : 1;
+        return (s32)(Period / 2 + Jitter % Period + 1);
+    }
+
+    // sampled mode: counts Weight times the accesses of the instruction that
+    // started at PC with these registers. It is decoded as the 6502 defines
+    // it, reading memory through the page table only (unmapped pages read
+    // as 0xFF)
+    void Sample( Word PC, Byte X, Byte Y, Byte SP, Byte* const* Pages, u64 Weight )
+    {
+        if (!Weight)
+        {
+            return;
+        }
+        auto Peek = [Pages]( Word Address ) -> Byte
+        {
+            const Byte* Page = Pages[Address / 256];
+            return Page ? Page[Address % 256] : 0xFF;
+        };
+        // zero-page pointer, whose two bytes are read
+        auto Pointer = [&]( Byte At ) -> Word
+        {
+            Add(READ, At, Weight);
+            Add(READ, (Byte)(At + 1), Weight);
+            return (Word)(Peek(At) | Peek((Byte)(At + 1)) << 8);
+        };
+        // pushes write downwards from SP, pulls read upwards from SP + 1
+        auto Stack = [&]( Kind What, u32 Bytes )
+        {
+            for (u32 i = 0; i < Bytes; i++)
+            {
+                Add(What, (Word)(0x100 | (Byte)(What == WRITE ? SP - i : SP + 1 + i)), Weight);
+            }
+        };
+
+        const Byte Ins = Peek(PC);
+        const Byte Lo = Peek((Word)(PC + 1));
+        const Word Abs = (Word)(Lo | Peek((Word)(PC + 2)) << 8);
+        // opcode bits aaabbbcc: aaa operation, bbb addressing mode, cc group
+        const u32 Group = Ins & 3, Mode = (Ins >> 2) & 7, Operation = Ins >> 5;
+        u32 Length = 1;
+        switch (Ins)
+        {
+        case 0x00:  // BRK
+            Length = 2;
+            Stack(WRITE, 3);
+            Add(READ, 0xFFFE, Weight);
+            Add(READ, 0xFFFF, Weight);
+            break;
+        case 0x20:  // JSR
+            Length = 3;
+            Stack(WRITE, 2);
+            break;
+        case 0x40:  // RTI
+            Stack(READ, 3);
+            break;
+        case 0x60:  // RTS
+            Stack(READ, 2);
+            break;
+        case 0x08:  // PHP
+        case 0x48:  // PHA
+            Stack(WRITE, 1);
+            break;
+        case 0x28:  // PLP
+        case 0x68:  // PLA
+            Stack(READ, 1);
+            break;
+        case 0x4C:  // JMP abs
+            Length = 3;
+            break;
+        case 0x6C:  // JMP (abs)
+            Length = 3;
+            Add(READ, Abs, Weight);
+            Add(READ, (Word)(Abs + 1), Weight);
+            break;
+        default:
+            if (Group != 1 && (Mode == 2 || Mode == 6))
+            {
+                // implied and accumulator
+            }
+            else if ((Group != 1 && (Mode == 0 || Mode == 4)) || Mode == 2)
+            {
+                // immediate and branches
+                Length = 2;
+            }
+            else
+            {
+                // STX and LDX index with Y where the others use X
+                const Byte Index = Group == 2 && (Operation == 4 || Operation == 5) ? Y : X;
+                Word Target;
+                switch (Mode)
+                {
+                case 0: Target = Pointer((Byte)(Lo + X)); break;        // (zp,X)
+                case 1: Target = Lo; break;                             // zp
+                case 3: Target = Abs; break;                            // abs
+                case 4: Target = (Word)(Pointer(Lo) + Y); break;        // (zp),Y
+                case 5: Target = (Byte)(Lo + Index); break;             // zp,X / zp,Y
+                case 6: Target = (Word)(Abs + Y); break;                // abs,Y
+                default: Target = (Word)(Abs + Index); break;           // abs,X / abs,Y
+                }
+                Length = Mode == 3 || Mode >= 6 ? 3 : 2;
+                // operation 4 stores; group 2 apart from LDX reads and writes
+                if (Operation != 4)
+                {
+                    Add(READ, Target, Weight);
+                }
+                if (Operation == 4 || (Group == 2 && Operation != 5))
+                {
+                    Add(WRITE, Target, Weight);
+                }
+            }
+            break;
+        }
+        for (u32 i = 0; i < Length; i++)
+        {
+            Add(FETCH, (Word)(PC + i), Weight);
+        }
+    }
+
+    u64 CyclesLeftInWindow() const
+    {
+        return WindowCycles ? WindowStart + WindowCycles - Clock : ~0ull;
+    }
+
+    // Cycles more have run; closes the window once it is full
+    void Advance( u64 Cycles )
+    {
+        Clock += Cycles;
+        if (WindowCycles && Clock - WindowStart >= WindowCycles)
+        {
+            CloseWindow();
+        }
+    }
+
+    // closes a partly filled window, e.g. at the end of a run
+    void Finish()
+    {
+        if (Clock > WindowStart)
+        {
+            CloseWindow();
+        }
+    }
+
+    void Restart()
+    {
+        Finish();
+        Clock = WindowStart = 0;
+        Index = 0;
+        SampleIn = SampleGap = 1;
+    }
+
+    // sums another map's windows into this one, window by window
+    void Merge( const AccessHeatMap& Other )
+    {
+        for (size_t i = 0; i < Other.Windows.size(); i++)
+        {
+            Add(i, Other.Windows[i]);
+        }
+    }
+
+    // one row per touched page or zero-page byte and window:
+    // window,start_cycle,end_cycle,kind,address,reads,writes,fetches
+    bool WriteCsv( const char* Path ) const
+    {
+        FILE* File = fopen(Path, "w");
+        if (!File)
+        {
+            fprintf(stderr, "cannot write %s\n", Path);
+            return false;
+        }
+        fprintf(File, "window,start_cycle,end_cycle,kind,address,reads,writes,fetches\n");
+        for (size_t i = 0; i < Windows.size(); i++)
+        {
+            const Window& Entry = Windows[i];
+            for (const Cell& Touched : Entry.Cells)
+            {
+                const bool Page = Touched.Where < PAGES;
+                fprintf(File, "%zu,%llu,%llu,%s,0x%04X,%llu,%llu,%llu\n", i, (unsigned long long)Entry.StartCycle,
+                    (unsigned long long)Entry.EndCycle, Page ? "page" : "zp",
+                    Page ? Touched.Where * 256u : Touched.Where - ZERO_PAGE, (unsigned long long)Touched.Count[READ],
+                    (unsigned long long)Touched.Count[WRITE], (unsigned long long)Touched.Count[FETCH]);
+            }
+        }
+        fclose(File);
+        return true;
+    }
+
+    // {"window_cycles": N, "sample_period": P (0 when exact), "windows": [{"start": ..,
+    //   "end": .., "working_set": .., "pages": [[page, reads, writes, fetches], ...],
+    //   "zero_page": [[byte, ...], ...]}]}
+    bool WriteJson( const char* Path ) const
+    {
+        FILE* File = fopen(Path, "w");
+        if (!File)
+        {
+            fprintf(stderr, "cannot write %s\n", Path);
+            return false;
+        }
+        fprintf(File, "{\"window_cycles\": %llu, \"sample_period\": %u, \"windows\": [\n",
+            (unsigned long long)WindowCycles, COUNTS_BUILT_IN ? 0u : SamplePeriod);
+        for (size_t i = 0; i < Windows.size(); i++)
+        {
+            const Window& Entry = Windows[i];
+            fprintf(File, "  {\"start\": %llu, \"end\": %llu, \"working_set\": %u, \"pages\": [",
+                (unsigned long long)Entry.StartCycle, (unsigned long long)Entry.EndCycle, Entry.WorkingSet());
+            bool ZeroPage = false;
+            const char* Separator = "";
+            for (const Cell& Touched : Entry.Cells)
+            {
+                if (Touched.Where >= ZERO_PAGE && !ZeroPage)
+                {
+                    ZeroPage = true;
+                    Separator = "";
+                    fprintf(File, "], \"zero_page\": [");
+                }
+                fprintf(File, "%s[%u, %llu, %llu, %llu]", Separator, Touched.Where % 256u,
+                    (unsigned long long)Touched.Count[READ], (unsigned long long)Touched.Count[WRITE],
+                    (unsigned long long)Touched.Count[FETCH]);
+                Separator = ", ";
+            }
+            fprintf(File, "%s]}%s\n", ZeroPage ? "" : "], \"zero_page\": [", i + 1 < Windows.size() ? "," : "");
+        }
+        fprintf(File, "]}\n");
+        fclose(File);
+        return true;
+    }
+
+    // .json gets JSON, anything else CSV
+    bool Write( const char* Path ) const
+    {
+        const size_t Length = strlen(Path);
+        return Length >= 5 && !strcmp(Path + Length - 5, ".json") ? WriteJson(Path) : WriteCsv(Path);
+    }
+
+private:
+    u64 Current[CELLS][KINDS] = {};
+    u32 Jitter = 0x9E3779B9;
+    u64 Clock = 0;
+    u64 WindowStart = 0;
+    size_t Index = 0;
+
+    void CloseWindow()
+    {
+        Window Closed;
+        Closed.StartCycle = WindowStart;
+        Closed.EndCycle = Clock;
+        for (u32 Where = 0; Where < CELLS; Where++)
+        {
+            const u64* Counts = Current[Where];
+            if (Counts[READ] | Counts[WRITE] | Counts[FETCH])
+            {
+                Closed.Cells.push_back({ (Word)Where, { Counts[READ], Counts[WRITE], Counts[FETCH] } });
+            }
+        }
+        memset(Current, 0, sizeof(Current));
+        Add(Index++, Closed);
+        WindowStart = Clock;
+    }
+
+    void Add( Kind What, Word Address, u64 Weight )
+    {
+        Current[Address / 256][What] += Weight;
+        if (Address < 256)
+        {
+            Current[ZERO_PAGE + Address][What] += Weight;
+        }
+    }
+
+    void Add( size_t At, const Window& Extra )
+    {
+        if (At >= Windows.size())
+        {
+            Windows.resize(At + 1);
+            Windows[At].StartCycle = Extra.StartCycle;
+        }
+        Window& Into = Windows[At];
+        Into.EndCycle = Extra.EndCycle > Into.EndCycle ? Extra.EndCycle : Into.EndCycle;
+
+        // both lists are sorted by cell
+        std::vector<Cell> Merged;
+        Merged.reserve(Into.Cells.size() + Extra.Cells.size());
+        size_t i = 0, j = 0;
+        while (i < Into.Cells.size() || j < Extra.Cells.size())
+        {
+            if (j == Extra.Cells.size() || (i < Into.Cells.size() && Into.Cells[i].Where < Extra.Cells[j].Where))
+            {
+                Merged.push_back(Into.Cells[i++]);
+            }
+            else if (i == Into.Cells.size() || Extra.Cells[j].Where < Into.Cells[i].Where)
+            {
+                Merged.push_back(Extra.Cells[j++]);
+            }
+            else
+            {
+                Cell Sum = Into.Cells[i++];
+                for (u32 k = 0; k < KINDS; k++)
+                {
+                    Sum.Count[k] += Extra.Cells[j].Count[k];
+                }
+                Merged.push_back(Sum);
+                j++;
+            }
+        }
+        Into.Cells.swap(Merged);
+    }
+};
@@ -0,0 +1,146 @@
+// High-level emulation traps: native stand-ins for hot guest subroutines.
+//
+// A routine is registered against the guest address its callers JSR to,
+// either unconditionally or only for one ROM (FNV-1a hash of the image plus
+// the address, activated by Bind()). When a JSR lands on an active trap,
+// CPU::Execute runs the native routine in place of the guest code and then
+// performs the routine's RTS itself.
+//
+// The native routine must leave registers, flags and memory exactly as the
+// guest code would have and report what the guest code would have cost, from
+// its first instruction up to but not including the final RTS. With
+// Validate set every call is also run through the interpreter on copies of
+// the CPU and memory and the two results are compared; on a mismatch the
+// interpreter's result is kept and the trap is reported. Only Mem::Data is
+// copied and compared, so routines that touch banked storage or devices
+// cannot be validated this way: the copy's device pages and writable banks
+// are cut off from the live ones, and a guest run that reaches one stops
+// there, leaves the devices alone and counts the call as Unvalidated.
+//
+// A trapped call is atomic: a slice can overrun by the length of the routine
+// and events or interrupts due during it are taken after it returns.
+
+#pragma once
+
+#include <stdio.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Types.h"
+
+struct CPU;
+struct Mem;
+
+struct HleCost {
+    u32 Cycles;
+    u32 Instructions;
+};
+
+struct HleTable {
+    using Routine = std::function<HleCost( CPU& cpu, Mem& memory )>;
+
+    struct Entry {
+        Word Address;
+        u64 RomHash;        // 0 for traps that apply to any image
+        bool Active;
+        std::string Name;
+        Routine Fn;
+        u64 Calls = 0;
+        u64 Mismatches = 0;
+        u64 Unvalidated = 0;    // touched a device or bank, see above
+    };
+
+    // cross-check every call against the interpreter
+    bool Validate = false;
+
+    u64 Calls = 0;
+    u64 Mismatches = 0;
+    u64 Unvalidated = 0;
+
+    void Register( Word Address, const char* Name, Routine Fn )
+    {
+        Add({ Address, 0, true, Name, std::move(Fn) });
+    }
+
+    // inactive until Bind() is called with a matching hash
+    void RegisterForRom( u64 RomHash, Word Address, const char* Name, Routine Fn )
+    {
+        Add({ Address, RomHash, false, Name, std::move(Fn) });
+    }
+
+    // activates the traps registered for RomHash and deactivates those for
+    // other images; returns how many are active for it
+    u32 Bind( u64 RomHash )
+    {
+        u32 Bound = 0;
+        for (u64& Bits : Mask)
+        {
+            Bits = 0;
+        }
+        for (Entry& E : Entries)
+        {
+            if (E.RomHash != 0)
+            {
+                E.Active = E.RomHash == RomHash;
+                Bound += E.Active;
+            }
+            if (E.Active)
+            {
+                Mask[E.Address / 64] |= 1ull << (E.Address % 64);
+            }
+        }
+        return Bound;
+    }
+
+    static u64 HashRom( const Byte* Data, size_t Size )
+    {
+        u64 Hash = 0xCBF29CE484222325ull;
+        for (size_t i = 0; i < Size; i++)
+        {
+            Hash = (Hash ^ Data[i]) * 0x100000001B3ull;
+        }
+        return Hash;
+    }
+
+    bool Has( Word Address ) const
+    {
+        return (Mask[Address / 64] >> (Address % 64)) & 1;
+    }
+
+    Entry* Find( Word Address )
+    {
+        for (Entry& E : Entries)
+        {
+            if (E.Address == Address && E.Active)
+            {
+                return &E;
+            }
+        }
+        return nullptr;
+    }
+
+    void Report() const
+    {
+        for (const Entry& E : Entries)
+        {
+            printf("  %04X %-20s %10llu calls %6llu mismatches %6llu unvalidated%s\n", E.Address, E.Name.c_str(),
+                (unsigned long long)E.Calls, (unsigned long long)E.Mismatches, (unsigned long long)E.Unvalidated,
+                E.Active ? "" : " (inactive)");
+        }
+    }
+
+private:
+    std::vector<Entry> Entries;
+    u64 Mask[65536 / 64] = {};
+
+    void Add( Entry E )
+    {
+        if (E.Active)
+        {
+            Mask[E.Address / 64] |= 1ull << (E.Address % 64);
+        }
+        Entries.push_back(std::move(E));
+    }
+};
@@ -0,0 +1,623 @@
+// Emulation job server: other processes submit short ROM jobs over a Unix
+// socket and read results back, without paying process startup or a cold
+// 64 KB reset per job.
+//
+// Protocol, one line per job, key=value pairs as in the runner's manifest:
+//
+//   id=<token> rom=<file> [load=0x8000] [entry=<load>] [budget=1000000]
+//   [trap=0xADDR] [timeout=<ms>] [a=N] [x=N] [y=N] [sp=N]
+//   [poke=0xADDR:<hex bytes>]... [peek=0xADDR:<length>]...
+//
+//   poke      bytes written over the ROM image before the job starts (inputs)
+//   peek      memory returned with the result (outputs)
+//   rom       opened by the server, relative to its working directory; an
+//             image running past 0xFFFF from its load address is an error
+//   timeout   wall-clock limit in milliseconds, counted from arrival
+//
+// and one line back per job, in completion order, not submission order:
+//
+//   id=<token> status=trap|budget|timeout|busy|error cycles=N us=N
+//   pc=0xADDR a=N x=N y=N sp=N ps=N [peek=0xADDR:<hex bytes>]... [error=<text>]
+//
+// A job ends when PC reaches its trap (status=trap), when it has used its
+// cycle budget (status=budget) or when its timeout expires. Jobs arriving
+// while MaxQueued are already waiting are turned away at once with
+// status=busy, so a flooded server answers quickly instead of building a
+// backlog; budgets over MaxBudget are refused as errors.
+//
+// Each worker thread keeps one warm CPU and Mem for its whole life. ROM
+// images are loaded once per (file, load address) into a shared baseline
+// Mem, reloaded only when the file's size or modification time changes. A
+// worker whose last job ran the same image rolls back just the pages that
+// job wrote (CPU::Reset with a baseline), so a small job costs a few page
+// copies rather than a 64 KB clear and a file read.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CPU.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+struct JobServer {
+    u32 Threads = std::thread::hardware_concurrency();
+    u32 MaxQueued = 4096;
+    u64 MaxBudget = 1ull << 36;
+    u32 DefaultTimeoutMs = 10000;
+
+    // a client that leaves its results unread this long is dropped
+    u32 SendTimeoutMs = 1000;
+
+    // cycles between timeout checks
+    s32 SliceCycles = 1 << 16;
+
+    std::atomic<u64> Accepted{0};
+    std::atomic<u64> Completed{0};
+    std::atomic<u64> Rejected{0};
+    std::atomic<u64> TimedOut{0};
+    std::atomic<u64> Failed{0};
+
+    ~JobServer()
+    {
+        Stop();
+    }
+
+    bool ListenUnix( const char* InPath )
+    {
+        ListenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        sockaddr_un Address = {};
+        Address.sun_family = AF_UNIX;
+        strncpy(Address.sun_path, InPath, sizeof(Address.sun_path) - 1);
+        unlink(InPath);
+        if (ListenFd < 0 || bind(ListenFd, (sockaddr*)&Address, sizeof(Address)) != 0 || listen(ListenFd, 64) != 0)
+        {
+            perror("job server: unix socket");
+            return false;
+        }
+        Path = InPath;
+        return true;
+    }
+
+    bool Start()
+    {
+        Epoll = epoll_create1(0);
+        WakeFd = eventfd(0, EFD_NONBLOCK);
+        if (ListenFd < 0 || Epoll < 0 || WakeFd < 0)
+        {
+            perror("job server: epoll");
+            return false;
+        }
+        Watch(WakeFd);
+        Watch(ListenFd);
+        Running.store(true);
+        for (u32 i = 0; i < (Threads ? Threads : 1); i++)
+        {
+            Workers.emplace_back([this]() { Work(); });
+        }
+        Io = std::thread([this]() { Serve(); });
+        return true;
+    }
+
+    // queued jobs are dropped; running ones stop at their next slice
+    void Stop()
+    {
+        if (!Running.exchange(false))
+        {
+            return;
+        }
+        const u64 One = 1;
+        if (write(WakeFd, &One, sizeof(One)) < 0)
+        {
+            perror("job server: wake");
+        }
+        Io.join();
+        {
+            std::lock_guard<std::mutex> Guard(QueueLock);
+            Queue.clear();
+        }
+        QueueReady.notify_all();
+        for (std::thread& Worker : Workers)
+        {
+            Worker.join();
+        }
+        Workers.clear();
+        Clients.clear();
+        close(Epoll);
+        close(WakeFd);
+        close(ListenFd);
+        ListenFd = -1;
+        unlink(Path.c_str());
+    }
+
+private:
+    struct Connection {
+        int Fd;
+        std::atomic<bool> Closed{false};
+        std::mutex WriteLock;
+        std::string Output;         // queued, not yet sent; under WriteLock
+        std::string Input;          // I/O thread only
+
+        explicit Connection( int InFd ) : Fd(InFd) {}
+        ~Connection() { close(Fd); }
+    };
+
+    struct Poke {
+        Word Address;
+        std::vector<Byte> Bytes;
+    };
+
+    struct Peek {
+        Word Address;
+        u32 Length;
+    };
+
+    struct Job {
+        std::string Id;
+        std::string RomPath;
+        Word LoadAddress = 0x8000;
+        s32 Entry = -1;
+        u64 Budget = 1000000;
+        s32 Trap = -1;
+        u32 TimeoutMs = 0;
+        s32 A = -1, X = -1, Y = -1, SP = -1;
+        std::vector<Poke> Pokes;
+        std::vector<Peek> Peeks;
+        std::chrono::steady_clock::time_point Arrived;
+        std::shared_ptr<Connection> Client;
+    };
+
+    // a ROM file at a load address, in an otherwise zeroed Mem
+    struct RomImage {
+        Mem Image;
+        off_t Size = 0;
+        timespec Modified = {};
+    };
+
+    std::string Path;
+    int ListenFd = -1;
+    int Epoll = -1;
+    int WakeFd = -1;
+    std::atomic<bool> Running{false};
+    std::thread Io;
+    std::vector<std::thread> Workers;
+    std::map<int, std::shared_ptr<Connection>> Clients;     // I/O thread only
+
+    std::mutex QueueLock;
+    std::condition_variable QueueReady;
+    std::deque<std::unique_ptr<Job>> Queue;
+
+    std::mutex RomLock;
+    std::map<std::string, std::shared_ptr<const RomImage>> Roms;
+
+    void Watch( int Fd )
+    {
+        epoll_event Event = {};
+        Event.events = EPOLLIN;
+        Event.data.fd = Fd;
+        epoll_ctl(Epoll, EPOLL_CTL_ADD, Fd, &Event);
+    }
+
+    // I/O thread: accepts clients, splits their input into lines and queues
+    // or refuses each job
+    void Serve()
+    {
+        epoll_event Events[64];
+        char Buffer[1 << 16];
+        while (Running.load())
+        {
+            const int Count = epoll_wait(Epoll, Events, 64, -1);
+            for (int i = 0; i < Count; i++)
+            {
+                const int Fd = Events[i].data.fd;
+                if (Fd == WakeFd)
+                {
+                    continue;
+                }
+                if (Fd == ListenFd)
+                {
+                    for (int Client; (Client = accept4(ListenFd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0; )
+                    {
+                        Clients[Client] = std::make_shared<Connection>(Client);
+                        Watch(Client);
+                    }
+                    continue;
+                }
+                auto Found = Clients.find(Fd);
+                if (Found == Clients.end())
+                {
+                    continue;
+                }
+                const std::shared_ptr<Connection> Client = Found->second;
+                ssize_t Read;
+                while ((Read = recv(Fd, Buffer, sizeof(Buffer), 0)) > 0)
+                {
+                    Client->Input.append(Buffer, (size_t)Read);
+                }
+                size_t Begin = 0;
+                for (size_t End; (End = Client->Input.find('\n', Begin)) != std::string::npos; Begin = End + 1)
+                {
+                    Client->Input[End] = 0;
+                    Submit(&Client->Input[Begin], Client);
+                }
+                Client->Input.erase(0, Begin);
+                const bool Gone = Read == 0 || (Read < 0 && errno != EAGAIN && errno != EINTR);
+                if (Gone || Client->Closed.load() || Client->Input.size() > sizeof(Buffer))
+                {
+                    // jobs still queued for it are skipped; the descriptor
+                    // closes with the last reference
+                    Client->Closed.store(true);
+                    epoll_ctl(Epoll, EPOLL_CTL_DEL, Fd, nullptr);
+                    shutdown(Fd, SHUT_RDWR);
+                    Clients.erase(Found);
+                }
+            }
+        }
+    }
+
+    void Submit( char* Line, const std::shared_ptr<Connection>& Client )
+    {
+        std::unique_ptr<Job> Next(new Job);
+        Next->Arrived = std::chrono::steady_clock::now();
+        Next->Client = Client;
+        std::string Error;
+        if (!Parse(Line, *Next, Error))
+        {
+            if (!Error.empty())
+            {
+                Failed++;
+                Reply(*Next, "error", Error.c_str());
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> Guard(QueueLock);
+            if (Queue.size() < MaxQueued)
+            {
+                Queue.push_back(std::move(Next));
+            }
+        }
+        if (Next)
+        {
+            Rejected++;
+            Reply(*Next, "busy", nullptr);
+            return;
+        }
+        Accepted++;
+        QueueReady.notify_one();
+    }
+
+    // false with Error empty for a blank line
+    bool Parse( char* Line, Job& Out, std::string& Error ) const
+    {
+        bool Any = false;
+        char* Save = nullptr;
+        for (char* Token = strtok_r(Line, " \t\r", &Save); Token; Token = strtok_r(nullptr, " \t\r", &Save))
+        {
+            char* Value = strchr(Token, '=');
+            if (!Value)
+            {
+                Error = std::string("malformed field ") + Token;
+                return false;
+            }
+            *Value++ = 0;
+            Any = true;
+            const char* Key = Token;
+            if (!strcmp(Key, "id"))            Out.Id = Value;
+            else if (!strcmp(Key, "rom"))      Out.RomPath = Value;
+            else if (!strcmp(Key, "load"))     Out.LoadAddress = (Word)strtoul(Value, nullptr, 0);
+            else if (!strcmp(Key, "entry"))    Out.Entry = (s32)(strtoul(Value, nullptr, 0) & 0xFFFF);
+            else if (!strcmp(Key, "budget"))   Out.Budget = strtoull(Value, nullptr, 0);
+            else if (!strcmp(Key, "trap"))     Out.Trap = (s32)(strtoul(Value, nullptr, 0) & 0xFFFF);
+            else if (!strcmp(Key, "timeout"))  Out.TimeoutMs = (u32)strtoul(Value, nullptr, 0);
+            else if (!strcmp(Key, "a"))        Out.A = (s32)(strtoul(Value, nullptr, 0) & 0xFF);
+            else if (!strcmp(Key, "x"))        Out.X = (s32)(strtoul(Value, nullptr, 0) & 0xFF);
+            else if (!strcmp(Key, "y"))        Out.Y = (s32)(strtoul(Value, nullptr, 0) & 0xFF);
+            else if (!strcmp(Key, "sp"))       Out.SP = (s32)(strtoul(Value, nullptr, 0) & 0xFF);
+            else if (!strcmp(Key, "poke") || !strcmp(Key, "peek"))
+            {
+                char* Rest = nullptr;
+                const unsigned long Address = strtoul(Value, &Rest, 0);
+                if (Address > 0xFFFF || *Rest != ':')
+                {
+                    Error = std::string("malformed ") + Key;
+                    return false;
+                }
+                Rest++;
+                if (Key[1] == 'e')
+                {
+                    const unsigned long Length = strtoul(Rest, nullptr, 0);
+                    if (Length == 0 || Address + Length > Mem::MAX_MEM)
+                    {
+                        Error = "peek outside memory";
+                        return false;
+                    }
+                    Out.Peeks.push_back({ (Word)Address, (u32)Length });
+                    continue;
+                }
+                Poke Bytes = { (Word)Address, {} };
+                if (!ParseHex(Rest, Bytes.Bytes) || Address + Bytes.Bytes.size() > Mem::MAX_MEM)
+                {
+                    Error = "malformed poke";
+                    return false;
+                }
+                Out.Pokes.push_back(std::move(Bytes));
+            }
+            else
+            {
+                Error = std::string("unknown key ") + Key;
+                return false;
+            }
+        }
+        if (Any && Out.RomPath.empty())
+        {
+            Error = "missing rom=";
+            return false;
+        }
+        if (Out.Budget > MaxBudget)
+        {
+            Error = "budget over the server limit";
+            return false;
+        }
+        return Any;
+    }
+
+    static bool ParseHex( const char* Text, std::vector<Byte>& Out )
+    {
+        auto Digit = [](char C) -> int
+        {
+            return C >= '0' && C <= '9' ? C - '0' : C >= 'a' && C <= 'f' ? C - 'a' + 10 : C >= 'A' && C <= 'F' ? C - 'A' + 10 : -1;
+        };
+        for (; Text[0] && Text[1]; Text += 2)
+        {
+            const int High = Digit(Text[0]);
+            const int Low = Digit(Text[1]);
+            if (High < 0 || Low < 0)
+            {
+                return false;
+            }
+            Out.push_back((Byte)(High << 4 | Low));
+        }
+        return !Text[0] && !Out.empty();
+    }
+
+    std::shared_ptr<const RomImage> LoadRom( const std::string& RomPath, Word LoadAddress, std::string& Error )
+    {
+        struct stat Info;
+        if (stat(RomPath.c_str(), &Info) != 0)
+        {
+            Error = "cannot open rom " + RomPath;
+            return nullptr;
+        }
+        const std::string Key = RomPath + "@" + std::to_string(LoadAddress);
+        std::lock_guard<std::mutex> Guard(RomLock);
+        std::shared_ptr<const RomImage>& Cached = Roms[Key];
+        if (Cached && Cached->Size == Info.st_size && Cached->Modified.tv_sec == Info.st_mtim.tv_sec
+            && Cached->Modified.tv_nsec == Info.st_mtim.tv_nsec)
+        {
+            return Cached;
+        }
+        if (Info.st_size > (off_t)(Mem::MAX_MEM - LoadAddress))
+        {
+            Error = "rom " + RomPath + " runs past 0xFFFF";
+            return nullptr;
+        }
+        std::shared_ptr<RomImage> Loaded(new RomImage);
+        Loaded->Size = Info.st_size;
+        Loaded->Modified = Info.st_mtim;
+        Loaded->Image.Initialize();
+        FILE* File = fopen(RomPath.c_str(), "rb");
+        const size_t Read = File ? fread(&Loaded->Image.Data[LoadAddress], 1, Mem::MAX_MEM - LoadAddress, File) : 0;
+        if (File)
+        {
+            fclose(File);
+        }
+        if (Read == 0)
+        {
+            Error = "empty rom " + RomPath;
+            return nullptr;
+        }
+        Cached = Loaded;
+        return Cached;
+    }
+
+    void Work()
+    {
+        std::unique_ptr<Mem> memory(new Mem);
+        CPU cpu;
+        cpu.Reset(*memory);
+        std::shared_ptr<const RomImage> Current;
+        for (;;)
+        {
+            std::unique_ptr<Job> Next;
+            {
+                std::unique_lock<std::mutex> Guard(QueueLock);
+                QueueReady.wait(Guard, [this]() { return !Queue.empty() || !Running.load(); });
+                if (!Running.load())
+                {
+                    return;
+                }
+                Next = std::move(Queue.front());
+                Queue.pop_front();
+            }
+            if (!Next->Client->Closed.load())
+            {
+                Run(*Next, cpu, *memory, Current);
+            }
+        }
+    }
+
+    void Run( Job& Task, CPU& cpu, Mem& memory, std::shared_ptr<const RomImage>& Current )
+    {
+        std::string Error;
+        std::shared_ptr<const RomImage> Rom = LoadRom(Task.RomPath, Task.LoadAddress, Error);
+        if (!Rom)
+        {
+            Failed++;
+            Reply(Task, "error", Error.c_str());
+            return;
+        }
+        if (Rom == Current)
+        {
+            cpu.Reset(memory, Rom->Image);
+        }
+        else
+        {
+            cpu.ResetCPU();
+            memory = Rom->Image;
+            memory.ClearDirtyPages();
+            Current = Rom;
+        }
+        for (const Poke& Bytes : Task.Pokes)
+        {
+            memcpy(&memory.Data[Bytes.Address], Bytes.Bytes.data(), Bytes.Bytes.size());
+            memory.MarkDirtyRange(Bytes.Address, (u32)Bytes.Bytes.size());
+        }
+        cpu.PC = Task.Entry >= 0 ? (Word)Task.Entry : Task.LoadAddress;
+        cpu.A = Task.A >= 0 ? (Byte)Task.A : 0;
+        cpu.X = Task.X >= 0 ? (Byte)Task.X : 0;
+        cpu.Y = Task.Y >= 0 ? (Byte)Task.Y : 0;
+        cpu.SP = Task.SP >= 0 ? (Byte)Task.SP : 0xFF;
+        cpu.TrapPC = Task.Trap;
+
+        const auto Deadline = Task.Arrived + std::chrono::milliseconds(Task.TimeoutMs ? Task.TimeoutMs : DefaultTimeoutMs);
+        const char* Status = "budget";
+        bool Expired = false;
+        u64 Used = 0;
+        while (Used < Task.Budget)
+        {
+            if (cpu.PC == Task.Trap)
+            {
+                break;
+            }
+            if (std::chrono::steady_clock::now() >= Deadline || !Running.load())
+            {
+                Expired = true;
+                break;
+            }
+            const u64 Remaining = Task.Budget - Used;
+            Used += cpu.Execute(Remaining < (u64)SliceCycles ? (s32)Remaining : SliceCycles, memory);
+        }
+        if (cpu.PC == Task.Trap)
+        {
+            Status = "trap";
+        }
+        else if (Expired)
+        {
+            Status = "timeout";
+            TimedOut++;
+        }
+        Completed++;
+        Reply(Task, Status, nullptr, &cpu, &memory, Used);
+    }
+
+    void Reply( const Job& Task, const char* Status, const char* Error, const CPU* cpu = nullptr,
+        const Mem* memory = nullptr, u64 Cycles = 0 )
+    {
+        static const char HexDigits[] = "0123456789abcdef";
+        std::string Line;
+        Line.reserve(160);
+        Line += "id=";
+        Line += Task.Id.empty() ? "-" : Task.Id;
+        Line += " status=";
+        Line += Status;
+        char Field[160];
+        if (cpu)
+        {
+            const long long Micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - Task.Arrived).count();
+            snprintf(Field, sizeof(Field), " cycles=%llu us=%lld pc=0x%04X a=%u x=%u y=%u sp=%u ps=%u",
+                (unsigned long long)Cycles, Micros, cpu->PC, cpu->A, cpu->X, cpu->Y, cpu->SP, cpu->PS);
+            Line += Field;
+            for (const Peek& Range : Task.Peeks)
+            {
+                snprintf(Field, sizeof(Field), " peek=0x%04X:", Range.Address);
+                Line += Field;
+                for (u32 i = 0; i < Range.Length; i++)
+                {
+                    const Byte Value = memory->Data[Range.Address + i];
+                    Line += HexDigits[Value >> 4];
+                    Line += HexDigits[Value & 15];
+                }
+            }
+        }
+        if (Error)
+        {
+            // keep it one field
+            Line += " error=";
+            for (const char* C = Error; *C; C++)
+            {
+                Line += *C == ' ' ? '_' : *C;
+            }
+        }
+        Line += '\n';
+        Send(*Task.Client, Line);
+    }
+
+    // queues Line behind the client's unsent output and sends what the
+    // socket takes. WriteLock is never held across a wait: a worker facing a
+    // full socket buffer polls unlocked, up to SendTimeoutMs, while others
+    // keep queueing. The I/O thread (busy and parse-error replies) never
+    // waits, so a client that cannot take its line at once is dropped rather
+    // than stalling every other connection
+    void Send( Connection& Client, const std::string& Line )
+    {
+        const bool Wait = std::this_thread::get_id() != Io.get_id();
+        const auto Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SendTimeoutMs);
+        std::unique_lock<std::mutex> Guard(Client.WriteLock);
+        Client.Output += Line;
+        while (!Client.Output.empty() && !Client.Closed.load())
+        {
+            const ssize_t Count = send(Client.Fd, Client.Output.data(), Client.Output.size(), MSG_NOSIGNAL);
+            const int Failure = errno;
+            if (Count > 0)
+            {
+                Client.Output.erase(0, (size_t)Count);
+                continue;
+            }
+            if (Count < 0 && Failure == EINTR)
+            {
+                continue;
+            }
+            const long long Left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                Deadline - std::chrono::steady_clock::now()).count();
+            if (Count < 0 && Failure == EAGAIN && Wait && Left > 0)
+            {
+                Guard.unlock();
+                pollfd Writable = { Client.Fd, POLLOUT, 0 };
+                poll(&Writable, 1, (int)Left);
+                Guard.lock();
+                continue;
+            }
+            // the I/O thread notices at its next read of this client
+            Client.Closed.store(true);
+            shutdown(Client.Fd, SHUT_RDWR);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,593 @@
+// Lockstep interpreter: runs LANES instances of the same program side by side.
+//
+// Registers and flags live in structure-of-arrays form, one byte per lane,
+// so each shared instruction is decoded once and its ALU work is a
+// fixed-length, branch-free loop over lanes that the compiler turns into
+// AVX2 / AVX-512 code (build with -O3 -march=native). Memory stays per lane.
+//
+// Lanes whose PC (or code bytes) stop matching the leading lane are split
+// off and finished by the scalar CPU::Execute. Opcodes without a lane-wise
+// handler are stepped through CPU::Execute one lane at a time, which keeps
+// the group together as long as control flow does not diverge.
+//
+// Without vector instructions the lane loops run element by element and the
+// group is no faster than the scalar core (measured at 0.97x with plain -O2
+// on x86-64), so unless the build targets AVX2 or NEON, UseLanes starts off
+// and Execute simply runs every lane through CPU::Execute.
+//
+// Code bytes are decoded and compared straight from Mem::Data, which is only
+// what the CPU sees under the identity page table, so a lane whose memory is
+// remapped (mapper banks, mirrors, bus handlers) runs scalar from the start,
+// as does one with a Scheduler attached, since lane-wise steps do not run
+// events or take interrupts, or with a heat map, which samples in Execute.
+// Operand loads and stores go through Mem::Read / Mem::Write like the
+// interpreter's, keeping the state hash and the sanitizer current.
+//
+// Results are identical to running every lane with CPU::Execute, except
+// that edge coverage, the shadow call stack and the sampler only observe
+// the instructions that took the scalar path.
+
+#pragma once
+
+#include <string.h>
+
+#include "CPU.h"
+
+template <u32 LANES>
+struct LockstepGroup {
+    static_assert(LANES >= 2 && LANES <= 64, "lane count out of range");
+
+#if defined(__AVX2__) || defined(__ARM_NEON)
+    static constexpr bool LANES_VECTORIZED = true;
+#else
+    static constexpr bool LANES_VECTORIZED = false;
+#endif
+
+    // share decode and ALU work across lanes; off, every lane runs scalar
+    bool UseLanes = LANES_VECTORIZED;
+
+    u64 VectorSteps = 0;     // shared instructions executed lane-wise
+    u64 ScalarSteps = 0;     // shared instructions stepped one lane at a time
+    u64 SplitLanes = 0;      // lanes that left the group early
+
+    // run each Cpus[i] against *Memories[i] for Cycles cycles, like calling
+    // Cpus[i].Execute(Cycles, *Memories[i]) for every lane
+    void Execute( CPU* Cpus, Mem* const* Memories, s32 Cycles )
+    {
+        for (u32 i = 0; i < LANES; i++)
+        {
+            Load(i, Cpus[i]);
+            Trap[i] = Cpus[i].TrapPC;
+            Remaining[i] = Cycles;
+            Retired[i] = 0;
+            VectorCycles[i] = 0;
+            Split[i] = !UseLanes;
+            // lane-wise steps neither advance a scheduler nor take IRQs or
+            // NMIs, nor sample heat
+            if (UseLanes && (!Memories[i]->IsFlat() || Cpus[i].Events || Cpus[i].Heat))
+            {
+                Split[i] = true;
+                SplitLanes++;
+            }
+        }
+        for (u64& Bits : SharedPages)
+        {
+            Bits = 0;
+        }
+
+        for (;;)
+        {
+            u32 Runnable = 0;
+            for (u32 i = 0; i < LANES; i++)
+            {
+                Live[i] = !Split[i] & (Remaining[i] > 0) & (PC[i] != Trap[i]);
+                Runnable += Live[i];
+            }
+            if (Runnable == 0)
+            {
+                break;
+            }
+
+            // the leading lane decides which instruction the group runs next
+            u32 Leader = 0;
+            while (!Live[Leader])
+            {
+                Leader++;
+            }
+            const Mem& Code = *Memories[Leader];
+            const Word InsPC = PC[Leader];
+            const Byte Ins = Code[InsPC];
+            const Byte Lo = Code[(Word)(InsPC + 1)];
+            const Byte Hi = Code[(Word)(InsPC + 2)];
+
+            u32 Members = 0;
+            for (u32 i = 0; i < LANES; i++)
+            {
+                Active[i] = Live[i] & (PC[i] == InsPC);
+                Members += Active[i];
+            }
+            if (!IsShared(InsPC, Memories) || !IsShared((Word)(InsPC + 2), Memories))
+            {
+                for (u32 i = 0; i < LANES; i++)
+                {
+                    const Mem& M = *Memories[i];
+                    if (Active[i] && (M[InsPC] != Ins || M[(Word)(InsPC + 1)] != Lo || M[(Word)(InsPC + 2)] != Hi))
+                    {
+                        Active[i] = false;
+                        Members--;
+                    }
+                }
+            }
+            if (Members != Runnable)
+            {
+                for (u32 i = 0; i < LANES; i++)
+                {
+                    if (Live[i] && !Active[i])
+                    {
+                        Split[i] = true;
+                        SplitLanes++;
+                    }
+                }
+            }
+            if (Members == 1)
+            {
+                // nothing left to share, the scalar core is faster for one lane
+                Split[Leader] = true;
+                SplitLanes++;
+                continue;
+            }
+
+            if (StepShared(Ins, Lo, Hi, Memories))
+            {
+                VectorSteps++;
+            }
+            else
+            {
+                for (u32 i = 0; i < LANES; i++)
+                {
+                    if (Active[i])
+                    {
+                        Store(i, Cpus[i]);
+                        Remaining[i] -= Cpus[i].Execute(1, *Memories[i]);
+                        Load(i, Cpus[i]);
+                    }
+                }
+                // the scalar step may have written anywhere
+                for (u64& Bits : SharedPages)
+                {
+                    Bits = 0;
+                }
+                ScalarSteps++;
+            }
+        }
+
+        for (u32 i = 0; i < LANES; i++)
+        {
+            Store(i, Cpus[i]);
+            Cpus[i].Counters.InstructionsRetired += Retired[i];
+            Cpus[i].Counters.Cycles += VectorCycles[i];
+            if (Split[i] && Remaining[i] > 0)
+            {
+                Remaining[i] -= Cpus[i].Execute(Remaining[i], *Memories[i]);
+            }
+        }
+    }
+
+private:
+    alignas(64) Byte A[LANES], X[LANES], Y[LANES], SP[LANES];
+    alignas(64) Byte C[LANES], Z[LANES], I[LANES], D[LANES], B[LANES], U[LANES], V[LANES], N[LANES];
+    alignas(64) Byte Operand[LANES], Result[LANES], Active[LANES], Live[LANES], Split[LANES];
+    alignas(64) Word PC[LANES], Address[LANES];
+    // per-call totals fit in s32 because Execute's budget is an s32
+    alignas(64) s32 Trap[LANES], Remaining[LANES], Cost[LANES], Retired[LANES], VectorCycles[LANES];
+
+    // pages known to hold the same bytes in every live lane; set lazily, cleared
+    // by stores, so code bytes are compared once per page instead of per step
+    u64 SharedPages[Mem::NUM_PAGES / 64];
+
+    bool IsShared( Word Address, Mem* const* Memories )
+    {
+        const u32 Page = Address / Mem::PAGE_SIZE;
+        const u64 Bit = 1ull << (Page % 64);
+        if (SharedPages[Page / 64] & Bit)
+        {
+            return true;
+        }
+        const Byte* First = nullptr;
+        for (u32 i = 0; i < LANES; i++)
+        {
+            if (!Live[i])
+            {
+                continue;
+            }
+            const Byte* Bytes = Memories[i]->Data + Page * Mem::PAGE_SIZE;
+            if (!First)
+            {
+                First = Bytes;
+            }
+            else if (memcmp(First, Bytes, Mem::PAGE_SIZE) != 0)
+            {
+                return false;
+            }
+        }
+        // lanes only ever leave the group, so the bit stays valid until a store
+        SharedPages[Page / 64] |= Bit;
+        return true;
+    }
+
+    void Unshare( u32 Page )
+    {
+        Page %= Mem::NUM_PAGES;
+        SharedPages[Page / 64] &= ~(1ull << (Page % 64));
+    }
+
+    void Load( u32 i, const CPU& cpu )
+    {
+        A[i] = cpu.A; X[i] = cpu.X; Y[i] = cpu.Y; SP[i] = cpu.SP; PC[i] = cpu.PC;
+        C[i] = cpu.Flag.C; Z[i] = cpu.Flag.Z; I[i] = cpu.Flag.I; D[i] = cpu.Flag.D;
+        B[i] = cpu.Flag.B; U[i] = cpu.Flag.Unused; V[i] = cpu.Flag.V; N[i] = cpu.Flag.N;
+    }
+
+    void Store( u32 i, CPU& cpu ) const
+    {
+        cpu.A = A[i]; cpu.X = X[i]; cpu.Y = Y[i]; cpu.SP = SP[i]; cpu.PC = PC[i];
+        cpu.Flag.C = C[i]; cpu.Flag.Z = Z[i]; cpu.Flag.I = I[i]; cpu.Flag.D = D[i];
+        cpu.Flag.B = B[i]; cpu.Flag.Unused = U[i]; cpu.Flag.V = V[i]; cpu.Flag.N = N[i];
+    }
+
+    enum class Mode { Implied, Immediate, ZeroPage, ZeroPageX, ZeroPageY, Absolute, AbsoluteX, AbsoluteY };
+
+    // lane-wise helpers; every loop is fixed length and branch free
+
+    void SetZN( const Byte* Reg )
+    {
+        for (u32 i = 0; i < LANES; i++)
+        {
+            Z[i] = Active[i] ? Reg[i] == 0 : Z[i];
+            N[i] = Active[i] ? Reg[i] >> 7 : N[i];
+        }
+    }
+
+    void Assign( Byte* Reg, const Byte* From )
+    {
+        for (u32 i = 0; i < LANES; i++)
+        {
+            Reg[i] = Active[i] ? From[i] : Reg[i];
+        }
+    }
+
+    // cycles every active lane pays; Cost[] holds per-lane extras
+    s32 BaseCost = 0;
+
+    void AddCost( s32 Cycles )
+    {
+        BaseCost += Cycles;
+    }
+
+    // effective addresses and cycle costs, matching the CPU::Addr* helpers
+    void ComputeAddress( Mode M, Byte Lo, Byte Hi, bool IsStore )
+    {
+        const Word Base = (Word)(Lo | (Hi << 8));
+        switch (M)
+        {
+        case Mode::ZeroPage:
+            for (u32 i = 0; i < LANES; i++) Address[i] = Lo;
+            AddCost(1);
+            break;
+        case Mode::ZeroPageX:
+            for (u32 i = 0; i < LANES; i++) Address[i] = (Byte)(Lo + X[i]);
+            AddCost(2);
+            break;
+        case Mode::ZeroPageY:
+            for (u32 i = 0; i < LANES; i++) Address[i] = (Byte)(Lo + Y[i]);
+            AddCost(2);
+            break;
+        case Mode::Absolute:
+            for (u32 i = 0; i < LANES; i++) Address[i] = Base;
+            AddCost(2);
+            break;
+        case Mode::AbsoluteX:
+        case Mode::AbsoluteY:
+        {
+            const Byte* Index = M == Mode::AbsoluteX ? X : Y;
+            AddCost(2);
+            for (u32 i = 0; i < LANES; i++)
+            {
+                Address[i] = (Word)(Base + Index[i]);
+                // stores always pay the extra cycle, loads only on a page cross
+                Cost[i] += IsStore || (Address[i] & 0xFF00) != (Base & 0xFF00);
+            }
+        } break;
+        default:
+            break;
+        }
+    }
+
+    void FetchOperand( Mode M, Byte Lo, Byte Hi, Mem* const* Memories )
+    {
+        if (M == Mode::Immediate)
+        {
+            for (u32 i = 0; i < LANES; i++) Operand[i] = Lo;
+            AddCost(1);
+            return;
+        }
+        ComputeAddress(M, Lo, Hi, false);
+        for (u32 i = 0; i < LANES; i++)
+        {
+            if (Active[i])
+            {
+                Operand[i] = Memories[i]->Read(Address[i]);
+            }
+        }
+        AddCost(1);
+    }
+
+    void StoreRegister( Mode M, Byte Lo, Byte Hi, const Byte* Reg, Mem* const* Memories )
+    {
+        ComputeAddress(M, Lo, Hi, true);
+        Unshare(M == Mode::Absolute || M == Mode::AbsoluteX || M == Mode::AbsoluteY ? Hi : 0);
+        if (M == Mode::AbsoluteX || M == Mode::AbsoluteY)
+        {
+            Unshare(Hi + 1u);
+        }
+        for (u32 i = 0; i < LANES; i++)
+        {
+            if (Active[i])
+            {
+                Memories[i]->Write(Address[i], Reg[i]);
+            }
+        }
+        AddCost(1);
+    }
+
+    void Adc( bool Subtract )
+    {
+        for (u32 i = 0; i < LANES; i++)
+        {
+            const Byte Op = Subtract ? (Byte)~Operand[i] : Operand[i];
+            const bool SignsSame = !((A[i] ^ Op) & 0x80);
+            const u32 Sum = (u32)A[i] + Op + C[i];
+            const Byte NewA = (Byte)Sum;
+            Result[i] = NewA;
+            const Byte NewC = Sum > 0xFF;
+            const Byte NewV = SignsSame && (NewA & Op & 0x80);
+            C[i] = Active[i] ? NewC : C[i];
+            V[i] = Active[i] ? NewV : V[i];
+        }
+        Assign(A, Result);
+        SetZN(A);
+    }
+
+    // same flag rules as the interpreter's RegisterCompare, which takes Z and
+    // C from A whichever register is compared
+    void Compare( const Byte* Reg )
+    {
+        for (u32 i = 0; i < LANES; i++)
+        {
+            const Byte Temp = (Byte)(Reg[i] - Operand[i]);
+            N[i] = Active[i] ? Temp >> 7 : N[i];
+            Z[i] = Active[i] ? A[i] == Operand[i] : Z[i];
+            C[i] = Active[i] ? A[i] >= Operand[i] : C[i];
+        }
+    }
+
+    void Branch( const Byte* FlagArray, bool Expected, Byte Lo )
+    {
+        const SByte Offset = (SByte)Lo;
+        AddCost(1);
+        for (u32 i = 0; i < LANES; i++)
+        {
+            const Word Next = (Word)(PC[i] + 2);
+            const Word Target = (Word)(Next + Offset);
+            const bool Taken = (FlagArray[i] != 0) == Expected;
+            const s32 Extra = Taken ? 1 + ((Target >> 8) != (Next >> 8)) : 0;
+            Cost[i] += Extra;
+            PC[i] = Active[i] ? (Taken ? Target : Next) : PC[i];
+        }
+    }
+
+    // returns false when the opcode has no lane-wise handler
+    bool StepShared( Byte Ins, Byte Lo, Byte Hi, Mem* const* Memories )
+    {
+        for (u32 i = 0; i < LANES; i++)
+        {
+            Cost[i] = 0;
+        }
+
+        BaseCost = 1;    // opcode fetch
+        Mode M = Mode::Implied;
+        u32 Length = 1;
+        enum class Op { None, LDA, LDX, LDY, STA, STX, STY, AND, ORA, EOR, ADC, SBC, CMP, CPX, CPY } Operation = Op::None;
+
+        switch (Ins)
+        {
+        case CPU::INS_LDA_IM:   Operation = Op::LDA; M = Mode::Immediate; break;
+        case CPU::INS_LDA_ZP:   Operation = Op::LDA; M = Mode::ZeroPage; break;
+        case CPU::INS_LDA_ZPX:  Operation = Op::LDA; M = Mode::ZeroPageX; break;
+        case CPU::INS_LDA_ABS:  Operation = Op::LDA; M = Mode::Absolute; break;
+        case CPU::INS_LDA_ABSX: Operation = Op::LDA; M = Mode::AbsoluteX; break;
+        case CPU::INS_LDA_ABSY: Operation = Op::LDA; M = Mode::AbsoluteY; break;
+        case CPU::INS_LDX_IM:   Operation = Op::LDX; M = Mode::Immediate; break;
+        case CPU::INS_LDX_ZP:   Operation = Op::LDX; M = Mode::ZeroPage; break;
+        case CPU::INS_LDX_ZPY:  Operation = Op::LDX; M = Mode::ZeroPageY; break;
+        case CPU::INS_LDX_ABS:  Operation = Op::LDX; M = Mode::Absolute; break;
+        case CPU::INS_LDX_ABSY: Operation = Op::LDX; M = Mode::AbsoluteY; break;
+        case CPU::INS_LDY_IM:   Operation = Op::LDY; M = Mode::Immediate; break;
+        case CPU::INS_LDY_ZP:   Operation = Op::LDY; M = Mode::ZeroPage; break;
+        case CPU::INS_LDY_ZPX:  Operation = Op::LDY; M = Mode::ZeroPageX; break;
+        case CPU::INS_LDY_ABS:  Operation = Op::LDY; M = Mode::Absolute; break;
+        case CPU::INS_LDY_ABSX: Operation = Op::LDY; M = Mode::AbsoluteX; break;
+        case CPU::INS_STA_ZP:   Operation = Op::STA; M = Mode::ZeroPage; break;
+        case CPU::INS_STA_ZPX:  Operation = Op::STA; M = Mode::ZeroPageX; break;
+        case CPU::INS_STA_ABS:  Operation = Op::STA; M = Mode::Absolute; break;
+        case CPU::INS_STA_ABSX: Operation = Op::STA; M = Mode::AbsoluteX; break;
+        case CPU::INS_STA_ABSY: Operation = Op::STA; M = Mode::AbsoluteY; break;
+        case CPU::INS_STX_ZP:   Operation = Op::STX; M = Mode::ZeroPage; break;
+        case CPU::INS_STX_ZPY:  Operation = Op::STX; M = Mode::ZeroPageY; break;
+        case CPU::INS_STX_ABS:  Operation = Op::STX; M = Mode::Absolute; break;
+        case CPU::INS_STY_ZP:   Operation = Op::STY; M = Mode::ZeroPage; break;
+        case CPU::INS_STY_ZPX:  Operation = Op::STY; M = Mode::ZeroPageX; break;
+        case CPU::INS_STY_ABS:  Operation = Op::STY; M = Mode::Absolute; break;
+        case CPU::INS_AND_IM:   Operation = Op::AND; M = Mode::Immediate; break;
+        case CPU::INS_AND_ZP:   Operation = Op::AND; M = Mode::ZeroPage; break;
+        case CPU::INS_AND_ZPX:  Operation = Op::AND; M = Mode::ZeroPageX; break;
+        case CPU::INS_AND_ABS:  Operation = Op::AND; M = Mode::Absolute; break;
+        case CPU::INS_AND_ABSX: Operation = Op::AND; M = Mode::AbsoluteX; break;
+        case CPU::INS_AND_ABSY: Operation = Op::AND; M = Mode::AbsoluteY; break;
+        case CPU::INS_ORA_IM:   Operation = Op::ORA; M = Mode::Immediate; break;
+        case CPU::INS_ORA_ZP:   Operation = Op::ORA; M = Mode::ZeroPage; break;
+        case CPU::INS_ORA_ZPX:  Operation = Op::ORA; M = Mode::ZeroPageX; break;
+        case CPU::INS_ORA_ABS:  Operation = Op::ORA; M = Mode::Absolute; break;
+        case CPU::INS_ORA_ABSX: Operation = Op::ORA; M = Mode::AbsoluteX; break;
+        case CPU::INS_ORA_ABSY: Operation = Op::ORA; M = Mode::AbsoluteY; break;
+        case CPU::INS_EOR_IM:   Operation = Op::EOR; M = Mode::Immediate; break;
+        case CPU::INS_EOR_ZP:   Operation = Op::EOR; M = Mode::ZeroPage; break;
+        case CPU::INS_EOR_ZPX:  Operation = Op::EOR; M = Mode::ZeroPageX; break;
+        case CPU::INS_EOR_ABS:  Operation = Op::EOR; M = Mode::Absolute; break;
+        case CPU::INS_EOR_ABSX: Operation = Op::EOR; M = Mode::AbsoluteX; break;
+        case CPU::INS_EOR_ABSY: Operation = Op::EOR; M = Mode::AbsoluteY; break;
+        case CPU::INS_ADC_IM:   Operation = Op::ADC; M = Mode::Immediate; break;
+        case CPU::INS_ADC_ZP:   Operation = Op::ADC; M = Mode::ZeroPage; break;
+        case CPU::INS_ADC_ZPX:  Operation = Op::ADC; M = Mode::ZeroPageX; break;
+        case CPU::INS_ADC_ABS:  Operation = Op::ADC; M = Mode::Absolute; break;
+        case CPU::INS_ADC_ABSX: Operation = Op::ADC; M = Mode::AbsoluteX; break;
+        case CPU::INS_ADC_ABSY: Operation = Op::ADC; M = Mode::AbsoluteY; break;
+        case CPU::INS_SBC:      Operation = Op::SBC; M = Mode::Immediate; break;
+        case CPU::INS_SBC_ZP:   Operation = Op::SBC; M = Mode::ZeroPage; break;
+        case CPU::INS_SBC_ZPX:  Operation = Op::SBC; M = Mode::ZeroPageX; break;
+        case CPU::INS_SBC_ABS:  Operation = Op::SBC; M = Mode::Absolute; break;
+        case CPU::INS_SBC_ABSX: Operation = Op::SBC; M = Mode::AbsoluteX; break;
+        case CPU::INS_SBC_ABSY: Operation = Op::SBC; M = Mode::AbsoluteY; break;
+        case CPU::INS_CMP:      Operation = Op::CMP; M = Mode::Immediate; break;
+        case CPU::INS_CMP_ZP:   Operation = Op::CMP; M = Mode::ZeroPage; break;
+        case CPU::INS_CMP_ZPX:  Operation = Op::CMP; M = Mode::ZeroPageX; break;
+        case CPU::INS_CMP_ABS:  Operation = Op::CMP; M = Mode::Absolute; break;
+        case CPU::INS_CMP_ABSX: Operation = Op::CMP; M = Mode::AbsoluteX; break;
+        case CPU::INS_CMP_ABSY: Operation = Op::CMP; M = Mode::AbsoluteY; break;
+        case CPU::INS_CPX:      Operation = Op::CPX; M = Mode::Immediate; break;
+        case CPU::INS_CPX_ZP:   Operation = Op::CPX; M = Mode::ZeroPage; break;
+        case CPU::INS_CPX_ABS:  Operation = Op::CPX; M = Mode::Absolute; break;
+        case CPU::INS_CPY:      Operation = Op::CPY; M = Mode::Immediate; break;
+        case CPU::INS_CPY_ZP:   Operation = Op::CPY; M = Mode::ZeroPage; break;
+        case CPU::INS_CPY_ABS:  Operation = Op::CPY; M = Mode::Absolute; break;
+
+        case CPU::INS_TAX: AddCost(1); Assign(X, A); SetZN(X); break;
+        case CPU::INS_TAY: AddCost(1); Assign(Y, A); SetZN(Y); break;
+        case CPU::INS_TXA: AddCost(1); Assign(A, X); SetZN(A); break;
+        case CPU::INS_TYA: AddCost(1); Assign(A, Y); SetZN(A); break;
+        case CPU::INS_TSX: AddCost(1); Assign(X, SP); SetZN(X); break;
+        case CPU::INS_TXS: AddCost(1); Assign(SP, X); break;
+        case CPU::INS_INX:
+        case CPU::INS_INY:
+        case CPU::INS_DEX:
+        case CPU::INS_DEY:
+        {
+            Byte* Reg = (Ins == CPU::INS_INX || Ins == CPU::INS_DEX) ? X : Y;
+            const Byte Delta = (Ins == CPU::INS_INX || Ins == CPU::INS_INY) ? 1 : 0xFF;
+            for (u32 i = 0; i < LANES; i++)
+            {
+                Result[i] = (Byte)(Reg[i] + Delta);
+            }
+            AddCost(1);
+            Assign(Reg, Result);
+            // the interpreter's DEX sets flags from Y
+            SetZN(Ins == CPU::INS_DEX ? Y : Reg);
+        } break;
+        case CPU::INS_CLC: AddCost(1); for (u32 i = 0; i < LANES; i++) C[i] = Active[i] ? 0 : C[i]; break;
+        case CPU::INS_SEC: AddCost(1); for (u32 i = 0; i < LANES; i++) C[i] = Active[i] ? 1 : C[i]; break;
+        case CPU::INS_CLV: AddCost(1); for (u32 i = 0; i < LANES; i++) V[i] = Active[i] ? 0 : V[i]; break;
+        case CPU::INS_NOP: AddCost(1); break;
+        case CPU::INS_ASL:
+        case CPU::INS_LSR:
+        case CPU::INS_ROL:
+        case CPU::INS_ROR:
+        {
+            // one loop per opcode keeps each of them branch free
+            switch (Ins)
+            {
+            case CPU::INS_ASL:
+                for (u32 i = 0; i < LANES; i++) { Result[i] = (Byte)(A[i] << 1); Operand[i] = A[i] >> 7; }
+                break;
+            case CPU::INS_LSR:
+                for (u32 i = 0; i < LANES; i++) { Result[i] = A[i] >> 1; Operand[i] = A[i] & 1; }
+                break;
+            case CPU::INS_ROL:
+                for (u32 i = 0; i < LANES; i++) { Result[i] = (Byte)((A[i] << 1) | C[i]); Operand[i] = A[i] >> 7; }
+                break;
+            default:
+                for (u32 i = 0; i < LANES; i++) { Result[i] = (Byte)((A[i] >> 1) | (C[i] << 7)); Operand[i] = A[i] & 1; }
+                break;
+            }
+            Assign(C, Operand);
+            AddCost(1);
+            Assign(A, Result);
+            SetZN(A);
+        } break;
+
+        case CPU::INS_BEQ: Branch(Z, true, Lo);  return Finish(0);
+        case CPU::INS_BNE: Branch(Z, false, Lo); return Finish(0);
+        case CPU::INS_BCS: Branch(C, true, Lo);  return Finish(0);
+        case CPU::INS_BCC: Branch(C, false, Lo); return Finish(0);
+        case CPU::INS_BMI: Branch(N, true, Lo);  return Finish(0);
+        case CPU::INS_BPL: Branch(N, false, Lo); return Finish(0);
+        case CPU::INS_BVS: Branch(V, true, Lo);  return Finish(0);
+        case CPU::INS_BVC: Branch(V, false, Lo); return Finish(0);
+        case CPU::INS_JMP_ABS:
+        {
+            AddCost(2);
+            const Word Target = (Word)(Lo | (Hi << 8));
+            for (u32 i = 0; i < LANES; i++)
+            {
+                PC[i] = Active[i] ? Target : PC[i];
+            }
+        } return Finish(0);
+
+        default:
+            return false;
+        }
+
+        if (Operation != Op::None)
+        {
+            Length = (M == Mode::Absolute || M == Mode::AbsoluteX || M == Mode::AbsoluteY) ? 3 : 2;
+            switch (Operation)
+            {
+            case Op::STA: StoreRegister(M, Lo, Hi, A, Memories); break;
+            case Op::STX: StoreRegister(M, Lo, Hi, X, Memories); break;
+            case Op::STY: StoreRegister(M, Lo, Hi, Y, Memories); break;
+            default:
+            {
+                FetchOperand(M, Lo, Hi, Memories);
+                switch (Operation)
+                {
+                case Op::LDA: Assign(A, Operand); SetZN(A); break;
+                case Op::LDX: Assign(X, Operand); SetZN(X); break;
+                case Op::LDY: Assign(Y, Operand); SetZN(Y); break;
+                case Op::AND: for (u32 i = 0; i < LANES; i++) Result[i] = A[i] & Operand[i]; Assign(A, Result); SetZN(A); break;
+                case Op::ORA: for (u32 i = 0; i < LANES; i++) Result[i] = A[i] | Operand[i]; Assign(A, Result); SetZN(A); break;
+                case Op::EOR: for (u32 i = 0; i < LANES; i++) Result[i] = A[i] ^ Operand[i]; Assign(A, Result); SetZN(A); break;
+                case Op::ADC: Adc(false); break;
+                case Op::SBC: Adc(true); break;
+                case Op::CMP: Compare(A); break;
+                case Op::CPX: Compare(X); break;
+                case Op::CPY: Compare(Y); break;
+                default: break;
+                }
+            } break;
+            }
+        }
+        return Finish(Length);
+    }
+
+    bool Finish( u32 Length )
+    {
+        for (u32 i = 0; i < LANES; i++)
+        {
+            PC[i] = Active[i] ? (Word)(PC[i] + Length) : PC[i];
+            const s32 Used = Active[i] ? BaseCost + Cost[i] : 0;
+            Remaining[i] -= Used;
+            VectorCycles[i] += Used;
+            Retired[i] += Active[i];
+        }
+        return true;
+    }
+};
@@ -0,0 +1,575 @@
+// Machine descriptions: a text file listing a board's RAM, ROM, mirrors,
+// devices, cartridge and vectors, compiled into the page table of a Mem once
+// at startup. One binary then runs any board layout, and the CPU pays no
+// per-access region checks since everything ends up as page pointers or
+// BusHandlers.
+//
+// One entry per line, '#' starts a comment. Addresses and sizes take C
+// notation and must cover whole 256-byte pages; anything decoded more
+// finely belongs inside a device. Lines apply in order, so later entries
+// override earlier ones on the pages they share; pages no line covers are
+// unmapped (reads 0xFF, writes dropped).
+//
+//   ram     <start> <size> [mirror=<bytes>]
+//   rom     <start> <size> file=<path> [offset=<n>] [mirror=<bytes>]
+//   mirror  <start> <size> of=<source>
+//   device  <start> <size> type=<type> [name=<id>] [<key>=<value>]...
+//   mapper  file=<path> [type=nrom|uxrom|mmc1|latch] [ram=<bytes>]
+//           [window=<a>] [window-size=<n>] [latch=<first>-<last>]
+//           [shift=<n>] [mask=<n>] [writable=1]
+//   vectors [reset=<a>] [nmi=<a>] [irq=<a>]
+//   entry   <address>
+//
+// RAM and ROM live in Mem::Data at their own addresses, so host code indexing
+// mem[...] sees them; ROM pages simply have no write pointer. mirror= repeats
+// a region until it fills that many bytes, and a mirror line aliases pages
+// onto whatever is mapped at the source when the line is reached. A mapper
+// file with an iNES header picks its own mapper; otherwise type= is required.
+// vectors patches the bytes mapped at 0xFFFA-0xFFFF. File paths are relative
+// to the description.
+//
+//   # 2 KB RAM mirrored to 8 KB, 16 KB BASIC + monitor, a terminal at 0xD000
+//   ram     0x0000 0x0800 mirror=0x2000
+//   rom     0xC000 0x4000 file=basic.bin
+//   device  0xD000 0x0100 type=acia name=console host=stdio
+//
+// Built-in device types:
+//   acia    6551 serial port (Acia.h); host=stdio|pty|unix:<path>|none,
+//           clock=<cpu hz> for baud rate timing. A pty's name is printed
+//           on stderr.
+//   via     6522 VIA timers, shift register and ports (Via.h); irq=<bit>
+//           picks its Scheduler IRQ source bit (default 10).
+//
+// A MachineDescription is parsed once and read-only afterwards, so any number
+// of threads can Install() it into their own Machine and Mem.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Acia.h"
+#include "Mapper.h"
+#include "Scheduler.h"
+#include "Via.h"
+
+struct MachineRegion {
+    enum class Kind { Ram, Rom, Mirror, Device, Cartridge };
+
+    Kind Type = Kind::Ram;
+    u32 Line = 0;
+    Word Start = 0;
+    u32 Size = 0;
+    u32 MirrorSize = 0;                 // ram / rom: repeat to fill this many bytes
+    Word Source = 0;                    // mirror: aliased address
+    std::vector<Byte> Image;            // rom contents, padded with 0xFF
+    std::string DeviceType;
+    std::string Name;
+    std::map<std::string, std::string> Params;     // device settings
+    std::shared_ptr<const Mapper> Cartridge;        // cloned on every Install
+
+    // a device setting as a number, or Default when absent
+    u32 Param( const char* Key, u32 Default ) const
+    {
+        const auto It = Params.find(Key);
+        return It == Params.end() ? Default : (u32)strtoul(It->second.c_str(), nullptr, 0);
+    }
+};
+
+struct MachineDescription {
+    std::string Path;
+    std::vector<MachineRegion> Regions;
+    s32 Vectors[3] = { -1, -1, -1 };    // NMI, reset, IRQ as at 0xFFFA
+    s32 Entry = -1;
+
+    bool Load( const char* InPath )
+    {
+        Path = InPath;
+        Regions.clear();
+        FILE* File = fopen(InPath, "r");
+        if (!File)
+        {
+            fprintf(stderr, "cannot open machine description %s\n", InPath);
+            return false;
+        }
+        char Line[4096];
+        u32 LineNumber = 0;
+        bool Ok = true;
+        while (Ok && fgets(Line, sizeof(Line), File))
+        {
+            LineNumber++;
+            if (char* Comment = strchr(Line, '#'))
+            {
+                *Comment = 0;
+            }
+            Ok = ParseLine(Line, LineNumber);
+        }
+        fclose(File);
+        return Ok;
+    }
+
+private:
+    bool Fail( u32 Line, const char* Message, const std::string& Detail = "" ) const
+    {
+        fprintf(stderr, "%s:%u: %s%s\n", Path.c_str(), Line, Message, Detail.c_str());
+        return false;
+    }
+
+    static bool ParseNumber( const std::string& Text, u32 Max, u32& Out )
+    {
+        char* End = nullptr;
+        const unsigned long Value = strtoul(Text.c_str(), &End, 0);
+        if (Text.empty() || *End || Value > Max)
+        {
+            return false;
+        }
+        Out = (u32)Value;
+        return true;
+    }
+
+    std::string Resolve( const std::string& File ) const
+    {
+        const size_t Slash = Path.find_last_of('/');
+        if (File.empty() || File[0] == '/' || Slash == std::string::npos)
+        {
+            return File;
+        }
+        return Path.substr(0, Slash + 1) + File;
+    }
+
+    bool ParseLine( char* Line, u32 LineNumber )
+    {
+        std::vector<std::string> Words;
+        std::map<std::string, std::string> Keys;
+        for (char* Token = strtok(Line, " \t\r\n"); Token; Token = strtok(nullptr, " \t\r\n"))
+        {
+            if (char* Equals = strchr(Token, '='))
+            {
+                *Equals = 0;
+                Keys[Token] = Equals + 1;
+            }
+            else
+            {
+                Words.push_back(Token);
+            }
+        }
+        if (Words.empty())
+        {
+            return Keys.empty() || Fail(LineNumber, "missing entry kind");
+        }
+
+        const std::string& Kind = Words[0];
+        u32 Number = 0;
+        if (Kind == "vectors")
+        {
+            static const char* const Names[3] = { "nmi", "reset", "irq" };
+            for (u32 i = 0; i < 3; i++)
+            {
+                const auto It = Keys.find(Names[i]);
+                if (It == Keys.end())
+                {
+                    continue;
+                }
+                if (!ParseNumber(It->second, 0xFFFF, Number))
+                {
+                    return Fail(LineNumber, "bad vector ", It->second);
+                }
+                Vectors[i] = (s32)Number;
+                Keys.erase(It);
+            }
+            return Keys.empty() || Fail(LineNumber, "unknown key ", Keys.begin()->first);
+        }
+        if (Kind == "entry")
+        {
+            if (Words.size() != 2 || !ParseNumber(Words[1], 0xFFFF, Number))
+            {
+                return Fail(LineNumber, "expected entry <address>");
+            }
+            Entry = (s32)Number;
+            return true;
+        }
+
+        MachineRegion Region;
+        Region.Line = LineNumber;
+        if (Kind == "mapper")
+        {
+            Region.Type = MachineRegion::Kind::Cartridge;
+            if (!ParseMapper(Region, Keys))
+            {
+                return false;
+            }
+            Regions.push_back(std::move(Region));
+            return true;
+        }
+
+        if (Kind == "ram")          Region.Type = MachineRegion::Kind::Ram;
+        else if (Kind == "rom")     Region.Type = MachineRegion::Kind::Rom;
+        else if (Kind == "mirror")  Region.Type = MachineRegion::Kind::Mirror;
+        else if (Kind == "device")  Region.Type = MachineRegion::Kind::Device;
+        else
+        {
+            return Fail(LineNumber, "unknown entry ", Kind);
+        }
+        u32 Start = 0;
+        if (Words.size() != 3 || !ParseNumber(Words[1], 0xFFFF, Start) || !ParseNumber(Words[2], Mem::MAX_MEM, Region.Size))
+        {
+            return Fail(LineNumber, "expected ", Kind + " <start> <size>");
+        }
+        Region.Start = (Word)Start;
+        if (Start % Mem::PAGE_SIZE || Region.Size == 0 || Region.Size % Mem::PAGE_SIZE || Start + Region.Size > Mem::MAX_MEM)
+        {
+            return Fail(LineNumber, "region must cover whole 256-byte pages inside 64 KB");
+        }
+        if (Keys.count("mirror"))
+        {
+            if (!ParseNumber(Keys["mirror"], Mem::MAX_MEM, Region.MirrorSize) || Region.MirrorSize % Region.Size
+                || Start + Region.MirrorSize > Mem::MAX_MEM || Region.Type == MachineRegion::Kind::Mirror
+                || Region.Type == MachineRegion::Kind::Device)
+            {
+                return Fail(LineNumber, "mirror= must be a multiple of the region size that fits in 64 KB");
+            }
+            Keys.erase("mirror");
+        }
+
+        switch (Region.Type)
+        {
+        case MachineRegion::Kind::Rom:
+        {
+            u32 Offset = 0;
+            if (!Keys.count("file") || (Keys.count("offset") && !ParseNumber(Keys["offset"], ~0u, Offset)))
+            {
+                return Fail(LineNumber, "rom needs file= and a numeric offset=");
+            }
+            const std::string File = Resolve(Keys["file"]);
+            if (!ReadImage(File, Offset, Region.Size, Region.Image, LineNumber))
+            {
+                return false;
+            }
+            Keys.erase("file");
+            Keys.erase("offset");
+        } break;
+        case MachineRegion::Kind::Mirror:
+            if (!Keys.count("of") || !ParseNumber(Keys["of"], 0xFFFF, Start) || Start % Mem::PAGE_SIZE
+                || Start + Region.Size > Mem::MAX_MEM)
+            {
+                return Fail(LineNumber, "mirror needs a page-aligned of=<source>");
+            }
+            Region.Source = (Word)Start;
+            Keys.erase("of");
+            break;
+        case MachineRegion::Kind::Device:
+            if (!Keys.count("type"))
+            {
+                return Fail(LineNumber, "device needs type=");
+            }
+            Region.DeviceType = Keys["type"];
+            Region.Name = Keys.count("name") ? Keys["name"] : Region.DeviceType;
+            Keys.erase("type");
+            Keys.erase("name");
+            Region.Params = std::move(Keys);
+            Keys.clear();
+            break;
+        default:
+            break;
+        }
+        if (!Keys.empty())
+        {
+            return Fail(LineNumber, "unknown key ", Keys.begin()->first);
+        }
+        Regions.push_back(std::move(Region));
+        return true;
+    }
+
+    bool ReadImage( const std::string& File, u32 Offset, u32 Size, std::vector<Byte>& Image, u32 LineNumber ) const
+    {
+        FILE* Rom = fopen(File.c_str(), "rb");
+        if (!Rom)
+        {
+            return Fail(LineNumber, "cannot open ", File);
+        }
+        Image.assign(Size, 0xFF);
+        const bool Seeked = fseek(Rom, (long)Offset, SEEK_SET) == 0;
+        const size_t Read = Seeked ? fread(Image.data(), 1, Size, Rom) : 0;
+        const bool Longer = Read == Size && fgetc(Rom) != EOF;
+        fclose(Rom);
+        if (Read == 0)
+        {
+            return Fail(LineNumber, "nothing to read from ", File);
+        }
+        if (Longer)
+        {
+            return Fail(LineNumber, "image is larger than its region: ", File);
+        }
+        return true;
+    }
+
+    bool ParseMapper( MachineRegion& Region, std::map<std::string, std::string>& Keys )
+    {
+        const u32 LineNumber = Region.Line;
+        if (!Keys.count("file"))
+        {
+            return Fail(LineNumber, "mapper needs file=");
+        }
+        const std::string File = Resolve(Keys["file"]);
+        Keys.erase("file");
+
+        std::unique_ptr<Mapper> Cart;
+        if (!Keys.count("type"))
+        {
+            // iNES images name their own mapper
+            Cart = LoadINes(File.c_str());
+            if (!Cart)
+            {
+                return Fail(LineNumber, "mapper without type= needs an iNES file: ", File);
+            }
+        }
+        else
+        {
+            Cart = CreateMapper(Keys["type"]);
+            if (!Cart)
+            {
+                return Fail(LineNumber, "unknown mapper type ", Keys["type"]);
+            }
+            Keys.erase("type");
+            FILE* Rom = fopen(File.c_str(), "rb");
+            if (!Rom)
+            {
+                return Fail(LineNumber, "cannot open ", File);
+            }
+            Byte Chunk[4096];
+            for (size_t Read; (Read = fread(Chunk, 1, sizeof(Chunk), Rom)) > 0;)
+            {
+                Cart->Rom.insert(Cart->Rom.end(), Chunk, Chunk + Read);
+            }
+            fclose(Rom);
+            if (Cart->Rom.size() < 0x4000)
+            {
+                return Fail(LineNumber, "mapper images hold at least 16 KB: ", File);
+            }
+        }
+
+        u32 Number = 0;
+        if (Keys.count("ram"))
+        {
+            if (!ParseNumber(Keys["ram"], 0x2000, Number))
+            {
+                return Fail(LineNumber, "ram= is at most 0x2000");
+            }
+            Cart->Ram.assign(Number, 0);
+            Keys.erase("ram");
+        }
+        if (LatchMapper* Latch = dynamic_cast<LatchMapper*>(Cart.get()))
+        {
+            u32 First = Latch->LatchFirst, Last = Latch->LatchLast;
+            if (Keys.count("latch"))
+            {
+                const std::string& Range = Keys["latch"];
+                const size_t Dash = Range.find('-');
+                if (Dash == std::string::npos || !ParseNumber(Range.substr(0, Dash), 0xFFFF, First)
+                    || !ParseNumber(Range.substr(Dash + 1), 0xFFFF, Last))
+                {
+                    return Fail(LineNumber, "latch= takes <first>-<last>");
+                }
+            }
+            u32 Window = Latch->WindowAddress, Shift = Latch->Shift, Mask = Latch->Mask, Writable = Latch->Writable;
+            const bool Ok = (!Keys.count("window") || ParseNumber(Keys["window"], 0xFFFF, Window))
+                && (!Keys.count("window-size") || ParseNumber(Keys["window-size"], Mem::MAX_MEM, Latch->WindowSize))
+                && (!Keys.count("shift") || ParseNumber(Keys["shift"], 7, Shift))
+                && (!Keys.count("mask") || ParseNumber(Keys["mask"], 0xFF, Mask))
+                && (!Keys.count("writable") || ParseNumber(Keys["writable"], 1, Writable))
+                && First <= Last && Window + Latch->WindowSize <= Mem::MAX_MEM;
+            if (!Ok)
+            {
+                return Fail(LineNumber, "bad latch mapper settings");
+            }
+            Latch->WindowAddress = (Word)Window;
+            Latch->LatchFirst = (Word)First;
+            Latch->LatchLast = (Word)Last;
+            Latch->Shift = Shift;
+            Latch->Mask = (Byte)Mask;
+            Latch->Writable = Writable != 0;
+            for (const char* Key : { "latch", "window", "window-size", "shift", "mask", "writable" })
+            {
+                Keys.erase(Key);
+            }
+        }
+        if (!Keys.empty())
+        {
+            return Fail(LineNumber, "unknown key ", Keys.begin()->first);
+        }
+        Region.Cartridge = std::move(Cart);
+        return true;
+    }
+};
+
+// builds a device for a "device" line; Events is the instance's scheduler
+// (may be null) for devices that raise interrupts or keep time
+using DeviceFactory = std::function<std::unique_ptr<BusHandler>( const MachineRegion& Spec, Scheduler* Events )>;
+
+// device types every Machine knows; nullptr for anything else or a device
+// whose host side could not be opened
+inline std::unique_ptr<BusHandler> CreateDevice( const MachineRegion& Spec, Scheduler* Events )
+{
+    if (Spec.DeviceType == "acia")
+    {
+        const auto Param = Spec.Params.find("host");
+        const std::string Host = Param == Spec.Params.end() ? "none" : Param->second;
+        std::unique_ptr<SerialHost> Line(new SerialHost);
+        bool Opened = true;
+        if (Host == "stdio")
+        {
+            Opened = Line->OpenStdio();
+        }
+        else if (Host == "pty")
+        {
+            std::string SlaveName;
+            Opened = Line->OpenPty(SlaveName);
+            if (Opened)
+            {
+                fprintf(stderr, "%s: serial port on %s\n", Spec.Name.c_str(), SlaveName.c_str());
+            }
+        }
+        else if (Host.compare(0, 5, "unix:") == 0)
+        {
+            Opened = Line->ListenUnix(Host.c_str() + 5);
+        }
+        else if (Host != "none")
+        {
+            fprintf(stderr, "acia: unknown host %s\n", Host.c_str());
+            return nullptr;
+        }
+        if (!Opened)
+        {
+            return nullptr;
+        }
+        std::unique_ptr<Acia6551> Port(new Acia6551(std::move(Line), Events));
+        Port->Clock = Spec.Param("clock", 0);
+        return Port;
+    }
+    if (Spec.DeviceType == "via")
+    {
+        std::unique_ptr<Via6522> Via(new Via6522(Events));
+        Via->IrqSource = 1u << Spec.Param("irq", 10);
+        return Via;
+    }
+    return nullptr;
+}
+
+// the devices and cartridge of one running instance
+struct Machine {
+    // embedder-provided device types, checked before the built-in ones
+    std::map<std::string, DeviceFactory> DeviceTypes;
+
+    std::unique_ptr<Mapper> Cartridge;
+
+    // remaps all of memory to the description; false (with a message on
+    // stderr) for a device type nobody provides or vectors on unmapped pages
+    bool Install( const MachineDescription& Description, Mem& memory, Scheduler* Events = nullptr )
+    {
+        Devices.clear();
+        Cartridge.reset();
+        memory.MapRange(0, Mem::MAX_MEM, nullptr, nullptr, nullptr);
+        for (const MachineRegion& Region : Description.Regions)
+        {
+            const u32 Span = Region.MirrorSize ? Region.MirrorSize : Region.Size;
+            Byte* Base = &memory.Data[Region.Start];
+            switch (Region.Type)
+            {
+            case MachineRegion::Kind::Ram:
+                for (u32 Offset = 0; Offset < Span; Offset += Region.Size)
+                {
+                    memory.MapRange(Region.Start + Offset, Region.Size, Base, Base, nullptr);
+                }
+                break;
+            case MachineRegion::Kind::Rom:
+                memcpy(Base, Region.Image.data(), Region.Size);
+                memory.MarkDirtyRange(Region.Start, Region.Size);
+                for (u32 Offset = 0; Offset < Span; Offset += Region.Size)
+                {
+                    memory.MapRange(Region.Start + Offset, Region.Size, Base, nullptr, nullptr);
+                }
+                break;
+            case MachineRegion::Kind::Mirror:
+                for (u32 Page = 0; Page < Region.Size / Mem::PAGE_SIZE; Page++)
+                {
+                    const u32 From = Region.Source / Mem::PAGE_SIZE + Page;
+                    memory.MapRange(Region.Start + Page * Mem::PAGE_SIZE, Mem::PAGE_SIZE,
+                        memory.ReadPages[From], memory.WritePages[From], memory.Handlers[From]);
+                }
+                break;
+            case MachineRegion::Kind::Device:
+            {
+                const auto Custom = DeviceTypes.find(Region.DeviceType);
+                std::unique_ptr<BusHandler> Device = Custom != DeviceTypes.end()
+                    ? Custom->second(Region, Events) : CreateDevice(Region, Events);
+                if (!Device)
+                {
+                    fprintf(stderr, "%s:%u: cannot create a device of type %s\n", Description.Path.c_str(), Region.Line,
+                        Region.DeviceType.c_str());
+                    return false;
+                }
+                memory.MapRange(Region.Start, Region.Size, nullptr, nullptr, Device.get());
+                Devices.push_back({ Region.Name, std::move(Device) });
+            } break;
+            case MachineRegion::Kind::Cartridge:
+                Cartridge = Region.Cartridge->Clone();
+                Cartridge->Attach(memory);
+                break;
+            }
+        }
+
+        for (u32 i = 0; i < 3; i++)
+        {
+            const Word Address = 0xFFFA + i * 2;
+            Byte* Page = memory.ReadPages[Address / Mem::PAGE_SIZE];
+            if (Description.Vectors[i] < 0)
+            {
+                continue;
+            }
+            if (!Page)
+            {
+                fprintf(stderr, "%s: vectors need memory mapped at 0xFFFA-0xFFFF\n", Description.Path.c_str());
+                return false;
+            }
+            memory.Store(&Page[Address % Mem::PAGE_SIZE], Description.Vectors[i] & 0xFF);
+            memory.Store(&Page[Address % Mem::PAGE_SIZE + 1], Description.Vectors[i] >> 8);
+        }
+        Entry = Description.Entry;
+        return true;
+    }
+
+    // where execution starts: the entry line, otherwise the reset vector
+    Word EntryPoint( const Mem& memory ) const
+    {
+        return Entry >= 0 ? (Word)Entry : (Word)(memory.Read(0xFFFC) | (memory.Read(0xFFFD) << 8));
+    }
+
+    // the device a line named (or, unnamed, typed) Name; nullptr if none
+    BusHandler* Device( const std::string& Name ) const
+    {
+        for (const NamedDevice& D : Devices)
+        {
+            if (D.Name == Name)
+            {
+                return D.Handler.get();
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    struct NamedDevice {
+        std::string Name;
+        std::unique_ptr<BusHandler> Handler;
+    };
+
+    std::vector<NamedDevice> Devices;
+    s32 Entry = -1;
+};
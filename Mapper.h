@@ -0,0 +1,432 @@
+// Bank-switching mappers for ROM and RAM images larger than the 64 KB
+// address space.
+//
+// A mapper owns its banked storage and points the page table of a Mem at
+// the banks currently selected; a bank switch only rewrites those page
+// pointers. Pages holding ROM have no write pointer, so CPU stores to them
+// reach the mapper's Write() where the bank registers live.
+//
+// Built in: NROM, UxROM, MMC1 (including 512 KB SUROM-style outer banks) and
+// a generic latch (AxROM, GxROM and home-made boards that decode a write to
+// a fixed range as a bank number). LoadINes() reads the PRG part of an iNES
+// file and picks the matching mapper.
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mem.h"
+
+struct Mapper : BusHandler {
+    std::vector<Byte> Rom;
+    std::vector<Byte> Ram;      // battery/work RAM at 0x6000-0x7FFF when present
+    u64 BankSwitches = 0;
+
+    Mapper() = default;
+
+    // copies own their banks, taken from wherever the original's live
+    Mapper( const Mapper& Other )
+        : BusHandler(Other), Rom(Live(Other.Rom, Other.MovedRom)), Ram(Live(Other.Ram, Other.MovedRam)),
+          BankSwitches(Other.BankSwitches), Memory(Other.Memory)
+    {
+    }
+
+    virtual const char* Name() const = 0;
+
+    // an unattached copy with the same images and settings
+    virtual std::unique_ptr<Mapper> Clone() const = 0;
+
+    // maps the power-on banks into memory and takes over their pages
+    void Attach( Mem& memory )
+    {
+        Memory = &memory;
+        Pad(Rom);
+        Pad(Ram);
+        PowerOn();
+    }
+
+    // moves the banks to storage of Rom.size() and Ram.size() bytes (after
+    // Attach, so both have their final size; null leaves that image in its
+    // vector) and repoints the pages mapped there. The vectors keep their
+    // sizes but no longer see what the CPU writes, while a Clone copies
+    // the live banks. SharedMem.h uses this to put the banks in a shared
+    // mapping.
+    void Relocate( Byte* NewRom, Byte* NewRam )
+    {
+        Move(Rom, MovedRom, NewRom);
+        Move(Ram, MovedRam, NewRam);
+    }
+
+    // the live bank storage
+    Byte* RomBanks() { return MovedRom ? MovedRom : Rom.data(); }
+    Byte* RamBanks() { return MovedRam ? MovedRam : Ram.data(); }
+
+    // nothing readable sits behind a mapper's register-only pages
+    Byte Read( Word, u64 ) override
+    {
+        return 0xFF;
+    }
+
+protected:
+    Mem* Memory = nullptr;
+
+    virtual void PowerOn() = 0;
+
+    // ROM at Address from byte Offset of the image; offsets past the end
+    // wrap, as undecoded high bank bits do on a cartridge
+    void MapRom( Word Address, u32 Size, u32 Offset )
+    {
+        Map(Rom, Address, Size, Offset, false);
+    }
+
+    void MapRam( Word Address, u32 Size, u32 Offset )
+    {
+        Map(Ram, Address, Size, Offset, true);
+    }
+
+    void UnmapRam()
+    {
+        Memory->MapRange(0x6000, 0x2000, nullptr, nullptr, this);
+    }
+
+private:
+    Byte* MovedRom = nullptr;
+    Byte* MovedRam = nullptr;
+
+    static std::vector<Byte> Live( const std::vector<Byte>& Image, const Byte* Moved )
+    {
+        return Moved ? std::vector<Byte>(Moved, Moved + Image.size()) : Image;
+    }
+
+    void Move( const std::vector<Byte>& Image, Byte*& Moved, Byte* Target )
+    {
+        if (!Target || Image.empty())
+        {
+            return;
+        }
+        const Byte* Old = Moved ? Moved : Image.data();
+        memcpy(Target, Old, Image.size());
+        for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+        {
+            for (Byte** Pointer : { &Memory->ReadPages[Page], &Memory->WritePages[Page] })
+            {
+                if (*Pointer >= Old && *Pointer < Old + Image.size())
+                {
+                    *Pointer = Target + (*Pointer - Old);
+                }
+            }
+        }
+        Moved = Target;
+        Memory->MapVersion++;
+    }
+
+    void Map( std::vector<Byte>& Image, Word Address, u32 Size, u32 Offset, bool Writable )
+    {
+        Byte* Storage = &Image == &Rom ? RomBanks() : RamBanks();
+        if (Offset >= Image.size())
+        {
+            Offset %= Image.size();
+        }
+        if (Offset + Size <= Image.size())
+        {
+            Byte* Bank = Storage + Offset;
+            if (!Writable && Memory->Handlers[Address / Mem::PAGE_SIZE] == this && !Memory->WritePages[Address / Mem::PAGE_SIZE])
+            {
+                // ROM over ROM: only the read pointers move
+                Memory->RemapReads(Address, Size, Bank, this);
+                return;
+            }
+            Memory->MapRange(Address, Size, Bank, Writable ? Bank : nullptr, this);
+            return;
+        }
+        // a bank larger than the image repeats it
+        for (u32 i = 0; i < Size; i += Mem::PAGE_SIZE)
+        {
+            Byte* Page = Storage + (Offset + i) % Image.size();
+            Memory->MapRange(Address + i, Mem::PAGE_SIZE, Page, Writable ? Page : nullptr, this);
+        }
+    }
+
+    // whole pages only, so a mapped page never runs past the image
+    static void Pad( std::vector<Byte>& Image )
+    {
+        if (!Image.empty() && Image.size() % Mem::PAGE_SIZE)
+        {
+            Image.resize(Image.size() + Mem::PAGE_SIZE - Image.size() % Mem::PAGE_SIZE, 0xFF);
+        }
+    }
+};
+
+// fixed 16 or 32 KB at 0x8000, a 16 KB image mirrored into 0xC000
+struct NromMapper : Mapper {
+    const char* Name() const override { return "NROM"; }
+    std::unique_ptr<Mapper> Clone() const override { return std::unique_ptr<Mapper>(new NromMapper(*this)); }
+
+    void PowerOn() override
+    {
+        MapRom(0x8000, 0x4000, 0);
+        MapRom(0xC000, 0x4000, Rom.size() > 0x4000 ? 0x4000 : 0);
+        if (!Ram.empty())
+        {
+            MapRam(0x6000, 0x2000, 0);
+        }
+    }
+
+    void Write( Word, Byte, u64 ) override {}
+};
+
+// 16 KB switchable at 0x8000, last 16 KB fixed at 0xC000; any ROM write
+// selects the bank
+struct UxromMapper : Mapper {
+    const char* Name() const override { return "UxROM"; }
+    std::unique_ptr<Mapper> Clone() const override { return std::unique_ptr<Mapper>(new UxromMapper(*this)); }
+
+    void PowerOn() override
+    {
+        MapRom(0x8000, 0x4000, 0);
+        MapRom(0xC000, 0x4000, (u32)Rom.size() - 0x4000);
+        if (!Ram.empty())
+        {
+            MapRam(0x6000, 0x2000, 0);
+        }
+    }
+
+    void Write( Word Address, Byte Value, u64 ) override
+    {
+        if (Address >= 0x8000)
+        {
+            MapRom(0x8000, 0x4000, Value * 0x4000u);
+            BankSwitches++;
+        }
+    }
+};
+
+// Nintendo MMC1: registers are loaded one bit per write through a 5-bit
+// shift register; a write with bit 7 set resets it and selects mode 3
+struct Mmc1Mapper : Mapper {
+    Byte Shift = 0;
+    u32 ShiftCount = 0;
+    Byte Control = 0x0C;
+    Byte ChrBank0 = 0;
+    Byte ChrBank1 = 0;
+    Byte PrgBank = 0;
+
+    const char* Name() const override { return "MMC1"; }
+    std::unique_ptr<Mapper> Clone() const override { return std::unique_ptr<Mapper>(new Mmc1Mapper(*this)); }
+
+    void PowerOn() override
+    {
+        if (Ram.empty())
+        {
+            Ram.assign(0x2000, 0);
+        }
+        Update();
+    }
+
+    void Write( Word Address, Byte Value, u64 ) override
+    {
+        if (Address < 0x8000)
+        {
+            return;     // PRG RAM disabled
+        }
+        if (Value & 0x80)
+        {
+            Shift = 0;
+            ShiftCount = 0;
+            Control |= 0x0C;
+            Update();
+            return;
+        }
+        Shift |= (Value & 1) << ShiftCount;
+        if (++ShiftCount < 5)
+        {
+            return;
+        }
+        switch ((Address >> 13) & 3)
+        {
+        case 0: Control = Shift; break;
+        case 1: ChrBank0 = Shift; break;
+        case 2: ChrBank1 = Shift; break;
+        case 3: PrgBank = Shift; break;
+        }
+        Shift = 0;
+        ShiftCount = 0;
+        Update();
+    }
+
+private:
+    void Update()
+    {
+        // 512 KB boards use CHR bank bit 4 to pick the 256 KB half
+        const u32 Outer = Rom.size() > 0x40000 ? (ChrBank0 & 0x10) * 0x4000u : 0;
+        const u32 Bank = (PrgBank & 0x0F) * 0x4000u;
+        const u32 LastBank = (u32)(Rom.size() > 0x40000 ? 0x40000 : Rom.size()) - 0x4000;
+        switch ((Control >> 2) & 3)
+        {
+        case 0:
+        case 1:
+            MapRom(0x8000, 0x8000, Outer + (Bank & ~0x7FFFu));
+            break;
+        case 2:
+            MapRom(0x8000, 0x4000, Outer);
+            MapRom(0xC000, 0x4000, Outer + Bank);
+            break;
+        case 3:
+            MapRom(0x8000, 0x4000, Outer + Bank);
+            MapRom(0xC000, 0x4000, Outer + LastBank);
+            break;
+        }
+        if (PrgBank & 0x10)
+        {
+            UnmapRam();
+        }
+        else
+        {
+            MapRam(0x6000, 0x2000, 0);
+        }
+        BankSwitches++;
+    }
+};
+
+// a window of WindowSize bytes at WindowAddress shows bank
+// (Value >> Shift) & Mask of the image after any write to
+// LatchFirst..LatchLast. The window holds ROM, or RAM when Writable, in
+// which case the latch must sit outside it; other writes on the latch pages
+// reach the RAM that was mapped there before.
+struct LatchMapper : Mapper {
+    Word WindowAddress = 0x8000;
+    u32 WindowSize = 0x8000;
+    Word LatchFirst = 0x8000;
+    Word LatchLast = 0xFFFF;
+    u32 Shift = 0;
+    Byte Mask = 0xFF;
+    bool Writable = false;
+    Byte Latch = 0;
+
+    const char* Name() const override { return "latch"; }
+    std::unique_ptr<Mapper> Clone() const override { return std::unique_ptr<Mapper>(new LatchMapper(*this)); }
+
+    void PowerOn() override
+    {
+        const u32 First = LatchFirst / Mem::PAGE_SIZE;
+        const u32 Last = LatchLast / Mem::PAGE_SIZE;
+        Below.clear();
+        for (u32 Page = First; Page <= Last; Page++)
+        {
+            Below.push_back(Memory->WritePages[Page]);
+            Memory->WritePages[Page] = nullptr;
+            Memory->Handlers[Page] = this;
+        }
+        Select(0);
+        BankSwitches = 0;
+    }
+
+    void Write( Word Address, Byte Value, u64 ) override
+    {
+        if (Address >= LatchFirst && Address <= LatchLast)
+        {
+            Select(Value);
+            return;
+        }
+        const u32 Index = Address / Mem::PAGE_SIZE - LatchFirst / Mem::PAGE_SIZE;
+        if (Index < Below.size() && Below[Index])
+        {
+            Memory->Store(&Below[Index][Address % Mem::PAGE_SIZE], Value);
+        }
+    }
+
+private:
+    std::vector<Byte*> Below;
+
+    void Select( Byte Value )
+    {
+        Latch = Value;
+        const u32 Offset = ((Value >> Shift) & Mask) * WindowSize;
+        if (Writable)
+        {
+            MapRam(WindowAddress, WindowSize, Offset);
+        }
+        else
+        {
+            MapRom(WindowAddress, WindowSize, Offset);
+        }
+        // the window may cover latch pages; keep them routed here
+        for (u32 Page = LatchFirst / Mem::PAGE_SIZE; Page <= LatchLast / Mem::PAGE_SIZE; Page++)
+        {
+            Memory->WritePages[Page] = nullptr;
+            Memory->Handlers[Page] = this;
+        }
+        BankSwitches++;
+    }
+};
+
+// "nrom", "uxrom", "mmc1" or "latch"; nullptr for anything else
+inline std::unique_ptr<Mapper> CreateMapper( const std::string& Name )
+{
+    if (Name == "nrom")  return std::unique_ptr<Mapper>(new NromMapper);
+    if (Name == "uxrom") return std::unique_ptr<Mapper>(new UxromMapper);
+    if (Name == "mmc1")  return std::unique_ptr<Mapper>(new Mmc1Mapper);
+    if (Name == "latch") return std::unique_ptr<Mapper>(new LatchMapper);
+    return nullptr;
+}
+
+// PRG ROM of an iNES file with mapper 0 (NROM), 1 (MMC1), 2 (UxROM),
+// 7 (AxROM) or 66 (GxROM); CHR data is skipped
+inline std::unique_ptr<Mapper> LoadINes( const char* Path )
+{
+    FILE* File = fopen(Path, "rb");
+    if (!File)
+    {
+        fprintf(stderr, "cannot open %s\n", Path);
+        return nullptr;
+    }
+    Byte Header[16];
+    if (fread(Header, 1, sizeof(Header), File) != sizeof(Header) || memcmp(Header, "NES\x1A", 4) != 0)
+    {
+        fprintf(stderr, "%s is not an iNES file\n", Path);
+        fclose(File);
+        return nullptr;
+    }
+    const u32 Number = (Header[6] >> 4) | (Header[7] & 0xF0);
+    std::unique_ptr<Mapper> Result;
+    switch (Number)
+    {
+    case 0: Result.reset(new NromMapper); break;
+    case 1: Result.reset(new Mmc1Mapper); break;
+    case 2: Result.reset(new UxromMapper); break;
+    case 7:
+    case 66:
+    {
+        LatchMapper* Latch = new LatchMapper;
+        Latch->Mask = Number == 7 ? 0x07 : 0x03;
+        Latch->Shift = Number == 7 ? 0 : 4;
+        Result.reset(Latch);
+    } break;
+    default:
+        fprintf(stderr, "%s uses unsupported mapper %u\n", Path, Number);
+        fclose(File);
+        return nullptr;
+    }
+    if (Header[6] & 0x04)
+    {
+        fseek(File, 512, SEEK_CUR);     // trainer
+    }
+    Result->Rom.resize(Header[4] * 0x4000u);
+    if (Result->Rom.empty() || fread(Result->Rom.data(), 1, Result->Rom.size(), File) != Result->Rom.size())
+    {
+        fprintf(stderr, "%s: truncated PRG ROM\n", Path);
+        fclose(File);
+        return nullptr;
+    }
+    if (Header[6] & 0x02)
+    {
+        Result->Ram.assign(0x2000, 0);
+    }
+    fclose(File);
+    return Result;
+}
@@ -0,0 +1,355 @@
+// 64 KB address space of the emulated 6502
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Sanitizer.h"
+#include "StateHash.h"
+#include "Types.h"
+
+// receives CPU accesses to pages mapped without a direct pointer: bank
+// registers, memory-mapped devices. Time is the emulated cycle of the access
+// (see Mem::SliceEnd).
+struct BusHandler {
+    virtual ~BusHandler() = default;
+    virtual Byte Read( Word Address, u64 Time ) = 0;
+    virtual void Write( Word Address, Byte Value, u64 Time ) = 0;
+};
+
+struct Mem {
+    static constexpr u32 MAX_MEM = 1024 * 64;
+    static constexpr u32 PAGE_SIZE = 256;
+    static constexpr u32 NUM_PAGES = MAX_MEM / PAGE_SIZE;
+    Byte Data[MAX_MEM];
+
+    // the CPU's view of the address space, one read and one write pointer per
+    // page; both point into Data unless remapped (see Mapper.h). A null
+    // pointer hands the access to the page's handler, or reads 0xFF and
+    // drops writes when there is none. Host code using operator[] and Data
+    // always sees the flat array.
+    Byte* ReadPages[NUM_PAGES];
+    Byte* WritePages[NUM_PAGES];
+    BusHandler* Handlers[NUM_PAGES];
+
+    // bumped on every remap, so caches of the mapping can tell it changed
+    u64 MapVersion = 0;
+
+    // cycle at which the running Execute slice's countdown reaches zero, so
+    // an access made with Cycles left happens at SliceEnd - Cycles; between
+    // slices it is the current cycle. Kept by CPU::Execute on the CPU's
+    // clock (the scheduler's when one is attached).
+    u64 SliceEnd = 0;
+
+    // optional running hash of Data (see StateHash.h), not owned; a copy
+    // of a Mem does not inherit it
+    StateHash* Hash = nullptr;
+
+    // optional shadow-memory checks on CPU accesses (see Sanitizer.h; the
+    // per-access checks are only compiled in with SANITIZE6502), not owned
+    // and not inherited by copies either
+    GuestSanitizer* Shadow = nullptr;
+
+    Mem() {
+        ResetMap();
+    }
+
+    // copies keep their own Data behind pages that mapped the original's
+    Mem( const Mem& Other ) {
+        *this = Other;
+    }
+
+    Mem& operator=( const Mem& Other ) {
+        if (this == &Other) {
+            return *this;
+        }
+        memcpy(Data, Other.Data, MAX_MEM);
+        if (Hash) {
+            Hash->MarkAllStale();
+        }
+        memcpy(DirtyPages, Other.DirtyPages, sizeof(DirtyPages));
+        CleanPagesAreZero = Other.CleanPagesAreZero;
+        for (u32 Page = 0; Page < NUM_PAGES; Page++) {
+            ReadPages[Page] = Rebase(Other.ReadPages[Page], Other);
+            WritePages[Page] = Rebase(Other.WritePages[Page], Other);
+            Handlers[Page] = Other.Handlers[Page];
+        }
+        MapVersion++;
+        return *this;
+    }
+
+    // every page back to plain RAM in Data
+    void ResetMap() {
+        for (u32 Page = 0; Page < NUM_PAGES; Page++) {
+            ReadPages[Page] = WritePages[Page] = &Data[Page * PAGE_SIZE];
+            Handlers[Page] = nullptr;
+        }
+        MapVersion++;
+    }
+
+    // maps Size bytes (whole pages) at Address; non-null pointers advance
+    // one page at a time
+    void MapRange( Word Address, u32 Size, Byte* Read, Byte* Write, BusHandler* Handler ) {
+        const u32 First = Address / PAGE_SIZE;
+        const u32 Count = Size / PAGE_SIZE < NUM_PAGES - First ? Size / PAGE_SIZE : NUM_PAGES - First;
+        MapPointers(ReadPages + First, Count, Read);
+        MapPointers(WritePages + First, Count, Write);
+        for (u32 i = 0; i < Count; i++) {
+            Handlers[First + i] = Handler;
+        }
+        MapVersion++;
+    }
+
+    // moves the read pointers of the pages in the range that Owner still
+    // handles to another bank; pages remapped to anything else since are
+    // left alone, as are write pointers and handlers
+    void RemapReads( Word Address, u32 Size, Byte* Read, const BusHandler* Owner ) {
+        const u32 First = Address / PAGE_SIZE;
+        const u32 Count = Size / PAGE_SIZE < NUM_PAGES - First ? Size / PAGE_SIZE : NUM_PAGES - First;
+        for (u32 i = 0; i < Count; i++, Read += PAGE_SIZE) {
+            if (Handlers[First + i] == Owner) {
+                ReadPages[First + i] = Read;
+            }
+        }
+        MapVersion++;
+    }
+
+    // CPU-side accesses, through the page table; Cycles is the countdown
+    // of the slice making the access
+    FORCE_INLINE Byte Read( Word Address, s32 Cycles = 0 ) const {
+        const Byte* Page = ReadPages[Address / PAGE_SIZE];
+#ifdef SANITIZE6502
+        // keyed by offset into Data, as Store marks it, so a byte written
+        // through one mirror reads back initialized through another
+        if (UNLIKELY(Shadow) && Page) {
+            const uintptr_t Offset = (uintptr_t)&Page[Address % PAGE_SIZE] - (uintptr_t)Data;
+            if (Offset < MAX_MEM && !Shadow->IsInitialized((u32)Offset)) {
+                UninitializedRead(Address);
+            }
+        }
+#endif
+        return Page ? Page[Address % PAGE_SIZE] : ReadHandler(Address, SliceEnd - (s64)Cycles);
+    }
+
+    FORCE_INLINE void Write( Word Address, Byte Value, s32 Cycles = 0 ) {
+        Byte* Page = WritePages[Address / PAGE_SIZE];
+#ifdef SANITIZE6502
+        if (UNLIKELY(Shadow)) {
+            Shadow->CheckWrite(Address);
+        }
+#endif
+        if (Page) {
+            Store(&Page[Address % PAGE_SIZE], Value);
+        } else if (Handlers[Address / PAGE_SIZE]) {
+            Handlers[Address / PAGE_SIZE]->Write(Address, Value, SliceEnd - (s64)Cycles);
+        }
+#ifdef SANITIZE6502
+        // nothing takes the store: ROM or an unmapped hole
+        else if (UNLIKELY(Shadow)) {
+            Shadow->Flag(GuestSanitizer::ROM_WRITE, Address);
+        }
+#endif
+    }
+
+    // stores through a pointer taken from the page table, as Write does:
+    // if it lies in Data the page is marked dirty and the hash updated
+    FORCE_INLINE void Store( Byte* Slot, Byte Value ) {
+        const uintptr_t Offset = (uintptr_t)Slot - (uintptr_t)Data;
+        if (Offset < MAX_MEM) {
+            if (UNLIKELY(Hash)) {
+                HashStore((u32)Offset, Value);
+            }
+#ifdef SANITIZE6502
+            if (UNLIKELY(Shadow)) {
+                Shadow->MarkInitialized((u32)Offset);
+            }
+#endif
+            MarkDirty((u32)Offset);
+        }
+        *Slot = Value;
+    }
+
+    // starts maintaining Hash for this memory's current contents (null to
+    // stop); the first read of it hashes all of Data once
+    void AttachHash( StateHash* InHash ) {
+        Hash = InHash;
+        if (Hash) {
+            Hash->MarkAllStale();
+        }
+    }
+
+    // starts checking CPU accesses against InShadow (null to stop). Bytes
+    // on pages written since the last Initialize() count as initialized,
+    // and that state becomes the shadow's baseline
+    void AttachSanitizer( GuestSanitizer* InShadow ) {
+        Shadow = InShadow;
+        if (Shadow) {
+            Shadow->SetInitialized(0, MAX_MEM, !CleanPagesAreZero);
+            ForEachDirtyPage([this](u32 Page) {
+                Shadow->SetInitialized(Page * PAGE_SIZE, PAGE_SIZE, true);
+            });
+            Shadow->SaveBaseline();
+        }
+    }
+
+    // true if reading Address has no side effects
+    bool IsPlainRead( Word Address ) const {
+        return ReadPages[Address / PAGE_SIZE] != nullptr;
+    }
+
+    // true if the page table is the identity map ResetMap() sets up, so
+    // Data is exactly what the CPU sees
+    bool IsFlat() const {
+        for (u32 Page = 0; Page < NUM_PAGES; Page++) {
+            Byte* Own = const_cast<Byte*>(&Data[Page * PAGE_SIZE]);
+            if (ReadPages[Page] != Own || WritePages[Page] != Own || Handlers[Page]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // one bit per 256-byte page of Data written through operator[] or Write()
+    // since the last ClearDirtyPages(); writes straight into Data are not
+    // tracked
+    u64 DirtyPages[NUM_PAGES / 64] = {};
+
+    // true once Initialize() has run and every page not marked dirty since
+    // is known to still be zero
+    bool CleanPagesAreZero = false;
+
+    // zero the address space; after the first call only dirty pages are touched
+    void Initialize() {
+        if (CleanPagesAreZero) {
+            ForEachDirtyPage([this](u32 Page) {
+                memset(&Data[Page * PAGE_SIZE], 0, PAGE_SIZE);
+                MarkStale(Page);
+            });
+        } else {
+            memset(Data, 0, MAX_MEM);
+            if (Hash) {
+                Hash->MarkAllStale();
+            }
+        }
+        if (Shadow) {
+            Shadow->SetInitialized(0, MAX_MEM, false);
+        }
+        for (u64& Bits : DirtyPages) {
+            Bits = 0;
+        }
+        CleanPagesAreZero = true;
+    }
+
+    // read byte
+    Byte operator[]( u32 Address ) const {
+        // Address 
+        return Data[Address];
+    }
+    
+    // write 1 byte
+    Byte& operator[]( u32 Address ) {
+        // Address 
+        MarkDirty(Address);
+        MarkStale(Address / PAGE_SIZE);
+        if (Shadow) {
+            Shadow->MarkInitialized(Address);
+        }
+        return Data[Address];
+    }
+
+    FORCE_INLINE void MarkDirty( u32 Address ) {
+        const u32 Page = Address / PAGE_SIZE;
+        DirtyPages[Page / 64] |= 1ull << (Page % 64);
+    }
+
+    bool IsPageDirty( u32 Page ) const {
+        return (DirtyPages[Page / 64] >> (Page % 64)) & 1;
+    }
+
+    // for host code that fills Data directly, e.g. with fread
+    void MarkDirtyRange( u32 Address, u32 Size ) {
+        for (u32 Page = Address / PAGE_SIZE; Page * PAGE_SIZE < Address + Size && Page < NUM_PAGES; Page++) {
+            DirtyPages[Page / 64] |= 1ull << (Page % 64);
+            MarkStale(Page);
+        }
+        if (Shadow) {
+            Shadow->SetInitialized(Address, Size, true);
+        }
+    }
+
+    // forget the dirty set; clean pages are no longer assumed to be zero
+    void ClearDirtyPages() {
+        for (u64& Bits : DirtyPages) {
+            Bits = 0;
+        }
+        CleanPagesAreZero = false;
+    }
+
+    // calls Func(Page) for each dirty page in ascending order
+    template <typename F>
+    void ForEachDirtyPage( F Func ) const {
+        for (u32 i = 0; i < NUM_PAGES / 64; i++) {
+            u64 Bits = DirtyPages[i];
+            for (u32 Bit = 0; Bits; Bit++, Bits >>= 1) {
+                if (Bits & 1) {
+                    Func(i * 64 + Bit);
+                }
+            }
+        }
+    }
+
+    // copy back only the pages written since Baseline was taken
+    void RestoreDirtyPages( const Mem& Baseline ) {
+        ForEachDirtyPage([this, &Baseline](u32 Page) {
+            memcpy(&Data[Page * PAGE_SIZE], &Baseline.Data[Page * PAGE_SIZE], PAGE_SIZE);
+            MarkStale(Page);
+            if (Shadow) {
+                Shadow->RestorePage(Page);
+            }
+        });
+        ClearDirtyPages();
+    }
+
+private:
+    // out of line so that memories without a hash keep a small Write
+    NO_INLINE void HashStore( u32 Offset, Byte Value ) {
+        Hash->Update(Offset, Data[Offset], Value);
+    }
+
+    // only pages backed by Data hold guest RAM; devices and banks are
+    // exempt, which Read checks before calling
+    NO_INLINE void UninitializedRead( Word Address ) const {
+        Shadow->Flag(GuestSanitizer::UNINITIALIZED_READ, Address);
+    }
+
+    void MarkStale( u32 Page ) {
+        if (Hash) {
+            Hash->MarkStale(Page);
+        }
+    }
+
+    static void MapPointers( Byte** Pages, u32 Count, Byte* Base ) {
+        if (Base) {
+            for (u32 i = 0; i < Count; i++, Base += PAGE_SIZE) {
+                Pages[i] = Base;
+            }
+        } else {
+            for (u32 i = 0; i < Count; i++) {
+                Pages[i] = nullptr;
+            }
+        }
+    }
+
+    Byte ReadHandler( Word Address, u64 Time ) const {
+        BusHandler* Handler = Handlers[Address / PAGE_SIZE];
+        return Handler ? Handler->Read(Address, Time) : 0xFF;
+    }
+
+    Byte* Rebase( Byte* Pointer, const Mem& Other ) {
+        if (Pointer >= Other.Data && Pointer < Other.Data + MAX_MEM) {
+            return Data + (Pointer - Other.Data);
+        }
+        return Pointer;
+    }
+};
@@ -0,0 +1,337 @@
+// Per-instance emulator counters and a Prometheus text exporter.
+//
+// The CPU bumps plain counters in CPUCounters while it runs; at the end of
+// every Execute() slice it copies them into its MetricsSlot with relaxed
+// stores. Only the exporter thread reads slots, so the hot path never
+// issues a locked instruction.
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Types.h"
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+// one cache line per instance so neighbouring CPUs never share it
+struct alignas(64) CPUCounters {
+    u64 InstructionsRetired = 0;
+    u64 Cycles = 0;
+    u64 InterruptsTaken = 0;
+    u64 UnhandledOpcodes = 0;
+    u64 StackOverflows = 0;
+    u64 StackUnderflows = 0;
+    u64 IdleCyclesSkipped = 0;
+};
+
+struct alignas(64) MetricsSlot {
+    std::string Instance;
+    std::atomic<u64> InstructionsRetired{0};
+    std::atomic<u64> Cycles{0};
+    std::atomic<u64> InterruptsTaken{0};
+    std::atomic<u64> UnhandledOpcodes{0};
+    std::atomic<u64> StackOverflows{0};
+    std::atomic<u64> StackUnderflows{0};
+    std::atomic<u64> IdleCyclesSkipped{0};
+
+    // single writer, so plain relaxed stores are enough
+    void Publish( const CPUCounters& C )
+    {
+        InstructionsRetired.store(C.InstructionsRetired, std::memory_order_relaxed);
+        Cycles.store(C.Cycles, std::memory_order_relaxed);
+        InterruptsTaken.store(C.InterruptsTaken, std::memory_order_relaxed);
+        UnhandledOpcodes.store(C.UnhandledOpcodes, std::memory_order_relaxed);
+        StackOverflows.store(C.StackOverflows, std::memory_order_relaxed);
+        StackUnderflows.store(C.StackUnderflows, std::memory_order_relaxed);
+        IdleCyclesSkipped.store(C.IdleCyclesSkipped, std::memory_order_relaxed);
+    }
+};
+
+struct MetricsRegistry {
+    std::mutex Lock;
+    std::vector<std::unique_ptr<MetricsSlot>> Slots;
+
+    MetricsSlot* Register( const std::string& Instance )
+    {
+        std::lock_guard<std::mutex> Guard(Lock);
+        Slots.emplace_back(new MetricsSlot);
+        Slots.back()->Instance = Instance;
+        return Slots.back().get();
+    }
+};
+
+// scrapes a registry on its own thread, serving the result over HTTP
+// and/or rewriting a file every interval
+struct MetricsExporter {
+    MetricsRegistry& Registry;
+    int Port = 0;                  // 0 disables the HTTP endpoint
+    std::string FilePath;          // empty disables the file dump
+    u32 IntervalMs = 1000;
+
+    MetricsExporter( MetricsRegistry& InRegistry ) : Registry(InRegistry) {}
+    ~MetricsExporter() { Stop(); }
+
+    bool Start()
+    {
+#ifndef _WIN32
+        if (Port > 0)
+        {
+            Listener = socket(AF_INET, SOCK_STREAM, 0);
+            int Reuse = 1;
+            setsockopt(Listener, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof(Reuse));
+            sockaddr_in Address = {};
+            Address.sin_family = AF_INET;
+            Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            Address.sin_port = htons((unsigned short)Port);
+            if (Listener < 0 || bind(Listener, (sockaddr*)&Address, sizeof(Address)) < 0 || listen(Listener, 8) < 0)
+            {
+                fprintf(stderr, "metrics: cannot listen on port %d\n", Port);
+                if (Listener >= 0)
+                {
+                    close(Listener);
+                    Listener = -1;
+                }
+                return false;
+            }
+        }
+#endif
+        Running = true;
+        Worker = std::thread([this]() { Loop(); });
+        return true;
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> Guard(WakeLock);
+            if (!Running)
+            {
+                return;
+            }
+            Running = false;
+        }
+        Wake.notify_all();
+        Worker.join();
+#ifndef _WIN32
+        if (Listener >= 0)
+        {
+            close(Listener);
+            Listener = -1;
+        }
+#endif
+        Scrape();
+        WriteFile();
+    }
+
+    // Prometheus text exposition format
+    std::string Render()
+    {
+        std::lock_guard<std::mutex> Guard(TextLock);
+        return Text;
+    }
+
+private:
+    struct Previous {
+        u64 Cycles = 0;
+    };
+
+    std::thread Worker;
+    std::mutex WakeLock;
+    std::condition_variable Wake;
+    bool Running = false;
+    int Listener = -1;
+    std::mutex TextLock;
+    std::string Text;
+    std::vector<Previous> History;
+    std::chrono::steady_clock::time_point LastScrape = std::chrono::steady_clock::now();
+
+    // label values come from user-chosen names; backslash, quote and newline
+    // must be escaped
+    static std::string EscapeLabel( const std::string& Value )
+    {
+        std::string Escaped;
+        for (char c : Value)
+        {
+            if (c == '\\' || c == '"')
+            {
+                Escaped += '\\';
+                Escaped += c;
+            }
+            else if (c == '\n')
+            {
+                Escaped += "\\n";
+            }
+            else
+            {
+                Escaped += c;
+            }
+        }
+        return Escaped;
+    }
+
+    void Scrape()
+    {
+        const auto Now = std::chrono::steady_clock::now();
+        const double Elapsed = std::chrono::duration<double>(Now - LastScrape).count();
+        LastScrape = Now;
+
+        struct Family { const char* Name; const char* Type; const char* Help; std::atomic<u64> MetricsSlot::* Field; };
+        static const Family Families[] = {
+            { "emu6502_instructions_retired_total", "counter", "Instructions executed", &MetricsSlot::InstructionsRetired },
+            { "emu6502_cycles_total", "counter", "Emulated cycles", &MetricsSlot::Cycles },
+            { "emu6502_interrupts_total", "counter", "Interrupts taken", &MetricsSlot::InterruptsTaken },
+            { "emu6502_unhandled_opcodes_total", "counter", "Unhandled opcodes fetched", &MetricsSlot::UnhandledOpcodes },
+            { "emu6502_stack_overflows_total", "counter", "Pushes that wrapped SP below 0x00", &MetricsSlot::StackOverflows },
+            { "emu6502_stack_underflows_total", "counter", "Pops that wrapped SP above 0xFF", &MetricsSlot::StackUnderflows },
+            { "emu6502_idle_cycles_skipped_total", "counter", "Cycles fast-forwarded through polling loops", &MetricsSlot::IdleCyclesSkipped },
+        };
+
+        std::string Out;
+        char Line[256];
+        std::lock_guard<std::mutex> Guard(Registry.Lock);
+        const std::vector<std::unique_ptr<MetricsSlot>>& Slots = Registry.Slots;
+        std::vector<std::string> Labels;
+        for (const std::unique_ptr<MetricsSlot>& Slot : Slots)
+        {
+            Labels.push_back("{instance=\"" + EscapeLabel(Slot->Instance) + "\"} ");
+        }
+        for (const Family& F : Families)
+        {
+            snprintf(Line, sizeof(Line), "# HELP %s %s\n# TYPE %s %s\n", F.Name, F.Help, F.Name, F.Type);
+            Out += Line;
+            for (size_t i = 0; i < Slots.size(); i++)
+            {
+                snprintf(Line, sizeof(Line), "%llu\n",
+                    (unsigned long long)((*Slots[i]).*F.Field).load(std::memory_order_relaxed));
+                Out += F.Name + Labels[i] + Line;
+            }
+        }
+
+        // emulated clock rate between the last two scrapes
+        History.resize(Slots.size());
+        Out += "# HELP emu6502_emulated_mhz Emulated clock rate over the last scrape interval\n"
+               "# TYPE emu6502_emulated_mhz gauge\n";
+        for (size_t i = 0; i < Slots.size(); i++)
+        {
+            const u64 Cycles = Slots[i]->Cycles.load(std::memory_order_relaxed);
+            const double MHz = Elapsed > 0 ? (Cycles - History[i].Cycles) / Elapsed / 1e6 : 0.0;
+            History[i].Cycles = Cycles;
+            snprintf(Line, sizeof(Line), "%.3f\n", MHz);
+            Out += "emu6502_emulated_mhz" + Labels[i] + Line;
+        }
+
+        std::lock_guard<std::mutex> TextGuard(TextLock);
+        Text.swap(Out);
+    }
+
+    void WriteFile()
+    {
+        if (FilePath.empty())
+        {
+            return;
+        }
+        // write then rename so readers never see a half-written file
+        const std::string Temp = FilePath + ".tmp";
+        FILE* File = fopen(Temp.c_str(), "w");
+        if (!File)
+        {
+            return;
+        }
+        const std::string Body = Render();
+        fwrite(Body.data(), 1, Body.size(), File);
+        fclose(File);
+        rename(Temp.c_str(), FilePath.c_str());
+    }
+
+    void Serve()
+    {
+#ifndef _WIN32
+        const int Client = accept(Listener, nullptr, nullptr);
+        if (Client < 0)
+        {
+            return;
+        }
+        // a scraper that connects and goes quiet must not stall the loop
+        // (and with it Stop()); one that hangs up mid-response must not
+        // raise SIGPIPE in the emulator
+        const timeval Timeout = { 0, 200000 };
+        setsockopt(Client, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+        setsockopt(Client, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof(Timeout));
+#ifdef MSG_NOSIGNAL
+        const int SendFlags = MSG_NOSIGNAL;
+#else
+        const int SendFlags = 0;
+        const int NoSigPipe = 1;
+        setsockopt(Client, SOL_SOCKET, SO_NOSIGPIPE, &NoSigPipe, sizeof(NoSigPipe));
+#endif
+        char Request[1024];
+        if (recv(Client, Request, sizeof(Request), 0) <= 0)
+        {
+            close(Client);
+            return;
+        }
+        const std::string Body = Render();
+        char Header[160];
+        const int HeaderSize = snprintf(Header, sizeof(Header),
+            "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", Body.size());
+        if (send(Client, Header, HeaderSize, SendFlags) == HeaderSize)
+        {
+            send(Client, Body.data(), Body.size(), SendFlags);
+        }
+        close(Client);
+#endif
+    }
+
+    void Loop()
+    {
+        auto NextScrape = std::chrono::steady_clock::now();
+        for (;;)
+        {
+            if (std::chrono::steady_clock::now() >= NextScrape)
+            {
+                Scrape();
+                WriteFile();
+                NextScrape += std::chrono::milliseconds(IntervalMs);
+            }
+#ifndef _WIN32
+            if (Listener >= 0)
+            {
+                // short poll so Stop() is noticed promptly
+                pollfd Poll = { Listener, POLLIN, 0 };
+                if (poll(&Poll, 1, 50) > 0)
+                {
+                    Serve();
+                }
+                std::lock_guard<std::mutex> Guard(WakeLock);
+                if (!Running)
+                {
+                    return;
+                }
+                continue;
+            }
+#endif
+            std::unique_lock<std::mutex> Guard(WakeLock);
+            Wake.wait_until(Guard, NextScrape, [this]() { return !Running; });
+            if (!Running)
+            {
+                return;
+            }
+        }
+    }
+};
@@ -0,0 +1,334 @@
+// Several 6502s sharing RAM, each running on its own host thread.
+//
+// Every CPU has its own Mem (private RAM, ROM, devices) plus the shared
+// regions mapped at the same addresses in all of them. CPUs run in cycle
+// quanta separated by barriers. Within a quantum each CPU reads its own
+// view of the shared regions as they stood at the last barrier, and its
+// stores update that view and are logged. At the barrier the logs are
+// applied to the shared image in CPU order and every view is refreshed.
+// What a CPU computes therefore depends only on the state at the barriers,
+// never on how the host scheduled the threads, and a run is deterministic
+// for any thread count, including Parallel = false.
+//
+// A store becomes visible to the other CPUs at the next barrier, so
+// cross-CPU latency is at most one quantum. The quantum is adaptive:
+// barriers with no shared stores double it up to MaxQuantum, so CPUs that
+// rarely talk run nearly independently, and any shared store drops it back
+// to MinQuantum while the CPUs are exchanging data. Two CPUs storing to the
+// same byte in one quantum resolve in CPU order (the higher index wins).
+//
+// A mailbox is a shared byte that interrupts its owner: while it holds a
+// non-zero value the owner's IRQ line is asserted, and the owner
+// acknowledges by storing zero to it. Other CPUs' stores reach the line at
+// the next barrier, the owner's own at once.
+
+#pragma once
+
+#include <string.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "CPU.h"
+
+struct MultiCpuSystem {
+    static constexpr u32 MAILBOX_IRQ = 1u << 8;
+
+    u32 MinQuantum = 512;
+    u32 MaxQuantum = 65536;
+
+    // false runs every CPU on the calling thread; results are identical
+    bool Parallel = true;
+
+    u64 Barriers = 0;
+    u64 SharedWrites = 0;
+
+    struct Node {
+        CPU cpu;
+        std::unique_ptr<Mem> memory{ new Mem };
+        Scheduler Events;
+        u64 Time = 0;               // cycles run by this CPU
+    };
+
+    MultiCpuSystem()
+    {
+        for (s32& Offset : SharedOffset)
+        {
+            Offset = -1;
+        }
+    }
+
+    // returns the new CPU's index; it starts with the shared regions mapped
+    u32 AddCpu()
+    {
+        Ports.emplace_back(new Port);
+        Port& P = *Ports.back();
+        P.System = this;
+        P.View = Shared;
+        P.Owner.cpu.Events = &P.Owner.Events;
+        for (const Region& R : Regions)
+        {
+            MapShared(P, R);
+        }
+        return (u32)Ports.size() - 1;
+    }
+
+    Node& Cpu( u32 Index ) { return Ports[Index]->Owner; }
+    u32 CpuCount() const { return (u32)Ports.size(); }
+
+    // Size bytes (whole pages) at Address shared by every CPU, initially zero
+    void AddShared( Word Address, u32 Size )
+    {
+        const Region R = { Address, Size, (u32)Shared.size() };
+        for (u32 Page = 0; Page < Size / Mem::PAGE_SIZE; Page++)
+        {
+            SharedOffset[Address / Mem::PAGE_SIZE + Page] = (s32)(R.Offset + Page * Mem::PAGE_SIZE);
+        }
+        Regions.push_back(R);
+        Shared.resize(Shared.size() + Size, 0);
+        PageDirty.resize(Shared.size() / Mem::PAGE_SIZE, false);
+        for (std::unique_ptr<Port>& P : Ports)
+        {
+            P->View.resize(Shared.size(), 0);
+            // growing the view may have moved it
+            for (const Region& Mapped : Regions)
+            {
+                MapShared(*P, Mapped);
+            }
+        }
+    }
+
+    // a byte inside a shared region that raises IRQ on Owner while non-zero
+    void AddMailbox( Word Address, u32 Owner )
+    {
+        Mailboxes.push_back({ Address, Owner });
+    }
+
+    // the shared image as of the last barrier
+    Byte ReadShared( Word Address ) const
+    {
+        const s32 Offset = SharedOffset[Address / Mem::PAGE_SIZE];
+        return Offset >= 0 ? Shared[Offset + Address % Mem::PAGE_SIZE] : 0xFF;
+    }
+
+    // host-side store, visible to every CPU immediately; call between runs
+    void WriteShared( Word Address, Byte Value )
+    {
+        const s32 Offset = SharedOffset[Address / Mem::PAGE_SIZE];
+        if (Offset >= 0)
+        {
+            Shared[Offset + Address % Mem::PAGE_SIZE] = Value;
+            for (std::unique_ptr<Port>& P : Ports)
+            {
+                P->View[Offset + Address % Mem::PAGE_SIZE] = Value;
+            }
+        }
+    }
+
+    // runs every CPU for Cycles more cycles (each may overrun by the length
+    // of its last instruction)
+    void Run( u64 Cycles )
+    {
+        const u64 Until = Now + Cycles;
+        if (Ports.empty())
+        {
+            return;
+        }
+        if (Quantum < MinQuantum || Quantum > MaxQuantum)
+        {
+            Quantum = MinQuantum;
+        }
+        Refresh();
+        EpochEnd = Now + (Quantum < Until - Now ? Quantum : Until - Now);
+        if (!Parallel || Ports.size() == 1)
+        {
+            while (Now < Until)
+            {
+                for (std::unique_ptr<Port>& P : Ports)
+                {
+                    RunEpoch(P->Owner);
+                }
+                Merge(Until);
+            }
+            return;
+        }
+
+        Arrived.store(0, std::memory_order_relaxed);
+        std::vector<std::thread> Threads;
+        for (u32 i = 0; i < Ports.size(); i++)
+        {
+            Threads.emplace_back([this, i, Until]()
+            {
+                Node& Self = Ports[i]->Owner;
+                while (Now < Until)
+                {
+                    RunEpoch(Self);
+                    Barrier(Until);
+                }
+            });
+        }
+        for (std::thread& T : Threads)
+        {
+            T.join();
+        }
+    }
+
+private:
+    struct Region {
+        Word Address;
+        u32 Size;
+        u32 Offset;         // into Shared
+    };
+
+    struct Record {
+        u32 Offset;
+        Byte Value;
+    };
+
+    struct Mailbox {
+        Word Address;
+        u32 Owner;
+    };
+
+    // a CPU's shared pages: reads hit View directly, stores land here
+    struct Port : BusHandler {
+        MultiCpuSystem* System = nullptr;
+        Node Owner;
+        std::vector<Byte> View;
+        std::vector<Record> Log;
+
+        Byte Read( Word Address, u64 ) override
+        {
+            return View[System->SharedOffset[Address / Mem::PAGE_SIZE] + Address % Mem::PAGE_SIZE];
+        }
+
+        void Write( Word Address, Byte Value, u64 ) override
+        {
+            const u32 Offset = System->SharedOffset[Address / Mem::PAGE_SIZE] + Address % Mem::PAGE_SIZE;
+            View[Offset] = Value;
+            Log.push_back({ Offset, Value });
+            // the owner's line follows its own view, so an acknowledge
+            // takes effect before the handler returns
+            for (const Mailbox& M : System->Mailboxes)
+            {
+                if (M.Address == Address && &System->Ports[M.Owner]->Owner == &Owner)
+                {
+                    if (Value)
+                    {
+                        Owner.Events.RaiseIRQ(MAILBOX_IRQ);
+                    }
+                    else
+                    {
+                        Owner.Events.ClearIRQ(MAILBOX_IRQ);
+                    }
+                }
+            }
+        }
+    };
+
+    std::vector<std::unique_ptr<Port>> Ports;
+    std::vector<Region> Regions;
+    std::vector<Mailbox> Mailboxes;
+    std::vector<Byte> Shared;
+    std::vector<bool> PageDirty;
+    s32 SharedOffset[Mem::NUM_PAGES];
+
+    u64 Now = 0;                // start of the current quantum
+    u64 EpochEnd = 0;
+    u32 Quantum = 0;
+    std::atomic<u32> Arrived{0};
+    std::atomic<u64> Generation{0};
+
+    static void MapShared( Port& P, const Region& R )
+    {
+        P.Owner.memory->MapRange(R.Address, R.Size, &P.View[R.Offset], nullptr, &P);
+    }
+
+    void RunEpoch( Node& Self )
+    {
+        while (Self.Time < EpochEnd)
+        {
+            const u64 Left = EpochEnd - Self.Time;
+            const s32 Used = Self.cpu.Execute((s32)(Left < 0x40000000 ? Left : 0x40000000), *Self.memory);
+            if (Used == 0)
+            {
+                Self.Time = EpochEnd;   // stopped at TrapPC
+                break;
+            }
+            Self.Time += Used;
+        }
+    }
+
+    void Barrier( u64 Until )
+    {
+        const u64 Current = Generation.load(std::memory_order_acquire);
+        if (Arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == Ports.size())
+        {
+            Merge(Until);
+            Arrived.store(0, std::memory_order_relaxed);
+            Generation.store(Current + 1, std::memory_order_release);
+            return;
+        }
+        for (u32 Spins = 0; Generation.load(std::memory_order_acquire) == Current; Spins++)
+        {
+            if (Spins >= 64)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // single-threaded: every CPU is parked at the barrier
+    void Merge( u64 Until )
+    {
+        u64 Stores = 0;
+        for (std::unique_ptr<Port>& P : Ports)
+        {
+            for (const Record& R : P->Log)
+            {
+                Shared[R.Offset] = R.Value;
+                PageDirty[R.Offset / Mem::PAGE_SIZE] = true;
+            }
+            Stores += P->Log.size();
+            P->Log.clear();
+        }
+        Refresh();
+
+        SharedWrites += Stores;
+        Barriers++;
+        Quantum = Stores ? MinQuantum : (Quantum * 2 < MaxQuantum ? Quantum * 2 : MaxQuantum);
+        Now = EpochEnd;
+        EpochEnd = Now + (Quantum < Until - Now ? Quantum : Until - Now);
+    }
+
+    // copies changed shared pages into every view and updates mailbox IRQs
+    void Refresh()
+    {
+        for (u32 Page = 0; Page < PageDirty.size(); Page++)
+        {
+            if (!PageDirty[Page])
+            {
+                continue;
+            }
+            PageDirty[Page] = false;
+            for (std::unique_ptr<Port>& P : Ports)
+            {
+                memcpy(&P->View[Page * Mem::PAGE_SIZE], &Shared[Page * Mem::PAGE_SIZE], Mem::PAGE_SIZE);
+            }
+        }
+        for (const Mailbox& M : Mailboxes)
+        {
+            Scheduler& Events = Ports[M.Owner]->Owner.Events;
+            if (ReadShared(M.Address))
+            {
+                Events.RaiseIRQ(MAILBOX_IRQ);
+            }
+            else
+            {
+                Events.ClearIRQ(MAILBOX_IRQ);
+            }
+        }
+    }
+};
@@ -0,0 +1,181 @@
+// Opcode table for the interpreter's instruction set: operation, addressing
+// mode and mnemonic per opcode byte, shared by the ahead-of-time translator
+// and the disassembly in tool reports.
+//
+// BRK and RTI have names but no operation: the translator leaves them to
+// the interpreter. Opcodes the interpreter does not implement stay "???".
+//
+// Call DefineOps() once before using Ops.
+
+#pragma once
+
+#include <stdio.h>
+
+#include <string>
+
+#include "CPU.h"
+
+enum class Mode {
+    Implied, Accumulator, Immediate, Relative,
+    ZeroPage, ZeroPageX, ZeroPageY, ZeroPageXWide,
+    Absolute, AbsoluteX, AbsoluteX5, AbsoluteY, AbsoluteY5, Indirect,
+    IndirectX, IndirectY, IndirectY6,
+};
+
+enum class Op {
+    None,
+    LDA, LDX, LDY, STA, STX, STY,
+    AND, ORA, EOR, ADC, SBC, CMP, CPX, CPY, BIT,
+    INC, DEC, ASL, LSR, ROL, ROR,
+    TAX, TAY, TXA, TYA, TSX, TXS, INX, INY, DEX, DEY,
+    CLC, SEC, CLD, SED, CLI, SEI, CLV, NOP,
+    PHA, PLA, PHP, PLP,
+    BEQ, BNE, BCS, BCC, BMI, BPL, BVS, BVC,
+    JMP, JSR, RTS,
+};
+
+struct OpInfo {
+    Op Operation = Op::None;
+    Mode M = Mode::Implied;
+    const char* Name = "???";
+    bool Quirk = false;     // DEC abs,X increments in the interpreter
+};
+
+inline OpInfo Ops[256];
+
+// addressing modes are the ones the interpreter's handlers use, quirks
+// included (ROL/ROR zp read an absolute operand, INC/DEC zp,X do not wrap)
+inline void DefineOps()
+{
+    auto D = [](Byte Ins, Op O, Mode M, const char* Name, bool Quirk = false) { Ops[Ins] = { O, M, Name, Quirk }; };
+    D(CPU::INS_LDA_IM, Op::LDA, Mode::Immediate, "LDA");   D(CPU::INS_LDA_ZP, Op::LDA, Mode::ZeroPage, "LDA");
+    D(CPU::INS_LDA_ZPX, Op::LDA, Mode::ZeroPageX, "LDA");  D(CPU::INS_LDA_ABS, Op::LDA, Mode::Absolute, "LDA");
+    D(CPU::INS_LDA_ABSX, Op::LDA, Mode::AbsoluteX, "LDA"); D(CPU::INS_LDA_ABSY, Op::LDA, Mode::AbsoluteY, "LDA");
+    D(CPU::INS_LDA_INDX, Op::LDA, Mode::IndirectX, "LDA"); D(CPU::INS_LDA_INDY, Op::LDA, Mode::IndirectY, "LDA");
+    D(CPU::INS_LDX_IM, Op::LDX, Mode::Immediate, "LDX");   D(CPU::INS_LDX_ZP, Op::LDX, Mode::ZeroPage, "LDX");
+    D(CPU::INS_LDX_ZPY, Op::LDX, Mode::ZeroPageY, "LDX");  D(CPU::INS_LDX_ABS, Op::LDX, Mode::Absolute, "LDX");
+    D(CPU::INS_LDX_ABSY, Op::LDX, Mode::AbsoluteY, "LDX");
+    D(CPU::INS_LDY_IM, Op::LDY, Mode::Immediate, "LDY");   D(CPU::INS_LDY_ZP, Op::LDY, Mode::ZeroPage, "LDY");
+    D(CPU::INS_LDY_ZPX, Op::LDY, Mode::ZeroPageX, "LDY");  D(CPU::INS_LDY_ABS, Op::LDY, Mode::Absolute, "LDY");
+    D(CPU::INS_LDY_ABSX, Op::LDY, Mode::AbsoluteX, "LDY");
+
+    D(CPU::INS_STA_ZP, Op::STA, Mode::ZeroPage, "STA");    D(CPU::INS_STA_ZPX, Op::STA, Mode::ZeroPageX, "STA");
+    D(CPU::INS_STA_ABS, Op::STA, Mode::Absolute, "STA");   D(CPU::INS_STA_ABSX, Op::STA, Mode::AbsoluteX5, "STA");
+    D(CPU::INS_STA_ABSY, Op::STA, Mode::AbsoluteY5, "STA"); D(CPU::INS_STA_INDX, Op::STA, Mode::IndirectX, "STA");
+    D(CPU::INS_STA_INDY, Op::STA, Mode::IndirectY6, "STA");
+    D(CPU::INS_STX_ZP, Op::STX, Mode::ZeroPage, "STX");    D(CPU::INS_STX_ZPY, Op::STX, Mode::ZeroPageY, "STX");
+    D(CPU::INS_STX_ABS, Op::STX, Mode::Absolute, "STX");
+    D(CPU::INS_STY_ZP, Op::STY, Mode::ZeroPage, "STY");    D(CPU::INS_STY_ZPX, Op::STY, Mode::ZeroPageX, "STY");
+    D(CPU::INS_STY_ABS, Op::STY, Mode::Absolute, "STY");
+
+    struct Alu { Op O; const char* Name; Byte Im, Zp, Zpx, Abs, Absx, Absy, Indx, Indy; };
+    const Alu Group[] = {
+        { Op::AND, "AND", CPU::INS_AND_IM, CPU::INS_AND_ZP, CPU::INS_AND_ZPX, CPU::INS_AND_ABS, CPU::INS_AND_ABSX, CPU::INS_AND_ABSY, CPU::INS_AND_INDX, CPU::INS_AND_INDY },
+        { Op::ORA, "ORA", CPU::INS_ORA_IM, CPU::INS_ORA_ZP, CPU::INS_ORA_ZPX, CPU::INS_ORA_ABS, CPU::INS_ORA_ABSX, CPU::INS_ORA_ABSY, CPU::INS_ORA_INDX, CPU::INS_ORA_INDY },
+        { Op::EOR, "EOR", CPU::INS_EOR_IM, CPU::INS_EOR_ZP, CPU::INS_EOR_ZPX, CPU::INS_EOR_ABS, CPU::INS_EOR_ABSX, CPU::INS_EOR_ABSY, CPU::INS_EOR_INDX, CPU::INS_EOR_INDY },
+        { Op::ADC, "ADC", CPU::INS_ADC_IM, CPU::INS_ADC_ZP, CPU::INS_ADC_ZPX, CPU::INS_ADC_ABS, CPU::INS_ADC_ABSX, CPU::INS_ADC_ABSY, CPU::INS_ADC_INDX, CPU::INS_ADC_INDY },
+        { Op::SBC, "SBC", CPU::INS_SBC, CPU::INS_SBC_ZP, CPU::INS_SBC_ZPX, CPU::INS_SBC_ABS, CPU::INS_SBC_ABSX, CPU::INS_SBC_ABSY, CPU::INS_SBC_INDX, CPU::INS_SBC_INDY },
+        { Op::CMP, "CMP", CPU::INS_CMP, CPU::INS_CMP_ZP, CPU::INS_CMP_ZPX, CPU::INS_CMP_ABS, CPU::INS_CMP_ABSX, CPU::INS_CMP_ABSY, CPU::INS_CMP_INDX, CPU::INS_CMP_INDY },
+    };
+    for (const Alu& G : Group)
+    {
+        D(G.Im, G.O, Mode::Immediate, G.Name);   D(G.Zp, G.O, Mode::ZeroPage, G.Name);
+        D(G.Zpx, G.O, Mode::ZeroPageX, G.Name);  D(G.Abs, G.O, Mode::Absolute, G.Name);
+        D(G.Absx, G.O, Mode::AbsoluteX, G.Name); D(G.Absy, G.O, Mode::AbsoluteY, G.Name);
+        D(G.Indx, G.O, Mode::IndirectX, G.Name); D(G.Indy, G.O, Mode::IndirectY, G.Name);
+    }
+    D(CPU::INS_CPX, Op::CPX, Mode::Immediate, "CPX"); D(CPU::INS_CPX_ZP, Op::CPX, Mode::ZeroPage, "CPX");
+    D(CPU::INS_CPX_ABS, Op::CPX, Mode::Absolute, "CPX");
+    D(CPU::INS_CPY, Op::CPY, Mode::Immediate, "CPY"); D(CPU::INS_CPY_ZP, Op::CPY, Mode::ZeroPage, "CPY");
+    D(CPU::INS_CPY_ABS, Op::CPY, Mode::Absolute, "CPY");
+    D(CPU::INS_BIT_ZP, Op::BIT, Mode::ZeroPage, "BIT"); D(CPU::INS_BIT_ABS, Op::BIT, Mode::Absolute, "BIT");
+
+    D(CPU::INS_INC_ZP, Op::INC, Mode::ZeroPage, "INC");   D(CPU::INS_INC_ZPX, Op::INC, Mode::ZeroPageXWide, "INC");
+    D(CPU::INS_INC_ABS, Op::INC, Mode::Absolute, "INC");  D(CPU::INS_INC_ABSX, Op::INC, Mode::AbsoluteX5, "INC");
+    D(CPU::INS_DEC_ZP, Op::DEC, Mode::ZeroPage, "DEC");   D(CPU::INS_DEC_ZPX, Op::DEC, Mode::ZeroPageXWide, "DEC");
+    D(CPU::INS_DEC_ABS, Op::DEC, Mode::Absolute, "DEC");  D(CPU::INS_DEC_ABSX, Op::DEC, Mode::AbsoluteX5, "DEC", true);
+
+    struct Shift { Op O; const char* Name; Byte Acc, Zp, Zpx, Abs, Absx; Mode ZpMode; };
+    const Shift Shifts[] = {
+        { Op::ASL, "ASL", CPU::INS_ASL, CPU::INS_ASL_ZP, CPU::INS_ASL_ZPX, CPU::INS_ASL_ABS, CPU::INS_ASL_ABSX, Mode::ZeroPage },
+        { Op::LSR, "LSR", CPU::INS_LSR, CPU::INS_LSR_ZP, CPU::INS_LSR_ZPX, CPU::INS_LSR_ABS, CPU::INS_LSR_ABSX, Mode::ZeroPage },
+        { Op::ROL, "ROL", CPU::INS_ROL, CPU::INS_ROL_ZP, CPU::INS_ROL_ZPX, CPU::INS_ROL_ABS, CPU::INS_ROL_ABSX, Mode::Absolute },
+        { Op::ROR, "ROR", CPU::INS_ROR, CPU::INS_ROR_ZP, CPU::INS_ROR_ZPX, CPU::INS_ROR_ABS, CPU::INS_ROR_ABSX, Mode::Absolute },
+    };
+    for (const Shift& S : Shifts)
+    {
+        D(S.Acc, S.O, Mode::Accumulator, S.Name); D(S.Zp, S.O, S.ZpMode, S.Name);
+        D(S.Zpx, S.O, Mode::ZeroPageX, S.Name);   D(S.Abs, S.O, Mode::Absolute, S.Name);
+        D(S.Absx, S.O, Mode::AbsoluteX5, S.Name);
+    }
+
+    D(CPU::INS_TAX, Op::TAX, Mode::Implied, "TAX"); D(CPU::INS_TAY, Op::TAY, Mode::Implied, "TAY");
+    D(CPU::INS_TXA, Op::TXA, Mode::Implied, "TXA"); D(CPU::INS_TYA, Op::TYA, Mode::Implied, "TYA");
+    D(CPU::INS_TSX, Op::TSX, Mode::Implied, "TSX"); D(CPU::INS_TXS, Op::TXS, Mode::Implied, "TXS");
+    D(CPU::INS_INX, Op::INX, Mode::Implied, "INX"); D(CPU::INS_INY, Op::INY, Mode::Implied, "INY");
+    D(CPU::INS_DEX, Op::DEX, Mode::Implied, "DEX"); D(CPU::INS_DEY, Op::DEY, Mode::Implied, "DEY");
+    D(CPU::INS_CLC, Op::CLC, Mode::Implied, "CLC"); D(CPU::INS_SEC, Op::SEC, Mode::Implied, "SEC");
+    D(CPU::INS_CLD, Op::CLD, Mode::Implied, "CLD"); D(CPU::INS_SED, Op::SED, Mode::Implied, "SED");
+    D(CPU::INS_CLI, Op::CLI, Mode::Implied, "CLI"); D(CPU::INS_SEI, Op::SEI, Mode::Implied, "SEI");
+    D(CPU::INS_CLV, Op::CLV, Mode::Implied, "CLV"); D(CPU::INS_NOP, Op::NOP, Mode::Implied, "NOP");
+    D(CPU::INS_PHA, Op::PHA, Mode::Implied, "PHA"); D(CPU::INS_PLA, Op::PLA, Mode::Implied, "PLA");
+    D(CPU::INS_PHP, Op::PHP, Mode::Implied, "PHP"); D(CPU::INS_PLP, Op::PLP, Mode::Implied, "PLP");
+
+    D(CPU::INS_BEQ, Op::BEQ, Mode::Relative, "BEQ"); D(CPU::INS_BNE, Op::BNE, Mode::Relative, "BNE");
+    D(CPU::INS_BCS, Op::BCS, Mode::Relative, "BCS"); D(CPU::INS_BCC, Op::BCC, Mode::Relative, "BCC");
+    D(CPU::INS_BMI, Op::BMI, Mode::Relative, "BMI"); D(CPU::INS_BPL, Op::BPL, Mode::Relative, "BPL");
+    D(CPU::INS_BVS, Op::BVS, Mode::Relative, "BVS"); D(CPU::INS_BVC, Op::BVC, Mode::Relative, "BVC");
+    D(CPU::INS_JMP_ABS, Op::JMP, Mode::Absolute, "JMP"); D(CPU::INS_JMP_IND, Op::JMP, Mode::Indirect, "JMP");
+    D(CPU::INS_JSR, Op::JSR, Mode::Absolute, "JSR"); D(CPU::INS_RTS, Op::RTS, Mode::Implied, "RTS");
+
+    D(CPU::INS_BRK, Op::None, Mode::Implied, "BRK"); D(CPU::INS_RTI, Op::None, Mode::Implied, "RTI");
+}
+
+inline u32 InstructionLength( Mode M )
+{
+    switch (M)
+    {
+    case Mode::Implied:
+    case Mode::Accumulator:
+        return 1;
+    case Mode::Absolute:
+    case Mode::AbsoluteX:
+    case Mode::AbsoluteX5:
+    case Mode::AbsoluteY:
+    case Mode::AbsoluteY5:
+    case Mode::Indirect:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+// "STA $0200,X" for the instruction at PC; Data is the 64 KB address space
+inline std::string Disassemble( const Byte* Data, Word PC )
+{
+    const OpInfo& Info = Ops[Data[PC]];
+    const Byte Lo = Data[(Word)(PC + 1)];
+    const Word Abs = (Word)(Lo | Data[(Word)(PC + 2)] << 8);
+    char Buffer[32];
+    switch (Info.Name[0] == '?' ? Mode::Implied : Info.M)
+    {
+    case Mode::Implied:       snprintf(Buffer, sizeof(Buffer), "%s", Info.Name); break;
+    case Mode::Accumulator:   snprintf(Buffer, sizeof(Buffer), "%s A", Info.Name); break;
+    case Mode::Immediate:     snprintf(Buffer, sizeof(Buffer), "%s #$%02X", Info.Name, Lo); break;
+    case Mode::Relative:      snprintf(Buffer, sizeof(Buffer), "%s $%04X", Info.Name, (Word)(PC + 2 + (SByte)Lo)); break;
+    case Mode::ZeroPage:      snprintf(Buffer, sizeof(Buffer), "%s $%02X", Info.Name, Lo); break;
+    case Mode::ZeroPageX:
+    case Mode::ZeroPageXWide: snprintf(Buffer, sizeof(Buffer), "%s $%02X,X", Info.Name, Lo); break;
+    case Mode::ZeroPageY:     snprintf(Buffer, sizeof(Buffer), "%s $%02X,Y", Info.Name, Lo); break;
+    case Mode::Absolute:      snprintf(Buffer, sizeof(Buffer), "%s $%04X", Info.Name, Abs); break;
+    case Mode::AbsoluteX:
+    case Mode::AbsoluteX5:    snprintf(Buffer, sizeof(Buffer), "%s $%04X,X", Info.Name, Abs); break;
+    case Mode::AbsoluteY:
+    case Mode::AbsoluteY5:    snprintf(Buffer, sizeof(Buffer), "%s $%04X,Y", Info.Name, Abs); break;
+    case Mode::Indirect:      snprintf(Buffer, sizeof(Buffer), "%s ($%04X)", Info.Name, Abs); break;
+    case Mode::IndirectX:     snprintf(Buffer, sizeof(Buffer), "%s ($%02X,X)", Info.Name, Lo); break;
+    case Mode::IndirectY:
+    case Mode::IndirectY6:    snprintf(Buffer, sizeof(Buffer), "%s ($%02X),Y", Info.Name, Lo); break;
+    }
+    return Buffer;
+}
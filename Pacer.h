@@ -0,0 +1,225 @@
+// Real-time pacing: runs a CPU in short slices and holds each slice back
+// until wall-clock time catches up with the emulated time at its end, so the
+// guest sees a steady 1.000 MHz, 1.789773 MHz or whatever ClockHz says.
+//
+// Deadlines are absolute (start time + cycles run / clock rate) on the
+// monotonic clock, so per-slice errors never accumulate into drift. Each wait
+// sleeps until shortly before the deadline and then spins, yielding, for the
+// rest. The spin margin follows how late the OS has actually been waking this
+// thread: a few tens of microseconds on an idle machine, more under load. So
+// the thread is asleep for nearly all of its idle time, and many paced
+// instances can share a host.
+//
+// Turbo multiplies the rate (0 runs unpaced). If the host falls more than
+// MaxLagMicros behind, e.g. after a debugger stop, pacing restarts from the
+// current time instead of racing to catch up; Stats.Resyncs counts those.
+
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <thread>
+
+#include "CPU.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <time.h>
+#endif
+
+struct PacingStats {
+    u64 Slices = 0;
+    u64 Cycles = 0;
+    u64 Resyncs = 0;
+
+    // how far past its deadline each slice was released, in microseconds
+    double LatenessSum = 0.0;
+    double LatenessSquares = 0.0;
+    double LatenessMax = 0.0;
+
+    // wall-clock time behind emulated time after the last slice
+    double DriftMicros = 0.0;
+
+    // since Start, and where the host's time went
+    double WallSeconds = 0.0;
+    double RunSeconds = 0.0;
+    double SleepSeconds = 0.0;
+    double SpinSeconds = 0.0;
+
+    double MeanLateness() const { return Slices ? LatenessSum / Slices : 0.0; }
+    double Jitter() const { return Slices ? sqrt(LatenessSquares / Slices) : 0.0; }
+    // share of one host core spent emulating or spinning
+    double HostLoad() const
+    {
+        return WallSeconds > 0 ? (RunSeconds + SpinSeconds) / WallSeconds : 0.0;
+    }
+
+    void Print( FILE* Out, double ClockHz ) const
+    {
+        const double Achieved = WallSeconds > 0 ? Cycles / WallSeconds : 0.0;
+        fprintf(Out, "paced %llu cycles in %.3f s: %.6f MHz (%+.0f ppm), lateness %.1f us mean, %.1f us rms, "
+            "%.1f us max, drift %.1f us, %llu resyncs, host load %.1f%%\n",
+            (unsigned long long)Cycles, WallSeconds, Achieved / 1e6, ClockHz > 0 ? (Achieved / ClockHz - 1.0) * 1e6 : 0.0,
+            MeanLateness(), Jitter(), LatenessMax, DriftMicros, (unsigned long long)Resyncs, HostLoad() * 100.0);
+    }
+};
+
+struct RealTimePacer {
+    using Clock = std::chrono::steady_clock;
+
+    double ClockHz = 1000000.0;
+    u32 SliceMicros = 1000;
+    u32 MaxLagMicros = 50000;
+
+    // bounds of the adaptive spin margin
+    u32 MinSpinMicros = 20;
+    u32 MaxSpinMicros = 2000;
+
+    PacingStats Stats;
+
+    // the deadlines count from here; also resets the statistics
+    void Start()
+    {
+        Stats = PacingStats();
+        Started = Clock::now();
+        Rebase(Started);
+    }
+
+    double Turbo() const { return Multiplier; }
+
+    // takes effect from the next slice without a jump in either clock
+    void SetTurbo( double Factor )
+    {
+        Multiplier = Factor > 0 ? Factor : 0.0;
+        Rebase(Clock::now());
+    }
+
+    // one slice, then waits until it is due; returns the cycles used, 0 once
+    // the CPU sits at its TrapPC
+    s32 Step( CPU& cpu, Mem& memory )
+    {
+        const double Rate = ClockHz * Multiplier;
+        const double Wanted = Rate > 0 ? Rate * SliceMicros / 1e6 : ClockHz * SliceMicros / 1e6;
+        const s32 Slice = Wanted < 1.0 ? 1 : Wanted > 0x40000000 ? 0x40000000 : (s32)Wanted;
+
+        const Clock::time_point Begin = Clock::now();
+        const s32 Used = cpu.Execute(Slice, memory);
+        const Clock::time_point Ran = Clock::now();
+        Stats.RunSeconds += Seconds(Ran - Begin);
+        Stats.Cycles += (u64)Used;
+        Stats.Slices++;
+        Stats.WallSeconds = Seconds(Ran - Started);
+        if (Rate <= 0)
+        {
+            return Used;
+        }
+
+        const Clock::time_point Deadline = Origin + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>((Stats.Cycles - OriginCycles) / Rate));
+        Clock::time_point Released = Ran;
+        if (Ran > Deadline + std::chrono::microseconds(MaxLagMicros))
+        {
+            Stats.Resyncs++;
+            Rebase(Ran);
+            return Used;
+        }
+        if (Ran < Deadline)
+        {
+            Released = WaitUntil(Deadline);
+        }
+        const double Lateness = Seconds(Released - Deadline) * 1e6;
+        Stats.LatenessSum += Lateness;
+        Stats.LatenessSquares += Lateness * Lateness;
+        Stats.LatenessMax = Lateness > Stats.LatenessMax ? Lateness : Stats.LatenessMax;
+        Stats.DriftMicros = Lateness;
+        Stats.WallSeconds = Seconds(Released - Started);
+        return Used;
+    }
+
+    // paces for a stretch of emulated time, stopping early if the CPU
+    // reaches its TrapPC; returns the cycles run
+    u64 Run( CPU& cpu, Mem& memory, double EmulatedSeconds )
+    {
+        const u64 From = Stats.Cycles;
+        const u64 Until = From + (u64)(EmulatedSeconds * ClockHz);
+        while (Stats.Cycles < Until)
+        {
+            if (Step(cpu, memory) == 0)
+            {
+                break;
+            }
+        }
+        return Stats.Cycles - From;
+    }
+
+private:
+    double Multiplier = 1.0;
+    Clock::time_point Started = Clock::now();
+    Clock::time_point Origin = Started;
+    u64 OriginCycles = 0;
+
+    // running estimate of how late a sleep wakes, in nanoseconds
+    double Oversleep = 50000.0;
+
+    static double Seconds( Clock::duration Span )
+    {
+        return std::chrono::duration<double>(Span).count();
+    }
+
+    void Rebase( Clock::time_point Now )
+    {
+        Origin = Now;
+        OriginCycles = Stats.Cycles;
+    }
+
+    Clock::time_point WaitUntil( Clock::time_point Deadline )
+    {
+        const double MinSpin = MinSpinMicros * 1e3;
+        const double MaxSpin = MaxSpinMicros * 1e3;
+        const double Margin = Oversleep * 1.5 < MinSpin ? MinSpin : Oversleep * 1.5 > MaxSpin ? MaxSpin : Oversleep * 1.5;
+        const Clock::time_point WakeAt = Deadline - std::chrono::nanoseconds((s64)Margin);
+        Clock::time_point Now = Clock::now();
+        if (Now < WakeAt)
+        {
+            const Clock::time_point Slept = Now;
+            SleepUntil(WakeAt);
+            Now = Clock::now();
+            Stats.SleepSeconds += Seconds(Now - Slept);
+            // one long stall must not leave the margin wide for good
+            double Late = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Now - WakeAt).count();
+            Late = Late < 0 ? 0.0 : Late > MaxSpin ? MaxSpin : Late;
+            Oversleep += (Late - Oversleep) / 8;
+        }
+        else
+        {
+            // no sample while the margin covers the whole wait, so let it
+            // shrink until sleeping is tried again
+            Oversleep -= Oversleep / 16;
+        }
+        const Clock::time_point Spun = Now;
+        while (Now < Deadline)
+        {
+            std::this_thread::yield();
+            Now = Clock::now();
+        }
+        Stats.SpinSeconds += Seconds(Now - Spun);
+        return Now;
+    }
+
+    static void SleepUntil( Clock::time_point When )
+    {
+#ifdef __linux__
+        // steady_clock is CLOCK_MONOTONIC here; an absolute sleep does not
+        // lose the time between reading the clock and going to sleep
+        const s64 Nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(When.time_since_epoch()).count();
+        timespec Until = { (time_t)(Nanos / 1000000000), (long)(Nanos % 1000000000) };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Until, nullptr) == EINTR)
+        {
+        }
+#else
+        std::this_thread::sleep_until(When);
+#endif
+    }
+};
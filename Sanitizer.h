@@ -0,0 +1,250 @@
+// Shadow-memory sanitizer for guest code: reads of RAM never written,
+// writes into ROM ranges, execution outside code ranges and stack pointer
+// wraps, each reported with the PC of the offending instruction and the
+// guest call stack.
+//
+// The shadow is three bitmaps over the 64 KB address space, one bit per
+// byte: initialized, writable, executable, 8 KB each. A check is a shift and
+// a mask on a word that is almost always in cache, and everything past a
+// failed test is out of line, so checked code runs close to normal speed.
+// Range updates work a 64-bit word (64 bytes of guest memory) at a time.
+//
+// The per-access checks sit on the hottest paths of the interpreter, so
+// like a compiler sanitizer they are only built in with -DSANITIZE6502;
+// other builds keep the fast paths untouched and only catch stack wraps.
+// In a sanitizer build, attach with Mem::AttachSanitizer; from then on
+// every CPU read, write and opcode fetch through the Mem is checked, and so
+// are stores that nothing takes (a Machine's ROM regions, unmapped holes).
+// Host writes through operator[] and MarkDirtyRange (ROM loading) count as
+// initializing, Initialize() makes memory uninitialized again (RAM comes up
+// undefined on real hardware), and RestoreDirtyPages puts back the shadow
+// saved by SaveBaseline. Reads of pages that do not map into Data (devices,
+// mapper banks) are never flagged.
+//
+// Findings are counted per kind; the first MaxReports distinct (kind, PC)
+// pairs are kept with their call stacks when Calls points at the CPU's
+// ShadowCallStack.
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CallStack.h"
+#include "Types.h"
+
+struct GuestSanitizer {
+    static constexpr u32 MAX_MEM = 1024 * 64;
+    static constexpr u32 WORDS = MAX_MEM / 64;
+    static constexpr u32 MAX_FRAMES = 8;
+
+#ifdef SANITIZE6502
+    static constexpr bool CHECKS_BUILT_IN = true;
+#else
+    static constexpr bool CHECKS_BUILT_IN = false;
+#endif
+
+    enum Kind : u32 {
+        UNINITIALIZED_READ,
+        ROM_WRITE,
+        NON_CODE_FETCH,
+        STACK_OVERFLOW,
+        STACK_UNDERFLOW,
+        KINDS
+    };
+
+    static const char* Name( u32 Which )
+    {
+        static const char* Names[KINDS] = {
+            "uninitialized read", "write to read-only memory", "fetch from non-code memory",
+            "stack overflow", "stack underflow",
+        };
+        return Which < KINDS ? Names[Which] : "?";
+    }
+
+    struct Report {
+        Kind What;
+        Word PC;                    // start of the offending instruction
+        Word Address;               // memory touched; SP page address for stack wraps
+        u64 Count;                  // occurrences of this (kind, PC)
+        u32 Depth;
+        Word CallSites[MAX_FRAMES]; // innermost first
+    };
+
+    u64 Initialized[WORDS] = {};
+    u64 Writable[WORDS];
+    u64 Executable[WORDS];
+
+    // optional, for call stacks in reports (usually cpu.CallStack)
+    const ShadowCallStack* Calls = nullptr;
+
+    // PC of the instruction being executed, kept by CPU::Execute
+    Word InstructionPC = 0;
+
+    u64 Counts[KINDS] = {};
+    u32 MaxReports = 64;
+    std::vector<Report> Reports;
+
+    GuestSanitizer()
+    {
+        SetRange(Writable, 0, MAX_MEM, true);
+        SetRange(Executable, 0, MAX_MEM, true);
+        SaveBaseline();
+    }
+
+    // ROM: contents are defined, stores are errors
+    void Protect( u32 Address, u32 Size )
+    {
+        SetRange(Initialized, Address, Size, true);
+        SetRange(Writable, Address, Size, false);
+    }
+
+    void SetInitialized( u32 Address, u32 Size, bool On ) { SetRange(Initialized, Address, Size, On); }
+    void SetWritable( u32 Address, u32 Size, bool On ) { SetRange(Writable, Address, Size, On); }
+    void SetExecutable( u32 Address, u32 Size, bool On ) { SetRange(Executable, Address, Size, On); }
+
+    // what Mem::RestoreDirtyPages returns pages to
+    void SaveBaseline()
+    {
+        memcpy(BaselineInitialized, Initialized, sizeof(Initialized));
+    }
+
+    void RestorePage( u32 Page )
+    {
+        memcpy(&Initialized[Page * 4], &BaselineInitialized[Page * 4], 4 * sizeof(u64));
+    }
+
+    u64 Total() const
+    {
+        u64 Sum = 0;
+        for (u64 Count : Counts)
+        {
+            Sum += Count;
+        }
+        return Sum;
+    }
+
+    void Clear()
+    {
+        memset(Counts, 0, sizeof(Counts));
+        Reports.clear();
+        Seen.clear();
+    }
+
+    FORCE_INLINE static bool Test( const u64* Bits, u32 Address )
+    {
+        return (Bits[Address / 64] >> (Address % 64)) & 1;
+    }
+
+    // Initialized is indexed by offset into Mem::Data, not CPU address
+    FORCE_INLINE bool IsInitialized( u32 Address ) const
+    {
+        return Test(Initialized, Address);
+    }
+
+    FORCE_INLINE void MarkInitialized( u32 Address )
+    {
+        Initialized[Address / 64] |= 1ull << (Address % 64);
+    }
+
+    FORCE_INLINE void CheckWrite( Word Address )
+    {
+        if (UNLIKELY(!Test(Writable, Address)))
+        {
+            Flag(ROM_WRITE, Address);
+        }
+    }
+
+    FORCE_INLINE void OnFetch( Word PC )
+    {
+        InstructionPC = PC;
+        if (UNLIKELY(!Test(Executable, PC)))
+        {
+            Flag(NON_CODE_FETCH, PC);
+        }
+    }
+
+    // SP wrapped while pushing (Overflow) or popping
+    void OnStackWrap( bool Overflow, Byte SP )
+    {
+        Flag(Overflow ? STACK_OVERFLOW : STACK_UNDERFLOW, (Word)(0x100 | SP));
+    }
+
+    NO_INLINE void Flag( Kind What, Word Address )
+    {
+        Counts[What]++;
+        const u32 Key = (u32)What << 16 | InstructionPC;
+        auto Found = Seen.find(Key);
+        if (Found != Seen.end())
+        {
+            Reports[Found->second].Count++;
+            return;
+        }
+        if (Reports.size() >= MaxReports)
+        {
+            return;
+        }
+        Report Entry = { What, InstructionPC, Address, 1, 0, {} };
+        if (Calls)
+        {
+            for (u32 i = Calls->Depth; i > 0 && Entry.Depth < MAX_FRAMES; i--)
+            {
+                Entry.CallSites[Entry.Depth++] = Calls->Frames[i - 1].CallSite;
+            }
+        }
+        Seen[Key] = Reports.size();
+        Reports.push_back(Entry);
+    }
+
+    // "uninitialized read at $0010 by PC $800C (3 x), called from $8003"
+    static std::string Describe( const Report& Entry )
+    {
+        char Buffer[96];
+        snprintf(Buffer, sizeof(Buffer), "%s at $%04X by PC $%04X (%llu x)", Name(Entry.What), Entry.Address,
+            Entry.PC, (unsigned long long)Entry.Count);
+        std::string Text = Buffer;
+        for (u32 i = 0; i < Entry.Depth; i++)
+        {
+            snprintf(Buffer, sizeof(Buffer), "%s$%04X", i ? " < " : ", called from ", Entry.CallSites[i]);
+            Text += Buffer;
+        }
+        return Text;
+    }
+
+    void Print( FILE* Out ) const
+    {
+        for (u32 Which = 0; Which < KINDS; Which++)
+        {
+            if (Counts[Which])
+            {
+                fprintf(Out, "sanitizer: %llu x %s\n", (unsigned long long)Counts[Which], Name(Which));
+            }
+        }
+        for (const Report& Entry : Reports)
+        {
+            fprintf(Out, "  %s\n", Describe(Entry).c_str());
+        }
+    }
+
+private:
+    u64 BaselineInitialized[WORDS];
+    std::unordered_map<u32, size_t> Seen;
+
+    static void SetRange( u64* Bits, u32 Address, u32 Size, bool On )
+    {
+        const u32 End = Address + Size < MAX_MEM ? Address + Size : MAX_MEM;
+        while (Address < End)
+        {
+            // whole words in one go, partial ones through a mask
+            const u32 Bit = Address % 64;
+            const u32 Span = End - Address < 64 - Bit ? End - Address : 64 - Bit;
+            const u64 Mask = Span == 64 ? ~0ull : ((1ull << Span) - 1) << Bit;
+            Bits[Address / 64] = On ? Bits[Address / 64] | Mask : Bits[Address / 64] & ~Mask;
+            Address += Span;
+        }
+    }
+};
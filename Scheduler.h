@@ -0,0 +1,176 @@
+// Cycle-timed event queue and interrupt lines shared by the CPU and devices.
+//
+// Devices schedule callbacks at absolute emulated cycles; CPU::Execute runs
+// them at the instruction boundary where they fall due and then takes any
+// pending NMI / IRQ. Time only advances through Execute, so a run is fully
+// deterministic.
+//
+// Other host threads never touch the queue directly: they Post() work that
+// the CPU thread runs at its next slice start or idle point. An instance
+// whose guest is idling with nothing scheduled can block on the mailbox
+// (BlockWhenIdle) instead of spinning.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "Types.h"
+
+struct Scheduler {
+    using Callback = std::function<void( Scheduler&, u64 When )>;
+    using Work = std::function<void( Scheduler& )>;
+
+    static constexpr u64 NEVER = ~0ull;
+
+    // emulated cycles since creation, advanced by CPU::Execute
+    u64 Now = 0;
+
+    // IRQ is level triggered: asserted while any source bit is set
+    u32 IRQLines = 0;
+    bool NMIPending = false;
+
+    // block the CPU thread in an idle loop when no event is queued, until
+    // Post() or Wake() is called; otherwise the rest of the slice is skipped
+    bool BlockWhenIdle = false;
+
+    // set by CPU::Execute for the length of a slice; a device that raises a
+    // line or schedules an event from a bus access mid-slice gets it looked
+    // at from the next instruction on
+    s32* Recheck = nullptr;
+
+    void RaiseIRQ( u32 Source ) { IRQLines |= Source; Changed(); }
+    void ClearIRQ( u32 Source ) { IRQLines &= ~Source; }
+    void TriggerNMI() { NMIPending = true; Changed(); }
+
+    // returns an id for Cancel()
+    u32 Schedule( u64 When, Callback Fn )
+    {
+        Queue.push_back({ When, NextId, std::move(Fn) });
+        std::push_heap(Queue.begin(), Queue.end(), Later);
+        Changed();
+        return NextId++;
+    }
+
+    u32 ScheduleIn( u64 Delay, Callback Fn )
+    {
+        return Schedule(Now + Delay, std::move(Fn));
+    }
+
+    bool Cancel( u32 Id )
+    {
+        for (size_t i = 0; i < Queue.size(); i++)
+        {
+            if (Queue[i].Id == Id)
+            {
+                Queue.erase(Queue.begin() + i);
+                std::make_heap(Queue.begin(), Queue.end(), Later);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    u64 NextEvent() const
+    {
+        return Queue.empty() ? NEVER : Queue.front().When;
+    }
+
+    // runs every event due at or before Time, in time then scheduling order
+    void RunDue( u64 Time )
+    {
+        while (!Queue.empty() && Queue.front().When <= Time)
+        {
+            std::pop_heap(Queue.begin(), Queue.end(), Later);
+            Event Due = std::move(Queue.back());
+            Queue.pop_back();
+            Due.Fn(*this, Due.When);
+        }
+    }
+
+    // thread safe; Fn runs on the CPU thread
+    void Post( Work Fn )
+    {
+        {
+            std::lock_guard<std::mutex> Guard(MailLock);
+            Mail.push_back(std::move(Fn));
+            HasMail.store(true, std::memory_order_release);
+        }
+        MailArrived.notify_one();
+    }
+
+    // thread safe; releases a CPU blocked in an idle loop without posting work
+    void Wake()
+    {
+        {
+            std::lock_guard<std::mutex> Guard(MailLock);
+            Woken = true;
+        }
+        MailArrived.notify_one();
+    }
+
+    // CPU thread only
+    void DrainMail()
+    {
+        if (!HasMail.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        std::vector<Work> Batch;
+        {
+            std::lock_guard<std::mutex> Guard(MailLock);
+            Batch.swap(Mail);
+            HasMail.store(false, std::memory_order_relaxed);
+        }
+        for (Work& Fn : Batch)
+        {
+            Fn(*this);
+        }
+    }
+
+    // CPU thread only; false when released by Wake() rather than by mail
+    bool WaitForMail()
+    {
+        std::unique_lock<std::mutex> Guard(MailLock);
+        MailArrived.wait(Guard, [this]() { return !Mail.empty() || Woken; });
+        const bool GotMail = !Mail.empty();
+        Woken = false;
+        Guard.unlock();
+        DrainMail();
+        return GotMail;
+    }
+
+private:
+    void Changed()
+    {
+        if (Recheck)
+        {
+            *Recheck = 0x7FFFFFFF;
+        }
+    }
+
+    struct Event {
+        u64 When;
+        u32 Id;
+        Callback Fn;
+    };
+
+    // min-heap on (When, Id) so equal times run in scheduling order
+    static bool Later( const Event& L, const Event& R )
+    {
+        return L.When != R.When ? L.When > R.When : L.Id > R.Id;
+    }
+
+    std::vector<Event> Queue;
+    u32 NextId = 1;
+
+    std::mutex MailLock;
+    std::condition_variable MailArrived;
+    std::vector<Work> Mail;
+    std::atomic<bool> HasMail{false};
+    bool Woken = false;
+};
@@ -0,0 +1,430 @@
+// Host end of an emulated serial line: stdin/stdout, a pseudo-terminal or a
+// Unix socket, serviced by an epoll loop on its own thread.
+//
+// The guest side (see Acia.h) and the I/O thread meet in two lock-free byte
+// rings. The I/O thread read()s straight into ToGuest's free space and
+// write()s straight out of ToHost's filled space, so bytes are never copied
+// between the rings and the kernel and each syscall moves as much as is
+// ready rather than one byte. The guest side wakes the I/O thread through an
+// eventfd only when it has gone idle, so a guest printing in a tight loop
+// costs no syscall per character either.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "SpscQueue.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+struct SerialHost {
+    static constexpr u32 RING_SIZE = 1 << 16;
+
+    SpscQueue<Byte, RING_SIZE> ToHost;      // guest transmit, drained by the I/O thread
+    SpscQueue<Byte, RING_SIZE> ToGuest;     // filled by the I/O thread, guest receive
+
+    // I/O thread: called after new bytes were queued for the guest
+    std::function<void()> OnReceive;
+
+    // I/O thread statistics
+    std::atomic<u64> BytesOut{0};
+    std::atomic<u64> BytesIn{0};
+    std::atomic<u64> WriteCalls{0};
+    std::atomic<u64> ReadCalls{0};
+
+    ~SerialHost()
+    {
+        Stop();
+        Close();
+    }
+
+    // any pair of descriptors (a socketpair end, pipes); they are made
+    // non-blocking and owned from here on unless Own is false, in which case
+    // Close() puts their original flags back
+    bool Attach( int In, int Out, bool Own = true )
+    {
+#ifdef __linux__
+        return AttachLine(In, Own, Out, Own);
+#else
+        (void)In; (void)Out; (void)Own;
+        return false;
+#endif
+    }
+
+    // stdin and stdout are shared with the rest of the process and the parent
+    // shell, and O_NONBLOCK belongs to the open file description, which dup()
+    // shares too. So terminals and pipes are reopened through /proc as a
+    // separate, non-blocking description; anything else (regular files,
+    // sockets) is borrowed as is and gets its flags back on Close()
+    bool OpenStdio()
+    {
+#ifdef __linux__
+        const int In = Reopen(0, O_RDONLY);
+        const int Out = Reopen(1, O_WRONLY);
+        return AttachLine(In >= 0 ? In : 0, In >= 0, Out >= 0 ? Out : 1, Out >= 0);
+#else
+        return false;
+#endif
+    }
+
+    // a new pseudo-terminal; SlaveName receives the path to connect to
+    bool OpenPty( std::string& SlaveName )
+    {
+#ifdef __linux__
+        const int Master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (Master < 0 || grantpt(Master) != 0 || unlockpt(Master) != 0)
+        {
+            perror("serial: pty");
+            return false;
+        }
+        SlaveName = ptsname(Master);
+        return Attach(Master, Master);
+#else
+        (void)SlaveName;
+        return false;
+#endif
+    }
+
+    // listens on Path and serves the first client that connects (the line
+    // is silent until then)
+    bool ListenUnix( const char* Path )
+    {
+#ifdef __linux__
+        ListenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        sockaddr_un Address = {};
+        Address.sun_family = AF_UNIX;
+        strncpy(Address.sun_path, Path, sizeof(Address.sun_path) - 1);
+        unlink(Path);
+        if (ListenFd < 0 || bind(ListenFd, (sockaddr*)&Address, sizeof(Address)) != 0 || listen(ListenFd, 1) != 0)
+        {
+            perror("serial: unix socket");
+            return false;
+        }
+        return true;
+#else
+        (void)Path;
+        return false;
+#endif
+    }
+
+    bool Start()
+    {
+#ifdef __linux__
+        if (Worker.joinable())
+        {
+            return true;
+        }
+        Epoll = epoll_create1(0);
+        WakeFd = eventfd(0, EFD_NONBLOCK);
+        if (Epoll < 0 || WakeFd < 0)
+        {
+            perror("serial: epoll");
+            return false;
+        }
+        Watch(WakeFd, EPOLLIN);
+        if (ListenFd >= 0)
+        {
+            Watch(ListenFd, EPOLLIN);
+        }
+        WatchLine();
+        Running.store(true);
+        Worker = std::thread([this]() { Loop(); });
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // flushes what the guest has queued (as far as the peer accepts it
+    // without blocking) and joins the I/O thread
+    void Stop()
+    {
+        if (Worker.joinable())
+        {
+            Running.store(false);
+            Notify();
+            Worker.join();
+        }
+    }
+
+    // guest side, after pushing to ToHost
+    void Kick()
+    {
+        if (Idle.load(std::memory_order_relaxed) && Idle.exchange(false))
+        {
+            Notify();
+        }
+    }
+
+private:
+    int InFd = -1;
+    int OutFd = -1;
+    int ListenFd = -1;
+    int Epoll = -1;
+    int WakeFd = -1;
+
+    // the line's descriptors as attached (InFd becomes -2 at EOF on stdio);
+    // Close() closes owned ones and restores borrowed ones' flags
+    struct LineFd {
+        int Fd = -1;
+        bool Own = true;
+        int Flags = 0;
+    };
+    LineFd Lines[2];
+    bool OutBlocked = false;
+    std::thread Worker;
+    std::atomic<bool> Running{false};
+    std::atomic<bool> Idle{false};
+
+#ifdef __linux__
+    // regular files and /dev/null cannot be watched; they are always
+    // ready, which the loop handles by trying them on every pass anyway
+    void Watch( int Fd, u32 Events )
+    {
+        epoll_event Event = {};
+        Event.events = Events;
+        Event.data.fd = Fd;
+        epoll_ctl(Epoll, EPOLL_CTL_ADD, Fd, &Event);
+    }
+
+    // edge triggered: every pass reads and writes until the kernel says
+    // EAGAIN, so only new readiness needs to wake the loop
+    void WatchLine()
+    {
+        if (InFd >= 0)
+        {
+            Watch(InFd, EPOLLIN | EPOLLET | (InFd == OutFd ? (u32)EPOLLOUT : 0u));
+        }
+        if (OutFd >= 0 && OutFd != InFd)
+        {
+            Watch(OutFd, EPOLLOUT | EPOLLET);
+        }
+    }
+
+    void Notify()
+    {
+        const u64 One = 1;
+        if (write(WakeFd, &One, sizeof(One)) < 0 && errno != EAGAIN)
+        {
+            perror("serial: eventfd");
+        }
+    }
+
+    void Accept()
+    {
+        const int Client = accept4(ListenFd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (Client < 0 || InFd >= 0)
+        {
+            if (Client >= 0)
+            {
+                close(Client);      // one client at a time
+            }
+            return;
+        }
+        InFd = OutFd = Client;
+        WatchLine();
+    }
+
+    // returns true if anything was delivered to the guest
+    bool Receive()
+    {
+        bool Any = false;
+        Byte* Span = nullptr;
+        for (u32 Room; InFd >= 0 && (Room = ToGuest.WritableSpan(Span)) > 0;)
+        {
+            const ssize_t Got = read(InFd, Span, Room);
+            ReadCalls++;
+            if (Got <= 0)
+            {
+                if (Got == 0 || (errno != EAGAIN && errno != EINTR))
+                {
+                    Disconnect();
+                }
+                break;
+            }
+            ToGuest.Commit((u32)Got);
+            BytesIn += Got;
+            Any = true;
+        }
+        return Any;
+    }
+
+    void Transmit()
+    {
+        const Byte* Span = nullptr;
+        bool Broken = OutFd < 0;
+        OutBlocked = false;
+        for (u32 Count; !Broken && (Count = ToHost.ReadableSpan(Span)) > 0;)
+        {
+            const ssize_t Put = write(OutFd, Span, Count);
+            WriteCalls++;
+            if (Put <= 0)
+            {
+                if (errno == EAGAIN)
+                {
+                    OutBlocked = true;
+                }
+                else if (errno != EINTR)
+                {
+                    // a pty without a terminal on the other end, a closed
+                    // pipe or a client that went away
+                    Broken = true;
+                    if (ListenFd >= 0)
+                    {
+                        Disconnect();
+                    }
+                }
+                break;
+            }
+            ToHost.Consume((u32)Put);
+            BytesOut += Put;
+        }
+        if (Broken)
+        {
+            // nobody listening: the line drops what the guest sends
+            const Byte* Dropped = nullptr;
+            for (u32 Count; (Count = ToHost.ReadableSpan(Dropped)) > 0;)
+            {
+                ToHost.Consume(Count);
+            }
+        }
+    }
+
+    void Disconnect()
+    {
+        if (ListenFd < 0)
+        {
+            // stdio or pty: keep the descriptors, stop reading on EOF
+            if (InFd >= 0 && InFd != OutFd)
+            {
+                epoll_ctl(Epoll, EPOLL_CTL_DEL, InFd, nullptr);
+                InFd = -2;
+            }
+            return;
+        }
+        epoll_ctl(Epoll, EPOLL_CTL_DEL, InFd, nullptr);
+        close(InFd);
+        InFd = OutFd = -1;
+    }
+
+    void Loop()
+    {
+        epoll_event Ready[8];
+        for (;;)
+        {
+            const bool Stopping = !Running.load();
+            Transmit();
+            if (Receive() && OnReceive)
+            {
+                OnReceive();
+            }
+            if (Stopping)
+            {
+                return;
+            }
+
+            // announce idleness, then make sure nothing slipped in before it
+            Idle.store(true);
+            if (!ToHost.Empty() && !OutBlocked && Idle.exchange(false))
+            {
+                continue;
+            }
+            // a full receive ring is polled until the guest makes room
+            const int Count = epoll_wait(Epoll, Ready, 8, ToGuest.Full() ? 1 : -1);
+            Idle.store(false);
+            for (int i = 0; i < Count; i++)
+            {
+                if (Ready[i].data.fd == WakeFd)
+                {
+                    u64 Value;
+                    if (read(WakeFd, &Value, sizeof(Value)) < 0 && errno != EAGAIN)
+                    {
+                        perror("serial: eventfd");
+                    }
+                }
+                else if (Ready[i].data.fd == ListenFd)
+                {
+                    Accept();
+                }
+            }
+        }
+    }
+
+    bool AttachLine( int In, bool OwnIn, int Out, bool OwnOut )
+    {
+        Lines[0] = { In, OwnIn, fcntl(In, F_GETFL) };
+        Lines[1] = In == Out ? LineFd() : LineFd{ Out, OwnOut, fcntl(Out, F_GETFL) };
+        for (const LineFd& Line : Lines)
+        {
+            if (Line.Fd >= 0)
+            {
+                fcntl(Line.Fd, F_SETFL, Line.Flags | O_NONBLOCK);
+            }
+        }
+        InFd = In;
+        OutFd = Out;
+        return true;
+    }
+
+    // a fresh open file description for a terminal or pipe, -1 otherwise
+    static int Reopen( int Fd, int Mode )
+    {
+        struct stat Info;
+        if (fstat(Fd, &Info) != 0 || !(S_ISCHR(Info.st_mode) || S_ISFIFO(Info.st_mode)))
+        {
+            return -1;
+        }
+        char Path[32];
+        snprintf(Path, sizeof(Path), "/proc/self/fd/%d", Fd);
+        return open(Path, Mode | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    }
+
+    void Close()
+    {
+        // a client accepted on ListenFd
+        if (ListenFd >= 0 && InFd >= 0)
+        {
+            close(InFd);
+        }
+        for (LineFd& Line : Lines)
+        {
+            if (Line.Fd >= 0 && Line.Own)
+            {
+                close(Line.Fd);
+            }
+            else if (Line.Fd >= 0)
+            {
+                fcntl(Line.Fd, F_SETFL, Line.Flags);
+            }
+            Line = LineFd();
+        }
+        for (int Fd : { ListenFd, Epoll, WakeFd })
+        {
+            if (Fd >= 0)
+            {
+                close(Fd);
+            }
+        }
+        InFd = OutFd = ListenFd = Epoll = WakeFd = -1;
+    }
+#else
+    void Notify() {}
+    void Close() {}
+#endif
+};
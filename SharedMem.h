@@ -0,0 +1,278 @@
+// A Mem that lives in a shared file mapping, so monitoring tools in other
+// processes can watch guest RAM and registers live: no pause, no copy, no
+// syscall per look.
+//
+// SharedMem maps a memfd (or a named file, e.g. under /dev/shm) and builds
+// the Mem itself inside the mapping, so Mem::Data is the shared bytes and
+// the CPU runs exactly the code and data layout it always does. A mapper's
+// banks can be moved into the same mapping with ShareMapper.
+//
+// The file starts with a SharedStateHeader giving the offsets of Data and
+// the banks, a page map (where each CPU page currently reads from) and the
+// registers. Publish(cpu), called by the host between slices, updates the
+// registers and page map under a sequence counter: it is odd while an update
+// is in progress, so a reader copies the fields and retries if the counter
+// was odd or changed meanwhile (SharedStateView does this). Memory bytes are
+// never locked; a reader sees them as the guest writes them.
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#include "CPU.h"
+#include "Mapper.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct SharedRegisters {
+    u64 Cycles;
+    u64 Instructions;
+    Word PC;
+    Byte A, X, Y, SP, PS;
+};
+
+struct SharedStateHeader {
+    static constexpr u32 MAGIC = 0x32303536;        // "6502"
+    static constexpr u32 VERSION = 1;
+
+    u32 Magic;
+    u32 Version;
+    u64 FileSize;
+    u64 DataOffset;                 // the 64 KB of Mem::Data
+    u64 RomOffset, RomSize;         // a shared mapper's banks; 0 when none
+    u64 RamOffset, RamSize;
+
+    // even when the fields below are stable, odd while Publish rewrites them
+    std::atomic<u64> Sequence;
+    SharedRegisters Cpu;
+    s64 PageOffsets[Mem::NUM_PAGES];    // file offset each page reads from, -1 for devices
+};
+
+#ifndef _WIN32
+
+// the emulator side
+struct SharedMem {
+    SharedStateHeader* Header = nullptr;
+
+    SharedMem() = default;
+    SharedMem( const SharedMem& ) = delete;
+    SharedMem& operator=( const SharedMem& ) = delete;
+
+    ~SharedMem()
+    {
+        if (Memory)
+        {
+            Memory->~Mem();
+        }
+        if (Base)
+        {
+            munmap(Base, Size);
+        }
+        if (Fd >= 0)
+        {
+            close(Fd);
+        }
+    }
+
+    // Path null makes an anonymous memfd (Linux), which other processes
+    // open as Path(); BankBytes reserves room for ShareMapper
+    bool Create( const char* InPath, u32 BankBytes = 0 )
+    {
+        if (InPath)
+        {
+            Fd = open(InPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            FilePath = InPath;
+        }
+        else
+        {
+#ifdef __linux__
+            Fd = memfd_create("6502-state", 0);
+            FilePath = "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(Fd);
+#endif
+        }
+        if (Fd < 0)
+        {
+            perror("shared memory");
+            return false;
+        }
+        MemOffset = Align(sizeof(SharedStateHeader));
+        BankOffset = Align(MemOffset + sizeof(Mem));
+        Size = Align(BankOffset + BankBytes);
+        BankRoom = (u32)(Size - BankOffset);
+        if (ftruncate(Fd, (off_t)Size) != 0)
+        {
+            perror("shared memory");
+            return false;
+        }
+        void* Mapping = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+        if (Mapping == MAP_FAILED)
+        {
+            perror("shared memory");
+            return false;
+        }
+        Base = (Byte*)Mapping;
+        Memory = new (Base + MemOffset) Mem;
+        Header = new (Base) SharedStateHeader();
+        Header->Magic = SharedStateHeader::MAGIC;
+        Header->Version = SharedStateHeader::VERSION;
+        Header->FileSize = Size;
+        Header->DataOffset = (u64)(Memory->Data - Base);
+        MapPages();
+        return true;
+    }
+
+    Mem& memory() { return *Memory; }
+
+    // where other processes open the state
+    const std::string& Path() const { return FilePath; }
+
+    // moves the banks of a mapper attached to memory() into the mapping
+    // (Mapper::Relocate); false if they do not fit in the BankBytes given
+    // to Create
+    bool ShareMapper( Mapper& Cartridge )
+    {
+        const u64 RomSize = Cartridge.Rom.size();
+        const u64 RamSize = Cartridge.Ram.size();
+        if (!Header || RomSize + RamSize > BankRoom)
+        {
+            fprintf(stderr, "shared memory: %llu bytes of banks do not fit in %u\n",
+                (unsigned long long)(RomSize + RamSize), BankRoom);
+            return false;
+        }
+        Cartridge.Relocate(Base + BankOffset, Base + BankOffset + RomSize);
+        Header->RomOffset = RomSize ? BankOffset : 0;
+        Header->RomSize = RomSize;
+        Header->RamOffset = RamSize ? BankOffset + RomSize : 0;
+        Header->RamSize = RamSize;
+        MapVersion = ~0ull;
+        return true;
+    }
+
+    // host thread, between slices: registers and, if the mapping changed,
+    // the page map
+    void Publish( const CPU& cpu )
+    {
+        const u64 Sequence = Header->Sequence.load(std::memory_order_relaxed);
+        Header->Sequence.store(Sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Header->Cpu = { cpu.Counters.Cycles, cpu.Counters.InstructionsRetired, cpu.PC, cpu.A, cpu.X, cpu.Y,
+            cpu.SP, cpu.PS };
+        if (Memory->MapVersion != MapVersion)
+        {
+            MapPages();
+        }
+        Header->Sequence.store(Sequence + 2, std::memory_order_release);
+    }
+
+private:
+    int Fd = -1;
+    Byte* Base = nullptr;
+    size_t Size = 0;
+    size_t MemOffset = 0;
+    size_t BankOffset = 0;
+    u32 BankRoom = 0;
+    Mem* Memory = nullptr;
+    u64 MapVersion = ~0ull;
+    std::string FilePath;
+
+    void MapPages()
+    {
+        MapVersion = Memory->MapVersion;
+        for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+        {
+            const Byte* Pointer = Memory->ReadPages[Page];
+            Header->PageOffsets[Page] = Pointer >= Base && Pointer < Base + Size ? Pointer - Base : -1;
+        }
+    }
+
+    static size_t Align( size_t Bytes )
+    {
+        return (Bytes + 4095) & ~(size_t)4095;
+    }
+};
+
+// the tool side: a read-only view of another process's SharedMem
+struct SharedStateView {
+    ~SharedStateView()
+    {
+        if (Base)
+        {
+            munmap((void*)Base, Size);
+        }
+    }
+
+    bool Open( const char* Path )
+    {
+        const int Fd = open(Path, O_RDONLY);
+        struct stat Info;
+        if (Fd < 0 || fstat(Fd, &Info) != 0 || (size_t)Info.st_size < sizeof(SharedStateHeader))
+        {
+            perror(Path);
+            if (Fd >= 0)
+            {
+                close(Fd);
+            }
+            return false;
+        }
+        Size = (size_t)Info.st_size;
+        void* Mapping = mmap(nullptr, Size, PROT_READ, MAP_SHARED, Fd, 0);
+        close(Fd);
+        if (Mapping == MAP_FAILED)
+        {
+            perror(Path);
+            return false;
+        }
+        Base = (const Byte*)Mapping;
+        if (Header()->Magic != SharedStateHeader::MAGIC || Header()->Version != SharedStateHeader::VERSION)
+        {
+            fprintf(stderr, "%s: not a 6502 state file\n", Path);
+            return false;
+        }
+        return true;
+    }
+
+    const SharedStateHeader* Header() const { return (const SharedStateHeader*)Base; }
+
+    // the guest's Mem::Data, live
+    const Byte* Data() const { return Base + Header()->DataOffset; }
+
+    // a consistent copy of the last published registers
+    SharedRegisters Registers() const
+    {
+        const SharedStateHeader* State = Header();
+        for (;;)
+        {
+            const u64 Before = State->Sequence.load(std::memory_order_acquire);
+            SharedRegisters Copy = State->Cpu;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (!(Before & 1) && State->Sequence.load(std::memory_order_relaxed) == Before)
+            {
+                return Copy;
+            }
+        }
+    }
+
+    // what the CPU reads at Address, as of the last published page map;
+    // 0xFF for device pages
+    Byte Peek( Word Address ) const
+    {
+        const s64 Offset = Header()->PageOffsets[Address / Mem::PAGE_SIZE];
+        return Offset >= 0 ? Base[Offset + Address % Mem::PAGE_SIZE] : 0xFF;
+    }
+
+private:
+    const Byte* Base = nullptr;
+    size_t Size = 0;
+};
+
+#endif
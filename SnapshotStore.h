@@ -0,0 +1,369 @@
+// Content-addressed store for large numbers of machine states (registers
+// plus the 64 KB of Mem::Data), for state-space exploration and fuzzing
+// corpora.
+//
+// A state is split into 256 pages of 256 bytes and each distinct page is
+// kept once, found again by a hash of its contents (and a compare, so a
+// hash collision can never merge two different pages). The 256 page ids of a
+// state are themselves split into 16 chunks of 16 ids, deduplicated the same
+// way, so a state that differs from earlier ones in a few pages costs 88
+// bytes plus the new pages and chunks. Storage grows with the distinct
+// contents seen, not with the number of states.
+//
+// SnapshotStore collects states in memory and writes them out with Save.
+// The file is the same three arrays (pages, chunks, fixed-size state
+// records) behind a header, so SnapshotFile maps it read-only and finds any
+// state by index without reading anything else: loading one is 256 page
+// copies straight out of the page cache.
+//
+// Only what lives in Data is captured; mapper banks and device state are the
+// host's to save alongside.
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "CPU.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct SnapshotRecord {
+    static constexpr u32 FANOUT = 16;
+    static constexpr u32 CHUNKS = Mem::NUM_PAGES / FANOUT;
+
+    u32 Chunks[CHUNKS];
+    u64 Cycles;
+    u64 Instructions;
+    Word PC;
+    Byte A, X, Y, SP, PS;
+    Byte Reserved;
+};
+
+struct SnapshotFileHeader {
+    static constexpr u32 MAGIC = 0x53353036;        // "605S"
+    static constexpr u32 VERSION = 1;
+
+    u32 Magic;
+    u32 Version;
+    u64 FileSize;
+    u64 PageCount, PagesOffset;         // PAGE_SIZE bytes each
+    u64 ChunkCount, ChunksOffset;       // FANOUT page ids each
+    u64 StateCount, StatesOffset;       // one SnapshotRecord each
+};
+
+namespace SnapshotFormat
+{
+    constexpr u32 PAGE_SIZE = Mem::PAGE_SIZE;
+    constexpr u32 FANOUT = SnapshotRecord::FANOUT;
+
+    // fast content hash; equal hashes are confirmed with a compare
+    inline u64 Hash( const void* Bytes, u32 Size )
+    {
+        const Byte* Cursor = (const Byte*)Bytes;
+        u64 Lanes[4] = { 1, 2, 3, 4 };
+        for (u32 i = 0; i < Size; i += 32)
+        {
+            for (u32 Lane = 0; Lane < 4; Lane++)
+            {
+                u64 Bits;
+                memcpy(&Bits, Cursor + i + Lane * 8, 8);
+                Lanes[Lane] = (Lanes[Lane] ^ Bits) * 0x9E3779B97F4A7C15ull;
+                Lanes[Lane] ^= Lanes[Lane] >> 31;
+            }
+        }
+        return StateHash::Mix(Lanes[0] + StateHash::Mix(Lanes[1] + StateHash::Mix(Lanes[2] + StateHash::Mix(Lanes[3]))));
+    }
+
+    inline void Restore( const Byte* Pages, const u32* Chunks, const SnapshotRecord& Record, CPU& cpu, Mem& memory )
+    {
+        for (u32 Chunk = 0; Chunk < SnapshotRecord::CHUNKS; Chunk++)
+        {
+            const u32* Ids = &Chunks[(size_t)Record.Chunks[Chunk] * FANOUT];
+            for (u32 i = 0; i < FANOUT; i++)
+            {
+                memcpy(&memory.Data[(Chunk * FANOUT + i) * PAGE_SIZE], &Pages[(size_t)Ids[i] * PAGE_SIZE], PAGE_SIZE);
+            }
+        }
+        memory.MarkDirtyRange(0, Mem::MAX_MEM);
+        cpu.PC = Record.PC;
+        cpu.A = Record.A;
+        cpu.X = Record.X;
+        cpu.Y = Record.Y;
+        cpu.SP = Record.SP;
+        cpu.PS = Record.PS;
+    }
+}
+
+struct SnapshotStore {
+    // stores the state and returns its index
+    u64 Add( const CPU& cpu, const Mem& memory )
+    {
+        // successive states mostly repeat the pages of the one before, and
+        // comparing against those is much cheaper than hashing
+        SnapshotRecord Record = {};
+        for (u32 Chunk = 0; Chunk < SnapshotRecord::CHUNKS; Chunk++)
+        {
+            u32* Ids = &LastIds[Chunk * SnapshotFormat::FANOUT];
+            bool Changed = Records.empty();
+            for (u32 i = 0; i < SnapshotFormat::FANOUT; i++)
+            {
+                const Byte* Page = &memory.Data[(Chunk * SnapshotFormat::FANOUT + i) * SnapshotFormat::PAGE_SIZE];
+                if (Records.empty() || memcmp(Page, Pages.Item(Ids[i]), SnapshotFormat::PAGE_SIZE))
+                {
+                    Ids[i] = Pages.Intern(Page);
+                    Changed = true;
+                }
+            }
+            Record.Chunks[Chunk] = Changed ? Chunks.Intern(Ids) : Records.back().Chunks[Chunk];
+        }
+        Record.Cycles = cpu.Counters.Cycles;
+        Record.Instructions = cpu.Counters.InstructionsRetired;
+        Record.PC = cpu.PC;
+        Record.A = cpu.A;
+        Record.X = cpu.X;
+        Record.Y = cpu.Y;
+        Record.SP = cpu.SP;
+        Record.PS = cpu.PS;
+        Records.push_back(Record);
+        return Records.size() - 1;
+    }
+
+    // registers and Data as they were; every page is marked dirty
+    void Load( u64 Index, CPU& cpu, Mem& memory ) const
+    {
+        SnapshotFormat::Restore(Pages.Data.data(), (const u32*)Chunks.Data.data(), Records[Index], cpu, memory);
+    }
+
+    u64 States() const { return Records.size(); }
+    const SnapshotRecord& State( u64 Index ) const { return Records[Index]; }
+    u64 UniquePages() const { return Pages.Count(); }
+    u64 UniqueChunks() const { return Chunks.Count(); }
+
+    // what Save writes, less the header's alignment padding
+    u64 Bytes() const
+    {
+        return Pages.Data.size() + Chunks.Data.size() + Records.size() * sizeof(SnapshotRecord);
+    }
+
+    bool Save( const char* Path ) const
+    {
+        FILE* File = fopen(Path, "wb");
+        if (!File)
+        {
+            perror(Path);
+            return false;
+        }
+        SnapshotFileHeader Header = {};
+        Header.Magic = SnapshotFileHeader::MAGIC;
+        Header.Version = SnapshotFileHeader::VERSION;
+        Header.PageCount = Pages.Count();
+        Header.PagesOffset = Align(sizeof(Header));
+        Header.ChunkCount = Chunks.Count();
+        Header.ChunksOffset = Align(Header.PagesOffset + Pages.Data.size());
+        Header.StateCount = Records.size();
+        Header.StatesOffset = Align(Header.ChunksOffset + Chunks.Data.size());
+        Header.FileSize = Header.StatesOffset + Records.size() * sizeof(SnapshotRecord);
+
+        static const Byte Padding[4096] = {};
+        u64 At = 0;
+        auto Put = [&]( const void* Bytes, u64 Size, u64 Offset )
+        {
+            const bool Ok = fwrite(Padding, 1, Offset - At, File) == Offset - At && fwrite(Bytes, 1, Size, File) == Size;
+            At = Offset + Size;
+            return Ok;
+        };
+        const bool Ok = Put(&Header, sizeof(Header), 0)
+            && Put(Pages.Data.data(), Pages.Data.size(), Header.PagesOffset)
+            && Put(Chunks.Data.data(), Chunks.Data.size(), Header.ChunksOffset)
+            && Put(Records.data(), Records.size() * sizeof(SnapshotRecord), Header.StatesOffset);
+        if (fclose(File) != 0 || !Ok)
+        {
+            perror(Path);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // open-addressed set of fixed-size items, ids in insertion order
+    template <u32 SIZE>
+    struct ContentTable {
+        std::vector<Byte> Data;
+        std::vector<u64> Hashes;
+        std::vector<u32> Slots;     // id + 1, 0 when empty
+
+        u32 Count() const { return (u32)Hashes.size(); }
+        const Byte* Item( u32 Id ) const { return &Data[(size_t)Id * SIZE]; }
+
+        u32 Intern( const void* Item )
+        {
+            if ((Hashes.size() + 1) * 2 > Slots.size())
+            {
+                Grow();
+            }
+            const u64 Hash = SnapshotFormat::Hash(Item, SIZE);
+            const size_t Mask = Slots.size() - 1;
+            for (size_t Slot = Hash & Mask;; Slot = (Slot + 1) & Mask)
+            {
+                const u32 Entry = Slots[Slot];
+                if (!Entry)
+                {
+                    Slots[Slot] = Count() + 1;
+                    Hashes.push_back(Hash);
+                    Data.insert(Data.end(), (const Byte*)Item, (const Byte*)Item + SIZE);
+                    return Count() - 1;
+                }
+                if (Hashes[Entry - 1] == Hash && !memcmp(&Data[(size_t)(Entry - 1) * SIZE], Item, SIZE))
+                {
+                    return Entry - 1;
+                }
+            }
+        }
+
+        void Grow()
+        {
+            std::vector<u32> Bigger(Slots.empty() ? 1024 : Slots.size() * 2, 0);
+            const size_t Mask = Bigger.size() - 1;
+            for (u32 Id = 0; Id < Count(); Id++)
+            {
+                size_t Slot = Hashes[Id] & Mask;
+                while (Bigger[Slot])
+                {
+                    Slot = (Slot + 1) & Mask;
+                }
+                Bigger[Slot] = Id + 1;
+            }
+            Slots.swap(Bigger);
+        }
+    };
+
+    ContentTable<SnapshotFormat::PAGE_SIZE> Pages;
+    ContentTable<SnapshotFormat::FANOUT * sizeof(u32)> Chunks;
+    std::vector<SnapshotRecord> Records;
+    u32 LastIds[Mem::NUM_PAGES];
+
+    static u64 Align( u64 Bytes )
+    {
+        return (Bytes + 4095) & ~(u64)4095;
+    }
+};
+
+#ifndef _WIN32
+
+// a saved store, mapped read-only
+struct SnapshotFile {
+    SnapshotFile() = default;
+    SnapshotFile( const SnapshotFile& ) = delete;
+    SnapshotFile& operator=( const SnapshotFile& ) = delete;
+
+    ~SnapshotFile()
+    {
+        if (Base)
+        {
+            munmap((void*)Base, Size);
+        }
+    }
+
+    bool Open( const char* Path )
+    {
+        const int Fd = open(Path, O_RDONLY);
+        struct stat Info;
+        if (Fd < 0 || fstat(Fd, &Info) != 0)
+        {
+            perror(Path);
+            if (Fd >= 0)
+            {
+                close(Fd);
+            }
+            return false;
+        }
+        Size = (size_t)Info.st_size;
+        void* Mapping = Size >= sizeof(SnapshotFileHeader) ? mmap(nullptr, Size, PROT_READ, MAP_SHARED, Fd, 0) : MAP_FAILED;
+        close(Fd);
+        if (Mapping == MAP_FAILED)
+        {
+            fprintf(stderr, "%s: not a snapshot store\n", Path);
+            Size = 0;
+            return false;
+        }
+        Base = (const Byte*)Mapping;
+        if (!Valid())
+        {
+            fprintf(stderr, "%s: not a snapshot store, or truncated\n", Path);
+            return false;
+        }
+        Pages = Base + Header()->PagesOffset;
+        Chunks = (const u32*)(Base + Header()->ChunksOffset);
+        Records = (const SnapshotRecord*)(Base + Header()->StatesOffset);
+        return true;
+    }
+
+    const SnapshotFileHeader* Header() const { return (const SnapshotFileHeader*)Base; }
+
+    u64 States() const { return Records ? Header()->StateCount : 0; }
+    const SnapshotRecord& State( u64 Index ) const { return Records[Index]; }
+
+    // false for an index past the end or a record naming a chunk that is not there
+    bool Load( u64 Index, CPU& cpu, Mem& memory ) const
+    {
+        if (Index >= States())
+        {
+            return false;
+        }
+        for (u32 Chunk : Records[Index].Chunks)
+        {
+            if (Chunk >= Header()->ChunkCount)
+            {
+                return false;
+            }
+        }
+        SnapshotFormat::Restore(Pages, Chunks, Records[Index], cpu, memory);
+        return true;
+    }
+
+private:
+    const Byte* Base = nullptr;
+    size_t Size = 0;
+    const Byte* Pages = nullptr;
+    const u32* Chunks = nullptr;
+    const SnapshotRecord* Records = nullptr;
+
+    // sizes first, then the chunks' page ids, so Load only checks its record
+    bool Valid() const
+    {
+        const SnapshotFileHeader* H = Header();
+        if (H->Magic != SnapshotFileHeader::MAGIC || H->Version != SnapshotFileHeader::VERSION || H->FileSize > Size)
+        {
+            return false;
+        }
+        const auto Fits = [&]( u64 Offset, u64 Count, u64 Each )
+        {
+            return Offset % 8 == 0 && Offset <= H->FileSize && Count <= (H->FileSize - Offset) / Each;
+        };
+        if (!Fits(H->PagesOffset, H->PageCount, SnapshotFormat::PAGE_SIZE)
+            || !Fits(H->ChunksOffset, H->ChunkCount, SnapshotFormat::FANOUT * sizeof(u32))
+            || !Fits(H->StatesOffset, H->StateCount, sizeof(SnapshotRecord)))
+        {
+            return false;
+        }
+        const u32* Ids = (const u32*)(Base + H->ChunksOffset);
+        for (u64 i = 0; i < H->ChunkCount * SnapshotFormat::FANOUT; i++)
+        {
+            if (Ids[i] >= H->PageCount)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif
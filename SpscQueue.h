@@ -0,0 +1,141 @@
+// Bounded single-producer / single-consumer ring buffer for passing records
+// between two threads without locks.
+//
+// One thread may push and one other thread may pop; each side only writes
+// its own index and reads the other's with acquire ordering. The capacity
+// is a power of two so positions wrap with a mask, and the indices are kept
+// on separate cache lines with each side caching the other's last seen
+// value, so a steady stream costs no shared cache-line traffic per record.
+
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+
+#include "Types.h"
+
+template <typename T, u32 CAPACITY>
+struct SpscQueue {
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+    // producer side; false when full
+    bool Push( const T& Item )
+    {
+        const u32 Tail = TailIndex.load(std::memory_order_relaxed);
+        if (Tail - HeadSeen == CAPACITY)
+        {
+            HeadSeen = HeadIndex.load(std::memory_order_acquire);
+            if (Tail - HeadSeen == CAPACITY)
+            {
+                return false;
+            }
+        }
+        Items[Tail & (CAPACITY - 1)] = Item;
+        TailIndex.store(Tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer side; pushes as many of Count items as fit and returns how
+    // many, publishing them with a single release
+    u32 PushBatch( const T* Source, u32 Count )
+    {
+        const u32 Tail = TailIndex.load(std::memory_order_relaxed);
+        if (CAPACITY - (Tail - HeadSeen) < Count)
+        {
+            HeadSeen = HeadIndex.load(std::memory_order_acquire);
+        }
+        const u32 Space = CAPACITY - (Tail - HeadSeen);
+        const u32 Pushed = Count < Space ? Count : Space;
+        for (u32 i = 0; i < Pushed; i++)
+        {
+            Items[(Tail + i) & (CAPACITY - 1)] = Source[i];
+        }
+        TailIndex.store(Tail + Pushed, std::memory_order_release);
+        return Pushed;
+    }
+
+    // consumer side; false when empty
+    bool Pop( T& Item )
+    {
+        return PopBatch(&Item, 1) == 1;
+    }
+
+    // consumer side; pops up to Count items and returns how many
+    u32 PopBatch( T* Destination, u32 Count )
+    {
+        const u32 Head = HeadIndex.load(std::memory_order_relaxed);
+        if (TailSeen - Head < Count)
+        {
+            TailSeen = TailIndex.load(std::memory_order_acquire);
+        }
+        const u32 Available = TailSeen - Head;
+        const u32 Popped = Count < Available ? Count : Available;
+        for (u32 i = 0; i < Popped; i++)
+        {
+            Destination[i] = Items[(Head + i) & (CAPACITY - 1)];
+        }
+        HeadIndex.store(Head + Popped, std::memory_order_release);
+        return Popped;
+    }
+
+    // zero-copy access for bulk I/O: the contiguous run of free (producer)
+    // or filled (consumer) slots starting at the current position, which a
+    // read() or write() can use directly; Commit / Consume then publish how
+    // many slots were actually used. The run stops at the wrap point, so a
+    // second call may return the rest.
+    u32 WritableSpan( T*& Span )
+    {
+        const u32 Tail = TailIndex.load(std::memory_order_relaxed);
+        HeadSeen = HeadIndex.load(std::memory_order_acquire);
+        const u32 Free = CAPACITY - (Tail - HeadSeen);
+        const u32 ToEnd = CAPACITY - (Tail & (CAPACITY - 1));
+        Span = &Items[Tail & (CAPACITY - 1)];
+        return Free < ToEnd ? Free : ToEnd;
+    }
+
+    void Commit( u32 Count )
+    {
+        TailIndex.store(TailIndex.load(std::memory_order_relaxed) + Count, std::memory_order_release);
+    }
+
+    u32 ReadableSpan( const T*& Span )
+    {
+        const u32 Head = HeadIndex.load(std::memory_order_relaxed);
+        TailSeen = TailIndex.load(std::memory_order_acquire);
+        const u32 Filled = TailSeen - Head;
+        const u32 ToEnd = CAPACITY - (Head & (CAPACITY - 1));
+        Span = &Items[Head & (CAPACITY - 1)];
+        return Filled < ToEnd ? Filled : ToEnd;
+    }
+
+    void Consume( u32 Count )
+    {
+        HeadIndex.store(HeadIndex.load(std::memory_order_relaxed) + Count, std::memory_order_release);
+    }
+
+    // either side; a snapshot that may be stale by the time it is used
+    bool Empty() const
+    {
+        return TailIndex.load(std::memory_order_acquire) == HeadIndex.load(std::memory_order_acquire);
+    }
+
+    u32 Size() const
+    {
+        return TailIndex.load(std::memory_order_acquire) - HeadIndex.load(std::memory_order_acquire);
+    }
+
+    bool Full() const
+    {
+        return Size() == CAPACITY;
+    }
+
+private:
+    static constexpr size_t LINE = 64;
+
+    alignas(LINE) std::atomic<u32> TailIndex{0};
+    u32 HeadSeen = 0;           // producer's copy of HeadIndex
+    alignas(LINE) std::atomic<u32> HeadIndex{0};
+    u32 TailSeen = 0;           // consumer's copy of TailIndex
+    alignas(LINE) T Items[CAPACITY];
+};
@@ -0,0 +1,101 @@
+// Incrementally maintained hash of a Mem's 64 KB Data.
+//
+// The hash is a sum over every address of a 64-bit mix of (address, byte),
+// kept per 256-byte page and in total. Summing makes it order-free, so a
+// store only has to subtract the old byte's term and add the new one: O(1)
+// per write, and the total is always current, so reading it is O(1) too.
+// Two memories with equal totals hold the same bytes with overwhelming
+// probability, and when totals differ the page sums say where.
+//
+// Attach it with Mem::AttachHash. CPU stores (Mem::Write and Mem::Store)
+// update it as they happen; host writes through operator[] or covered by
+// MarkDirtyRange, Initialize and RestoreDirtyPages only mark their pages
+// stale, and those are rehashed the next time a hash is read. CPU::StateDigest
+// folds the registers in.
+
+#pragma once
+
+#include "Types.h"
+
+struct StateHash {
+    static constexpr u32 PAGE_SIZE = 256;
+    static constexpr u32 NUM_PAGES = 256;
+
+    // a bijective 64-bit mixer, so distinct keys never share a value
+    static FORCE_INLINE u64 Mix( u64 Key ) {
+        Key += 0x9E3779B97F4A7C15ull;
+        Key ^= Key >> 33;
+        Key *= 0xFF51AFD7ED558CCDull;
+        Key ^= Key >> 33;
+        Key *= 0xC4CEB9FE1A85EC53ull;
+        Key ^= Key >> 33;
+        return Key;
+    }
+
+    // a byte's contribution
+    static FORCE_INLINE u64 Term( u32 Address, Byte Value ) {
+        return Mix((u64)Address << 8 | Value);
+    }
+
+    // Address is the byte's offset in Data, about to change from Old to New
+    FORCE_INLINE void Update( u32 Address, Byte Old, Byte New ) {
+        if (Old != New) {
+            const u64 Delta = Term(Address, New) - Term(Address, Old);
+            Pages[Address / PAGE_SIZE] += Delta;
+            Total += Delta;
+        }
+    }
+
+    void MarkStale( u32 Page ) {
+        Stale[Page / 64] |= 1ull << (Page % 64);
+    }
+
+    void MarkAllStale() {
+        for (u64& Bits : Stale) {
+            Bits = ~0ull;
+        }
+    }
+
+    // the whole of Data, and one page of it
+    u64 Memory( const Byte* Data ) {
+        Refresh(Data);
+        return Total;
+    }
+
+    u64 Page( const Byte* Data, u32 Index ) {
+        Refresh(Data);
+        return Pages[Index];
+    }
+
+    // what Memory() would return for Data, from scratch
+    static u64 Compute( const Byte* Data ) {
+        u64 Sum = 0;
+        for (u32 Address = 0; Address < PAGE_SIZE * NUM_PAGES; Address++) {
+            Sum += Term(Address, Data[Address]);
+        }
+        return Sum;
+    }
+
+private:
+    u64 Pages[NUM_PAGES] = {};
+    u64 Total = 0;
+    u64 Stale[NUM_PAGES / 64] = { ~0ull, ~0ull, ~0ull, ~0ull };
+
+    void Refresh( const Byte* Data ) {
+        for (u32 i = 0; i < NUM_PAGES / 64; i++) {
+            u64 Bits = Stale[i];
+            for (u32 Index = i * 64; Bits; Index++, Bits >>= 1) {
+                if (!(Bits & 1)) {
+                    continue;
+                }
+                u64 Sum = 0;
+                for (u32 Offset = 0; Offset < PAGE_SIZE; Offset++) {
+                    Sum += Term(Index * PAGE_SIZE + Offset, Data[Index * PAGE_SIZE + Offset]);
+                }
+                Total += Sum - Pages[Index];
+                Pages[Index] = Sum;
+            }
+            Stale[i] = 0;
+        }
+    }
+};
@@ -0,0 +1,17 @@
+// Processor status register of the emulated 6502
+
+#pragma once
+
+#include "Types.h"
+
+struct StatusFlags {
+    Byte C : 1; // status flag 
+    Byte Z : 1;
+    Byte I : 1;
+    Byte D : 1;
+    Byte B : 1;
+    Byte Unused : 1;
+    Byte V : 1;
+    Byte N : 1;
+
+};
@@ -0,0 +1,29 @@
+// Basic integer types shared by the 6502 emulator
+
+#pragma once
+
+using SByte = signed char;
+using Byte = unsigned char;
+using Word = unsigned short;
+
+using u32 = unsigned int;
+using s32 = signed int;
+using u64 = unsigned long long;
+using s64 = signed long long;
+
+// for the small memory and addressing helpers the dispatch loop in
+// CPU::Execute has to inline (once one is called out of line, the cycle
+// countdown it takes by reference is forced out of a register), and for the
+// rarely taken paths that must not bloat the loop instead; UNLIKELY keeps
+// such a path's test off the fall-through of the code around it
+#if defined(_MSC_VER)
+#define FORCE_INLINE __forceinline
+#define FORCE_INLINE_LAMBDA
+#define NO_INLINE __declspec(noinline)
+#define UNLIKELY(x) (x)
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#define FORCE_INLINE_LAMBDA __attribute__((always_inline))
+#define NO_INLINE __attribute__((noinline))
+#define UNLIKELY(x) __builtin_expect(!!(x), 0)
+#endif
@@ -0,0 +1,466 @@
+// 6522 VIA: two 16-bit timers, a shift register, two 8-bit ports with
+// CA1/CA2/CB1/CB2 control lines, and an IRQ output.
+//
+// Registers (repeated through the mapped range):
+//   +0 ORB/IRB   +1 ORA/IRA   +2 DDRB      +3 DDRA
+//   +4 T1C-L     +5 T1C-H     +6 T1L-L     +7 T1L-H
+//   +8 T2C-L     +9 T2C-H     +A SR        +B ACR
+//   +C PCR       +D IFR       +E IER       +F ORA/IRA without handshake
+//
+// Nothing is ticked. Each counter is kept as the value it was loaded with
+// and the cycle it was loaded at, and a read works out the current value
+// from the access time; underflows, free-running reloads, PB7 toggles and
+// shift register progress are settled the same way, in closed form, on the
+// next access. An interrupt the guest has enabled in IER is a single
+// Scheduler event at the time its flag will set, so a guest with timers
+// running costs one event per interrupt taken and nothing per cycle. A
+// timer whose interrupt is disabled is only ever looked at when read.
+//
+// Timing follows the data sheet: T1 and T2 flag N + 1 cycles after a
+// counter load of N, free-running T1 reloads from its latch every N + 2
+// cycles, and the shift register moves a bit every 2 cycles under phi2 or
+// every 2 * (T2 latch low + 2) cycles under T2. T2's pulse counting mode and
+// the shift modes clocked by CB1 have no external pulses to count unless the
+// host provides them, so those counters hold. CA2/CB2 are modelled as
+// interrupt inputs; their handshake and pulse output modes are not.
+//
+// Host-side pins (inputs, SetCA1 and friends) are for the CPU thread, with
+// Time on the bus clock (the scheduler's Now between slices). Without a
+// Scheduler the VIA still counts and can be polled, but has no IRQ line.
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+
+#include "Mem.h"
+#include "Scheduler.h"
+
+struct Via6522 : BusHandler {
+    enum : Byte {
+        IFR_CA2 = 0x01,
+        IFR_CA1 = 0x02,
+        IFR_SR = 0x04,
+        IFR_CB2 = 0x08,
+        IFR_CB1 = 0x10,
+        IFR_T2 = 0x20,
+        IFR_T1 = 0x40,
+    };
+
+    // the Scheduler IRQ line bit this VIA drives
+    u32 IrqSource = 1u << 10;
+
+    // pin levels read on bits whose DDR bit is 0
+    Byte InputA = 0xFF;
+    Byte InputB = 0xFF;
+
+    // what CB2 clocks into the shift register in the shift-in modes
+    Byte ShiftInput = 0xFF;
+
+    // Port 0 is A, 1 is B; Value is the output register masked by the DDR
+    std::function<void( u32 Port, Byte Value, u64 Time )> OnOutput;
+    // each completed shift out, except in the free-running mode
+    std::function<void( Byte Value, u64 Time )> OnShiftOut;
+
+    explicit Via6522( Scheduler* InEvents )
+        : Events(InEvents)
+    {
+    }
+
+    ~Via6522() override
+    {
+        if (Events && EventId)
+        {
+            Events->Cancel(EventId);
+        }
+        if (Events)
+        {
+            Events->ClearIRQ(IrqSource);
+        }
+    }
+
+    Byte Read( Word Address, u64 Time ) override
+    {
+        Sync(Time);
+        Byte Value = 0;
+        switch (Address & 0x0F)
+        {
+        case 0x0:
+            Value = (ORB & DDRB) | (InputB & ~DDRB);
+            if (ACR & 0x80)
+            {
+                Value = (Value & 0x7F) | (PB7 ? 0x80 : 0);
+            }
+            IFR &= ~PortFlags(false);
+            break;
+        case 0x1:
+            Value = (ORA & DDRA) | (InputA & ~DDRA);
+            IFR &= ~PortFlags(true);
+            break;
+        case 0x2: Value = DDRB; break;
+        case 0x3: Value = DDRA; break;
+        case 0x4:
+            Value = (Byte)Timer1(Time);
+            IFR &= ~IFR_T1;
+            break;
+        case 0x5: Value = (Byte)(Timer1(Time) >> 8); break;
+        case 0x6: Value = (Byte)T1Latch; break;
+        case 0x7: Value = (Byte)(T1Latch >> 8); break;
+        case 0x8:
+            Value = (Byte)Timer2(Time);
+            IFR &= ~IFR_T2;
+            break;
+        case 0x9: Value = (Byte)(Timer2(Time) >> 8); break;
+        case 0xA:
+            Value = ShiftValue(Time);
+            SR = Value;
+            StartShift(Time);
+            break;
+        case 0xB: Value = ACR; break;
+        case 0xC: Value = PCR; break;
+        case 0xD: Value = IFR | ((IFR & IER & 0x7F) ? 0x80 : 0); break;
+        case 0xE: Value = IER | 0x80; break;
+        default:  Value = (ORA & DDRA) | (InputA & ~DDRA); break;
+        }
+        UpdateIRQ(Time);
+        return Value;
+    }
+
+    void Write( Word Address, Byte Value, u64 Time ) override
+    {
+        Sync(Time);
+        switch (Address & 0x0F)
+        {
+        case 0x0:
+            ORB = Value;
+            IFR &= ~PortFlags(false);
+            Output(1, Time);
+            break;
+        case 0x1:
+            ORA = Value;
+            IFR &= ~PortFlags(true);
+            Output(0, Time);
+            break;
+        case 0x2:
+            DDRB = Value;
+            Output(1, Time);
+            break;
+        case 0x3:
+            DDRA = Value;
+            Output(0, Time);
+            break;
+        case 0x4:
+        case 0x6:
+            T1Latch = (T1Latch & 0xFF00) | Value;
+            break;
+        case 0x5:
+            T1Latch = (Word)(Value << 8 | (T1Latch & 0xFF));
+            T1Base = Time;
+            T1Value = T1Latch;
+            T1Loaded = true;
+            T1Armed = true;
+            PB7 = false;
+            IFR &= ~IFR_T1;
+            break;
+        case 0x7:
+            T1Latch = (Word)(Value << 8 | (T1Latch & 0xFF));
+            IFR &= ~IFR_T1;
+            break;
+        case 0x8:
+            T2LatchLow = Value;
+            break;
+        case 0x9:
+            T2Base = Time;
+            T2Value = (Word)(Value << 8 | T2LatchLow);
+            T2Loaded = true;
+            T2Armed = true;
+            IFR &= ~IFR_T2;
+            break;
+        case 0xA:
+            SR = Value;
+            StartShift(Time);
+            break;
+        case 0xB:
+        {
+            const Byte Before = ACR;
+            // T2 stops or starts counting with its mode; the count carries over
+            T2Value = Timer2(Time);
+            T2Base = Time;
+            ACR = Value;
+            if ((Before ^ ACR) & 0x1C)
+            {
+                Shifting = false;
+                if (ShiftMode() == 4)
+                {
+                    StartShift(Time);
+                }
+            }
+        } break;
+        case 0xC:
+            PCR = Value;
+            break;
+        case 0xD:
+            IFR &= ~Value & 0x7F;
+            break;
+        case 0xE:
+            IER = Value & 0x80 ? IER | (Value & 0x7F) : IER & ~Value;
+            break;
+        default:
+            ORA = Value;
+            Output(0, Time);
+            break;
+        }
+        UpdateIRQ(Time);
+    }
+
+    // edges on the control lines; the active edge is chosen in PCR
+    void SetCA1( bool Level, u64 Time ) { Edge(CA1, Level, PCR & 0x01, IFR_CA1, Time); }
+    void SetCB1( bool Level, u64 Time ) { Edge(CB1, Level, PCR & 0x10, IFR_CB1, Time); }
+    void SetCA2( bool Level, u64 Time )
+    {
+        Edge(CA2, Level, PCR & 0x04, (PCR & 0x08) ? 0 : IFR_CA2, Time);
+    }
+    void SetCB2( bool Level, u64 Time )
+    {
+        Edge(CB2, Level, PCR & 0x40, (PCR & 0x80) ? 0 : IFR_CB2, Time);
+    }
+
+    // current counter values, for hosts and debuggers; unlike a guest read
+    // of T1C-L / T2C-L these do not clear the interrupt flags
+    Word Timer1( u64 Time )
+    {
+        SyncTimer1(Time);
+        return Time < T1Base ? 0xFFFF : (Word)(T1Value - (Time - T1Base));
+    }
+
+    Word Timer2( u64 Time )
+    {
+        SyncTimer2(Time);
+        return Time < T2Base || (ACR & 0x20) ? T2Value : (Word)(T2Value - (Time - T2Base));
+    }
+
+private:
+    Scheduler* Events;
+
+    Byte ORA = 0, ORB = 0, DDRA = 0, DDRB = 0;
+    Byte ACR = 0, PCR = 0, IFR = 0, IER = 0;
+    bool CA1 = true, CA2 = true, CB1 = true, CB2 = true;
+
+    // counters as (value, cycle it held that value)
+    Word T1Latch = 0;
+    Word T1Value = 0;
+    u64 T1Base = 0;
+    bool T1Loaded = false;
+    bool T1Armed = false;
+    bool PB7 = false;
+
+    Byte T2LatchLow = 0;
+    Word T2Value = 0;
+    u64 T2Base = 0;
+    bool T2Loaded = false;
+    bool T2Armed = false;
+
+    Byte SR = 0;
+    bool Shifting = false;
+    u64 ShiftStart = 0;
+
+    u32 EventId = 0;
+    u64 EventAt = Scheduler::NEVER;
+
+    Byte ShiftMode() const { return ACR >> 2 & 7; }
+
+    void Sync( u64 Time )
+    {
+        SyncTimer1(Time);
+        SyncTimer2(Time);
+        SyncShift(Time);
+    }
+
+    // settles every T1 underflow up to Time
+    void SyncTimer1( u64 Time )
+    {
+        const u64 Underflow = T1Base + T1Value + 1;
+        if (!T1Loaded || Time < Underflow)
+        {
+            return;
+        }
+        if (ACR & 0x40)
+        {
+            // free-running: reload from the latch the cycle after each underflow
+            const u64 Period = (u64)T1Latch + 2;
+            const u64 Count = (Time - Underflow) / Period + 1;
+            IFR |= IFR_T1;
+            PB7 = PB7 != (Count & 1);
+            T1Base = Underflow + 1 + (Count - 1) * Period;
+            T1Value = T1Latch;
+        }
+        else
+        {
+            // one-shot: flags once, then keeps counting down through 0xFFFF
+            const u64 Count = (Time - Underflow) / 0x10000 + 1;
+            if (T1Armed)
+            {
+                IFR |= IFR_T1;
+                PB7 = true;
+                T1Armed = false;
+            }
+            T1Base = Underflow + (Count - 1) * 0x10000;
+            T1Value = 0xFFFF;
+        }
+    }
+
+    void SyncTimer2( u64 Time )
+    {
+        const u64 Underflow = T2Base + T2Value + 1;
+        if (!T2Loaded || (ACR & 0x20) || Time < Underflow)
+        {
+            return;
+        }
+        if (T2Armed)
+        {
+            IFR |= IFR_T2;
+            T2Armed = false;
+        }
+        T2Base = Underflow + (Time - Underflow) / 0x10000 * 0x10000;
+        T2Value = 0xFFFF;
+    }
+
+    // cycles per shifted bit; 0 when the clock is CB1 or shifting is off
+    u64 ShiftPeriod() const
+    {
+        switch (ShiftMode())
+        {
+        case 1: case 4: case 5: return 2 * ((u64)T2LatchLow + 2);
+        case 2: case 6:         return 2;
+        default:                return 0;
+        }
+    }
+
+    void StartShift( u64 Time )
+    {
+        IFR &= ~IFR_SR;
+        Shifting = ShiftPeriod() != 0;
+        ShiftStart = Time;
+    }
+
+    // the register after the bits shifted so far (out: rotated, in: filled
+    // from ShiftInput); never more than 8 bits for the counted modes
+    Byte ShiftValue( u64 Time ) const
+    {
+        if (!Shifting || Time < ShiftStart)
+        {
+            return SR;
+        }
+        u64 Bits = (Time - ShiftStart) / ShiftPeriod();
+        Bits = ShiftMode() == 4 ? Bits % 8 : Bits < 8 ? Bits : 8;
+        if (ShiftMode() >= 4)
+        {
+            return (Byte)(SR << Bits | SR >> (8 - Bits));
+        }
+        return Bits == 8 ? ShiftInput : (Byte)(SR << Bits | ShiftInput >> (8 - Bits));
+    }
+
+    u64 ShiftDone() const
+    {
+        return Shifting && ShiftMode() != 4 ? ShiftStart + 8 * ShiftPeriod() : Scheduler::NEVER;
+    }
+
+    void SyncShift( u64 Time )
+    {
+        const u64 Done = ShiftDone();
+        if (Time < Done)
+        {
+            return;
+        }
+        SR = ShiftValue(Time);
+        Shifting = false;
+        IFR |= IFR_SR;
+        if (ShiftMode() >= 4 && OnShiftOut)
+        {
+            OnShiftOut(SR, Done);
+        }
+    }
+
+    // the control line flags a port access clears: CA1/CB1, and CA2/CB2
+    // unless PCR puts them in an independent interrupt mode
+    Byte PortFlags( bool PortA ) const
+    {
+        if (PortA)
+        {
+            return IFR_CA1 | ((PCR & 0x0A) == 0x02 ? 0 : IFR_CA2);
+        }
+        return IFR_CB1 | ((PCR & 0xA0) == 0x20 ? 0 : IFR_CB2);
+    }
+
+    void Output( u32 Port, u64 Time )
+    {
+        if (OnOutput)
+        {
+            OnOutput(Port, Port ? ORB & DDRB : ORA & DDRA, Time);
+        }
+    }
+
+    void Edge( bool& Line, bool Level, bool Positive, Byte Flag, u64 Time )
+    {
+        if (Line != Level && Level == Positive)
+        {
+            Sync(Time);
+            IFR |= Flag;
+            UpdateIRQ(Time);
+        }
+        Line = Level;
+    }
+
+    // drives the IRQ line and keeps one event at the next time an enabled,
+    // not yet set flag will set
+    void UpdateIRQ( u64 Time )
+    {
+        if (!Events)
+        {
+            return;
+        }
+        if (IFR & IER & 0x7F)
+        {
+            Events->RaiseIRQ(IrqSource);
+        }
+        else
+        {
+            Events->ClearIRQ(IrqSource);
+        }
+
+        const Byte Waiting = IER & ~IFR;
+        u64 Next = Scheduler::NEVER;
+        if ((Waiting & IFR_T1) && T1Loaded && (T1Armed || (ACR & 0x40)))
+        {
+            Next = T1Base + T1Value + 1;
+        }
+        if ((Waiting & IFR_T2) && T2Armed && !(ACR & 0x20))
+        {
+            Next = std::min(Next, T2Base + T2Value + 1);
+        }
+        if (Waiting & IFR_SR)
+        {
+            Next = std::min(Next, ShiftDone());
+        }
+        if (Next == EventAt)
+        {
+            return;
+        }
+        if (EventId)
+        {
+            Events->Cancel(EventId);
+            EventId = 0;
+        }
+        EventAt = Next;
+        if (Next != Scheduler::NEVER)
+        {
+            EventId = Events->Schedule(Next < Time ? Time : Next, [this]( Scheduler&, u64 Now )
+            {
+                EventId = 0;
+                EventAt = Scheduler::NEVER;
+                Sync(Now);
+                UpdateIRQ(Now);
+            });
+        }
+    }
+};
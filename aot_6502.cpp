@@ -0,0 +1,597 @@
+// Ahead-of-time translator: turns a ROM image into C++ source with one native
+// function per basic block, for firmware that never modifies its own code.
+//
+// Usage: 6502aot translate <rom> <out.cpp> [--load 0x8000] [--entry 0xADDR]...
+//                          [--vectors]
+//        6502aot check <rom> <module.so> [--load 0x8000] [--entry 0xADDR]
+//                      [--cycles N] [--slice N]
+//
+// translate follows control flow from the entry points (the load address if
+// none are given, plus the NMI/reset/IRQ vectors with --vectors) and emits a
+// block for every address reached. Blocks end at branches, jumps, JSR/RTS and
+// at any opcode they cannot translate, which is then left to the
+// interpreter. Compile the output into a shared object:
+//
+//   g++ -std=c++17 -O2 -shared -fPIC -I<emulator dir> out.cpp -o rom.so
+//
+// check is the differential test: it runs the ROM under CPU::Execute and
+// under the translated module side by side and compares registers, flags,
+// cycle and instruction counts and all of memory after every slice. Memory
+// is compared through incrementally maintained state hashes, so the check
+// costs the same however small the slice (--slice 1 compares after every
+// instruction).
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Aot.h"
+#include "Opcodes.h"
+
+static bool EndsBlock( Op O )
+{
+    return (O >= Op::BEQ && O <= Op::BVC) || O == Op::JMP || O == Op::JSR || O == Op::RTS;
+}
+
+static std::string Format( const char* Fmt, ... ) __attribute__((format(printf, 1, 2)));
+static std::string Format( const char* Fmt, ... )
+{
+    char Buffer[512];
+    va_list Args;
+    va_start(Args, Fmt);
+    vsnprintf(Buffer, sizeof(Buffer), Fmt, Args);
+    va_end(Args);
+    return Buffer;
+}
+
+struct Translator {
+    static constexpr u32 MAX_BLOCK_INSTRUCTIONS = 64;
+
+    std::vector<Byte> Image;
+    Word ImageStart = 0;
+    std::set<Word> Entries;
+    bool CodePage[Mem::NUM_PAGES] = {};
+
+    bool Contains( u32 Address, u32 Size ) const
+    {
+        return Address >= ImageStart && Address + Size <= ImageStart + Image.size();
+    }
+
+    Byte At( u32 Address ) const
+    {
+        return Image[Address - ImageStart];
+    }
+
+    // walks one block from Entry; calls Visit for each translatable
+    // instruction and returns the address the block stops at
+    template <typename F>
+    Word Walk( Word Entry, F&& Visit ) const
+    {
+        Word PC = Entry;
+        for (u32 Count = 0; Count < MAX_BLOCK_INSTRUCTIONS; Count++)
+        {
+            if (!Contains(PC, 1))
+            {
+                return PC;
+            }
+            const OpInfo& Info = Ops[At(PC)];
+            const u32 Length = InstructionLength(Info.M);
+            if (Info.Operation == Op::None || !Contains(PC, Length))
+            {
+                return PC;
+            }
+            Visit(PC, Info, Length);
+            PC += Length;
+            if (EndsBlock(Info.Operation))
+            {
+                return PC;
+            }
+        }
+        return PC;
+    }
+
+    void Discover()
+    {
+        std::vector<Word> Work(Entries.begin(), Entries.end());
+        std::set<Word> Seen;
+        while (!Work.empty())
+        {
+            const Word Entry = Work.back();
+            Work.pop_back();
+            if (!Seen.insert(Entry).second)
+            {
+                continue;
+            }
+            auto Follow = [&](Word Target)
+            {
+                if (Contains(Target, 1) && !Seen.count(Target))
+                {
+                    Work.push_back(Target);
+                }
+            };
+            bool Terminated = false;
+            const Word Stop = Walk(Entry, [&](Word PC, const OpInfo& Info, u32 Length)
+            {
+                const Word Next = PC + Length;
+                const Word Operand = Length == 3 ? (Word)(At(PC + 1) | (At(PC + 2) << 8)) : 0;
+                switch (Info.Operation)
+                {
+                case Op::JMP:
+                    if (Info.M == Mode::Absolute)
+                    {
+                        Follow(Operand);
+                    }
+                    Terminated = true;
+                    break;
+                case Op::JSR:
+                    Follow(Operand);
+                    Follow(Next);
+                    Terminated = true;
+                    break;
+                case Op::RTS:
+                    Terminated = true;
+                    break;
+                default:
+                    if (Info.M == Mode::Relative)
+                    {
+                        Follow((Word)(Next + (SByte)At(PC + 1)));
+                        Follow(Next);
+                        Terminated = true;
+                    }
+                    break;
+                }
+            });
+            if (Stop != Entry)
+            {
+                Entries.insert(Entry);
+                for (u32 Page = Entry / Mem::PAGE_SIZE; Page <= (Stop - 1u) / Mem::PAGE_SIZE; Page++)
+                {
+                    CodePage[Page] = true;
+                }
+            }
+            else
+            {
+                Entries.erase(Entry);
+            }
+            if (!Terminated && Contains(Stop, 1))
+            {
+                // the interpreter runs the untranslatable opcode; an unknown
+                // one only consumes its opcode byte
+                const OpInfo& Info = Ops[At(Stop)];
+                if (Stop != Entry)
+                {
+                    Follow(Stop);
+                }
+                else if (At(Stop) != CPU::INS_BRK && At(Stop) != CPU::INS_RTI)
+                {
+                    Follow((Word)(Stop + (Info.Operation == Op::None ? 1 : InstructionLength(Info.M))));
+                }
+            }
+        }
+    }
+
+    std::string EffectiveAddress( Mode M, Word PC ) const
+    {
+        const Byte Lo = Contains(PC + 1, 1) ? At(PC + 1) : 0;
+        const Word Abs = Contains(PC + 2, 1) ? (Word)(Lo | (At(PC + 2) << 8)) : 0;
+        switch (M)
+        {
+        case Mode::ZeroPage:      return Format("        const Word EA = 0x%02X;\n", Lo);
+        case Mode::ZeroPageX:     return Format("        const Word EA = (Byte)(0x%02X + c.X); Cycles--;\n", Lo);
+        case Mode::ZeroPageY:     return Format("        const Word EA = (Byte)(0x%02X + c.Y); Cycles--;\n", Lo);
+        case Mode::ZeroPageXWide: return Format("        const Word EA = (Word)(0x%02X + c.X); Cycles--;\n", Lo);
+        case Mode::Absolute:      return Format("        const Word EA = 0x%04X;\n", Abs);
+        case Mode::AbsoluteX:
+            return Format("        const Word EA = (Word)(0x%04X + c.X); if ((EA & 0xFF00) != 0x%04X) Cycles--;\n", Abs, Abs & 0xFF00);
+        case Mode::AbsoluteY:
+            return Format("        const Word EA = (Word)(0x%04X + c.Y); if ((EA & 0xFF00) != 0x%04X) Cycles--;\n", Abs, Abs & 0xFF00);
+        case Mode::AbsoluteX5:    return Format("        const Word EA = (Word)(0x%04X + c.X); Cycles--;\n", Abs);
+        case Mode::AbsoluteY5:    return Format("        const Word EA = (Word)(0x%04X + c.Y); Cycles--;\n", Abs);
+        case Mode::IndirectX:
+            return Format("        const Word EA = c.ReadWord(Cycles, (Byte)(0x%02X + c.X), memory); Cycles--;\n", Lo);
+        case Mode::IndirectY:
+            return Format("        const Word Base = c.ReadWord(Cycles, 0x%02X, memory);\n"
+                          "        const Word EA = (Word)(Base + c.Y); if ((EA & 0xFF00) != (Base & 0xFF00)) Cycles--;\n", Lo);
+        case Mode::IndirectY6:
+            return Format("        const Word EA = (Word)(c.ReadWord(Cycles, 0x%02X, memory) + c.Y); Cycles--;\n", Lo);
+        default:
+            return "";
+        }
+    }
+
+    std::string EmitInstruction( Word PC, const OpInfo& Info, u32 Length ) const
+    {
+        const Word Next = PC + Length;
+        const Byte Lo = Length > 1 ? At(PC + 1) : 0;
+        const Word Abs = Length == 3 ? (Word)(Lo | (At(PC + 2) << 8)) : 0;
+        const bool Imm = Info.M == Mode::Immediate;
+        const std::string Value = Imm ? Format("0x%02X", Lo) : "c.ReadByte(Cycles, EA, memory)";
+        const char* StoreCheck = "        AOT_STORE(EA);\n";
+        const char* StackCheck = CodePage[1] ? "        Ctx.CodeWritten = true;\n" : "";
+
+        std::string Out = Format("    {   // %04X %s\n        Cycles -= %u;\n", PC, Info.Name, Length);
+        if (Info.M != Mode::Immediate && Info.M != Mode::Relative && Info.M != Mode::Indirect
+            && !(Info.Operation == Op::JMP || Info.Operation == Op::JSR))
+        {
+            Out += EffectiveAddress(Info.M, PC);
+        }
+
+        auto Register = [](Op O) { return O == Op::LDX || O == Op::STX || O == Op::CPX ? "c.X" : O == Op::LDY || O == Op::STY || O == Op::CPY ? "c.Y" : "c.A"; };
+        auto Shift = [](Op O) { return O == Op::ASL ? "ShiftLeft" : O == Op::LSR ? "ShiftRight" : O == Op::ROL ? "RotateLeft" : "RotateRight"; };
+
+        switch (Info.Operation)
+        {
+        case Op::LDA: case Op::LDX: case Op::LDY:
+            Out += Format("        %s = %s;\n        c.SetZeroAndNegativeFlags(%s);\n", Register(Info.Operation), Value.c_str(), Register(Info.Operation));
+            break;
+        case Op::STA: case Op::STX: case Op::STY:
+            Out += Format("        c.WriteByte(%s, Cycles, EA, memory);\n", Register(Info.Operation));
+            Out += StoreCheck;
+            break;
+        case Op::AND: Out += Format("        c.A &= %s;\n        c.SetZeroAndNegativeFlags(c.A);\n", Value.c_str()); break;
+        case Op::ORA: Out += Format("        c.A |= %s;\n        c.SetZeroAndNegativeFlags(c.A);\n", Value.c_str()); break;
+        case Op::EOR: Out += Format("        c.A ^= %s;\n        c.SetZeroAndNegativeFlags(c.A);\n", Value.c_str()); break;
+        case Op::ADC: Out += Format("        c.AddWithCarry(%s);\n", Value.c_str()); break;
+        case Op::SBC: Out += Format("        c.SubtractWithCarry(%s);\n", Value.c_str()); break;
+        case Op::CMP: case Op::CPX: case Op::CPY:
+            Out += Format("        c.CompareRegister(%s, %s);\n", Value.c_str(), Register(Info.Operation));
+            break;
+        case Op::BIT:
+            Out += "        const Byte Value = c.ReadByte(Cycles, EA, memory);\n"
+                   "        c.Flag.Z = !(c.A & Value);\n"
+                   "        c.Flag.N = (Value & CPU::NegativeFlagBit) != 0;\n"
+                   "        c.Flag.V = (Value * CPU::OverflowFlagBit) != 0;\n";
+            break;
+        case Op::INC: case Op::DEC:
+            Out += Format("        Byte Value = c.ReadByte(Cycles, EA, memory);\n"
+                          "        Value%s;\n        Cycles--;\n"
+                          "        c.WriteByte(Value, Cycles, EA, memory);\n"
+                          "        c.SetZeroAndNegativeFlags(Value);\n",
+                          Info.Operation == Op::INC || Info.Quirk ? "++" : "--");
+            Out += StoreCheck;
+            break;
+        case Op::ASL: case Op::LSR: case Op::ROL: case Op::ROR:
+            if (Info.M == Mode::Accumulator)
+            {
+                Out += Format("        c.A = c.%s(c.A, Cycles);\n", Shift(Info.Operation));
+            }
+            else
+            {
+                Out += Format("        const Byte Value = c.%s(c.ReadByte(Cycles, EA, memory), Cycles);\n"
+                              "        c.WriteByte(Value, Cycles, EA, memory);\n", Shift(Info.Operation));
+                Out += StoreCheck;
+            }
+            break;
+        case Op::TAX: Out += "        c.X = c.A;\n        Cycles--;\n        c.SetZeroAndNegativeFlags(c.X);\n"; break;
+        case Op::TAY: Out += "        c.Y = c.A;\n        Cycles--;\n        c.SetZeroAndNegativeFlags(c.Y);\n"; break;
+        case Op::TXA: Out += "        c.A = c.X;\n        Cycles--;\n        c.SetZeroAndNegativeFlags(c.A);\n"; break;
+        case Op::TYA: Out += "        c.A = c.Y;\n        Cycles--;\n        c.SetZeroAndNegativeFlags(c.A);\n"; break;
+        case Op::TSX: Out += "        c.X = c.SP;\n        Cycles--;\n        c.SetZeroAndNegativeFlags(c.X);\n"; break;
+        case Op::TXS: Out += "        c.SP = c.X;\n        Cycles--;\n"; break;
+        case Op::INX: Out += "        c.X++;\n        Cycles--;\n        c.SetZeroAndNegativeFlags(c.X);\n"; break;
+        case Op::INY: Out += "        c.Y++;\n        Cycles--;\n        c.SetZeroAndNegativeFlags(c.Y);\n"; break;
+        case Op::DEY: Out += "        c.Y--;\n        Cycles--;\n        c.SetZeroAndNegativeFlags(c.Y);\n"; break;
+        // the interpreter's DEX sets flags from Y
+        case Op::DEX: Out += "        c.X--;\n        Cycles--;\n        c.SetZeroAndNegativeFlags(c.Y);\n"; break;
+        case Op::CLC: Out += "        c.Flag.C = false;\n        Cycles--;\n"; break;
+        case Op::SEC: Out += "        c.Flag.C = true;\n        Cycles--;\n"; break;
+        case Op::CLD: Out += "        c.Flag.D = false;\n        Cycles--;\n"; break;
+        case Op::SED: Out += "        c.Flag.D = true;\n        Cycles--;\n"; break;
+        case Op::CLI: Out += "        c.Flag.I = false;\n        Cycles--;\n"; break;
+        case Op::SEI: Out += "        c.Flag.I = true;\n        Cycles--;\n"; break;
+        case Op::CLV: Out += "        c.Flag.V = false;\n        Cycles--;\n"; break;
+        case Op::NOP: Out += "        Cycles--;\n"; break;
+        case Op::PHA:
+            Out += "        c.PushByteOnToStack(Cycles, c.A, memory);\n";
+            Out += StackCheck;
+            break;
+        case Op::PHP:
+            Out += "        c.PushByteOnToStack(Cycles, c.PS | CPU::BreakFlagBit | CPU::UnusedFlagBit, memory);\n";
+            Out += StackCheck;
+            break;
+        case Op::PLA:
+            Out += "        c.A = c.PopByteFromStack(Cycles, memory);\n        c.SetZeroAndNegativeFlags(c.A);\n        Cycles--;\n";
+            break;
+        case Op::PLP:
+            Out += "        c.PS = c.PopByteFromStack(Cycles, memory);\n        c.Flag.B = false;\n        c.Flag.Unused = false;\n        Cycles--;\n";
+            break;
+        case Op::BEQ: case Op::BNE: case Op::BCS: case Op::BCC:
+        case Op::BMI: case Op::BPL: case Op::BVS: case Op::BVC:
+        {
+            static const char* const Tests[] = { "c.Flag.Z", "!c.Flag.Z", "c.Flag.C", "!c.Flag.C", "c.Flag.N", "!c.Flag.N", "c.Flag.V", "!c.Flag.V" };
+            const Word Target = (Word)(Next + (SByte)Lo);
+            const bool PageChanged = (Target >> 8) != (Next >> 8);
+            Out += Format("        if (%s) { Cycles -= %d; c.PC = 0x%04X; } else { c.PC = 0x%04X; }\n",
+                Tests[(int)Info.Operation - (int)Op::BEQ], PageChanged ? 2 : 1, Target, Next);
+        } break;
+        case Op::JMP:
+            if (Info.M == Mode::Indirect)
+            {
+                Out += Format("        c.PC = c.ReadWord(Cycles, 0x%04X, memory);\n", Abs);
+            }
+            else
+            {
+                Out += Format("        c.PC = 0x%04X;\n", Abs);
+            }
+            break;
+        case Op::JSR:
+            Out += Format("        c.PC = 0x%04X;\n        c.PushPCMinusOneToStack(Cycles, memory);\n        c.PC = 0x%04X;\n        Cycles--;\n", Next, Abs);
+            Out += StackCheck;
+            break;
+        case Op::RTS:
+            Out += "        c.PC = (Word)(c.PopWordFromStack(Cycles, memory) + 1);\n        Cycles -= 2;\n";
+            break;
+        case Op::None:
+            break;
+        }
+        Out += "    }\n";
+        return Out;
+    }
+
+    std::string EmitBlock( Word Entry, Word& End ) const
+    {
+        std::string Body;
+        u32 Count = 0;
+        bool Terminated = false;
+        const Word Stop = Walk(Entry, [&](Word PC, const OpInfo& Info, u32 Length)
+        {
+            Body += EmitInstruction(PC, Info, Length);
+            Count++;
+            if (EndsBlock(Info.Operation))
+            {
+                Terminated = true;
+                return;
+            }
+            // same stop conditions as the interpreter loop, plus stores into code
+            const bool Stores = Info.Operation == Op::STA || Info.Operation == Op::STX || Info.Operation == Op::STY
+                || Info.Operation == Op::INC || Info.Operation == Op::DEC
+                || ((Info.Operation == Op::ASL || Info.Operation == Op::LSR || Info.Operation == Op::ROL || Info.Operation == Op::ROR) && Info.M != Mode::Accumulator)
+                || (CodePage[1] && (Info.Operation == Op::PHA || Info.Operation == Op::PHP));
+            Body += Format("    if (Cycles <= 0%s) { c.PC = 0x%04X; Ctx.Retired += %u; return Cycles; }\n",
+                Stores ? " || Ctx.CodeWritten" : "", (Word)(PC + Length), Count);
+        });
+        End = Stop;
+        std::string Out = Format("static s32 Block_%04X( AotContext& Ctx, s32 Cycles )\n{\n    CPU& c = *Ctx.cpu;\n    Mem& memory = *Ctx.memory;\n    (void)memory;\n", Entry);
+        Out += Body;
+        if (Terminated)
+        {
+            Out += Format("    Ctx.Retired += %u;\n    return Cycles;\n}\n\n", Count);
+        }
+        else
+        {
+            Out += Format("    c.PC = 0x%04X;\n    Ctx.Retired += %u;\n    return Cycles;\n}\n\n", Stop, Count);
+        }
+        return Out;
+    }
+
+    bool Write( const char* Path ) const
+    {
+        FILE* File = fopen(Path, "w");
+        if (!File)
+        {
+            fprintf(stderr, "cannot write %s\n", Path);
+            return false;
+        }
+        fprintf(File, "// Generated by 6502aot from a %zu byte image at 0x%04X. Do not edit.\n\n", Image.size(), ImageStart);
+        fprintf(File, "#include \"Aot.h\"\n\n");
+
+        fprintf(File, "static const Byte Image[] = {");
+        for (size_t i = 0; i < Image.size(); i++)
+        {
+            fprintf(File, "%s0x%02X,", i % 16 ? " " : "\n    ", Image[i]);
+        }
+        fprintf(File, "\n};\n\n");
+
+        u64 Pages[Mem::NUM_PAGES / 64] = {};
+        for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+        {
+            Pages[Page / 64] |= (u64)CodePage[Page] << (Page % 64);
+        }
+        fprintf(File, "static const u64 CodePages[] = { 0x%llxull, 0x%llxull, 0x%llxull, 0x%llxull };\n",
+            (unsigned long long)Pages[0], (unsigned long long)Pages[1], (unsigned long long)Pages[2], (unsigned long long)Pages[3]);
+        fprintf(File, "#define AOT_STORE(Address) if ((CodePages[(Address) >> 14] >> (((Address) >> 8) & 63)) & 1) Ctx.CodeWritten = true\n\n");
+
+        std::vector<std::pair<Word, Word>> Ranges;
+        for (Word Entry : Entries)
+        {
+            Word End;
+            const std::string Block = EmitBlock(Entry, End);
+            fputs(Block.c_str(), File);
+            Ranges.push_back({ Entry, End });
+        }
+
+        fprintf(File, "static const AotBlock Blocks[] = {\n");
+        for (const auto& Range : Ranges)
+        {
+            fprintf(File, "    { 0x%04X, 0x%04X, Block_%04X },\n", Range.first, Range.second, Range.first);
+        }
+        fprintf(File, "};\n\n");
+        fprintf(File, "static const AotModule Module = { AOT_MODULE_VERSION, 0x%04X, %zu, Image, %zu, Blocks };\n\n",
+            ImageStart, Image.size(), Ranges.size());
+        fprintf(File, "extern \"C\" const AotModule* Aot6502Module()\n{\n    return &Module;\n}\n");
+        fclose(File);
+        return true;
+    }
+};
+
+static bool ReadFile( const char* Path, std::vector<Byte>& Data )
+{
+    FILE* File = fopen(Path, "rb");
+    if (!File)
+    {
+        fprintf(stderr, "cannot open %s\n", Path);
+        return false;
+    }
+    Byte Buffer[4096];
+    size_t Read;
+    while ((Read = fread(Buffer, 1, sizeof(Buffer), File)) > 0)
+    {
+        Data.insert(Data.end(), Buffer, Buffer + Read);
+    }
+    fclose(File);
+    return true;
+}
+
+static int Translate( const char* RomPath, const char* OutPath, Word Load, const std::vector<Word>& EntryList, bool Vectors )
+{
+    Translator T;
+    T.ImageStart = Load;
+    if (!ReadFile(RomPath, T.Image))
+    {
+        return 2;
+    }
+    if (T.Image.empty() || Load + T.Image.size() > Mem::MAX_MEM)
+    {
+        fprintf(stderr, "%s does not fit at 0x%04X\n", RomPath, Load);
+        return 2;
+    }
+    T.Entries.insert(EntryList.begin(), EntryList.end());
+    if (Vectors)
+    {
+        for (Word Vector : { 0xFFFA, 0xFFFC, 0xFFFE })
+        {
+            if (T.Contains(Vector, 2))
+            {
+                T.Entries.insert((Word)(T.At(Vector) | (T.At(Vector + 1) << 8)));
+            }
+        }
+    }
+    if (T.Entries.empty())
+    {
+        T.Entries.insert(Load);
+    }
+    T.Discover();
+    if (!T.Write(OutPath))
+    {
+        return 2;
+    }
+    printf("%zu blocks written to %s\n", T.Entries.size(), OutPath);
+    return 0;
+}
+
+// differential test: interpreter and translated module from the same state
+static int Check( const char* RomPath, const char* ModulePath, Word Load, Word Entry, u64 TotalCycles, s32 Slice )
+{
+    std::vector<Byte> Rom;
+    if (!ReadFile(RomPath, Rom))
+    {
+        return 2;
+    }
+    AotRunner Runner;
+    if (!Runner.Load(ModulePath))
+    {
+        return 2;
+    }
+
+    std::unique_ptr<Mem> Memories[2] = { std::unique_ptr<Mem>(new Mem), std::unique_ptr<Mem>(new Mem) };
+    StateHash Hashes[2];
+    CPU Cpus[2];
+    for (u32 i = 0; i < 2; i++)
+    {
+        Memories[i]->AttachHash(&Hashes[i]);
+        Cpus[i].Reset(*Memories[i]);
+        Cpus[i].PS = 0;
+        for (size_t b = 0; b < Rom.size() && Load + b < Mem::MAX_MEM; b++)
+        {
+            (*Memories[i])[(Word)(Load + b)] = Rom[b];
+        }
+        Cpus[i].PC = Entry;
+    }
+
+    double Seconds[2] = {};
+    u64 Done = 0;
+    while (Done < TotalCycles)
+    {
+        const s32 Cycles = (s32)(TotalCycles - Done < (u64)Slice ? TotalCycles - Done : Slice);
+        auto Start = std::chrono::steady_clock::now();
+        Done += Cpus[0].Execute(Cycles, *Memories[0]);
+        Seconds[0] += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+        Start = std::chrono::steady_clock::now();
+        Runner.Execute(Cpus[1], *Memories[1], Cycles);
+        Seconds[1] += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+        const CPU& I = Cpus[0];
+        const CPU& T = Cpus[1];
+        if (I.PC != T.PC || I.A != T.A || I.X != T.X || I.Y != T.Y || I.SP != T.SP || I.PS != T.PS
+            || I.Counters.Cycles != T.Counters.Cycles || I.Counters.InstructionsRetired != T.Counters.InstructionsRetired
+            || I.StateDigest(*Memories[0]) != T.StateDigest(*Memories[1]))
+        {
+            printf("MISMATCH after %llu cycles\n", (unsigned long long)Done);
+            printf("  interpreter PC=%04X A=%02X X=%02X Y=%02X SP=%02X PS=%02X cycles=%llu instructions=%llu\n",
+                I.PC, I.A, I.X, I.Y, I.SP, I.PS, (unsigned long long)I.Counters.Cycles, (unsigned long long)I.Counters.InstructionsRetired);
+            printf("  translated  PC=%04X A=%02X X=%02X Y=%02X SP=%02X PS=%02X cycles=%llu instructions=%llu\n",
+                T.PC, T.A, T.X, T.Y, T.SP, T.PS, (unsigned long long)T.Counters.Cycles, (unsigned long long)T.Counters.InstructionsRetired);
+            for (u32 Page = 0; Page < Mem::NUM_PAGES; Page++)
+            {
+                if (Hashes[0].Page(Memories[0]->Data, Page) == Hashes[1].Page(Memories[1]->Data, Page))
+                {
+                    continue;
+                }
+                for (u32 Address = Page * Mem::PAGE_SIZE; Address < (Page + 1) * Mem::PAGE_SIZE; Address++)
+                {
+                    if (Memories[0]->Data[Address] != Memories[1]->Data[Address])
+                    {
+                        printf("  first memory difference at 0x%04X: %02X vs %02X\n", Address, Memories[0]->Data[Address], Memories[1]->Data[Address]);
+                        break;
+                    }
+                }
+                break;
+            }
+            return 1;
+        }
+    }
+
+    printf("match after %llu cycles\n", (unsigned long long)Done);
+    printf("  interpreter %10.1f MHz\n", Done / Seconds[0] / 1e6);
+    printf("  translated  %10.1f MHz (%.2fx)\n", Done / Seconds[1] / 1e6, Seconds[0] / Seconds[1]);
+    printf("  %llu blocks run, %llu interpreted steps, %llu page checks, %llu pages rejected\n",
+        (unsigned long long)Runner.BlocksRun, (unsigned long long)Runner.InterpretedSteps,
+        (unsigned long long)Runner.PageChecks, (unsigned long long)Runner.PagesRejected);
+    return 0;
+}
+
+int main( int argc, char** argv )
+{
+    DefineOps();
+    const char* Command = argc > 1 ? argv[1] : "";
+    const char* Positional[2] = {};
+    int PositionalCount = 0;
+    Word Load = 0x8000;
+    std::vector<Word> EntryList;
+    bool Vectors = false;
+    u64 TotalCycles = 100000000;
+    s32 Slice = 100000;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--load") && i + 1 < argc)        Load = (Word)strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--entry") && i + 1 < argc)  EntryList.push_back((Word)strtoul(argv[++i], nullptr, 0));
+        else if (!strcmp(argv[i], "--vectors"))                Vectors = true;
+        else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) TotalCycles = strtoull(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--slice") && i + 1 < argc)  Slice = (s32)strtol(argv[++i], nullptr, 0);
+        else if (PositionalCount < 2)                          Positional[PositionalCount++] = argv[i];
+        else
+        {
+            fprintf(stderr, "unexpected argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!strcmp(Command, "translate") && PositionalCount == 2)
+    {
+        return Translate(Positional[0], Positional[1], Load, EntryList, Vectors);
+    }
+    if (!strcmp(Command, "check") && PositionalCount == 2 && Slice > 0)
+    {
+        return Check(Positional[0], Positional[1], Load, EntryList.empty() ? Load : EntryList[0], TotalCycles, Slice);
+    }
+    fprintf(stderr, "usage: %s translate <rom> <out.cpp> [--load 0x8000] [--entry 0xADDR]... [--vectors]\n"
+                    "       %s check <rom> <module.so> [--load 0x8000] [--entry 0xADDR] [--cycles N] [--slice N]\n",
+        argv[0], argv[0]);
+    return 2;
+}
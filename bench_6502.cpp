@@ -0,0 +1,1605 @@
+// Micro-benchmarks for the emulator core.
+//
+// Usage: 6502bench [scenario ...]   (all scenarios when none are given)
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Acia.h"
+#include "AsyncDevice.h"
+#include "CPU.h"
+#include "JobServer.h"
+#include "Lockstep.h"
+#include "Mapper.h"
+#include "MultiCpu.h"
+#include "Pacer.h"
+#include "SharedMem.h"
+#include "SnapshotStore.h"
+#include "Via.h"
+
+// LDX #0 / loop: TXA / STA $0200,X / STA $0300,X / INX / BNE loop / JMP *
+static const Byte FillProgram[] = {
+    0xA2, 0x00,
+    0x8A,
+    0x9D, 0x00, 0x02,
+    0x9D, 0x00, 0x03,
+    0xE8,
+    0xD0, 0xF6,
+    0x4C, 0x0C, 0x80,
+};
+static constexpr Word ProgramAddress = 0x8000;
+
+static void LoadProgram( Mem& memory, const Byte* Program, u32 Size )
+{
+    for (u32 i = 0; i < Size; i++)
+    {
+        memory[ProgramAddress + i] = Program[i];
+    }
+}
+
+static double SecondsSince( std::chrono::steady_clock::time_point Start )
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+}
+
+// short-lived instances: reset, load, run a few thousand cycles
+static void BenchReset()
+{
+    constexpr u32 Instances = 200000;
+    constexpr s32 CyclesPerInstance = 4000;
+    std::unique_ptr<Mem> memory(new Mem);
+    std::unique_ptr<Mem> Baseline(new Mem);
+    CPU cpu;
+
+    cpu.Reset(*Baseline);
+    LoadProgram(*Baseline, FillProgram, sizeof(FillProgram));
+
+    auto Report = [](const char* Name, double Seconds)
+    {
+        printf("  %-28s %10.0f instances/s\n", Name, Instances / Seconds);
+    };
+
+    // what CPU::Reset used to do: clear all 64 KB a byte at a time
+    auto Start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < Instances; i++)
+    {
+        cpu.ResetCPU();
+        volatile Byte* Data = memory->Data;
+        for (u32 Address = 0; Address < Mem::MAX_MEM; Address++)
+        {
+            Data[Address] = 0;
+        }
+        LoadProgram(*memory, FillProgram, sizeof(FillProgram));
+        cpu.PC = ProgramAddress;
+        cpu.Execute(CyclesPerInstance, *memory);
+    }
+    Report("full 64 KB clear (before)", SecondsSince(Start));
+
+    Start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < Instances; i++)
+    {
+        cpu.Reset(*memory);
+        LoadProgram(*memory, FillProgram, sizeof(FillProgram));
+        cpu.PC = ProgramAddress;
+        cpu.Execute(CyclesPerInstance, *memory);
+    }
+    Report("dirty-page clear", SecondsSince(Start));
+
+    memcpy(memory->Data, Baseline->Data, Mem::MAX_MEM);
+    memory->ClearDirtyPages();
+    Start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < Instances; i++)
+    {
+        cpu.Reset(*memory, *Baseline);
+        cpu.PC = ProgramAddress;
+        cpu.Execute(CyclesPerInstance, *memory);
+    }
+    Report("restore to baseline", SecondsSince(Start));
+}
+
+// steady-state throughput with and without a live metrics exporter
+static void BenchMetrics()
+{
+    constexpr s32 SliceCycles = 100000;
+    constexpr u32 Slices = 2000;
+    std::unique_ptr<Mem> memory(new Mem);
+    CPU cpu;
+    cpu.SkipIdleLoops = false;
+    cpu.Reset(*memory);
+    LoadProgram(*memory, FillProgram, sizeof(FillProgram));
+
+    auto Run = [&]() -> double
+    {
+        // keep re-entering the fill loop so the guest never settles in JMP *
+        const auto Start = std::chrono::steady_clock::now();
+        for (u32 i = 0; i < Slices; i++)
+        {
+            cpu.PC = ProgramAddress;
+            cpu.Execute(SliceCycles, *memory);
+        }
+        return (double)SliceCycles * Slices / SecondsSince(Start) / 1e6;
+    };
+
+    Run();
+    const double Plain = Run();
+
+    MetricsRegistry Registry;
+    MetricsExporter Exporter(Registry);
+    Exporter.IntervalMs = 10;
+    Exporter.Start();
+    cpu.Metrics = Registry.Register("bench");
+    const double Exported = Run();
+    Exporter.Stop();
+    cpu.Metrics = nullptr;
+
+    printf("  %-28s %10.1f MHz\n", "no exporter", Plain);
+    printf("  %-28s %10.1f MHz (%+.2f%%)\n", "exporter scraping at 100 Hz", Exported, (Exported / Plain - 1) * 100);
+}
+
+// steady-state throughput with and without a heat map attached
+static void BenchHeatMap()
+{
+    constexpr s32 SliceCycles = 100000;
+    constexpr u32 Slices = 2000;
+    std::unique_ptr<Mem> memory(new Mem);
+    CPU cpu;
+    cpu.SkipIdleLoops = false;
+    cpu.Reset(*memory);
+    LoadProgram(*memory, FillProgram, sizeof(FillProgram));
+
+    auto Run = [&]() -> double
+    {
+        const auto Start = std::chrono::steady_clock::now();
+        for (u32 i = 0; i < Slices; i++)
+        {
+            cpu.PC = ProgramAddress;
+            cpu.Execute(SliceCycles, *memory);
+            if (cpu.Heat)
+            {
+                cpu.Heat->Advance(SliceCycles);
+            }
+        }
+        return (double)SliceCycles * Slices / SecondsSince(Start) / 1e6;
+    };
+
+    Run();
+    const double Plain = Run();
+    printf("  %-28s %10.1f MHz\n", "no heat map", Plain);
+
+    // an exact build counts every access whatever the period
+    const u32 Periods[] = { 2000, 500 };
+    for (u32 Period : Periods)
+    {
+        AccessHeatMap Heat;
+        Heat.SamplePeriod = Period;
+        cpu.Heat = &Heat;
+        const double Mapped = Run();
+        cpu.Heat = nullptr;
+        char Label[64];
+        if (AccessHeatMap::COUNTS_BUILT_IN)
+        {
+            snprintf(Label, sizeof(Label), "exact (HEATMAP6502)");
+        }
+        else
+        {
+            snprintf(Label, sizeof(Label), "sampled every %u cycles", Period);
+        }
+        printf("  %-28s %10.1f MHz (%+.2f%%)\n", Label, Mapped, (Mapped / Plain - 1) * 100);
+        if (AccessHeatMap::COUNTS_BUILT_IN)
+        {
+            break;
+        }
+    }
+}
+
+// data-parallel kernel: same code, different zero-page data per instance
+//   LDY #0 / loop: LDA $10 / CLC / ADC $11 / STA $10 / EOR $12 / ASL A / STA $12
+//   LDA $11 / AND #$7F / ORA #$01 / STA $11 / CMP #$40 / DEY / BNE loop / JMP $8000
+static const Byte MixProgram[] = {
+    0xA0, 0x00,
+    0xA5, 0x10, 0x18, 0x65, 0x11, 0x85, 0x10, 0x45, 0x12, 0x0A, 0x85, 0x12,
+    0xA5, 0x11, 0x29, 0x7F, 0x09, 0x01, 0x85, 0x11, 0xC9, 0x40,
+    0x88,
+    0xD0, 0xE7,
+    0x4C, 0x00, 0x80,
+};
+
+// NMI handler for the fusion and lockstep checks: adds the pushed return address into $13,
+// so an interrupt taken at a different instruction boundary shows up
+//   PHA / TXA / PHA / TSX / LDA $0104,X / CLC / ADC $13 / ADC $0105,X
+//   STA $13 / PLA / TAX / PLA / RTI
+static const Byte ReturnSumHandler[] = {
+    0x48, 0x8A, 0x48, 0xBA,
+    0xBD, 0x04, 0x01, 0x18, 0x65, 0x13, 0x7D, 0x05, 0x01,
+    0x85, 0x13, 0x68, 0xAA, 0x68, 0x40,
+};
+
+// many instances of one program: scalar core vs lockstep lanes
+static void BenchLockstep()
+{
+    constexpr u32 Lanes = 32;
+    constexpr s32 Cycles = 2000000;
+    std::unique_ptr<Mem> ScalarMem[Lanes], LaneMem[Lanes];
+    Mem* LanePtrs[Lanes];
+    CPU ScalarCpu[Lanes], LaneCpu[Lanes];
+    for (u32 i = 0; i < Lanes; i++)
+    {
+        for (std::unique_ptr<Mem>* M : { &ScalarMem[i], &LaneMem[i] })
+        {
+            M->reset(new Mem);
+            (*M)->Initialize();
+            LoadProgram(**M, MixProgram, sizeof(MixProgram));
+            (**M)[0x10] = (Byte)(i * 7);
+            (**M)[0x11] = (Byte)(i * 13 + 1);
+            (**M)[0x12] = (Byte)(i * 29 + 3);
+            if (i == Lanes - 1)
+            {
+                // one lane with its zero page mirrored to page 2 must run
+                // scalar and still match
+                Mem& Remapped = **M;
+                Remapped.MapRange(0x0000, Mem::PAGE_SIZE, &Remapped.Data[0x0200], &Remapped.Data[0x0200], nullptr);
+                memcpy(&Remapped.Data[0x0200], Remapped.Data, Mem::PAGE_SIZE);
+            }
+        }
+        ScalarCpu[i].ResetCPU();
+        ScalarCpu[i].PC = ProgramAddress;
+        LaneCpu[i] = ScalarCpu[i];
+        LanePtrs[i] = LaneMem[i].get();
+    }
+
+    auto Start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < Lanes; i++)
+    {
+        ScalarCpu[i].Execute(Cycles, *ScalarMem[i]);
+    }
+    const double Scalar = (double)Cycles * Lanes / SecondsSince(Start) / 1e6;
+
+    LockstepGroup<Lanes> Group;
+    if (!Group.LANES_VECTORIZED)
+    {
+        // the lane path still runs, for its results, but cannot pay off
+        printf("  warning: built without AVX2/NEON (add -O3 -march=native); lockstep groups run scalar "
+            "by default, lanes are forced on here\n");
+        Group.UseLanes = true;
+    }
+    Start = std::chrono::steady_clock::now();
+    Group.Execute(LaneCpu, LanePtrs, Cycles);
+    const double Lockstep = (double)Cycles * Lanes / SecondsSince(Start) / 1e6;
+
+    u32 Mismatches = 0;
+    for (u32 i = 0; i < Lanes; i++)
+    {
+        const CPU& S = ScalarCpu[i];
+        const CPU& L = LaneCpu[i];
+        if (S.PC != L.PC || S.A != L.A || S.X != L.X || S.Y != L.Y || S.SP != L.SP || S.PS != L.PS
+            || S.Counters.Cycles != L.Counters.Cycles
+            || memcmp(ScalarMem[i]->Data, LaneMem[i]->Data, Mem::MAX_MEM) != 0)
+        {
+            Mismatches++;
+        }
+    }
+
+    // lanes driven by a scheduler (events, IRQ, NMI) must still end exactly
+    // where scalar runs do
+    constexpr u32 EventLanes = 4;
+    constexpr s32 EventCycles = 200000;
+    std::unique_ptr<Mem> EventMem[2][EventLanes];
+    Mem* EventPtrs[EventLanes];
+    CPU EventCpu[2][EventLanes];
+    Scheduler Clocks[2][EventLanes];
+    std::function<void(Scheduler&, u64)> Pulse = [&Pulse](Scheduler& S, u64 When)
+    {
+        S.TriggerNMI();
+        S.Schedule(When + 997, Pulse);
+    };
+    for (u32 Run = 0; Run < 2; Run++)
+    {
+        for (u32 i = 0; i < EventLanes; i++)
+        {
+            EventMem[Run][i].reset(new Mem);
+            Mem& memory = *EventMem[Run][i];
+            memory.Initialize();
+            LoadProgram(memory, MixProgram, sizeof(MixProgram));
+            memory[0x10] = (Byte)(i * 7);
+            memory[0x11] = (Byte)(i * 13 + 1);
+            memory[0x12] = (Byte)(i * 29 + 3);
+            for (u32 b = 0; b < sizeof(ReturnSumHandler); b++)
+            {
+                memory[0x9000 + b] = ReturnSumHandler[b];
+            }
+            memory[0xFFFA] = 0x00;
+            memory[0xFFFB] = 0x90;
+            CPU& cpu = EventCpu[Run][i];
+            cpu.ResetCPU();
+            cpu.PC = ProgramAddress;
+            cpu.Events = &Clocks[Run][i];
+            Clocks[Run][i].Schedule(997, Pulse);
+            if (Run == 1)
+            {
+                EventPtrs[i] = &memory;
+            }
+        }
+    }
+    for (u32 i = 0; i < EventLanes; i++)
+    {
+        EventCpu[0][i].Execute(EventCycles, *EventMem[0][i]);
+    }
+    LockstepGroup<EventLanes> EventGroup;
+    EventGroup.UseLanes = true;
+    EventGroup.Execute(EventCpu[1], EventPtrs, EventCycles);
+    u32 EventMismatches = 0;
+    for (u32 i = 0; i < EventLanes; i++)
+    {
+        const CPU& S = EventCpu[0][i];
+        const CPU& L = EventCpu[1][i];
+        if (S.PC != L.PC || S.A != L.A || S.X != L.X || S.Y != L.Y || S.SP != L.SP || S.PS != L.PS
+            || S.Counters.Cycles != L.Counters.Cycles || S.Counters.InterruptsTaken != L.Counters.InterruptsTaken
+            || Clocks[0][i].Now != Clocks[1][i].Now
+            || memcmp(EventMem[0][i]->Data, EventMem[1][i]->Data, Mem::MAX_MEM) != 0)
+        {
+            EventMismatches++;
+        }
+    }
+
+    printf("  %-28s %10.1f MHz aggregate\n", "scalar, 32 instances", Scalar);
+    printf("  %-28s %10.1f MHz aggregate (%.2fx)\n", "lockstep, 32 lanes", Lockstep, Lockstep / Scalar);
+    printf("  %llu lane-wise steps, %llu scalar steps, %llu lanes split, %u state mismatches\n",
+        (unsigned long long)Group.VectorSteps, (unsigned long long)Group.ScalarSteps,
+        (unsigned long long)Group.SplitLanes, Mismatches);
+    printf("  %u lanes with an NMI every 997 cycles, %llu NMIs each, %u state mismatches\n", EventLanes,
+        (unsigned long long)EventCpu[1][0].Counters.InterruptsTaken, EventMismatches);
+}
+
+// copy loop made of the idioms CPU::Execute fuses
+//   LDX #0 / LDY #0 / loop: LDA ($20),Y / STA ($22),Y / INY / CLC / ADC #1
+//   CMP #$40 / BNE skip / LDA #0 / skip: DEX / BNE loop / JMP $8000
+static const Byte FusionProgram[] = {
+    0xA2, 0x00,
+    0xA0, 0x00,
+    0xB1, 0x20, 0x91, 0x22, 0xC8,
+    0x18, 0x69, 0x01,
+    0xC9, 0x40, 0xD0, 0x02, 0xA9, 0x00,
+    0xCA, 0xD0, 0xEF,
+    0x4C, 0x00, 0x80,
+};
+
+// superinstructions on and off, same program and budget
+static void BenchFusion()
+{
+    constexpr s32 SliceCycles = 100000;
+    constexpr u32 Slices = 2000;
+    std::unique_ptr<Mem> Memories[2];
+    CPU Cpus[2];
+    double MHz[2];
+    for (u32 Run = 0; Run < 2; Run++)
+    {
+        Memories[Run].reset(new Mem);
+        Mem& memory = *Memories[Run];
+        CPU& cpu = Cpus[Run];
+        cpu.Reset(memory);
+        cpu.PS = 0;
+        LoadProgram(memory, FusionProgram, sizeof(FusionProgram));
+        memory[0x20] = 0x00; memory[0x21] = 0x03;
+        memory[0x22] = 0x00; memory[0x23] = 0x04;
+        cpu.PC = ProgramAddress;
+        cpu.FuseInstructions = Run == 1;
+
+        const auto Start = std::chrono::steady_clock::now();
+        for (u32 i = 0; i < Slices; i++)
+        {
+            cpu.Execute(SliceCycles, memory);
+        }
+        MHz[Run] = (double)SliceCycles * Slices / SecondsSince(Start) / 1e6;
+    }
+
+    const CPU& Plain = Cpus[0];
+    const CPU& Fused = Cpus[1];
+    const bool Same = Plain.PC == Fused.PC && Plain.A == Fused.A && Plain.X == Fused.X && Plain.Y == Fused.Y
+        && Plain.PS == Fused.PS && Plain.Counters.Cycles == Fused.Counters.Cycles
+        && Plain.Counters.InstructionsRetired == Fused.Counters.InstructionsRetired
+        && memcmp(Memories[0]->Data, Memories[1]->Data, Mem::MAX_MEM) == 0;
+
+    // NMIs every 997 cycles fall inside fused sequences too; each must be
+    // taken at the same instruction boundary as without fusion
+    std::unique_ptr<Mem> Interrupted[2];
+    CPU Targets[2];
+    Scheduler Clocks[2];
+    for (u32 Run = 0; Run < 2; Run++)
+    {
+        Interrupted[Run].reset(new Mem);
+        Mem& memory = *Interrupted[Run];
+        CPU& cpu = Targets[Run];
+        cpu.Reset(memory);
+        cpu.PS = 0;
+        LoadProgram(memory, FusionProgram, sizeof(FusionProgram));
+        memory[0x20] = 0x00; memory[0x21] = 0x03;
+        memory[0x22] = 0x00; memory[0x23] = 0x04;
+        for (u32 i = 0; i < sizeof(ReturnSumHandler); i++)
+        {
+            memory[0x9000 + i] = ReturnSumHandler[i];
+        }
+        memory[0xFFFA] = 0x00;
+        memory[0xFFFB] = 0x90;
+        cpu.PC = ProgramAddress;
+        cpu.FuseInstructions = Run == 1;
+        cpu.Events = &Clocks[Run];
+        std::function<void(Scheduler&, u64)> Pulse = [&Pulse](Scheduler& S, u64 When)
+        {
+            S.TriggerNMI();
+            S.Schedule(When + 997, Pulse);
+        };
+        Clocks[Run].Schedule(997, Pulse);
+        for (u32 i = 0; i < Slices / 10; i++)
+        {
+            cpu.Execute(SliceCycles, memory);
+        }
+    }
+    const bool SameWithEvents = Targets[0].PC == Targets[1].PC && Targets[0].A == Targets[1].A
+        && Targets[0].X == Targets[1].X && Targets[0].Y == Targets[1].Y && Targets[0].PS == Targets[1].PS
+        && Targets[0].SP == Targets[1].SP && Targets[0].Counters.Cycles == Targets[1].Counters.Cycles
+        && Targets[0].Counters.InterruptsTaken == Targets[1].Counters.InterruptsTaken
+        && memcmp(Interrupted[0]->Data, Interrupted[1]->Data, Mem::MAX_MEM) == 0;
+
+    printf("  %-28s %10.1f MHz\n", "unfused", MHz[0]);
+    printf("  %-28s %10.1f MHz (%.2fx), state %s\n", "fused", MHz[1], MHz[1] / MHz[0], Same ? "identical" : "DIFFERS");
+    printf("  %-28s %10llu NMIs, state %s\n", "fused, NMI every 997 cycles",
+        (unsigned long long)Targets[1].Counters.InterruptsTaken, SameWithEvents ? "identical" : "DIFFERS");
+    for (u32 Kind = 0; Kind < FUSION_KINDS; Kind++)
+    {
+        printf("  %-28s %10llu fused %10llu unfused\n", FusionCounters::Name(Kind),
+            (unsigned long long)Fused.Fusion.Fused[Kind], (unsigned long long)Fused.Fusion.Unfused[Kind]);
+    }
+}
+
+// polling loop woken by a timer event, which also raises an NMI
+//   loop: LDA $10 / BEQ loop / LDA #0 / STA $10 / INC $11 / JMP loop
+//   NMI at $9000: INC $12 / RTI
+static const Byte PollProgram[] = {
+    0xA5, 0x10, 0xF0, 0xFC,
+    0xA9, 0x00, 0x85, 0x10,
+    0xE6, 0x11,
+    0x4C, 0x00, 0x80,
+};
+static const Byte NmiHandler[] = { 0xE6, 0x12, 0x40 };
+
+// idle-loop fast-forward on and off: same events, same end state
+static void BenchIdle()
+{
+    constexpr s32 SliceCycles = 100000;
+    constexpr u32 Slices = 2000;
+    constexpr u64 Period = 20000;
+    std::unique_ptr<Mem> Memories[2];
+    CPU Cpus[2];
+    Scheduler Clocks[2];
+    double Seconds[2];
+    for (u32 Run = 0; Run < 2; Run++)
+    {
+        Memories[Run].reset(new Mem);
+        Mem& memory = *Memories[Run];
+        CPU& cpu = Cpus[Run];
+        Scheduler& Clock = Clocks[Run];
+        cpu.Reset(memory);
+        cpu.PS = 0;
+        LoadProgram(memory, PollProgram, sizeof(PollProgram));
+        for (u32 i = 0; i < sizeof(NmiHandler); i++)
+        {
+            memory[0x9000 + i] = NmiHandler[i];
+        }
+        memory[0xFFFA] = 0x00;
+        memory[0xFFFB] = 0x90;
+        cpu.PC = ProgramAddress;
+        cpu.Events = &Clock;
+        cpu.SkipIdleLoops = Run == 1;
+
+        // the "device": sets the flag the guest polls and pulses NMI
+        std::function<void(Scheduler&, u64)> Tick = [&memory, &Tick](Scheduler& S, u64 When)
+        {
+            memory[0x10] = 1;
+            S.TriggerNMI();
+            S.Schedule(When + Period, Tick);
+        };
+        Clock.Schedule(Period, Tick);
+
+        const auto Start = std::chrono::steady_clock::now();
+        for (u32 i = 0; i < Slices; i++)
+        {
+            cpu.Execute(SliceCycles, memory);
+        }
+        Seconds[Run] = SecondsSince(Start);
+    }
+
+    const CPU& Plain = Cpus[0];
+    const CPU& Skip = Cpus[1];
+    const bool Same = Plain.PC == Skip.PC && Plain.A == Skip.A && Plain.X == Skip.X && Plain.Y == Skip.Y
+        && Plain.PS == Skip.PS && Plain.SP == Skip.SP && Plain.Counters.Cycles == Skip.Counters.Cycles
+        && Plain.Counters.InstructionsRetired == Skip.Counters.InstructionsRetired
+        && Plain.Counters.InterruptsTaken == Skip.Counters.InterruptsTaken
+        && memcmp(Memories[0]->Data, Memories[1]->Data, Mem::MAX_MEM) == 0;
+
+    const double Emulated = (double)SliceCycles * Slices;
+    printf("  %-28s %10.1f MHz\n", "spinning", Emulated / Seconds[0] / 1e6);
+    printf("  %-28s %10.1f MHz (%.0fx less host time), state %s\n", "fast-forwarded", Emulated / Seconds[1] / 1e6,
+        Seconds[0] / Seconds[1], Same ? "identical" : "DIFFERS");
+    printf("  %llu interrupts, %.1f%% of cycles skipped\n", (unsigned long long)Skip.Counters.InterruptsTaken,
+        100.0 * Skip.Counters.IdleCyclesSkipped / Skip.Counters.Cycles);
+}
+
+// block copy through a guest library routine, 64 calls of 256 bytes
+//   loop: LDA #$80 / STA $F0 / LDA #$20 / STA $F1 / LDA #0 / STA $F2 / LDA #$30 / STA $F3
+//   LDY #0 / JSR $9000 / DEC $10 / BNE loop / JMP *
+//   copy at $9000: DEY / LDA ($F0),Y / STA ($F2),Y / TYA / BNE copy / RTS
+static const Byte CopyCaller[] = {
+    0xA9, 0x40, 0x85, 0x10,
+    0xA9, 0x80, 0x85, 0xF0, 0xA9, 0x20, 0x85, 0xF1,
+    0xA9, 0x00, 0x85, 0xF2, 0xA9, 0x30, 0x85, 0xF3,
+    0xA0, 0x00, 0x20, 0x00, 0x90,
+    0xC6, 0x10, 0xD0, 0xE7,
+    0x4C, 0x1D, 0x80,
+};
+static constexpr Word CopyCallerEnd = 0x801D;
+static constexpr Word CopyRoutine = 0x9000;
+static const Byte CopyRoutineCode[] = { 0x88, 0xB1, 0xF0, 0x91, 0xF2, 0x98, 0xD0, 0xF8, 0x60 };
+
+// native twin of the copy routine, including its cycle cost
+static HleCost NativeCopy( CPU& cpu, Mem& memory )
+{
+    const Word Source = memory.Data[0xF0] | (memory.Data[0xF1] << 8);
+    const Word Dest = memory.Data[0xF2] | (memory.Data[0xF3] << 8);
+    const u32 Count = cpu.Y ? cpu.Y : 256;
+    for (u32 i = Count; i-- > 0;)
+    {
+        memory[(Word)(Dest + i)] = memory.Data[(Word)(Source + i)];
+    }
+    // LDA ($F0),Y pays a cycle whenever Source + Y leaves Source's page
+    const u32 FirstCrossing = 256 - (Source & 0xFF);
+    const u32 Crossings = Count > FirstCrossing ? Count - FirstCrossing : 0;
+    cpu.A = 0;
+    cpu.Y = 0;
+    cpu.Flag.Z = true;
+    cpu.Flag.N = false;
+    return { 18 * Count - 1 + Crossings, 5 * Count };
+}
+
+// guest copy routine interpreted, trapped, and trapped with validation
+static void BenchHle()
+{
+    constexpr u32 Rounds = 300;
+    static const char* const Names[] = { "interpreted", "native trap", "native trap, validated" };
+    std::unique_ptr<Mem> Memories[3];
+    CPU Cpus[3];
+    HleTable Tables[3];
+    double Seconds[3];
+    for (u32 Run = 0; Run < 3; Run++)
+    {
+        Memories[Run].reset(new Mem);
+        Mem& memory = *Memories[Run];
+        CPU& cpu = Cpus[Run];
+        cpu.Reset(memory);
+        cpu.PS = 0;
+        LoadProgram(memory, CopyCaller, sizeof(CopyCaller));
+        for (u32 i = 0; i < sizeof(CopyRoutineCode); i++)
+        {
+            memory[CopyRoutine + i] = CopyRoutineCode[i];
+        }
+        for (u32 i = 0; i < 0x200; i++)
+        {
+            memory[0x2000 + i] = (Byte)(i * 7 + 3);
+        }
+        cpu.TrapPC = CopyCallerEnd;
+        if (Run > 0)
+        {
+            Tables[Run].Register(CopyRoutine, "copy", NativeCopy);
+            Tables[Run].Validate = Run == 2;
+            cpu.Traps = &Tables[Run];
+        }
+
+        const auto Start = std::chrono::steady_clock::now();
+        for (u32 Round = 0; Round < (Run == 2 ? 1 : Rounds); Round++)
+        {
+            cpu.PC = ProgramAddress;
+            while (cpu.PC != CopyCallerEnd)
+            {
+                cpu.Execute(100000, memory);
+            }
+        }
+        Seconds[Run] = SecondsSince(Start);
+    }
+
+    const CPU& Plain = Cpus[0];
+    const CPU& Trapped = Cpus[1];
+    const bool Same = Plain.A == Trapped.A && Plain.X == Trapped.X && Plain.Y == Trapped.Y
+        && Plain.PS == Trapped.PS && Plain.SP == Trapped.SP && Plain.Counters.Cycles == Trapped.Counters.Cycles
+        && Plain.Counters.InstructionsRetired == Trapped.Counters.InstructionsRetired
+        && memcmp(Memories[0]->Data, Memories[1]->Data, Mem::MAX_MEM) == 0;
+    for (u32 Run = 0; Run < 2; Run++)
+    {
+        printf("  %-28s %10.1f MHz\n", Names[Run], Cpus[Run].Counters.Cycles / Seconds[Run] / 1e6);
+    }
+    printf("  %.0fx less host time, state %s; %llu of %llu validated calls mismatched\n", Seconds[0] / Seconds[1],
+        Same ? "identical" : "DIFFERS", (unsigned long long)Tables[2].Mismatches, (unsigned long long)Tables[2].Calls);
+}
+
+// UxROM-style banking, one switch per loop iteration
+//   fixed bank at $C100: LDX #0 / loop: TXA / AND #7 / STA $FFF0 / JSR $8000 / INX / JMP loop
+//   every bank at offset 0: INC $02nn / RTS
+static const Byte BankingProgram[] = {
+    0xA2, 0x00,
+    0x8A, 0x29, 0x07, 0x8D, 0xF0, 0xFF,
+    0x20, 0x00, 0x80,
+    0xE8,
+    0x4C, 0x02, 0xC1,
+};
+static constexpr u32 BankCount = 8;
+
+// the old way to switch banks: copy the new bank into the flat array
+struct CopyingUxrom : BusHandler {
+    const std::vector<Byte>* Rom = nullptr;
+    Mem* Memory = nullptr;
+
+    Byte Read( Word, u64 ) override { return 0xFF; }
+
+    void Write( Word, Byte Value, u64 ) override
+    {
+        memcpy(&Memory->Data[0x8000], &(*Rom)[(Value % BankCount) * 0x4000u], 0x4000);
+    }
+};
+
+// bank switches through the page table vs copying each bank into place
+static void BenchBanking()
+{
+    constexpr s32 SliceCycles = 100000;
+    constexpr u32 Slices = 300;
+    UxromMapper Uxrom;
+    Uxrom.Rom.assign(BankCount * 0x4000, 0xFF);
+    for (u32 Bank = 0; Bank < BankCount; Bank++)
+    {
+        const Byte Routine[] = { 0xEE, (Byte)Bank, 0x02, 0x60 };
+        memcpy(&Uxrom.Rom[Bank * 0x4000], Routine, sizeof(Routine));
+    }
+    memcpy(&Uxrom.Rom[(BankCount - 1) * 0x4000 + 0x100], BankingProgram, sizeof(BankingProgram));
+    const std::vector<Byte> Rom = Uxrom.Rom;
+
+    std::unique_ptr<Mem> Memories[2];
+    CPU Cpus[2];
+    CopyingUxrom Copier;
+    double Seconds[2];
+    for (u32 Run = 0; Run < 2; Run++)
+    {
+        Memories[Run].reset(new Mem);
+        Mem& memory = *Memories[Run];
+        CPU& cpu = Cpus[Run];
+        cpu.Reset(memory);
+        cpu.PS = 0;
+        if (Run == 0)
+        {
+            Copier.Rom = &Rom;
+            Copier.Memory = &memory;
+            memcpy(&memory.Data[0x8000], &Rom[0], 0x4000);
+            memcpy(&memory.Data[0xC000], &Rom[(BankCount - 1) * 0x4000], 0x4000);
+            memory.MapRange(0x8000, 0x8000, &memory.Data[0x8000], nullptr, &Copier);
+        }
+        else
+        {
+            Uxrom.Attach(memory);
+        }
+        cpu.PC = 0xC100;
+
+        const auto Start = std::chrono::steady_clock::now();
+        for (u32 i = 0; i < Slices; i++)
+        {
+            cpu.Execute(SliceCycles, memory);
+        }
+        Seconds[Run] = SecondsSince(Start);
+    }
+
+    const bool Same = Cpus[0].PC == Cpus[1].PC && Cpus[0].Counters.Cycles == Cpus[1].Counters.Cycles
+        && memcmp(&Memories[0]->Data[0x200], &Memories[1]->Data[0x200], BankCount) == 0;
+    const double Emulated = (double)SliceCycles * Slices;
+    printf("  %-28s %10.1f MHz\n", "memcpy per switch", Emulated / Seconds[0] / 1e6);
+    printf("  %-28s %10.1f MHz (%.0fx), %.1fM switches/s, state %s\n", "page-table switch", Emulated / Seconds[1] / 1e6,
+        Seconds[0] / Seconds[1], Uxrom.BankSwitches / Seconds[1] / 1e6, Same ? "identical" : "DIFFERS");
+}
+
+// per CPU: loop: LDY #0 / outer: LDX #0 / spin: INX / BNE spin / INY / BNE outer /
+//          INC $04nn / JMP loop (one store to its shared slot every ~330k cycles)
+static const Byte SharedCounterProgram[] = {
+    0xA0, 0x00,
+    0xA2, 0x00,
+    0xE8,
+    0xD0, 0xFD,
+    0xC8,
+    0xD0, 0xF8,
+    0xEE, 0x00, 0x04,
+    0x4C, 0x00, 0x80,
+};
+static constexpr u32 SharedSlotOperand = 11;
+
+static void BuildSharedCounters( MultiCpuSystem& System, u32 Count )
+{
+    System.AddShared(0x0400, 0x100);
+    for (u32 i = 0; i < Count; i++)
+    {
+        MultiCpuSystem::Node& Node = System.Cpu(System.AddCpu());
+        Node.cpu.Reset(*Node.memory);
+        Node.cpu.PS = 0;
+        LoadProgram(*Node.memory, SharedCounterProgram, sizeof(SharedCounterProgram));
+        (*Node.memory)[ProgramAddress + SharedSlotOperand] = (Byte)i;
+        Node.cpu.PC = ProgramAddress;
+    }
+}
+
+// CPUs on a shared bus, one host thread each vs all on one thread
+static void BenchMultiCpu()
+{
+    constexpr u64 CyclesPerCpu = 40000000;
+    double Baseline = 0.0;
+    for (u32 Count : { 1u, 2u, 4u })
+    {
+        MultiCpuSystem Systems[2];
+        double Seconds[2];
+        for (u32 Run = 0; Run < 2; Run++)
+        {
+            BuildSharedCounters(Systems[Run], Count);
+            Systems[Run].Parallel = Run == 1;
+            const auto Start = std::chrono::steady_clock::now();
+            Systems[Run].Run(CyclesPerCpu);
+            Seconds[Run] = SecondsSince(Start);
+        }
+
+        bool Same = true;
+        for (u32 i = 0; i < Count; i++)
+        {
+            const MultiCpuSystem::Node& L = Systems[0].Cpu(i);
+            const MultiCpuSystem::Node& R = Systems[1].Cpu(i);
+            Same = Same && L.cpu.PC == R.cpu.PC && L.cpu.X == R.cpu.X && L.cpu.Y == R.cpu.Y && L.Time == R.Time
+                && Systems[0].ReadShared(0x0400 + i) == Systems[1].ReadShared(0x0400 + i);
+        }
+        const double Sequential = Count * (double)CyclesPerCpu / Seconds[0] / 1e6;
+        const double Parallel = Count * (double)CyclesPerCpu / Seconds[1] / 1e6;
+        if (Count == 1)
+        {
+            Baseline = Sequential;
+        }
+        printf("  %u CPU%s %-21s %10.1f MHz aggregate (%.2fx)\n", Count, Count == 1 ? " " : "s", "one thread",
+            Sequential, Sequential / Baseline);
+        printf("  %u CPU%s %-21s %10.1f MHz aggregate (%.2fx), %llu barriers, state %s\n", Count,
+            Count == 1 ? " " : "s", "thread each", Parallel, Parallel / Baseline,
+            (unsigned long long)Systems[1].Barriers, Same ? "identical" : "DIFFERS");
+    }
+    printf("  (%u host threads available)\n", std::thread::hardware_concurrency());
+}
+
+// a square-wave voice with a smoothing filter, one sample every 23 cycles
+// (44.1 kHz at 1 MHz); registers: 0 period lo, 1 period hi, 2 volume
+struct ToneSynth {
+    static constexpr u32 CYCLES_PER_SAMPLE = 23;
+    static constexpr u32 TAPS = 64;
+
+    Word Period = 100;
+    Byte Volume = 15;
+    u64 Clock = 0;
+    u32 Phase = 0;
+    float History[TAPS] = {};
+    u32 Cursor = 0;
+    u64 Samples = 0;
+    double Checksum = 0.0;
+
+    void Run( u64 Until )
+    {
+        for (; Clock + CYCLES_PER_SAMPLE <= Until; Clock += CYCLES_PER_SAMPLE)
+        {
+            Phase = (Phase + CYCLES_PER_SAMPLE) % (2u * Period + 2);
+            History[Cursor++ % TAPS] = Phase <= Period ? Volume : -(float)Volume;
+            float Sum = 0.0f;
+            for (u32 i = 0; i < TAPS; i++)
+            {
+                Sum += History[i] * (1.0f + i) / TAPS;
+            }
+            Checksum += Sum;
+            Samples++;
+        }
+    }
+
+    void Write( Word Address, Byte Value )
+    {
+        switch (Address & 3)
+        {
+        case 0: Period = (Period & 0xFF00) | Value; break;
+        case 1: Period = (Period & 0x00FF) | (Value << 8); break;
+        case 2: Volume = Value & 15; break;
+        }
+    }
+};
+
+// the synthesizer run inline on the CPU thread
+struct InlineTone : BusHandler {
+    ToneSynth Synth;
+    Byte Read( Word, u64 ) override { return 0xFF; }
+    void Write( Word Address, Byte Value, u64 Time ) override
+    {
+        Synth.Run(Time);
+        Synth.Write(Address, Value);
+    }
+};
+
+// the same synthesizer on a device thread
+struct AsyncTone : AsyncDevice {
+    ToneSynth Synth;
+    AsyncTone() : AsyncDevice(0xD000, 4) {}
+    ~AsyncTone() override { Stop(); }
+
+protected:
+    void CatchUp( u64 Cycle ) override { Synth.Run(Cycle); }
+    void OnWrite( Word Address, Byte Value, u64 ) override { Synth.Write(Address, Value); }
+};
+
+// loop: INX / STX $D000 / LDY #20 / wait: DEY / BNE wait / JMP loop
+static const Byte TonePokeProgram[] = {
+    0xE8,
+    0x8E, 0x00, 0xD0,
+    0xA0, 0x14,
+    0x88,
+    0xD0, 0xFD,
+    0x4C, 0x00, 0x80,
+};
+
+static double ThreadSeconds()
+{
+    timespec Now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Now);
+    return Now.tv_sec + Now.tv_nsec / 1e9;
+}
+
+// a sample-generating device run inline vs on its own thread
+static void BenchAsyncDevice()
+{
+    constexpr s32 SliceCycles = 100000;
+    constexpr u32 Slices = 200;
+    InlineTone Inline;
+    AsyncTone Async;
+    BusHandler* Devices[2] = { &Inline, &Async };
+    double Busy[2];
+    double Wall[2];
+    for (u32 Run = 0; Run < 2; Run++)
+    {
+        std::unique_ptr<Mem> memory(new Mem);
+        CPU cpu;
+        cpu.Reset(*memory);
+        cpu.PS = 0;
+        LoadProgram(*memory, TonePokeProgram, sizeof(TonePokeProgram));
+        memory->MapRange(0xD000, 0x100, nullptr, nullptr, Devices[Run]);
+        cpu.PC = ProgramAddress;
+        if (Run == 1)
+        {
+            Async.Start();
+        }
+
+        const auto Start = std::chrono::steady_clock::now();
+        const double StartBusy = ThreadSeconds();
+        for (u32 i = 0; i < Slices; i++)
+        {
+            cpu.Execute(SliceCycles, *memory);
+            if (Run == 1)
+            {
+                Async.Sync(memory->SliceEnd);
+            }
+        }
+        Busy[Run] = ThreadSeconds() - StartBusy;
+        if (Run == 0)
+        {
+            Inline.Synth.Run(memory->SliceEnd);
+        }
+        else
+        {
+            Async.WaitFor(memory->SliceEnd);
+            Async.Stop();
+        }
+        Wall[Run] = SecondsSince(Start);
+    }
+
+    const double Emulated = (double)SliceCycles * Slices;
+    const bool Same = Inline.Synth.Samples == Async.Synth.Samples && Inline.Synth.Checksum == Async.Synth.Checksum;
+    printf("  %-28s %10.1f MHz on the CPU thread, %.1f MHz to finished output\n", "inline device",
+        Emulated / Busy[0] / 1e6, Emulated / Wall[0] / 1e6);
+    printf("  %-28s %10.1f MHz on the CPU thread, %.1f MHz to finished output\n", "device thread",
+        Emulated / Busy[1] / 1e6, Emulated / Wall[1] / 1e6);
+    printf("  %llu stores posted, %llu stalls, %llu samples, output %s\n", (unsigned long long)Async.Posted,
+        (unsigned long long)Async.Stalls, (unsigned long long)Async.Synth.Samples, Same ? "identical" : "DIFFERS");
+}
+
+// console output: LDY #0 / wait: LDA $D001 / AND #$10 / BEQ wait / TYA /
+// STA $D000 / INY / JMP wait
+static const Byte ConsoleProgram[] = {
+    0xA0, 0x00,
+    0xAD, 0x01, 0xD0,
+    0x29, 0x10,
+    0xF0, 0xF9,
+    0x98,
+    0x8D, 0x00, 0xD0,
+    0xC8,
+    0x4C, 0x02, 0x80,
+};
+
+// interrupt-driven echo: enable the receive IRQ, CLI, JMP * and a handler
+// at $8010 that sends back what it reads
+static const Byte EchoProgram[] = {
+    0xA9, 0x09,
+    0x8D, 0x02, 0xD0,
+    0x58,
+    0x4C, 0x06, 0x80,
+};
+static const Byte EchoHandler[] = {
+    0x48,
+    0xAD, 0x00, 0xD0,
+    0x8D, 0x00, 0xD0,
+    0x68,
+    0x40,
+};
+
+// the obvious serial port: one write() per byte stored, up to Left bytes
+struct WritePerByte : BusHandler {
+    int Fd = -1;
+    u64 Left = 0;
+    Byte Read( Word Address, u64 ) override { return (Address & 3) == 1 ? 0x10 : 0; }
+    void Write( Word Address, Byte Value, u64 ) override
+    {
+        if ((Address & 3) == 0 && Left > 0 && write(Fd, &Value, 1) == 1)
+        {
+            Left--;
+        }
+    }
+};
+
+// reads Total bytes from Fd, checking they count up from 0 mod 256
+static void DrainConsole( int Fd, u64 Total, std::atomic<u64>& Received, u64& Reads, u64& Errors )
+{
+    std::vector<Byte> Buffer(1 << 16);
+    while (Received.load(std::memory_order_relaxed) < Total)
+    {
+        const ssize_t Got = read(Fd, Buffer.data(), Buffer.size());
+        if (Got <= 0)
+        {
+            break;
+        }
+        const u64 At = Received.load(std::memory_order_relaxed);
+        for (ssize_t i = 0; i < Got; i++)
+        {
+            Errors += Buffer[i] != (Byte)(At + i);
+        }
+        Reads++;
+        Received.store(At + Got, std::memory_order_release);
+    }
+}
+
+// bulk guest console output through the ACIA vs a syscall per byte, then
+// interrupt-driven echo round trips through the same path
+static void BenchSerial()
+{
+    constexpr u64 Bulk = 32ull << 20;
+    constexpr u64 Naive = 1ull << 20;
+    constexpr u32 Pings = 2000;
+
+    for (u32 Run = 0; Run < 2; Run++)
+    {
+        int Pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pair) != 0)
+        {
+            perror("socketpair");
+            return;
+        }
+        const u64 Total = Run == 0 ? Naive : Bulk;
+        std::unique_ptr<Mem> memory(new Mem);
+        CPU cpu;
+        Scheduler Events;
+        cpu.Events = &Events;
+        cpu.Reset(*memory);
+        cpu.PS = 0;
+        LoadProgram(*memory, ConsoleProgram, sizeof(ConsoleProgram));
+        cpu.PC = ProgramAddress;
+
+        WritePerByte Direct;
+        Direct.Fd = Pair[0];
+        Direct.Left = Total;
+        SerialHost Host;
+        Acia6551 Port(&Host, &Events);
+        if (Run == 0)
+        {
+            memory->MapRange(0xD000, 0x100, nullptr, nullptr, &Direct);
+        }
+        else
+        {
+            Host.Attach(Pair[0], Pair[0]);
+            Host.Start();
+            memory->MapRange(0xD000, 0x100, nullptr, nullptr, &Port);
+        }
+
+        std::atomic<u64> Received{0};
+        u64 Reads = 0;
+        u64 Errors = 0;
+        const auto Start = std::chrono::steady_clock::now();
+        std::thread Reader(DrainConsole, Pair[1], Total, std::ref(Received), std::ref(Reads), std::ref(Errors));
+        while (Received.load(std::memory_order_acquire) < Total)
+        {
+            cpu.Execute(100000, *memory);
+        }
+        Reader.join();
+        const double Seconds = SecondsSince(Start);
+        u64 Writes = Total;
+        if (Run == 1)
+        {
+            Host.Stop();
+            Writes = Host.WriteCalls.load();
+        }
+        else
+        {
+            close(Pair[0]);
+        }
+        close(Pair[1]);
+        printf("  %-28s %10.1f MB/s, %.0f bytes per write(), %.0f per read(), %llu MB, %s\n",
+            Run == 0 ? "write() per byte" : "acia + epoll rings", Total / Seconds / 1e6, (double)Total / Writes,
+            (double)Total / Reads, (unsigned long long)(Total >> 20), Errors ? "CORRUPT" : "intact");
+    }
+
+    int Pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, Pair) != 0)
+    {
+        perror("socketpair");
+        return;
+    }
+    std::unique_ptr<Mem> memory(new Mem);
+    CPU cpu;
+    Scheduler Events;
+    Events.BlockWhenIdle = true;
+    cpu.Events = &Events;
+    cpu.Reset(*memory);
+    LoadProgram(*memory, EchoProgram, sizeof(EchoProgram));
+    for (u32 i = 0; i < sizeof(EchoHandler); i++)
+    {
+        (*memory)[0x8010 + i] = EchoHandler[i];
+    }
+    (*memory)[0xFFFE] = 0x10;
+    (*memory)[0xFFFF] = 0x80;
+    cpu.PC = ProgramAddress;
+    SerialHost Host;
+    Host.Attach(Pair[0], Pair[0]);
+    Acia6551 Port(&Host, &Events);
+    memory->MapRange(0xD000, 0x100, nullptr, nullptr, &Port);
+    Host.Start();
+
+    std::atomic<bool> Done{false};
+    std::vector<double> Trips;
+    std::thread Client([&]()
+    {
+        for (u32 i = 0; i < Pings; i++)
+        {
+            const Byte Sent = (Byte)i;
+            Byte Back = 0;
+            const auto Start = std::chrono::steady_clock::now();
+            if (write(Pair[1], &Sent, 1) != 1 || read(Pair[1], &Back, 1) != 1 || Back != Sent)
+            {
+                break;
+            }
+            Trips.push_back(SecondsSince(Start) * 1e6);
+        }
+        Done.store(true);
+        Events.Wake();
+    });
+    while (!Done.load())
+    {
+        cpu.Execute(100000, *memory);
+    }
+    Client.join();
+    Host.Stop();
+    close(Pair[1]);
+    if (Trips.size() != Pings)
+    {
+        printf("  echo failed after %u round trips\n", (u32)Trips.size());
+        return;
+    }
+    std::sort(Trips.begin(), Trips.end());
+    printf("  %-28s %10.1f us median, %.1f us p99, %.1f us max over %u\n", "irq echo round trip",
+        Trips[Pings / 2], Trips[Pings * 99 / 100], Trips.back(), Pings);
+}
+
+// the interpreter on a Mem in a shared mapping, published every slice and
+// watched from another thread, against the usual heap Mem
+static void BenchSharedMem()
+{
+    constexpr s32 SliceCycles = 100000;
+    constexpr u32 Slices = 2000;
+    SharedMem Shared;
+    SharedStateView View;
+    if (!Shared.Create(nullptr) || !View.Open(Shared.Path().c_str()))
+    {
+        return;
+    }
+    std::unique_ptr<Mem> Heap(new Mem);
+    Mem* Memories[2] = { Heap.get(), &Shared.memory() };
+    double MHz[2] = {};
+    u64 Looks = 0;
+    bool Consistent = true;
+    for (u32 Round = 0; Round < 3; Round++)
+    {
+        for (u32 Run = 0; Run < 2; Run++)
+        {
+            Mem& memory = *Memories[Run];
+            CPU cpu;
+            cpu.SkipIdleLoops = false;
+            cpu.Reset(memory);
+            LoadProgram(memory, FillProgram, sizeof(FillProgram));
+
+            std::atomic<bool> Done{false};
+            std::thread Watcher;
+            if (Run == 1)
+            {
+                Watcher = std::thread([&]()
+                {
+                    while (!Done.load())
+                    {
+                        const SharedRegisters Registers = View.Registers();
+                        const Byte Filled = View.Peek(0x0210);
+                        Consistent = Consistent && (u32)(Registers.PC - ProgramAddress) < sizeof(FillProgram)
+                            && (Filled == 0x10 || Filled == 0);
+                        Looks++;
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                });
+            }
+            const auto Start = std::chrono::steady_clock::now();
+            for (u32 i = 0; i < Slices; i++)
+            {
+                cpu.PC = ProgramAddress;
+                cpu.Execute(SliceCycles, memory);
+                if (Run == 1)
+                {
+                    Shared.Publish(cpu);
+                }
+            }
+            const double Result = (double)SliceCycles * Slices / SecondsSince(Start) / 1e6;
+            MHz[Run] = Result > MHz[Run] ? Result : MHz[Run];
+            Done.store(true);
+            if (Watcher.joinable())
+            {
+                Watcher.join();
+            }
+            if (Run == 1)
+            {
+                Consistent = Consistent && memcmp(View.Data(), memory.Data, Mem::MAX_MEM) == 0;
+            }
+        }
+    }
+    printf("  %-28s %10.1f MHz\n", "heap Mem", MHz[0]);
+    printf("  %-28s %10.1f MHz (%.2fx), %llu looks from a watcher, %s\n", "shared mapping + publish", MHz[1],
+        MHz[1] / MHz[0], (unsigned long long)Looks, Consistent ? "consistent" : "INCONSISTENT");
+}
+
+// one connection to a JobServer socket, keeping up to Window jobs in flight;
+// returns the jobs answered with status=trap
+static u64 SubmitJobs( const char* SocketPath, const std::string& Line, u64 Jobs, u32 Window,
+    std::vector<double>* Trips )
+{
+    const int Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un Address = {};
+    Address.sun_family = AF_UNIX;
+    strncpy(Address.sun_path, SocketPath, sizeof(Address.sun_path) - 1);
+    if (Fd < 0 || connect(Fd, (sockaddr*)&Address, sizeof(Address)) != 0)
+    {
+        perror("job server client");
+        if (Fd >= 0)
+        {
+            close(Fd);
+        }
+        return 0;
+    }
+    std::string Batch;
+    for (u32 i = 0; i < Window; i++)
+    {
+        Batch += Line;
+    }
+    u64 Sent = 0;
+    u64 Answered = 0;
+    u64 Trapped = 0;
+    char Buffer[1 << 16];
+    auto Start = std::chrono::steady_clock::now();
+    while (Answered < Jobs)
+    {
+        const u64 Room = Window - (Sent - Answered);
+        const u64 Count = Jobs - Sent < Room ? Jobs - Sent : Room;
+        if (Count && send(Fd, Batch.data(), Line.size() * Count, MSG_NOSIGNAL) != (ssize_t)(Line.size() * Count))
+        {
+            break;
+        }
+        Sent += Count;
+        const ssize_t Read = recv(Fd, Buffer, sizeof(Buffer), 0);
+        if (Read <= 0)
+        {
+            break;
+        }
+        // replies are short enough never to straddle reads at these windows
+        for (const char* Reply = Buffer; (Reply = (const char*)memmem(Reply, Buffer + Read - Reply, "status=", 7)); Reply += 7)
+        {
+            Answered++;
+            Trapped += strncmp(Reply + 7, "trap", 4) == 0;
+            if (Trips)
+            {
+                Trips->push_back(SecondsSince(Start) * 1e6);
+                Start = std::chrono::steady_clock::now();
+            }
+        }
+    }
+    close(Fd);
+    return Trapped;
+}
+
+// small ROM jobs through a JobServer socket, against a cold instance (fresh
+// Mem, full reset, ROM read from disk) per job in-process
+static void BenchJobServer()
+{
+    const std::string RomPath = "/tmp/6502bench-" + std::to_string(getpid()) + ".bin";
+    const std::string SocketPath = "/tmp/6502bench-" + std::to_string(getpid()) + ".sock";
+    FILE* Rom = fopen(RomPath.c_str(), "wb");
+    if (!Rom || fwrite(FillProgram, 1, sizeof(FillProgram), Rom) != sizeof(FillProgram))
+    {
+        perror(RomPath.c_str());
+        return;
+    }
+    fclose(Rom);
+    char Line[256];
+    snprintf(Line, sizeof(Line), "id=1 rom=%s trap=0x%04X peek=0x0200:16\n", RomPath.c_str(),
+        ProgramAddress + (u32)sizeof(FillProgram) - 3);
+
+    constexpr u32 ColdJobs = 20000;
+    const auto ColdStart = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < ColdJobs; i++)
+    {
+        std::unique_ptr<Mem> memory(new Mem);
+        CPU cpu;
+        cpu.Reset(*memory);
+        FILE* File = fopen(RomPath.c_str(), "rb");
+        const size_t Size = fread(&memory->Data[ProgramAddress], 1, 0x8000, File);
+        fclose(File);
+        memory->MarkDirtyRange(ProgramAddress, (u32)Size);
+        cpu.PC = ProgramAddress;
+        cpu.TrapPC = ProgramAddress + (s32)sizeof(FillProgram) - 3;
+        cpu.Execute(1000000, *memory);
+    }
+    printf("  %-28s %10.1f us per job, in-process, no socket\n", "cold instance per job", SecondsSince(ColdStart) * 1e6 / ColdJobs);
+
+    // what the server does per job, minus the socket and the queue
+    {
+        std::unique_ptr<Mem> Baseline(new Mem);
+        std::unique_ptr<Mem> memory(new Mem);
+        CPU cpu;
+        cpu.Reset(*Baseline);
+        LoadProgram(*Baseline, FillProgram, sizeof(FillProgram));
+        *memory = *Baseline;
+        memory->ClearDirtyPages();
+        const auto WarmStart = std::chrono::steady_clock::now();
+        for (u32 i = 0; i < ColdJobs; i++)
+        {
+            cpu.Reset(*memory, *Baseline);
+            cpu.PC = ProgramAddress;
+            cpu.TrapPC = ProgramAddress + (s32)sizeof(FillProgram) - 3;
+            cpu.Execute(1000000, *memory);
+        }
+        printf("  %-28s %10.1f us per job, in-process, no socket\n", "warm instance per job", SecondsSince(WarmStart) * 1e6 / ColdJobs);
+    }
+
+    const u32 Cores = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    std::vector<u32> Pools = { 1 };
+    if (Cores > 1)
+    {
+        Pools.push_back(Cores);
+    }
+    for (u32 Threads : Pools)
+    {
+        JobServer Server;
+        Server.Threads = Threads;
+        if (!Server.ListenUnix(SocketPath.c_str()) || !Server.Start())
+        {
+            break;
+        }
+        if (Threads == 1)
+        {
+            constexpr u32 Pings = 5000;
+            std::vector<double> Trips;
+            SubmitJobs(SocketPath.c_str(), Line, Pings, 1, &Trips);
+            std::sort(Trips.begin(), Trips.end());
+            if (Trips.size() == Pings)
+            {
+                printf("  %-28s %10.1f us median, %.1f us p99 per round trip\n", "warm pool, one at a time",
+                    Trips[Pings / 2], Trips[Pings * 99 / 100]);
+            }
+        }
+        const u32 Clients = Threads;
+        const u64 Jobs = 400000 / Clients;
+        std::vector<std::thread> Submitters;
+        std::atomic<u64> Trapped{0};
+        const auto Start = std::chrono::steady_clock::now();
+        for (u32 c = 0; c < Clients; c++)
+        {
+            Submitters.emplace_back([&]() { Trapped += SubmitJobs(SocketPath.c_str(), Line, Jobs, 64, nullptr); });
+        }
+        for (std::thread& Submitter : Submitters)
+        {
+            Submitter.join();
+        }
+        const double Seconds = SecondsSince(Start);
+        char Label[64];
+        snprintf(Label, sizeof(Label), "warm pool, %u worker%s", Threads, Threads == 1 ? "" : "s");
+        printf("  %-28s %10.0f jobs/s pipelined, %llu of %llu trapped\n", Label, Jobs * Clients / Seconds,
+            (unsigned long long)Trapped.load(), (unsigned long long)(Jobs * Clients));
+    }
+    unlink(RomPath.c_str());
+}
+
+// paced instances against the wall clock: accuracy, jitter and what the
+// pacing costs the host
+static void BenchPacing()
+{
+    struct Case { const char* Name; double Hz; double Turbo; u32 Instances; };
+    const u32 Cores = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    const Case Cases[] = {
+        { "1.000000 MHz", 1000000.0, 1.0, 1 },
+        { "1.789773 MHz", 1789773.0, 1.0, 1 },
+        { "1.789773 MHz, turbo 4x", 1789773.0, 4.0, 1 },
+        { "1.000000 MHz, 4 per core", 1000000.0, 1.0, Cores * 4 },
+    };
+    constexpr double Seconds = 1.0;
+    for (const Case& C : Cases)
+    {
+        std::vector<PacingStats> Stats(C.Instances);
+        std::vector<double> Cpu(C.Instances);
+        std::vector<std::thread> Threads;
+        for (u32 i = 0; i < C.Instances; i++)
+        {
+            Threads.emplace_back([&, i]()
+            {
+                std::unique_ptr<Mem> memory(new Mem);
+                CPU cpu;
+                cpu.SkipIdleLoops = false;
+                cpu.Reset(*memory);
+                LoadProgram(*memory, FillProgram, sizeof(FillProgram));
+                RealTimePacer Pacer;
+                Pacer.ClockHz = C.Hz;
+                Pacer.SetTurbo(C.Turbo);
+                Pacer.Start();
+                const double CpuStart = ThreadSeconds();
+                Pacer.Run(cpu, *memory, Seconds * C.Turbo);
+                Cpu[i] = ThreadSeconds() - CpuStart;
+                Stats[i] = Pacer.Stats;
+            });
+        }
+        for (std::thread& Thread : Threads)
+        {
+            Thread.join();
+        }
+        double Ppm = 0, Mean = 0, Rms = 0, Max = 0, Load = 0;
+        for (u32 i = 0; i < C.Instances; i++)
+        {
+            const double Rate = Stats[i].Cycles / Stats[i].WallSeconds;
+            Ppm = std::max(Ppm, fabs(Rate / (C.Hz * C.Turbo) - 1.0) * 1e6);
+            Mean += Stats[i].MeanLateness() / C.Instances;
+            Rms = std::max(Rms, Stats[i].Jitter());
+            Max = std::max(Max, Stats[i].LatenessMax);
+            Load += Cpu[i] / Stats[i].WallSeconds;
+        }
+        printf("  %-28s %6.0f ppm off, lateness %.1f us mean, %.1f us rms, %.1f us max, %.2f cores busy\n",
+            C.Name, Ppm, Mean, Rms, Max, Load);
+    }
+}
+
+// states of a running guest: a few pages change between snapshots, the rest
+// (ROM, empty RAM) repeats
+static void BenchSnapshots()
+{
+    // LDX #0 / loop: TXA / STA $0200,X / STA $0300,X / INX / BNE loop /
+    // LDA $10 / ADC #1 / STA $10 / JMP $8000
+    static const Byte Program[] = {
+        0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x02, 0x9D, 0x00, 0x03, 0xE8, 0xD0, 0xF6,
+        0xA5, 0x10, 0x69, 0x01, 0x85, 0x10, 0x4C, 0x00, 0x80,
+    };
+    constexpr u32 States = 200000;
+    constexpr s32 CyclesBetween = 997;
+    constexpr u32 Loads = 100000;
+    const char* Path = "/tmp/6502bench-snapshots.bin";
+
+    std::unique_ptr<Mem> memory(new Mem);
+    CPU cpu;
+    cpu.SkipIdleLoops = false;
+    cpu.Reset(*memory);
+    LoadProgram(*memory, Program, sizeof(Program));
+    // something that looks like a ROM image in the upper pages
+    for (u32 Address = 0xC000; Address < Mem::MAX_MEM; Address++)
+    {
+        (*memory)[Address] = (Byte)(Address * 7 + (Address >> 8));
+    }
+    cpu.PC = ProgramAddress;
+
+    SnapshotStore Store;
+    std::vector<u64> Digests;
+    double AddSeconds = 0;
+    for (u32 i = 0; i < States; i++)
+    {
+        cpu.Execute(CyclesBetween, *memory);
+        const auto Added = std::chrono::steady_clock::now();
+        Store.Add(cpu, *memory);
+        AddSeconds += SecondsSince(Added);
+        if (i % 1000 == 0)
+        {
+            Digests.push_back(cpu.StateDigest(*memory));
+        }
+    }
+    printf("  %-28s %10.2f us per state, %llu unique pages, %llu chunks\n", "add", AddSeconds / States * 1e6,
+        (unsigned long long)Store.UniquePages(), (unsigned long long)Store.UniqueChunks());
+    printf("  %-28s %10.0f bytes per state (%.1f MB for %u states, %.0fx smaller than full copies)\n", "storage",
+        (double)Store.Bytes() / States, Store.Bytes() / 1e6, States, (double)States * Mem::MAX_MEM / Store.Bytes());
+
+    if (!Store.Save(Path))
+    {
+        return;
+    }
+    auto Start = std::chrono::steady_clock::now();
+    SnapshotFile File;
+    const bool Opened = File.Open(Path);
+    const double OpenSeconds = SecondsSince(Start);
+    unlink(Path);
+    if (!Opened)
+    {
+        return;
+    }
+    bool Same = File.States() == States;
+    for (size_t i = 0; i < Digests.size(); i++)
+    {
+        File.Load(i * 1000, cpu, *memory);
+        Same = Same && cpu.StateDigest(*memory) == Digests[i];
+    }
+    u64 Pick = 12345;
+    Start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < Loads; i++)
+    {
+        Pick = Pick * 6364136223846793005ull + 1442695040888963407ull;
+        File.Load((Pick >> 33) % States, cpu, *memory);
+    }
+    printf("  %-28s %10.2f us per random state (open %.0f us), %s\n", "load from mapped file",
+        SecondsSince(Start) / Loads * 1e6, OpenSeconds * 1e6, Same ? "states match" : "STATES DIFFER");
+}
+
+// a busy guest with a 6522 timer interrupting it: the timer costs one
+// scheduled event per interrupt and nothing per cycle
+static void BenchVia()
+{
+    // LDA #$40 / STA ACR (T1 free-running) / LDA #IER / STA IER /
+    // LDA #lo / STA T1C-L / LDA #hi / STA T1C-H / CLI, then the fill loop
+    static const Byte Setup[] = {
+        0xA9, 0x40, 0x8D, 0x0B, 0x90, 0xA9, 0xC0, 0x8D, 0x0E, 0x90,
+        0xA9, 0x00, 0x8D, 0x04, 0x90, 0xA9, 0x00, 0x8D, 0x05, 0x90, 0x58,
+        0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x02, 0x9D, 0x00, 0x03, 0xE8, 0xD0, 0xF6, 0x4C, 0x15, 0x80,
+    };
+    constexpr u32 IerAt = 6, LowAt = 11, HighAt = 16, LoopAt = 0x15;
+    // PHA / LDA T1C-L (acknowledge) / 24-bit INC $10-$12 / PLA / RTI
+    static const Byte Handler[] = {
+        0x48, 0xAD, 0x04, 0x90, 0xE6, 0x10, 0xD0, 0x06, 0xE6, 0x11, 0xD0, 0x02, 0xE6, 0x12, 0x68, 0x40,
+    };
+    constexpr s32 SliceCycles = 100000;
+    constexpr u32 Slices = 1000;
+
+    struct Config {
+        const char* Name;
+        bool Mapped;
+        Byte Ier;
+        Word Period;
+    };
+    static const Config Configs[] = {
+        { "no VIA", false, 0, 0 },
+        { "T1 running, IRQ off", true, 0x40, 10000 },
+        { "T1 IRQ every 10000 cycles", true, 0xC0, 10000 },
+        { "T1 IRQ every 1000 cycles", true, 0xC0, 1000 },
+    };
+    constexpr u32 Count = sizeof(Configs) / sizeof(Configs[0]);
+    double Best[Count] = {};
+    u32 Interrupts[Count] = {};
+    u64 Cycles[Count] = {};
+    // rounds interleave the configurations so host noise hits them alike
+    for (u32 Round = 0; Round < 3; Round++)
+    {
+        for (u32 c = 0; c < Count; c++)
+        {
+            const Config& C = Configs[c];
+            std::unique_ptr<Mem> memory(new Mem);
+            Scheduler Clock;
+            Via6522 Via(&Clock);
+            CPU cpu;
+            cpu.Reset(*memory);
+            cpu.PS = 0;
+            cpu.Events = &Clock;
+            LoadProgram(*memory, Setup, sizeof(Setup));
+            (*memory)[ProgramAddress + IerAt] = C.Ier;
+            (*memory)[ProgramAddress + LowAt] = (Byte)(C.Period - 2);
+            (*memory)[ProgramAddress + HighAt] = (Byte)((C.Period - 2) >> 8);
+            for (u32 i = 0; i < sizeof(Handler); i++)
+            {
+                (*memory)[0x8040 + i] = Handler[i];
+            }
+            (*memory)[0xFFFE] = 0x40;
+            (*memory)[0xFFFF] = 0x80;
+            cpu.PC = C.Mapped ? ProgramAddress : ProgramAddress + LoopAt;
+            if (C.Mapped)
+            {
+                memory->MapRange(0x9000, Mem::PAGE_SIZE, nullptr, nullptr, &Via);
+            }
+            const auto Start = std::chrono::steady_clock::now();
+            for (u32 i = 0; i < Slices; i++)
+            {
+                cpu.Execute(SliceCycles, *memory);
+            }
+            const double MHz = (double)SliceCycles * Slices / SecondsSince(Start) / 1e6;
+            Best[c] = MHz > Best[c] ? MHz : Best[c];
+            Interrupts[c] = (*memory)[0x10] | (*memory)[0x11] << 8 | (*memory)[0x12] << 16;
+            Cycles[c] = Clock.Now;
+        }
+    }
+    for (u32 c = 0; c < Count; c++)
+    {
+        printf("  %-28s %8.1f MHz (%.3fx), %u interrupts", Configs[c].Name, Best[c], Best[c] / Best[0], Interrupts[c]);
+        if (Configs[c].Ier & 0x80)
+        {
+            printf(" (%llu expected)", (unsigned long long)(Cycles[c] / Configs[c].Period));
+        }
+        printf("\n");
+    }
+}
+
+struct Scenario {
+    const char* Name;
+    void (*Run)();
+};
+
+static const Scenario Scenarios[] = {
+    { "reset", BenchReset },
+    { "metrics", BenchMetrics },
+    { "heatmap", BenchHeatMap },
+    { "lockstep", BenchLockstep },
+    { "fusion", BenchFusion },
+    { "idle", BenchIdle },
+    { "hle", BenchHle },
+    { "banking", BenchBanking },
+    { "multicpu", BenchMultiCpu },
+    { "async", BenchAsyncDevice },
+    { "serial", BenchSerial },
+    { "shared", BenchSharedMem },
+    { "jobs", BenchJobServer },
+    { "pacing", BenchPacing },
+    { "snapshots", BenchSnapshots },
+    { "via", BenchVia },
+};
+
+int main( int argc, char** argv )
+{
+    for (const Scenario& S : Scenarios)
+    {
+        bool Selected = argc == 1;
+        for (int i = 1; i < argc; i++)
+        {
+            Selected = Selected || !strcmp(argv[i], S.Name);
+        }
+        if (Selected)
+        {
+            printf("%s\n", S.Name);
+            S.Run();
+        }
+    }
+    return 0;
+}
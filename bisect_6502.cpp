@@ -0,0 +1,549 @@
+// Divergence bisection: runs a ROM under two configurations side by side and
+// finds the first instruction after which they disagree.
+//
+// Usage: 6502bisect <rom> --a CONFIG --b CONFIG [--load 0x8000]
+//                   [--entry 0xADDR] [--cycles N] [--checkpoint N]
+//
+// A CONFIG is a comma-separated list of:
+//   core          the interpreter in this binary (the default)
+//   aot=rom.so    a 6502aot module, with the interpreter for the rest
+//   lib=path.so   another build of the core, through lib6502's C interface
+//                 (e.g. the library built at the last good commit)
+//   nofuse        no superinstructions (core and aot only)
+//   noidle        no idle-loop skipping (core and aot only)
+//
+// Both sides run one checkpoint interval at a time (default 1M cycles),
+// then their registers, cycle and instruction counts and state digests are
+// compared. With a StateHash on memory a digest is O(1), and the two sides
+// run on their own cores, so the scan runs at about the speed of the slower
+// side. The last matching state is kept.
+//
+// After a mismatch both sides go back to that state and run half the
+// distance to the mismatch. If they still agree, that state becomes the new
+// checkpoint. If not, the distance is halved. This ends at one instruction
+// and reruns about two intervals of cycles however long the run before it
+// was. The report decodes the instruction with the translator's opcode table
+// and lists the registers, counters and memory bytes that differ after it.
+//
+// Runs are flat: the ROM is loaded into RAM, and there are no devices or
+// interrupts, whose state a checkpoint could not capture.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Aot.h"
+#include "Opcodes.h"
+#include "lib6502.h"
+
+struct Registers {
+    Word PC;
+    Byte A, X, Y, SP, PS;
+    u64 Cycles;         // since the start of the run
+    u64 Instructions;
+};
+
+struct Checkpoint {
+    Registers Regs;
+    std::vector<Byte> Memory;
+};
+
+// one configuration under test
+struct Side {
+    std::string Config;
+
+    virtual ~Side() {}
+    virtual bool Start( const std::vector<Byte>& Rom, Word Load, Word Entry ) = 0;
+    // runs at least Cycles; the last instruction may overshoot
+    virtual void Run( u64 Cycles ) = 0;
+    virtual Registers Read() = 0;
+    virtual u64 Digest() = 0;
+    virtual Byte* Memory() = 0;
+    virtual void Restore( const Checkpoint& From ) = 0;
+
+    void Save( Checkpoint& Into )
+    {
+        Into.Regs = Read();
+        Into.Memory.assign(Memory(), Memory() + Mem::MAX_MEM);
+    }
+};
+
+// the interpreter, optionally with translated blocks
+struct CoreSide : Side {
+    std::unique_ptr<Mem> memory{ new Mem };
+    StateHash Hash;
+    CPU cpu;
+    std::unique_ptr<AotRunner> Runner;
+
+    bool Start( const std::vector<Byte>& Rom, Word Load, Word Entry ) override
+    {
+        memory->AttachHash(&Hash);
+        cpu.Reset(*memory);
+        cpu.PS = 0;
+        memcpy(memory->Data + Load, Rom.data(), Rom.size());
+        memory->MarkDirtyRange(Load, (u32)Rom.size());
+        cpu.PC = Entry;
+        cpu.Counters = CPUCounters();
+        return true;
+    }
+
+    void Run( u64 Cycles ) override
+    {
+        while (Cycles > 0)
+        {
+            const s32 Slice = (s32)(Cycles < (1u << 30) ? Cycles : 1u << 30);
+            const s32 Used = Runner ? Runner->Execute(cpu, *memory, Slice) : cpu.Execute(Slice, *memory);
+            Cycles = (u64)Used < Cycles ? Cycles - Used : 0;
+        }
+    }
+
+    Registers Read() override
+    {
+        return { cpu.PC, cpu.A, cpu.X, cpu.Y, cpu.SP, cpu.PS, cpu.Counters.Cycles, cpu.Counters.InstructionsRetired };
+    }
+
+    u64 Digest() override { return cpu.StateDigest(*memory); }
+    Byte* Memory() override { return memory->Data; }
+
+    void Restore( const Checkpoint& From ) override
+    {
+        memcpy(memory->Data, From.Memory.data(), Mem::MAX_MEM);
+        memory->MarkDirtyRange(0, Mem::MAX_MEM);
+        const Registers& R = From.Regs;
+        cpu.PC = R.PC;
+        cpu.A = R.A;
+        cpu.X = R.X;
+        cpu.Y = R.Y;
+        cpu.SP = R.SP;
+        cpu.PS = R.PS;
+        cpu.Counters.Cycles = R.Cycles;
+        cpu.Counters.InstructionsRetired = R.Instructions;
+    }
+};
+
+// another build of the core, loaded as a shared library
+struct LibSide : Side {
+    void* Library = nullptr;
+    emu6502* Emu = nullptr;
+    decltype(&emu6502_destroy) Destroy = nullptr;
+    decltype(&emu6502_load) LoadImage = nullptr;
+    decltype(&emu6502_memory) MemoryOf = nullptr;
+    decltype(&emu6502_mark_written) MarkWritten = nullptr;
+    decltype(&emu6502_get_registers) GetRegisters = nullptr;
+    decltype(&emu6502_set_registers) SetRegisters = nullptr;
+    decltype(&emu6502_run) RunFor = nullptr;
+    decltype(&emu6502_state_digest) StateDigest = nullptr;
+
+    // the library's counters run on across restores; these map them back
+    // to the run's
+    u64 CycleBase = 0;
+    u64 InstructionBase = 0;
+
+    ~LibSide() override
+    {
+        if (Emu)
+        {
+            Destroy(Emu);
+        }
+#ifndef _WIN32
+        if (Library)
+        {
+            dlclose(Library);
+        }
+#endif
+    }
+
+    bool Open( const char* Path )
+    {
+#ifndef _WIN32
+        Library = dlopen(Path, RTLD_NOW | RTLD_LOCAL);
+        if (!Library)
+        {
+            fprintf(stderr, "%s\n", dlerror());
+            return false;
+        }
+        auto Find = [&](auto& Fn, const char* Name)
+        {
+            Fn = (std::remove_reference_t<decltype(Fn)>)dlsym(Library, Name);
+            return Fn != nullptr;
+        };
+        decltype(&emu6502_abi_version) Version = nullptr;
+        decltype(&emu6502_create) Create = nullptr;
+        if (!Find(Version, "emu6502_abi_version") || Version() != EMU6502_ABI_VERSION || !Find(Create, "emu6502_create")
+            || !Find(Destroy, "emu6502_destroy") || !Find(LoadImage, "emu6502_load") || !Find(MemoryOf, "emu6502_memory")
+            || !Find(MarkWritten, "emu6502_mark_written") || !Find(GetRegisters, "emu6502_get_registers")
+            || !Find(SetRegisters, "emu6502_set_registers") || !Find(RunFor, "emu6502_run")
+            || !Find(StateDigest, "emu6502_state_digest"))
+        {
+            fprintf(stderr, "%s is not a compatible lib6502 build\n", Path);
+            return false;
+        }
+        Emu = Create();
+        return Emu != nullptr;
+#else
+        (void)Path;
+        fprintf(stderr, "lib= is not supported on this platform\n");
+        return false;
+#endif
+    }
+
+    bool Start( const std::vector<Byte>& Rom, Word Load, Word Entry ) override
+    {
+        if (LoadImage(Emu, Load, Rom.data(), Rom.size()) != 0)
+        {
+            return false;
+        }
+        emu6502_registers R;
+        GetRegisters(Emu, &R);
+        R.pc = Entry;
+        R.ps = 0;
+        SetRegisters(Emu, &R);
+        CycleBase = R.cycles;
+        InstructionBase = R.instructions;
+        return true;
+    }
+
+    void Run( u64 Cycles ) override { RunFor(Emu, (int64_t)Cycles); }
+
+    Registers Read() override
+    {
+        emu6502_registers R;
+        GetRegisters(Emu, &R);
+        return { R.pc, R.a, R.x, R.y, R.sp, R.ps, R.cycles - CycleBase, R.instructions - InstructionBase };
+    }
+
+    u64 Digest() override { return StateDigest(Emu); }
+    Byte* Memory() override { return MemoryOf(Emu); }
+
+    void Restore( const Checkpoint& From ) override
+    {
+        memcpy(MemoryOf(Emu), From.Memory.data(), Mem::MAX_MEM);
+        MarkWritten(Emu, 0, Mem::MAX_MEM);
+        emu6502_registers R;
+        GetRegisters(Emu, &R);
+        CycleBase = R.cycles - From.Regs.Cycles;
+        InstructionBase = R.instructions - From.Regs.Instructions;
+        R.pc = From.Regs.PC;
+        R.a = From.Regs.A;
+        R.x = From.Regs.X;
+        R.y = From.Regs.Y;
+        R.sp = From.Regs.SP;
+        R.ps = From.Regs.PS;
+        SetRegisters(Emu, &R);
+    }
+};
+
+static std::unique_ptr<Side> MakeSide( const std::string& Config )
+{
+    std::string Aot, Lib;
+    bool Fuse = true, SkipIdle = true;
+    size_t At = 0;
+    while (At <= Config.size())
+    {
+        size_t End = Config.find(',', At);
+        End = End == std::string::npos ? Config.size() : End;
+        const std::string Option = Config.substr(At, End - At);
+        if (Option.compare(0, 4, "aot=") == 0)       Aot = Option.substr(4);
+        else if (Option.compare(0, 4, "lib=") == 0)  Lib = Option.substr(4);
+        else if (Option == "nofuse")                 Fuse = false;
+        else if (Option == "noidle")                 SkipIdle = false;
+        else if (Option != "core" && !Option.empty())
+        {
+            fprintf(stderr, "unknown option %s in %s\n", Option.c_str(), Config.c_str());
+            return nullptr;
+        }
+        At = End + 1;
+    }
+
+    std::unique_ptr<Side> Result;
+    if (!Lib.empty())
+    {
+        if (!Aot.empty() || !Fuse || !SkipIdle)
+        {
+            fprintf(stderr, "%s: lib= takes no other options\n", Config.c_str());
+            return nullptr;
+        }
+        std::unique_ptr<LibSide> Other(new LibSide);
+        if (!Other->Open(Lib.c_str()))
+        {
+            return nullptr;
+        }
+        Result = std::move(Other);
+    }
+    else
+    {
+        std::unique_ptr<CoreSide> Core(new CoreSide);
+        Core->cpu.FuseInstructions = Fuse;
+        Core->cpu.SkipIdleLoops = SkipIdle;
+        if (!Aot.empty())
+        {
+            Core->Runner.reset(new AotRunner);
+            if (!Core->Runner->Load(Aot.c_str()))
+            {
+                return nullptr;
+            }
+        }
+        Result = std::move(Core);
+    }
+    Result->Config = Config;
+    return Result;
+}
+
+// the sides share nothing, so long runs go on two cores; short ones are not
+// worth starting a thread for
+static void RunBoth( Side& L, Side& R, u64 Cycles )
+{
+    if (Cycles < 100000)
+    {
+        L.Run(Cycles);
+        R.Run(Cycles);
+        return;
+    }
+    std::thread Other([&]() { R.Run(Cycles); });
+    L.Run(Cycles);
+    Other.join();
+}
+
+static bool SameRegisters( const Registers& L, const Registers& R )
+{
+    return L.PC == R.PC && L.A == R.A && L.X == R.X && L.Y == R.Y && L.SP == R.SP && L.PS == R.PS
+        && L.Cycles == R.Cycles && L.Instructions == R.Instructions;
+}
+
+static bool Same( Side& L, Side& R )
+{
+    if (!SameRegisters(L.Read(), R.Read()))
+    {
+        return false;
+    }
+    if (L.Digest() == R.Digest())
+    {
+        return true;
+    }
+    // a library from another commit may hash differently; the bytes decide
+    return !memcmp(L.Memory(), R.Memory(), Mem::MAX_MEM);
+}
+
+static void PrintRegisters( const char* Label, const Registers& R, const Registers& Before )
+{
+    printf("  %-22s PC=%04X A=%02X X=%02X Y=%02X SP=%02X PS=%02X  +%llu cycles, +%llu instructions\n", Label, R.PC,
+        R.A, R.X, R.Y, R.SP, R.PS, (unsigned long long)(R.Cycles - Before.Cycles),
+        (unsigned long long)(R.Instructions - Before.Instructions));
+}
+
+static void Report( Side& L, Side& R, const Checkpoint& Before )
+{
+    const Registers& B = Before.Regs;
+    const Registers Lr = L.Read();
+    const Registers Rr = R.Read();
+    printf("first divergence at cycle %llu, instruction %llu:\n", (unsigned long long)B.Cycles,
+        (unsigned long long)B.Instructions);
+
+    // a step can retire a fused pair, so list everything either side ran
+    const u64 Ran = Lr.Instructions - B.Instructions > Rr.Instructions - B.Instructions
+        ? Lr.Instructions - B.Instructions : Rr.Instructions - B.Instructions;
+    Word PC = B.PC;
+    for (u64 i = 0; i < (Ran ? Ran : 1); i++)
+    {
+        const Byte* Data = Before.Memory.data();
+        const OpInfo& Info = Ops[Data[PC]];
+        const u32 Length = Info.Name[0] == '?' ? 1 : InstructionLength(Info.M);
+        char Bytes[16] = "";
+        for (u32 b = 0; b < Length; b++)
+        {
+            snprintf(Bytes + b * 3, sizeof(Bytes) - b * 3, "%02X ", Data[(Word)(PC + b)]);
+        }
+        printf("  $%04X  %-9s %s\n", PC, Bytes, Disassemble(Data, PC).c_str());
+        PC = (Word)(PC + Length);
+    }
+
+    printf("  %-22s PC=%04X A=%02X X=%02X Y=%02X SP=%02X PS=%02X\n", "before", B.PC, B.A, B.X, B.Y, B.SP, B.PS);
+    PrintRegisters(L.Config.c_str(), Lr, B);
+    PrintRegisters(R.Config.c_str(), Rr, B);
+
+    std::string Differs;
+    auto Check = [&](const char* Name, u64 Left, u64 Right)
+    {
+        if (Left != Right)
+        {
+            Differs += Differs.empty() ? Name : std::string(", ") + Name;
+        }
+    };
+    Check("PC", Lr.PC, Rr.PC);
+    Check("A", Lr.A, Rr.A);
+    Check("X", Lr.X, Rr.X);
+    Check("Y", Lr.Y, Rr.Y);
+    Check("SP", Lr.SP, Rr.SP);
+    Check("PS", Lr.PS, Rr.PS);
+    Check("cycles", Lr.Cycles, Rr.Cycles);
+    Check("instructions", Lr.Instructions, Rr.Instructions);
+    if (!Differs.empty())
+    {
+        printf("  registers differ: %s\n", Differs.c_str());
+    }
+
+    const Byte* Left = L.Memory();
+    const Byte* Right = R.Memory();
+    u32 Bytes = 0;
+    for (u32 Address = 0; Address < Mem::MAX_MEM; Address++)
+    {
+        if (Left[Address] != Right[Address] && Bytes++ < 8)
+        {
+            printf("  memory differs at $%04X: %02X vs %02X (was %02X)\n", Address, Left[Address], Right[Address],
+                Before.Memory[Address]);
+        }
+    }
+    if (Bytes > 8)
+    {
+        printf("  ... %u bytes differ in all\n", Bytes);
+    }
+}
+
+static bool ReadFile( const char* Path, std::vector<Byte>& Data )
+{
+    FILE* File = fopen(Path, "rb");
+    if (!File)
+    {
+        fprintf(stderr, "cannot open %s\n", Path);
+        return false;
+    }
+    Byte Buffer[4096];
+    size_t Read;
+    while ((Read = fread(Buffer, 1, sizeof(Buffer), File)) > 0)
+    {
+        Data.insert(Data.end(), Buffer, Buffer + Read);
+    }
+    fclose(File);
+    return true;
+}
+
+static double SecondsSince( std::chrono::steady_clock::time_point Start )
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+}
+
+int main( int argc, char** argv )
+{
+    DefineOps();
+    const char* RomPath = nullptr;
+    std::string Configs[2] = { "core", "core" };
+    Word Load = 0x8000;
+    int Entry = -1;
+    u64 TotalCycles = 1000000000;
+    u64 Interval = 1000000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--a") && i + 1 < argc)               Configs[0] = argv[++i];
+        else if (!strcmp(argv[i], "--b") && i + 1 < argc)          Configs[1] = argv[++i];
+        else if (!strcmp(argv[i], "--load") && i + 1 < argc)       Load = (Word)strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--entry") && i + 1 < argc)      Entry = (int)strtoul(argv[++i], nullptr, 0) & 0xFFFF;
+        else if (!strcmp(argv[i], "--cycles") && i + 1 < argc)     TotalCycles = strtoull(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--checkpoint") && i + 1 < argc) Interval = strtoull(argv[++i], nullptr, 0);
+        else if (!RomPath)                                         RomPath = argv[i];
+        else
+        {
+            fprintf(stderr, "unexpected argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!RomPath || Interval == 0)
+    {
+        fprintf(stderr, "usage: %s <rom> --a CONFIG --b CONFIG [--load 0x8000] [--entry 0xADDR] [--cycles N] "
+                        "[--checkpoint N]\n"
+                        "CONFIG: core | aot=module.so | lib=lib6502.so, plus nofuse, noidle\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<Byte> Rom;
+    if (!ReadFile(RomPath, Rom))
+    {
+        return 2;
+    }
+    if (Rom.empty() || Load + Rom.size() > Mem::MAX_MEM)
+    {
+        fprintf(stderr, "%s does not fit at 0x%04X\n", RomPath, Load);
+        return 2;
+    }
+    std::unique_ptr<Side> A = MakeSide(Configs[0]);
+    std::unique_ptr<Side> B = A ? MakeSide(Configs[1]) : nullptr;
+    if (!A || !B)
+    {
+        return 2;
+    }
+    const Word Start = Entry >= 0 ? (Word)Entry : Load;
+    if (!A->Start(Rom, Load, Start) || !B->Start(Rom, Load, Start))
+    {
+        fprintf(stderr, "cannot start %s\n", RomPath);
+        return 2;
+    }
+
+    // scan: compare at every checkpoint, keep the last good state
+    const auto Began = std::chrono::steady_clock::now();
+    Checkpoint Good;
+    A->Save(Good);
+    u64 Distance = 0;
+    while (Good.Regs.Cycles < TotalCycles)
+    {
+        Distance = TotalCycles - Good.Regs.Cycles < Interval ? TotalCycles - Good.Regs.Cycles : Interval;
+        RunBoth(*A, *B, Distance);
+        if (!Same(*A, *B))
+        {
+            break;
+        }
+        A->Save(Good);
+        Distance = 0;
+    }
+    const double ScanSeconds = SecondsSince(Began);
+    if (Distance == 0)
+    {
+        printf("no divergence in %llu cycles (%.3f s, %.1f MHz per side)\n", (unsigned long long)Good.Regs.Cycles,
+            ScanSeconds, Good.Regs.Cycles / ScanSeconds / 1e6);
+        return 0;
+    }
+
+    // bisect: a run of Distance cycles from Good diverges
+    const auto Bisecting = std::chrono::steady_clock::now();
+    const u64 Found = Good.Regs.Cycles;
+    u32 Probes = 0;
+    for (;;)
+    {
+        const u64 Half = Distance > 1 ? Distance / 2 : 1;
+        A->Restore(Good);
+        B->Restore(Good);
+        RunBoth(*A, *B, Half);
+        Probes++;
+        const bool Match = Same(*A, *B);
+        if (Distance == 1)
+        {
+            if (Match)
+            {
+                printf("divergence after cycle %llu did not reproduce from a checkpoint; a side is not "
+                    "deterministic\n", (unsigned long long)Found);
+                return 2;
+            }
+            break;
+        }
+        if (Match)
+        {
+            const u64 Used = A->Read().Cycles - Good.Regs.Cycles;
+            A->Save(Good);
+            Distance = Distance > Used + 1 ? Distance - Used : 1;
+        }
+        else
+        {
+            Distance = Half;
+        }
+    }
+
+    Report(*A, *B, Good);
+    printf("scanned %llu cycles in %.3f s, bisected in %u probes in %.3f s\n", (unsigned long long)Found,
+        ScanSeconds, Probes, SecondsSince(Bisecting));
+    return 1;
+}
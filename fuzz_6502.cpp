@@ -0,0 +1,244 @@
+// Coverage-guided fuzzing of guest programs.
+//
+// Built normally this is a standalone mutational fuzzer; built with
+// -DFUZZ6502_LIBFUZZER and clang's -fsanitize=fuzzer it exposes
+// LLVMFuzzerTestOneInput and hands the guest edge map to libFuzzer as
+// extra counters.
+//
+// The target is configured through the environment so libFuzzer keeps argv:
+//   FUZZ6502_ROM        guest image (required)
+//   FUZZ6502_LOAD       load address (0x8000)
+//   FUZZ6502_ENTRY      entry PC (load address)
+//   FUZZ6502_EXIT       PC that ends a run (none, runs until the budget)
+//   FUZZ6502_INPUT      address inputs are copied to (0x0200)
+//   FUZZ6502_INPUT_MAX  maximum input size (0x0600)
+//   FUZZ6502_LENGTH     address of a 16-bit input length word (none)
+//   FUZZ6502_BUDGET     cycle budget per run (100000)
+//
+// Standalone usage: 6502fuzz [iterations] [corpus output dir]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Fuzz.h"
+
+#ifdef FUZZ6502_LIBFUZZER
+__attribute__((used, section("__libfuzzer_extra_counters")))
+#endif
+static Byte GuestCoverage[CPU::CoverageMapSize];
+
+static std::unique_ptr<FuzzTarget> Target;
+
+static long EnvNumber( const char* Name, long Default )
+{
+    const char* Value = getenv(Name);
+    return Value ? strtol(Value, nullptr, 0) : Default;
+}
+
+static bool SetupTarget()
+{
+    const char* RomPath = getenv("FUZZ6502_ROM");
+    if (!RomPath)
+    {
+        fprintf(stderr, "FUZZ6502_ROM is not set\n");
+        return false;
+    }
+    Target.reset(new FuzzTarget);
+    FuzzTarget& T = *Target;
+    T.BaselineCPU.Reset(T.Baseline);
+
+    const Word LoadAddress = (Word)EnvNumber("FUZZ6502_LOAD", 0x8000);
+    FILE* File = fopen(RomPath, "rb");
+    if (!File)
+    {
+        fprintf(stderr, "cannot open %s\n", RomPath);
+        return false;
+    }
+    fread(&T.Baseline.Data[LoadAddress], 1, Mem::MAX_MEM - LoadAddress, File);
+    fclose(File);
+
+    T.BaselineCPU.PC = (Word)EnvNumber("FUZZ6502_ENTRY", LoadAddress);
+    T.ExitPC = (s32)EnvNumber("FUZZ6502_EXIT", -1);
+    T.InputAddress = (Word)EnvNumber("FUZZ6502_INPUT", 0x0200);
+    T.InputMaxSize = (Word)EnvNumber("FUZZ6502_INPUT_MAX", 0x0600);
+    T.LengthAddress = (s32)EnvNumber("FUZZ6502_LENGTH", -1);
+    T.CycleBudget = (s32)EnvNumber("FUZZ6502_BUDGET", 100000);
+    T.CoverageMap = GuestCoverage;
+    T.Prepare();
+    return true;
+}
+
+#ifdef FUZZ6502_LIBFUZZER
+
+extern "C" int LLVMFuzzerInitialize( int*, char*** )
+{
+    if (!SetupTarget())
+    {
+        abort();
+    }
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput( const uint8_t* Data, size_t Size )
+{
+    Target->Run(Data, Size);
+    return 0;
+}
+
+#else
+
+// AFL hit-count buckets, so loop trip counts only matter by magnitude
+static Byte Bucket( Byte Count )
+{
+    if (Count == 0)   return 0;
+    if (Count == 1)   return 1;
+    if (Count == 2)   return 2;
+    if (Count == 3)   return 4;
+    if (Count <= 7)   return 8;
+    if (Count <= 15)  return 16;
+    if (Count <= 31)  return 32;
+    if (Count <= 127) return 64;
+    return 128;
+}
+
+struct Rng {
+    u64 State = 0x2545F4914F6CDD1Dull;
+    u32 Next()
+    {
+        State ^= State << 13;
+        State ^= State >> 7;
+        State ^= State << 17;
+        return (u32)State;
+    }
+    u32 Below( u32 Limit ) { return Limit ? Next() % Limit : 0; }
+};
+
+static void Mutate( std::vector<Byte>& Input, const std::vector<std::vector<Byte>>& Corpus, Rng& R, size_t MaxSize )
+{
+    static const Byte Interesting[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF, 0x0A, 0x0D, 0x20 };
+    const u32 Rounds = 1 + R.Below(4);
+    for (u32 i = 0; i < Rounds; i++)
+    {
+        if (Input.empty())
+        {
+            Input.push_back((Byte)R.Next());
+            continue;
+        }
+        const size_t Pos = R.Below((u32)Input.size());
+        switch (R.Below(6))
+        {
+        case 0: Input[Pos] ^= 1 << R.Below(8); break;
+        case 1: Input[Pos] = (Byte)R.Next(); break;
+        case 2: Input[Pos] = Interesting[R.Below(sizeof(Interesting))]; break;
+        case 3:
+            if (Input.size() < MaxSize)
+            {
+                Input.insert(Input.begin() + Pos, (Byte)R.Next());
+            }
+            break;
+        case 4:
+            if (Input.size() > 1)
+            {
+                Input.erase(Input.begin() + Pos);
+            }
+            break;
+        case 5:
+        {
+            // splice the tail of another corpus entry
+            const std::vector<Byte>& Other = Corpus[R.Below((u32)Corpus.size())];
+            if (!Other.empty())
+            {
+                Input.resize(Pos);
+                const size_t From = R.Below((u32)Other.size());
+                Input.insert(Input.end(), Other.begin() + From, Other.end());
+                if (Input.size() > MaxSize)
+                {
+                    Input.resize(MaxSize);
+                }
+            }
+        } break;
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    if (!SetupTarget())
+    {
+        return 2;
+    }
+    const u64 Iterations = argc > 1 ? strtoull(argv[1], nullptr, 0) : 1000000;
+    const char* OutputDir = argc > 2 ? argv[2] : nullptr;
+
+    std::vector<Byte> Virgin(CPU::CoverageMapSize, 0xFF);
+    std::vector<std::vector<Byte>> Corpus(1, std::vector<Byte>(1, 0));
+    Rng R;
+    u64 Timeouts = 0;
+    u32 Edges = 0;
+
+    const auto Start = std::chrono::steady_clock::now();
+    for (u64 Iteration = 0; Iteration < Iterations; Iteration++)
+    {
+        std::vector<Byte> Input = Corpus[R.Below((u32)Corpus.size())];
+        Mutate(Input, Corpus, R, Target->InputMaxSize);
+
+        memset(GuestCoverage, 0, sizeof(GuestCoverage));
+        if (Target->Run(Input.data(), Input.size()) == FuzzTarget::Outcome::Timeout)
+        {
+            Timeouts++;
+        }
+
+        // the map is sparse, so skip untouched words eight bytes at a time
+        bool NewCoverage = false;
+        for (u32 Offset = 0; Offset < CPU::CoverageMapSize; Offset += 8)
+        {
+            u64 Chunk;
+            memcpy(&Chunk, &GuestCoverage[Offset], sizeof(Chunk));
+            if (!Chunk)
+            {
+                continue;
+            }
+            for (u32 i = Offset; i < Offset + 8; i++)
+            {
+                const Byte Hit = Bucket(GuestCoverage[i]) & Virgin[i];
+                if (Hit)
+                {
+                    if (Virgin[i] == 0xFF)
+                    {
+                        Edges++;
+                    }
+                    Virgin[i] &= ~Hit;
+                    NewCoverage = true;
+                }
+            }
+        }
+        if (NewCoverage)
+        {
+            Corpus.push_back(Input);
+            if (OutputDir)
+            {
+                const std::string Path = std::string(OutputDir) + "/input-" + std::to_string(Corpus.size() - 1);
+                if (FILE* File = fopen(Path.c_str(), "wb"))
+                {
+                    fwrite(Input.data(), 1, Input.size(), File);
+                    fclose(File);
+                }
+            }
+        }
+    }
+    const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    printf("%llu execs in %.2f s (%.0f exec/s), %u edges, %zu corpus entries, %llu timeouts\n",
+        (unsigned long long)Iterations, Seconds, Seconds > 0 ? Iterations / Seconds : 0.0,
+        Edges, Corpus.size(), (unsigned long long)Timeouts);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,229 @@
+// The C interface declared in lib6502.h, built as a shared library:
+//
+//     g++ -std=c++17 -O2 -shared -fPIC -fvisibility=hidden lib6502.cpp -o lib6502.so
+//
+// Each emu6502 is a CPU and a Mem as any C++ host would use them. The
+// scheduler (for the interrupt lines) and the state hash (for digests) are
+// only attached once the host first asks for them, so instances that never
+// use them run the same loop as a bare CPU.
+
+#define LIB6502_BUILD
+
+#include "lib6502.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <new>
+
+#include "CPU.h"
+#include "Scheduler.h"
+#include "StateHash.h"
+
+struct emu6502 {
+    CPU cpu;
+    Mem memory;
+    std::unique_ptr<Scheduler> Events;
+    std::unique_ptr<StateHash> Hash;
+
+    // what emu6502_reset returns to once emu6502_save_baseline has run
+    std::unique_ptr<Mem> Baseline;
+    emu6502_registers BaselineRegisters;
+};
+
+namespace
+{
+    constexpr u32 EXTERNAL_IRQ = 1u << 0;
+
+    // slices stay well inside Execute's s32 budget
+    constexpr s64 MAX_SLICE = 1 << 30;
+
+    Scheduler& Events( emu6502* Emu )
+    {
+        if (!Emu->Events)
+        {
+            Emu->Events.reset(new Scheduler);
+            Emu->cpu.Events = Emu->Events.get();
+        }
+        return *Emu->Events;
+    }
+}
+
+extern "C" {
+
+uint32_t emu6502_abi_version( void )
+{
+    return EMU6502_ABI_VERSION;
+}
+
+emu6502* emu6502_create( void )
+{
+    emu6502* Emu = new (std::nothrow) emu6502;
+    if (Emu)
+    {
+        Emu->cpu.Reset(Emu->memory);
+    }
+    return Emu;
+}
+
+void emu6502_destroy( emu6502* Emu )
+{
+    delete Emu;
+}
+
+int emu6502_load( emu6502* Emu, uint16_t Address, const uint8_t* Data, size_t Size )
+{
+    if (Size > Mem::MAX_MEM - Address)
+    {
+        return -1;
+    }
+    memcpy(&Emu->memory.Data[Address], Data, Size);
+    Emu->memory.MarkDirtyRange(Address, (u32)Size);
+    return 0;
+}
+
+long emu6502_load_file( emu6502* Emu, uint16_t Address, const char* Path )
+{
+    FILE* File = fopen(Path, "rb");
+    if (!File)
+    {
+        return -1;
+    }
+    const size_t Room = Mem::MAX_MEM - Address;
+    const size_t Size = fread(&Emu->memory.Data[Address], 1, Room, File);
+    // a file that does not fit is an error, not a silent truncation
+    const bool Fits = fgetc(File) == EOF && !ferror(File);
+    fclose(File);
+    Emu->memory.MarkDirtyRange(Address, (u32)Size);
+    return Fits ? (long)Size : -1;
+}
+
+uint8_t* emu6502_memory( emu6502* Emu )
+{
+    return Emu->memory.Data;
+}
+
+void emu6502_mark_written( emu6502* Emu, uint16_t Address, size_t Size )
+{
+    Emu->memory.MarkDirtyRange(Address, (u32)(Size < Mem::MAX_MEM ? Size : Mem::MAX_MEM));
+}
+
+void emu6502_save_baseline( emu6502* Emu )
+{
+    if (!Emu->Baseline)
+    {
+        Emu->Baseline.reset(new Mem);
+    }
+    *Emu->Baseline = Emu->memory;
+    Emu->memory.ClearDirtyPages();
+    emu6502_get_registers(Emu, &Emu->BaselineRegisters);
+}
+
+void emu6502_reset( emu6502* Emu )
+{
+    if (Emu->Baseline)
+    {
+        Emu->cpu.Reset(Emu->memory, *Emu->Baseline);
+        emu6502_set_registers(Emu, &Emu->BaselineRegisters);
+    }
+    else
+    {
+        Emu->cpu.Reset(Emu->memory);
+    }
+    if (Emu->Events)
+    {
+        Emu->Events->ClearIRQ(EXTERNAL_IRQ);
+    }
+}
+
+void emu6502_get_registers( const emu6502* Emu, emu6502_registers* Out )
+{
+    const CPU& cpu = Emu->cpu;
+    Out->pc = cpu.PC;
+    Out->a = cpu.A;
+    Out->x = cpu.X;
+    Out->y = cpu.Y;
+    Out->sp = cpu.SP;
+    Out->ps = cpu.PS;
+    Out->reserved = 0;
+    Out->cycles = cpu.Counters.Cycles;
+    Out->instructions = cpu.Counters.InstructionsRetired;
+}
+
+void emu6502_set_registers( emu6502* Emu, const emu6502_registers* In )
+{
+    CPU& cpu = Emu->cpu;
+    cpu.PC = In->pc;
+    cpu.A = In->a;
+    cpu.X = In->x;
+    cpu.Y = In->y;
+    cpu.SP = In->sp;
+    cpu.PS = In->ps;
+}
+
+void emu6502_set_trap( emu6502* Emu, int32_t PC )
+{
+    Emu->cpu.TrapPC = PC >= 0 && PC <= 0xFFFF ? PC : -1;
+}
+
+void emu6502_set_irq( emu6502* Emu, int Asserted )
+{
+    if (Asserted)
+    {
+        Events(Emu).RaiseIRQ(EXTERNAL_IRQ);
+    }
+    else if (Emu->Events)
+    {
+        Emu->Events->ClearIRQ(EXTERNAL_IRQ);
+    }
+}
+
+void emu6502_nmi( emu6502* Emu )
+{
+    Events(Emu).TriggerNMI();
+}
+
+int64_t emu6502_run( emu6502* Emu, int64_t Cycles )
+{
+    int64_t Total = 0;
+    while (Total < Cycles)
+    {
+        const s32 Slice = (s32)(Cycles - Total < MAX_SLICE ? Cycles - Total : MAX_SLICE);
+        const s32 Used = Emu->cpu.Execute(Slice, Emu->memory);
+        Total += Used;
+        // stopped at the trap
+        if (Used < Slice)
+        {
+            break;
+        }
+    }
+    return Total;
+}
+
+int64_t emu6502_run_batch( emu6502* const* Emus, size_t Count, int64_t Cycles, int64_t* Used )
+{
+    int64_t Total = 0;
+    for (size_t i = 0; i < Count; i++)
+    {
+        const int64_t Ran = emu6502_run(Emus[i], Cycles);
+        if (Used)
+        {
+            Used[i] = Ran;
+        }
+        Total += Ran;
+    }
+    return Total;
+}
+
+uint64_t emu6502_state_digest( emu6502* Emu )
+{
+    if (!Emu->Hash)
+    {
+        Emu->Hash.reset(new StateHash);
+        Emu->memory.AttachHash(Emu->Hash.get());
+    }
+    return Emu->cpu.StateDigest(Emu->memory);
+}
+
+}
@@ -0,0 +1,106 @@
+/* C interface to the 6502 core, for embedding it from other languages
+ * (Python ctypes/cffi, Rust, Go, Lua ...) through a shared library:
+ *
+ *     g++ -std=c++17 -O2 -shared -fPIC -fvisibility=hidden lib6502.cpp -o lib6502.so
+ *
+ * An emu6502 is one CPU with its own 64 KB of memory. Every call on one
+ * instance must come from one thread at a time; different instances are
+ * independent and may run on different threads at once.
+ *
+ * Foreign calls cost far more than a short slice of emulation, so hosts
+ * that drive many instances should step them with emu6502_run_batch, one
+ * call per round instead of one per instance. Memory is never copied
+ * across the boundary: emu6502_memory returns the instance's own bytes.
+ *
+ * The ABI is versioned. Functions and struct layouts only change together
+ * with EMU6502_ABI_VERSION; a host checks emu6502_abi_version() against the
+ * version it was written for before calling anything else. */
+
+#ifndef LIB6502_H
+#define LIB6502_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EMU6502_ABI_VERSION 1
+
+#if defined(_WIN32)
+#if defined(LIB6502_BUILD)
+#define EMU6502_API __declspec(dllexport)
+#else
+#define EMU6502_API __declspec(dllimport)
+#endif
+#else
+#define EMU6502_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct emu6502 emu6502;
+
+typedef struct emu6502_registers {
+    uint16_t pc;
+    uint8_t a, x, y, sp;
+    uint8_t ps;                 /* NV-BDIZC, as pushed by PHP */
+    uint8_t reserved;
+    uint64_t cycles;            /* totals since creation; ignored by set */
+    uint64_t instructions;
+} emu6502_registers;
+
+EMU6502_API uint32_t emu6502_abi_version( void );
+
+/* registers as after a reset, memory zeroed; NULL if out of memory */
+EMU6502_API emu6502* emu6502_create( void );
+EMU6502_API void emu6502_destroy( emu6502* emu );
+
+/* copies size bytes to address, which must not run past 0xFFFF; returns
+ * 0, or -1 if it would */
+EMU6502_API int emu6502_load( emu6502* emu, uint16_t address, const uint8_t* data, size_t size );
+
+/* reads a whole file to address; returns the bytes loaded, or -1 */
+EMU6502_API long emu6502_load_file( emu6502* emu, uint16_t address, const char* path );
+
+/* the instance's 64 KB address space, valid until emu6502_destroy. Writes
+ * through it must be followed by emu6502_mark_written for the range, or
+ * emu6502_reset will not know to undo them */
+EMU6502_API uint8_t* emu6502_memory( emu6502* emu );
+EMU6502_API void emu6502_mark_written( emu6502* emu, uint16_t address, size_t size );
+
+/* remembers the current memory and registers; emu6502_reset returns to
+ * them from then on instead of to zeroed memory */
+EMU6502_API void emu6502_save_baseline( emu6502* emu );
+
+/* back to the baseline, or to power-on with memory zeroed. Only the
+ * 256-byte pages written since the last reset are rewritten */
+EMU6502_API void emu6502_reset( emu6502* emu );
+
+EMU6502_API void emu6502_get_registers( const emu6502* emu, emu6502_registers* out );
+EMU6502_API void emu6502_set_registers( emu6502* emu, const emu6502_registers* in );
+
+/* execution stops before the instruction at pc; -1 clears the trap */
+EMU6502_API void emu6502_set_trap( emu6502* emu, int32_t pc );
+
+/* the IRQ input is a level: it stays asserted until cleared. An NMI is
+ * taken once, at the next instruction boundary */
+EMU6502_API void emu6502_set_irq( emu6502* emu, int asserted );
+EMU6502_API void emu6502_nmi( emu6502* emu );
+
+/* runs for at least cycles cycles, or until the trap; returns the cycles
+ * used (the last instruction may overshoot) */
+EMU6502_API int64_t emu6502_run( emu6502* emu, int64_t cycles );
+
+/* emu6502_run on each of count instances, in order, in one call. used, if
+ * not NULL, receives each instance's return value; the total is returned */
+EMU6502_API int64_t emu6502_run_batch( emu6502* const* emus, size_t count, int64_t cycles, int64_t* used );
+
+/* registers and memory folded into one 64-bit value, for comparing runs
+ * cheaply: equal states give equal digests */
+EMU6502_API uint64_t emu6502_state_digest( emu6502* emu );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,638 @@
+// Headless regression runner: executes a manifest of ROMs across a thread pool
+// and checks each one against its expected end state.
+//
+// Manifest format, one test per line, '#' starts a comment; a line that does
+// not parse (unknown key, bad range, unloadable machine) fails the load:
+//
+//   name=<id> rom=<file> [load=0x8000] [entry=<load>] [budget=1000000]
+//   [trap=0xADDR] [checksum=0xFNV1A] [cycles=N] [machine=<file>]
+//   [readonly=0xSTART-0xEND] [code=0xSTART-0xEND]
+//
+//   machine   board layout to run on (see Machine.h); rom= becomes optional
+//             and entry defaults to the machine's entry or reset vector
+//   trap      run until PC reaches this address (test fails if it never does)
+//   checksum  FNV-1a 32 of the full 64 KB address space after the run
+//   cycles    exact number of cycles used until the trap / end of budget
+//   readonly  with --sanitize, a range (inclusive, may repeat) the guest
+//             must not store into, e.g. the ROM image itself
+//   code      with --sanitize, a range (inclusive, may repeat) the guest may
+//             execute; once one is given, fetching an opcode anywhere else
+//             fails the test
+//
+// Usage: 6502farm <manifest> [-j threads] [--json out.json] [--junit out.xml]
+//                 [--metrics-port N] [--metrics-file path]
+//                 [--profile out.folded] [--profile-us N]
+//                 [--fusion] [--no-fusion] [--sanitize]
+//                 [--heatmap out.csv|out.json] [--heat-window N] [--heat-sample N]
+//
+// Every test runs with a shadow call stack; stack overflows, underflows and
+// mismatched returns are reported per test. --profile samples guest call
+// stacks on a timer and writes them in flame graph "folded" format.
+// --fusion prints how often each superinstruction idiom fused across the
+// corpus; --no-fusion runs the plain one-instruction-per-dispatch loop.
+// --sanitize (in a build with -DSANITIZE6502, see Sanitizer.h) fails tests
+// that read uninitialized RAM, store into read-only memory, execute outside
+// their code ranges or wrap the stack.
+// --heatmap counts reads, writes and fetches per page and zero-page byte,
+// summed over all tests in windows of --heat-window cycles (default 1000000)
+// from each test's start. The counts are estimated from one instruction
+// sampled every --heat-sample cycles (default 2000), cheap enough to leave
+// on; a build with -DHEATMAP6502 counts every access instead, with idle-loop
+// skipping turned off so polling loops are counted in full (see HeatMap.h).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CPU.h"
+#include "Machine.h"
+
+struct TestCase {
+    std::string Name;
+    std::string RomPath;
+    Word LoadAddress = 0x8000;
+    s32 Entry = -1;
+    u64 Budget = 1000000;
+    s32 Trap = -1;
+    bool HasChecksum = false;
+    u32 Checksum = 0;
+    bool HasCycles = false;
+    u64 Cycles = 0;
+    std::shared_ptr<const MachineDescription> Board;
+    std::vector<std::pair<Word, Word>> ReadOnly;
+    std::vector<std::pair<Word, Word>> Code;
+};
+
+struct TestResult {
+    bool Passed = false;
+    std::string Message;
+    u64 CyclesUsed = 0;
+    u32 Checksum = 0;
+    Word FinalPC = 0;
+    double Seconds = 0.0;
+    double EmulatedMHz = 0.0;
+    u64 StackOverflows = 0;
+    u64 StackUnderflows = 0;
+    u64 MismatchedReturns = 0;
+    u64 SanitizerFindings = 0;
+};
+
+static u32 ChecksumMemory( const Mem& memory )
+{
+    u32 Hash = 2166136261u;
+    for (u32 i = 0; i < Mem::MAX_MEM; i++)
+    {
+        Hash ^= memory.Data[i];
+        Hash *= 16777619u;
+    }
+    return Hash;
+}
+
+// descriptions are loaded once however many tests share them
+using MachineCache = std::map<std::string, std::shared_ptr<const MachineDescription>>;
+
+enum class LineStatus { Blank, Test, Error };
+
+static LineStatus ParseManifestLine( const char* Line, TestCase& Test, MachineCache& Machines )
+{
+    char Key[64], Value[1024];
+    const char* Cursor = Line;
+    int Consumed = 0;
+    bool Any = false;
+    while (sscanf(Cursor, " %63[^= \t\r\n]=%1023s%n", Key, Value, &Consumed) == 2)
+    {
+        Cursor += Consumed;
+        Any = true;
+        if (!strcmp(Key, "name"))          Test.Name = Value;
+        else if (!strcmp(Key, "rom"))      Test.RomPath = Value;
+        else if (!strcmp(Key, "load"))     Test.LoadAddress = (Word)strtoul(Value, nullptr, 0);
+        else if (!strcmp(Key, "entry"))    Test.Entry = (s32)strtoul(Value, nullptr, 0);
+        else if (!strcmp(Key, "budget"))   Test.Budget = strtoull(Value, nullptr, 0);
+        else if (!strcmp(Key, "trap"))     Test.Trap = (s32)strtoul(Value, nullptr, 0);
+        else if (!strcmp(Key, "checksum")) { Test.HasChecksum = true; Test.Checksum = (u32)strtoul(Value, nullptr, 0); }
+        else if (!strcmp(Key, "cycles"))   { Test.HasCycles = true; Test.Cycles = strtoull(Value, nullptr, 0); }
+        else if (!strcmp(Key, "readonly") || !strcmp(Key, "code"))
+        {
+            char* Dash = nullptr;
+            const Word First = (Word)strtoul(Value, &Dash, 0);
+            if (*Dash != '-')
+            {
+                fprintf(stderr, "%s=%s is not START-END\n", Key, Value);
+                return LineStatus::Error;
+            }
+            (Key[0] == 'r' ? Test.ReadOnly : Test.Code).push_back({ First, (Word)strtoul(Dash + 1, nullptr, 0) });
+        }
+        else if (!strcmp(Key, "machine"))
+        {
+            std::shared_ptr<const MachineDescription>& Board = Machines[Value];
+            if (!Board)
+            {
+                std::shared_ptr<MachineDescription> Loaded(new MachineDescription);
+                if (!Loaded->Load(Value))
+                {
+                    return LineStatus::Error;
+                }
+                Board = Loaded;
+            }
+            Test.Board = Board;
+        }
+        else
+        {
+            fprintf(stderr, "unknown manifest key '%s'\n", Key);
+            return LineStatus::Error;
+        }
+    }
+    // anything left is a field without '=' (or one too long to scan)
+    Cursor += strspn(Cursor, " \t\r\n");
+    if (*Cursor)
+    {
+        fprintf(stderr, "malformed manifest field '%.*s'\n", (int)strcspn(Cursor, " \t\r\n"), Cursor);
+        return LineStatus::Error;
+    }
+    return Any ? LineStatus::Test : LineStatus::Blank;
+}
+
+static bool LoadManifest( const char* Path, std::vector<TestCase>& Tests )
+{
+    FILE* File = fopen(Path, "r");
+    if (!File)
+    {
+        fprintf(stderr, "cannot open manifest %s\n", Path);
+        return false;
+    }
+    char Line[4096];
+    u32 LineNumber = 0;
+    MachineCache Machines;
+    while (fgets(Line, sizeof(Line), File))
+    {
+        LineNumber++;
+        if (char* Comment = strchr(Line, '#'))
+        {
+            *Comment = 0;
+        }
+        TestCase Test;
+        const LineStatus Status = ParseManifestLine(Line, Test, Machines);
+        if (Status == LineStatus::Blank)
+        {
+            continue;
+        }
+        if (Status == LineStatus::Error)
+        {
+            fprintf(stderr, "%s:%u: invalid test line\n", Path, LineNumber);
+            fclose(File);
+            return false;
+        }
+        if (Test.RomPath.empty() && !Test.Board)
+        {
+            fprintf(stderr, "%s:%u: missing rom= or machine=\n", Path, LineNumber);
+            fclose(File);
+            return false;
+        }
+        if (Test.Name.empty())
+        {
+            Test.Name = Test.RomPath.empty() ? Test.Board->Path : Test.RomPath;
+        }
+        Tests.push_back(Test);
+    }
+    fclose(File);
+    return true;
+}
+
+static bool LoadRom( const TestCase& Test, Mem& memory, std::string& Error )
+{
+    FILE* File = fopen(Test.RomPath.c_str(), "rb");
+    if (!File)
+    {
+        Error = "cannot open rom " + Test.RomPath;
+        return false;
+    }
+    const size_t Room = Mem::MAX_MEM - Test.LoadAddress;
+    const size_t Read = fread(&memory.Data[Test.LoadAddress], 1, Room, File);
+    // a file that does not fit is an error, not a silent truncation
+    const bool Fits = fgetc(File) == EOF && !ferror(File);
+    fclose(File);
+    memory.MarkDirtyRange(Test.LoadAddress, (u32)Read);
+    if (Read == 0)
+    {
+        Error = "empty rom " + Test.RomPath;
+        return false;
+    }
+    if (!Fits)
+    {
+        Error = "rom " + Test.RomPath + " runs past 0xFFFF";
+        return false;
+    }
+    return true;
+}
+
+static void RunTest( const TestCase& Test, CPU& cpu, Mem& memory, Machine& Board, Scheduler& Clock,
+    TestResult& Result )
+{
+    const auto Start = std::chrono::steady_clock::now();
+
+    cpu.Reset(memory);
+    cpu.CallStack->Clear();
+    // machine devices (timers, serial) need a clock and IRQ lines; plain
+    // tests keep the interpreter's event-free path
+    cpu.Events = Test.Board ? &Clock : nullptr;
+    if (Test.Board)
+    {
+        if (!Board.Install(*Test.Board, memory, cpu.Events))
+        {
+            Result.Message = "cannot install machine " + Test.Board->Path;
+            return;
+        }
+    }
+    else
+    {
+        memory.ResetMap();
+    }
+    if (!Test.RomPath.empty() && !LoadRom(Test, memory, Result.Message))
+    {
+        return;
+    }
+    if (Test.Entry >= 0)
+    {
+        cpu.PC = (Word)Test.Entry;
+    }
+    else
+    {
+        cpu.PC = Test.RomPath.empty() ? Board.EntryPoint(memory) : Test.LoadAddress;
+    }
+    cpu.TrapPC = Test.Trap;
+    if (cpu.Heat)
+    {
+        cpu.Heat->Restart();
+    }
+    if (memory.Shadow)
+    {
+        memory.Shadow->Clear();
+        memory.Shadow->SetWritable(0, Mem::MAX_MEM, true);
+        for (const std::pair<Word, Word>& Range : Test.ReadOnly)
+        {
+            memory.Shadow->Protect(Range.first, Range.second - Range.first + 1u);
+        }
+        // without code= ranges everything stays executable
+        memory.Shadow->SetExecutable(0, Mem::MAX_MEM, Test.Code.empty());
+        for (const std::pair<Word, Word>& Range : Test.Code)
+        {
+            memory.Shadow->SetExecutable(Range.first, Range.second - Range.first + 1u, true);
+        }
+    }
+
+    // run in slices so budgets larger than an s32 work
+    constexpr u64 SliceCycles = 1 << 24;
+    bool Trapped = false;
+    while (Result.CyclesUsed < Test.Budget)
+    {
+        if (cpu.PC == Test.Trap)
+        {
+            Trapped = true;
+            break;
+        }
+        const u64 Remaining = Test.Budget - Result.CyclesUsed;
+        u64 Limit = Remaining < SliceCycles ? Remaining : SliceCycles;
+        if (cpu.Heat && cpu.Heat->CyclesLeftInWindow() < Limit)
+        {
+            Limit = cpu.Heat->CyclesLeftInWindow();
+        }
+        const s32 Used = cpu.Execute((s32)Limit, memory);
+        Result.CyclesUsed += Used;
+        if (cpu.Heat)
+        {
+            cpu.Heat->Advance(Used);
+        }
+    }
+    Trapped = Trapped || cpu.PC == Test.Trap;
+
+    const auto End = std::chrono::steady_clock::now();
+    Result.Seconds = std::chrono::duration<double>(End - Start).count();
+    Result.EmulatedMHz = Result.Seconds > 0 ? Result.CyclesUsed / Result.Seconds / 1e6 : 0.0;
+    Result.FinalPC = cpu.PC;
+    Result.Checksum = ChecksumMemory(memory);
+    Result.StackOverflows = cpu.CallStack->Overflows;
+    Result.StackUnderflows = cpu.CallStack->Underflows;
+    Result.MismatchedReturns = cpu.CallStack->MismatchedReturns;
+
+    char Buffer[256];
+    Result.Passed = true;
+    if (Test.Trap >= 0 && !Trapped)
+    {
+        snprintf(Buffer, sizeof(Buffer), "trap 0x%04X not reached, PC=0x%04X", Test.Trap, cpu.PC);
+        Result.Message = Buffer;
+        Result.Passed = false;
+    }
+    else if (Test.HasChecksum && Result.Checksum != Test.Checksum)
+    {
+        snprintf(Buffer, sizeof(Buffer), "checksum 0x%08X, expected 0x%08X", Result.Checksum, Test.Checksum);
+        Result.Message = Buffer;
+        Result.Passed = false;
+    }
+    else if (Test.HasCycles && Result.CyclesUsed != Test.Cycles)
+    {
+        snprintf(Buffer, sizeof(Buffer), "%llu cycles, expected %llu",
+            (unsigned long long)Result.CyclesUsed, (unsigned long long)Test.Cycles);
+        Result.Message = Buffer;
+        Result.Passed = false;
+    }
+    else if (memory.Shadow && memory.Shadow->Total())
+    {
+        Result.Message = "sanitizer: " + GuestSanitizer::Describe(memory.Shadow->Reports.front());
+        Result.Passed = false;
+    }
+    if (memory.Shadow)
+    {
+        Result.SanitizerFindings = memory.Shadow->Total();
+    }
+}
+
+static std::string Escape( const std::string& Text, bool Xml )
+{
+    std::string Out;
+    for (char c : Text)
+    {
+        if (Xml && c == '<')       Out += "&lt;";
+        else if (Xml && c == '>')  Out += "&gt;";
+        else if (Xml && c == '&')  Out += "&amp;";
+        else if (Xml && c == '"')  Out += "&quot;";
+        else if (!Xml && (c == '"' || c == '\\')) { Out += '\\'; Out += c; }
+        else Out += c;
+    }
+    return Out;
+}
+
+static void WriteJson( const char* Path, const std::vector<TestCase>& Tests, const std::vector<TestResult>& Results )
+{
+    FILE* File = fopen(Path, "w");
+    if (!File)
+    {
+        fprintf(stderr, "cannot write %s\n", Path);
+        return;
+    }
+    fprintf(File, "[\n");
+    for (size_t i = 0; i < Tests.size(); i++)
+    {
+        const TestResult& R = Results[i];
+        fprintf(File, "  {\"name\": \"%s\", \"passed\": %s, \"message\": \"%s\", \"cycles\": %llu, "
+            "\"pc\": %u, \"checksum\": %u, \"seconds\": %.6f, \"mhz\": %.3f, "
+            "\"stack_overflows\": %llu, \"stack_underflows\": %llu, \"mismatched_returns\": %llu, \"sanitizer_findings\": %llu}%s\n",
+            Escape(Tests[i].Name, false).c_str(), R.Passed ? "true" : "false",
+            Escape(R.Message, false).c_str(), (unsigned long long)R.CyclesUsed,
+            R.FinalPC, R.Checksum, R.Seconds, R.EmulatedMHz, (unsigned long long)R.StackOverflows,
+            (unsigned long long)R.StackUnderflows, (unsigned long long)R.MismatchedReturns,
+            (unsigned long long)R.SanitizerFindings,
+            i + 1 < Tests.size() ? "," : "");
+    }
+    fprintf(File, "]\n");
+    fclose(File);
+}
+
+static void WriteJUnit( const char* Path, const std::vector<TestCase>& Tests, const std::vector<TestResult>& Results,
+    u32 Failures, double Seconds )
+{
+    FILE* File = fopen(Path, "w");
+    if (!File)
+    {
+        fprintf(stderr, "cannot write %s\n", Path);
+        return;
+    }
+    fprintf(File, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(File, "<testsuite name=\"6502farm\" tests=\"%zu\" failures=\"%u\" time=\"%.3f\">\n",
+        Tests.size(), Failures, Seconds);
+    for (size_t i = 0; i < Tests.size(); i++)
+    {
+        const TestResult& R = Results[i];
+        fprintf(File, "  <testcase name=\"%s\" time=\"%.6f\">\n", Escape(Tests[i].Name, true).c_str(), R.Seconds);
+        fprintf(File, "    <properties><property name=\"cycles\" value=\"%llu\"/>"
+            "<property name=\"mhz\" value=\"%.3f\"/></properties>\n",
+            (unsigned long long)R.CyclesUsed, R.EmulatedMHz);
+        if (!R.Passed)
+        {
+            fprintf(File, "    <failure message=\"%s\"/>\n", Escape(R.Message, true).c_str());
+        }
+        fprintf(File, "  </testcase>\n");
+    }
+    fprintf(File, "</testsuite>\n");
+    fclose(File);
+}
+
+int main( int argc, char** argv )
+{
+    const char* ManifestPath = nullptr;
+    const char* JsonPath = nullptr;
+    const char* JUnitPath = nullptr;
+    int MetricsPort = 0;
+    const char* MetricsFile = nullptr;
+    const char* ProfilePath = nullptr;
+    u32 ProfileIntervalUs = 1000;
+    bool FusionReport = false;
+    bool Fuse = true;
+    bool Sanitize = false;
+    const char* HeatPath = nullptr;
+    u64 HeatWindow = 1000000;
+    u32 HeatSample = 2000;
+    u32 Threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)             Threads = (u32)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--json") && i + 1 < argc)   JsonPath = argv[++i];
+        else if (!strcmp(argv[i], "--junit") && i + 1 < argc)  JUnitPath = argv[++i];
+        else if (!strcmp(argv[i], "--metrics-port") && i + 1 < argc) MetricsPort = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--metrics-file") && i + 1 < argc) MetricsFile = argv[++i];
+        else if (!strcmp(argv[i], "--profile") && i + 1 < argc)      ProfilePath = argv[++i];
+        else if (!strcmp(argv[i], "--profile-us") && i + 1 < argc)   ProfileIntervalUs = (u32)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--fusion"))                       FusionReport = true;
+        else if (!strcmp(argv[i], "--no-fusion"))                    Fuse = false;
+        else if (!strcmp(argv[i], "--sanitize"))                     Sanitize = true;
+        else if (!strcmp(argv[i], "--heatmap") && i + 1 < argc)      HeatPath = argv[++i];
+        else if (!strcmp(argv[i], "--heat-window") && i + 1 < argc)  HeatWindow = strtoull(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--heat-sample") && i + 1 < argc)  HeatSample = (u32)strtoul(argv[++i], nullptr, 0);
+        else if (!ManifestPath)                                ManifestPath = argv[i];
+        else
+        {
+            fprintf(stderr, "unexpected argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!ManifestPath)
+    {
+        fprintf(stderr, "usage: %s <manifest> [-j threads] [--json out.json] [--junit out.xml]\n", argv[0]);
+        return 2;
+    }
+    if (Threads == 0)
+    {
+        Threads = 1;
+    }
+    if (Sanitize && !GuestSanitizer::CHECKS_BUILT_IN)
+    {
+        fprintf(stderr, "--sanitize needs a build with -DSANITIZE6502\n");
+        return 2;
+    }
+
+    std::vector<TestCase> Tests;
+    if (!LoadManifest(ManifestPath, Tests))
+    {
+        return 2;
+    }
+    std::vector<TestResult> Results(Tests.size());
+
+    MetricsRegistry Registry;
+    MetricsExporter Exporter(Registry);
+    const bool ExportMetrics = MetricsPort > 0 || MetricsFile;
+    if (ExportMetrics)
+    {
+        Exporter.Port = MetricsPort;
+        Exporter.FilePath = MetricsFile ? MetricsFile : "";
+        if (!Exporter.Start())
+        {
+            return 2;
+        }
+    }
+
+    // workers pull the next test index; each keeps one machine for its lifetime
+    const auto Start = std::chrono::steady_clock::now();
+    std::atomic<size_t> NextTest{0};
+    std::vector<std::thread> Workers;
+    std::vector<std::unique_ptr<StackSampler>> Samplers(Threads);
+    std::vector<FusionCounters> Fusion(Threads);
+    std::vector<AccessHeatMap> Heat(HeatPath ? Threads : 0);
+    for (u32 t = 0; t < Threads; t++)
+    {
+        Workers.emplace_back([&, t]()
+        {
+            std::unique_ptr<Mem> memory(new Mem);
+            Machine Board;
+            Scheduler Clock;
+            CPU cpu;
+            cpu.FuseInstructions = Fuse;
+            if (ExportMetrics)
+            {
+                cpu.Metrics = Registry.Register("worker-" + std::to_string(t));
+            }
+            std::unique_ptr<ShadowCallStack> CallStack(new ShadowCallStack);
+            cpu.CallStack = CallStack.get();
+            std::unique_ptr<GuestSanitizer> Shadow;
+            if (Sanitize)
+            {
+                Shadow.reset(new GuestSanitizer);
+                Shadow->Calls = CallStack.get();
+                memory->AttachSanitizer(Shadow.get());
+            }
+            if (HeatPath)
+            {
+                Heat[t].WindowCycles = HeatWindow;
+                Heat[t].SamplePeriod = HeatSample;
+                cpu.Heat = &Heat[t];
+                // counting every access, fast-forwarded polling iterations
+                // would go uncounted; samples weigh them in
+                cpu.SkipIdleLoops = !AccessHeatMap::COUNTS_BUILT_IN;
+            }
+            if (ProfilePath)
+            {
+                Samplers[t].reset(new StackSampler);
+                Samplers[t]->IntervalUs = ProfileIntervalUs;
+                Samplers[t]->Start();
+                cpu.Sampler = Samplers[t].get();
+            }
+            for (size_t i = NextTest++; i < Tests.size(); i = NextTest++)
+            {
+                RunTest(Tests[i], cpu, *memory, Board, Clock, Results[i]);
+            }
+            if (cpu.Sampler)
+            {
+                cpu.Sampler->Stop();
+            }
+            Fusion[t] = cpu.Fusion;
+            if (cpu.Heat)
+            {
+                cpu.Heat->Finish();
+            }
+        });
+    }
+    for (std::thread& Worker : Workers)
+    {
+        Worker.join();
+    }
+    const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    if (ExportMetrics)
+    {
+        Exporter.Stop();
+    }
+
+    u32 Failures = 0;
+    u64 TotalCycles = 0;
+    for (size_t i = 0; i < Tests.size(); i++)
+    {
+        TotalCycles += Results[i].CyclesUsed;
+        if (!Results[i].Passed)
+        {
+            Failures++;
+            printf("FAIL %s: %s\n", Tests[i].Name.c_str(), Results[i].Message.c_str());
+        }
+    }
+    printf("%zu tests, %u failed, %.3f s, %.1f emulated MHz aggregate\n",
+        Tests.size(), Failures, Seconds, Seconds > 0 ? TotalCycles / Seconds / 1e6 : 0.0);
+
+    if (FusionReport)
+    {
+        FusionCounters Total;
+        for (const FusionCounters& Worker : Fusion)
+        {
+            Total.Add(Worker);
+        }
+        for (u32 Kind = 0; Kind < FUSION_KINDS; Kind++)
+        {
+            const u64 Seen = Total.Fused[Kind] + Total.Unfused[Kind];
+            printf("fusion %-24s %12llu fused %12llu unfused (%.1f%%)\n", FusionCounters::Name(Kind),
+                (unsigned long long)Total.Fused[Kind], (unsigned long long)Total.Unfused[Kind],
+                Seen ? 100.0 * Total.Fused[Kind] / Seen : 0.0);
+        }
+    }
+    if (ProfilePath)
+    {
+        StackSampler Profile;
+        for (const std::unique_ptr<StackSampler>& Sampler : Samplers)
+        {
+            Profile.Merge(*Sampler);
+        }
+        Profile.WriteFolded(ProfilePath);
+        printf("%llu profile samples written to %s\n", (unsigned long long)Profile.Samples, ProfilePath);
+    }
+    if (HeatPath)
+    {
+        AccessHeatMap Total;
+        Total.WindowCycles = HeatWindow;
+        Total.SamplePeriod = HeatSample;
+        u32 WorkingSet = 0;
+        for (const AccessHeatMap& Worker : Heat)
+        {
+            Total.Merge(Worker);
+        }
+        for (const AccessHeatMap::Window& Window : Total.Windows)
+        {
+            WorkingSet = Window.WorkingSet() > WorkingSet ? Window.WorkingSet() : WorkingSet;
+        }
+        if (Total.Write(HeatPath))
+        {
+            printf("heatmap: %zu windows, working set up to %u pages, written to %s\n", Total.Windows.size(),
+                WorkingSet, HeatPath);
+        }
+    }
+    if (JsonPath)
+    {
+        WriteJson(JsonPath, Tests, Results);
+    }
+    if (JUnitPath)
+    {
+        WriteJUnit(JUnitPath, Tests, Results, Failures, Seconds);
+    }
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+// Local emulation job server: runs ROM jobs submitted over a Unix socket on
+// a pool of warm instances until interrupted. See JobServer.h for the
+// protocol.
+//
+// Usage: 6502serve <socket path> [-j threads] [--queue N] [--timeout-ms N]
+//                  [--max-budget N]
+//
+//   -j            worker threads (default: one per core)
+//   --queue       jobs allowed to wait before new ones get status=busy
+//   --timeout-ms  limit for jobs that give no timeout= (default 10000)
+//   --max-budget  largest cycle budget accepted
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "JobServer.h"
+
+int main( int argc, char** argv )
+{
+#ifdef __linux__
+    JobServer Server;
+    const char* SocketPath = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)                     Server.Threads = (u32)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--queue") && i + 1 < argc)          Server.MaxQueued = (u32)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--timeout-ms") && i + 1 < argc)     Server.DefaultTimeoutMs = (u32)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--max-budget") && i + 1 < argc)     Server.MaxBudget = strtoull(argv[++i], nullptr, 0);
+        else if (!SocketPath)                                          SocketPath = argv[i];
+        else
+        {
+            fprintf(stderr, "unexpected argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!SocketPath)
+    {
+        fprintf(stderr, "usage: %s <socket path> [-j threads] [--queue N] [--timeout-ms N] [--max-budget N]\n", argv[0]);
+        return 2;
+    }
+
+    // block the stop signals before any thread starts, so only sigwait sees them
+    sigset_t Stop;
+    sigemptyset(&Stop);
+    sigaddset(&Stop, SIGINT);
+    sigaddset(&Stop, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &Stop, nullptr);
+
+    if (!Server.ListenUnix(SocketPath) || !Server.Start())
+    {
+        return 1;
+    }
+    fprintf(stderr, "6502serve: listening on %s with %u workers\n", SocketPath, Server.Threads);
+    int Signal = 0;
+    sigwait(&Stop, &Signal);
+    Server.Stop();
+    fprintf(stderr, "6502serve: %llu jobs accepted, %llu completed, %llu timed out, %llu refused busy, %llu errors\n",
+        (unsigned long long)Server.Accepted.load(), (unsigned long long)Server.Completed.load(),
+        (unsigned long long)Server.TimedOut.load(), (unsigned long long)Server.Rejected.load(),
+        (unsigned long long)Server.Failed.load());
+    return 0;
+#else
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "6502serve needs Linux (epoll)\n");
+    return 1;
+#endif
+}